@@ -73,6 +73,18 @@ typedef struct pj_pcap_udp_hdr
 } pj_pcap_udp_hdr;
 
 
+/**
+ * This describes the capture time of a packet, which may optionally be
+ * returned in #pj_pcap_read_udp2() function. It keeps the microsecond
+ * resolution of the PCAP record.
+ */
+typedef struct pj_pcap_time
+{
+    pj_uint32_t	sec;	    /**< Seconds.	    */
+    pj_uint32_t	usec;	    /**< Microseconds.	    */
+} pj_pcap_time;
+
+
 /**
  * This structure describes the filter to be used when reading packets from
  * a PCAP file. When a filter is configured, only packets matching all the
@@ -185,6 +197,28 @@ PJ_DECL(pj_status_t) pj_pcap_read_udp(pj_pcap_file *file,
 				      pj_uint8_t *udp_payload,
 				      pj_size_t *udp_payload_size);
 
+/**
+ * Read UDP payload from the next packet in the PCAP file, along with the
+ * capture time of the packet. This is useful to replay the packets with
+ * their original timing.
+ *
+ * @param file		    PCAP file handle.
+ * @param udp_hdr	    Optional buffer to receive UDP header.
+ * @param ts		    Optional buffer to receive the capture time of
+ *			    the packet.
+ * @param udp_payload	    Buffer to receive the UDP payload.
+ * @param udp_payload_size  On input, specify the size of the buffer.
+ *			    On output, it will be filled with the actual size
+ *			    of the payload as read from the packet.
+ *
+ * @return	    PJ_SUCCESS on success, or the appropriate error code.
+ */
+PJ_DECL(pj_status_t) pj_pcap_read_udp2(pj_pcap_file *file,
+				       pj_pcap_udp_hdr *udp_hdr,
+				       pj_pcap_time *ts,
+				       pj_uint8_t *udp_payload,
+				       pj_size_t *udp_payload_size);
+
 
 /**
  * @}
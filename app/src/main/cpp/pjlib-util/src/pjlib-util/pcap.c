@@ -207,6 +207,17 @@ PJ_DEF(pj_status_t) pj_pcap_read_udp(pj_pcap_file *file,
 				     pj_pcap_udp_hdr *udp_hdr,
 				     pj_uint8_t *udp_payload,
 				     pj_size_t *udp_payload_size)
+{
+    return pj_pcap_read_udp2(file, udp_hdr, NULL, udp_payload,
+			     udp_payload_size);
+}
+
+/* Read UDP packet and its capture time */
+PJ_DEF(pj_status_t) pj_pcap_read_udp2(pj_pcap_file *file,
+				      pj_pcap_udp_hdr *udp_hdr,
+				      pj_pcap_time *ts,
+				      pj_uint8_t *udp_payload,
+				      pj_size_t *udp_payload_size)
 {
     PJ_ASSERT_RETURN(file && udp_payload && udp_payload_size, PJ_EINVAL);
     PJ_ASSERT_RETURN(*udp_payload_size, PJ_EINVAL);
@@ -255,6 +266,12 @@ PJ_DEF(pj_status_t) pj_pcap_read_udp(pj_pcap_file *file,
 	    tmp.rec.ts_usec = pj_ntohl(tmp.rec.ts_usec);
 	}
 
+	/* Save capture time, the header is overwritten by the next reads */
+	if (ts) {
+	    ts->sec = tmp.rec.ts_sec;
+	    ts->usec = tmp.rec.ts_usec;
+	}
+
 	/* Read link layer header */
 	switch (file->hdr.network) {
 	case PJ_PCAP_LINK_TYPE_ETH:
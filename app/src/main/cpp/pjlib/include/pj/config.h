@@ -496,6 +496,21 @@
 #endif
 
 
+/**
+ * caching pool 为每个线程、每种池大小缓存的已释放池的数量。线程创建和释放池时
+ * 优先使用自己的缓存，只有缓存为空或已满时才会获取 caching pool 的全局锁。
+ * 设置为 0 则禁用每线程缓存。启用 PJ_SAFE_POOL 时总是禁用。
+ *
+ * 缓存中的池不计入 max_capacity，线程退出后也不会被回收，直到 caching pool
+ * 被销毁，因此适合线程数量固定的应用。
+ *
+ * 默认值: 0
+ */
+#ifndef PJ_CACHING_POOL_MAGAZINE_SIZE
+#  define PJ_CACHING_POOL_MAGAZINE_SIZE	    0
+#endif
+
+
 /**
  * 启用计时器堆调试工具。启用此选项后，应用程序可以调用 pj_timer_heap_dump() 来显示计时器堆的内容以及调度计时器项的源位置。
  * 更多信息详见：https://trac.pjsip.org/repos/ticket/1527
@@ -507,6 +522,18 @@
 #endif
 
 
+/**
+ * 设置为 1 时，pj_timer_heap_create() 及 pj_timer_heap_cfg_default() 默认使用
+ * 分层时间轮 (PJ_TIMER_HEAP_WHEEL) 代替二叉堆。时间轮的调度和取消为 O(1)，
+ * 适合同时存在大量计时器（例如成千上万个 ICE/STUN 事务）的场景。
+ *
+ * 默认值: 0
+ */
+#ifndef PJ_TIMER_HEAP_USE_WHEEL
+#  define PJ_TIMER_HEAP_USE_WHEEL   0
+#endif
+
+
 /**
  * 将其设置为 1 以启用对组锁的调试。默认值：0
  */
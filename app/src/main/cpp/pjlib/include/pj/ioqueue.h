@@ -321,6 +321,106 @@ PJ_DECL(pj_status_t) pj_ioqueue_create( pj_pool_t *pool,
 					pj_size_t max_fd,
 					pj_ioqueue_t **ioqueue);
 
+/**
+ * I/O 队列的创建参数，使用 pj_ioqueue_cfg_default() 初始化
+ */
+typedef struct pj_ioqueue_cfg
+{
+    /**
+     * 分片数量。大于 1 时，I/O 队列由多个独立的子队列（分片）组成，每个分片
+     * 有自己的 epoll 实例、锁和密钥表，分发事件时不需要全局锁。注册到 I/O 队列
+     * 的套接字按句柄的哈希值分配到分片，也可以使用 pj_ioqueue_get_shard()
+     * 获取分片并直接注册到该分片（例如每个分片一个 SO_REUSEPORT 套接字）。
+     *
+     * 目前只有 epoll 实现支持多个分片，其他实现返回 PJ_ENOTSUP。
+     *
+     * 默认值: 1
+     */
+    unsigned	    shard_cnt;
+
+    /**
+     * 非零时，为每个分片创建一个工作线程来轮询该分片，应用程序不再需要
+     * 调用 pj_ioqueue_poll()。工作线程在 pj_ioqueue_destroy() 中停止。
+     *
+     * 默认值: PJ_FALSE
+     */
+    pj_bool_t	    start_workers;
+
+} pj_ioqueue_cfg;
+
+/**
+ * I/O 队列（或其中一个分片）的统计信息，见 pj_ioqueue_get_stat()
+ */
+typedef struct pj_ioqueue_stat
+{
+    /** 返回了事件的轮询次数 */
+    pj_uint32_t	    poll_cnt;
+
+    /** 分发的事件数量 */
+    pj_uint32_t	    event_cnt;
+
+    /** 当前注册的密钥数量 */
+    unsigned	    key_cnt;
+
+} pj_ioqueue_stat;
+
+/**
+ * 使用默认值初始化创建参数
+ *
+ * @param cfg		要初始化的参数
+ */
+PJ_DECL(void) pj_ioqueue_cfg_default(pj_ioqueue_cfg *cfg);
+
+/**
+ * 使用指定的参数创建新的I/O队列框架
+ *
+ * @param pool		分配I/O队列结构的池
+ * @param max_fd	支持的最大句柄数，在各分片之间平分
+ * @param cfg		创建参数，NULL 表示使用默认值
+ * @param ioqueue	保存新创建的I/O队列的指针
+ *
+ * @return		成功返回 PJ_SUCCESS
+ */
+PJ_DECL(pj_status_t) pj_ioqueue_create2( pj_pool_t *pool,
+					 pj_size_t max_fd,
+					 const pj_ioqueue_cfg *cfg,
+					 pj_ioqueue_t **ioqueue);
+
+/**
+ * 获取I/O队列的分片数量。未分片的I/O队列返回 1
+ *
+ * @param ioque		I/O 队列
+ *
+ * @return		分片数量
+ */
+PJ_DECL(unsigned) pj_ioqueue_get_shard_count( pj_ioqueue_t *ioque );
+
+/**
+ * 获取I/O队列的一个分片。分片本身也是一个I/O队列，可以直接向其注册套接字，
+ * 也可以由应用程序自己的线程单独轮询。未分片的I/O队列的第 0 个分片就是它本身。
+ * 分片由所属的I/O队列销毁，应用程序不能调用 pj_ioqueue_destroy() 销毁分片。
+ *
+ * @param ioque		I/O 队列
+ * @param idx		分片的索引
+ *
+ * @return		分片，索引无效时返回 NULL
+ */
+PJ_DECL(pj_ioqueue_t*) pj_ioqueue_get_shard( pj_ioqueue_t *ioque,
+					     unsigned idx );
+
+/**
+ * 获取I/O队列中一个分片的统计信息
+ *
+ * @param ioque		I/O 队列
+ * @param idx		分片的索引
+ * @param stat		用于接收统计信息
+ *
+ * @return		成功返回 PJ_SUCCESS
+ */
+PJ_DECL(pj_status_t) pj_ioqueue_get_stat( pj_ioqueue_t *ioque,
+					  unsigned idx,
+					  pj_ioqueue_stat *stat );
+
 /**
  * 销毁 I/O 队列
  *
@@ -711,6 +711,34 @@ PJ_INLINE(void) pj_pool_factory_dump( pj_pool_factory *pf,
  */
 #define PJ_CACHING_POOL_ARRAY_SIZE	16
 
+/**
+ * Statistics of a caching pool, see #pj_caching_pool_get_stat().
+ */
+typedef struct pj_caching_pool_stat
+{
+    /** Number of pools created from the per-thread caches, without taking
+     *  the caching pool lock. */
+    pj_uint32_t	    hit_cnt;
+
+    /** Number of pools created with the caching pool lock held. */
+    pj_uint32_t	    miss_cnt;
+
+    /** Number of times a per-thread cache was full and some of its pools
+     *  were moved to the shared free lists. */
+    pj_uint32_t	    flush_cnt;
+
+    /** Number of pools currently held by application, including the
+     *  ones created from the per-thread caches. */
+    pj_size_t	    used_count;
+
+    /** Bytes kept in the per-thread caches, for each pool size. */
+    pj_size_t	    thread_cached[PJ_CACHING_POOL_ARRAY_SIZE];
+
+    /** Bytes kept in the shared free lists, for each pool size. */
+    pj_size_t	    shared_cached[PJ_CACHING_POOL_ARRAY_SIZE];
+
+} pj_caching_pool_stat;
+
 /**
  * Declaration for caching pool. Application doesn't normally need to
  * care about the contents of this struct, it is only provided here because
@@ -740,7 +768,10 @@ struct pj_caching_pool
     /**
      * Number of pools currently held by applications. This number gets
      * incremented everytime #pj_pool_create() is called, and gets
-     * decremented when #pj_pool_release() is called.
+     * decremented when #pj_pool_release() is called. When the per-thread
+     * caches are enabled, pools that are created from or released to
+     * them are counted per thread instead, so use
+     * #pj_caching_pool_get_stat() to get the total.
      */
     pj_size_t       used_count;
 
@@ -761,7 +792,8 @@ struct pj_caching_pool
     pj_list	    free_list[PJ_CACHING_POOL_ARRAY_SIZE];
 
     /**
-     * List of pools currently allocated by applications.
+     * List of pools currently allocated by applications, and of pools
+     * kept in the per-thread caches.
      */
     pj_list	    used_list;
 
@@ -774,6 +806,32 @@ struct pj_caching_pool
      * Mutex.
      */
     pj_lock_t	   *lock;
+
+    /**
+     * Number of pools of each size kept in the cache of each thread, so
+     * that pools can be created and released without taking the lock.
+     * It is initialized to PJ_CACHING_POOL_MAGAZINE_SIZE, and application
+     * may change it after #pj_caching_pool_init() and before creating
+     * the first pool. Zero disables the per-thread caches.
+     *
+     * Pools kept in the cache of a thread count towards neither
+     * @a capacity nor @a max_capacity, and they stay there until the
+     * caching pool is destroyed even if the thread has quit, which is
+     * why the caches are disabled by default. Pools in the per-thread
+     * caches are kept in @a used_list, so they are freed by
+     * #pj_caching_pool_destroy() like pools that are not released.
+     */
+    unsigned	    magazine_size;
+
+    /**
+     * Thread local storage index of the per-thread caches.
+     */
+    long	    tls_id;
+
+    /**
+     * List of the per-thread caches.
+     */
+    void	   *thread_caches;
 };
 
 
@@ -801,6 +859,16 @@ PJ_DECL(void) pj_caching_pool_init( pj_caching_pool *ch_pool,
  */
 PJ_DECL(void) pj_caching_pool_destroy( pj_caching_pool *ch_pool );
 
+/**
+ * Get the statistics of the caching pool, including the hit rate and
+ * the contents of the per-thread caches.
+ *
+ * @param ch_pool	The caching pool.
+ * @param stat		Pointer to receive the statistics.
+ */
+PJ_DECL(void) pj_caching_pool_get_stat( pj_caching_pool *ch_pool,
+					pj_caching_pool_stat *stat );
+
 /**
  * @}	// PJ_CACHING_POOL
  */
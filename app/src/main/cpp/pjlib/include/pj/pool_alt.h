@@ -183,8 +183,18 @@ struct pj_caching_pool
     unsigned used_count;
     unsigned used_size;
     unsigned peak_used_size;
+    unsigned magazine_size;
 };
 
+/* just to make it compilable */
+typedef struct pj_caching_pool_stat
+{
+    pj_uint32_t hit_cnt;
+    pj_uint32_t miss_cnt;
+    pj_uint32_t flush_cnt;
+    pj_size_t	used_count;
+} pj_caching_pool_stat;
+
 /* just to make it compilable */
 typedef struct pj_pool_block
 {
@@ -193,6 +203,7 @@ typedef struct pj_pool_block
 
 #define pj_caching_pool_init( cp, pol, mac)
 #define pj_caching_pool_destroy(cp)
+#define pj_caching_pool_get_stat(cp, st)    pj_bzero(st, sizeof(*(st)))
 #define pj_pool_factory_dump(pf, detail)
 
 PJ_END_DECL
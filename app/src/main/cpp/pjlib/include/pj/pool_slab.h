@@ -0,0 +1,153 @@
+/**
+ *	已完成
+ *		可释放的分级 slab 分配器
+ *
+ */
+#ifndef __PJ_POOL_SLAB_H__
+#define __PJ_POOL_SLAB_H__
+
+#include <pj/pool.h>
+
+/**
+ * @defgroup PJ_POOL_SLAB 可释放的分级 slab 分配器
+ * @ingroup PJ_POOL_GROUP
+ * @brief 在内存池之上提供可单独释放的内存分配
+ *
+ * 普通内存池只能整体释放，长期存在的池（会议桥、媒体端点、抖动缓冲区等）在
+ * 通话过程中反复分配的对象会让池不断增长。slab 分配器从内存池的工厂按大小
+ * 等级分配 slab 块，每个对象都可以用 pj_slab_free() 单独释放，分配和释放都是
+ * O(1) 的。空闲的 slab 块会归还给池工厂（每个大小等级最多保留一个空闲块），
+ * 因此占用的内存受当前使用量的限制，而不是受历史分配总量的限制。
+ *
+ * 大于最大等级 (#PJ_SLAB_MAX_SIZE) 的对象直接从池工厂分配，释放时立即归还。
+ *
+ * 与内存池一样，slab 分配器不是线程安全的。
+ *
+ * 使用例子:
+ *
+ * \code
+  pj_slab_t *slab;
+  void *frame;
+
+  pj_slab_create(pool, "frames", &slab);
+
+  frame = pj_slab_alloc(slab, 320);
+  ...
+  pj_slab_free(slab, frame);
+
+  // 必须在释放内存池之前销毁
+  pj_slab_destroy(slab);
+   \endcode
+ *
+ * @{
+ */
+
+PJ_BEGIN_DECL
+
+/**
+ * 由 slab 块分配的最大对象大小，更大的对象直接从池工厂分配。
+ */
+#define PJ_SLAB_MAX_SIZE	4088
+
+/**
+ * slab 分配器
+ */
+typedef struct pj_slab_t pj_slab_t;
+
+/**
+ * slab 分配器的统计信息，见 pj_slab_get_stat()。
+ */
+typedef struct pj_slab_stat
+{
+    /** 当前已分配的对象数量 */
+    pj_size_t	    obj_cnt;
+
+    /** 当前已分配对象所占用的字节数（按大小等级计算，包括对象头） */
+    pj_size_t	    used_size;
+
+    /** 当前从池工厂获取的字节数，包括未使用的部分 */
+    pj_size_t	    reserved_size;
+
+    /** reserved_size 的历史最大值 */
+    pj_size_t	    peak_reserved_size;
+
+    /** 累计分配次数 */
+    pj_uint32_t	    alloc_cnt;
+
+    /** 累计释放次数 */
+    pj_uint32_t	    free_cnt;
+
+} pj_slab_stat;
+
+/**
+ * 创建 slab 分配器。分配器本身从 @a pool 分配，slab 块从 @a pool 的工厂分配。
+ * 必须在释放 @a pool 之前调用 pj_slab_destroy()。
+ *
+ * @param pool	    内存池
+ * @param name	    可选名称，用于日志
+ * @param p_slab    用于接收 slab 分配器的指针
+ *
+ * @return	    PJ_SUCCESS 或错误码
+ */
+PJ_DECL(pj_status_t) pj_slab_create(pj_pool_t *pool,
+				    const char *name,
+				    pj_slab_t **p_slab);
+
+/**
+ * 销毁 slab 分配器，将所有 slab 块和大对象归还给池工厂。
+ * 之后不能再访问由它分配的对象。
+ *
+ * @param slab	    slab 分配器
+ */
+PJ_DECL(void) pj_slab_destroy(pj_slab_t *slab);
+
+/**
+ * 分配内存。返回的地址按 8 字节对齐。
+ *
+ * @param slab	    slab 分配器
+ * @param size	    要分配的字节数
+ *
+ * @return	    分配的内存，内存不足时返回 NULL
+ */
+PJ_DECL(void*) pj_slab_alloc(pj_slab_t *slab, pj_size_t size);
+
+/**
+ * 分配内存并清零。
+ *
+ * @param slab	    slab 分配器
+ * @param size	    要分配的字节数
+ *
+ * @return	    分配的内存，内存不足时返回 NULL
+ */
+PJ_DECL(void*) pj_slab_zalloc(pj_slab_t *slab, pj_size_t size);
+
+/**
+ * 释放由 pj_slab_alloc() 或 pj_slab_zalloc() 分配的内存。
+ *
+ * @param slab	    slab 分配器
+ * @param mem	    要释放的内存，可以为 NULL
+ */
+PJ_DECL(void) pj_slab_free(pj_slab_t *slab, void *mem);
+
+/**
+ * 获取统计信息，used_size 与 reserved_size 的差值表示碎片和缓存的空闲空间。
+ *
+ * @param slab	    slab 分配器
+ * @param stat	    用于接收统计信息
+ */
+PJ_DECL(void) pj_slab_get_stat(pj_slab_t *slab, pj_slab_stat *stat);
+
+/**
+ * 在日志中输出每个大小等级的使用情况。
+ *
+ * @param slab	    slab 分配器
+ */
+PJ_DECL(void) pj_slab_dump(pj_slab_t *slab);
+
+PJ_END_DECL
+
+/**
+ * @}
+ */
+
+#endif	/* __PJ_POOL_SLAB_H__ */
@@ -132,6 +132,65 @@ typedef struct pj_timer_entry
 } pj_timer_entry;
 
 
+/**
+ * Timer heap implementations.
+ */
+typedef enum pj_timer_heap_type
+{
+    /**
+     * Binary heap of absolute times. Scheduling, cancelling and expiring
+     * a timer is O(log N).
+     */
+    PJ_TIMER_HEAP_BINARY,
+
+    /**
+     * Hierarchical timing wheel with one millisecond resolution.
+     * Scheduling and cancelling a timer is O(1), and the entries may be
+     * spread over several shards with their own locks (see the shard_cnt
+     * field of #pj_timer_heap_cfg).
+     */
+    PJ_TIMER_HEAP_WHEEL
+
+} pj_timer_heap_type;
+
+
+/**
+ * Timer heap settings, to be initialized with #pj_timer_heap_cfg_default().
+ */
+typedef struct pj_timer_heap_cfg
+{
+    /**
+     * The implementation.
+     *
+     * Default: PJ_TIMER_HEAP_WHEEL if PJ_TIMER_HEAP_USE_WHEEL is set,
+     * otherwise PJ_TIMER_HEAP_BINARY.
+     */
+    pj_timer_heap_type	type;
+
+    /**
+     * The number of timer entries to be supported initially. The timer
+     * heap grows when more entries are scheduled.
+     *
+     * Default: 64
+     */
+    pj_size_t		count;
+
+    /**
+     * Number of shards of the timing wheel. The entries are spread over
+     * the shards by their address, and each shard has its own lock, so
+     * entries of different shards can be scheduled, cancelled and polled
+     * from several threads without contending on one lock. When there is
+     * more than one shard, the timer heap creates the shard locks itself,
+     * and the lock set with #pj_timer_heap_set_lock() is not used for
+     * synchronization. The binary heap only has one shard.
+     *
+     * Default: 1
+     */
+    unsigned		shard_cnt;
+
+} pj_timer_heap_cfg;
+
+
 /**
  * Calculate memory size required to create a timer heap.
  *
@@ -154,11 +213,34 @@ PJ_DECL(pj_size_t) pj_timer_heap_mem_size(pj_size_t count);
  * @param ht        Pointer to receive the created timer heap.
  *
  * @return          PJ_SUCCESS, or the appropriate error code.
+ *
+ * @see pj_timer_heap_create2()
  */
 PJ_DECL(pj_status_t) pj_timer_heap_create( pj_pool_t *pool,
 					   pj_size_t count,
                                            pj_timer_heap_t **ht);
 
+/**
+ * Initialize the timer heap settings with the default values.
+ *
+ * @param cfg       The settings to be initialized.
+ */
+PJ_DECL(void) pj_timer_heap_cfg_default(pj_timer_heap_cfg *cfg);
+
+/**
+ * Create a timer heap with the specified settings.
+ *
+ * @param pool      The pool where allocations in the timer heap will be
+ *                  allocated.
+ * @param cfg       The settings.
+ * @param ht        Pointer to receive the created timer heap.
+ *
+ * @return          PJ_SUCCESS, or the appropriate error code.
+ */
+PJ_DECL(pj_status_t) pj_timer_heap_create2( pj_pool_t *pool,
+					    const pj_timer_heap_cfg *cfg,
+					    pj_timer_heap_t **ht);
+
 /**
  * Destroy the timer heap.
  *
@@ -47,6 +47,7 @@
 #include <pj/os.h>
 #include <pj/pool.h>
 #include <pj/pool_buf.h>
+#include <pj/pool_slab.h>
 #include <pj/rand.h>
 #include <pj/rbtree.h>
 #include <pj/sock.h>
@@ -54,6 +54,36 @@ PJ_DEF(pj_status_t) pj_ioqueue_create( pj_pool_t *pool,
     return PJ_ENOTSUP;
 }
 
+PJ_DEF(void) pj_ioqueue_cfg_default(pj_ioqueue_cfg *cfg)
+{
+    pj_bzero(cfg, sizeof(*cfg));
+    cfg->shard_cnt = 1;
+}
+
+PJ_DEF(pj_status_t) pj_ioqueue_create2( pj_pool_t *pool,
+					pj_size_t max_fd,
+					const pj_ioqueue_cfg *cfg,
+					pj_ioqueue_t **ptr_ioqueue)
+{
+    return PJ_ENOTSUP;
+}
+
+PJ_DEF(unsigned) pj_ioqueue_get_shard_count(pj_ioqueue_t *ioque)
+{
+    return 1;
+}
+
+PJ_DEF(pj_ioqueue_t*) pj_ioqueue_get_shard(pj_ioqueue_t *ioque, unsigned idx)
+{
+    return idx == 0 ? ioque : NULL;
+}
+
+PJ_DEF(pj_status_t) pj_ioqueue_get_stat(pj_ioqueue_t *ioque, unsigned idx,
+					pj_ioqueue_stat *stat)
+{
+    return PJ_ENOTSUP;
+}
+
 PJ_DEF(pj_status_t) pj_ioqueue_destroy(pj_ioqueue_t *ioque)
 {
     return PJ_ENOTSUP;
@@ -85,6 +85,17 @@ struct pj_ioqueue_t
     pj_ioqueue_key_t	closing_list;
     pj_ioqueue_key_t	free_list;
 #endif
+
+    /* 分片模式下的子队列和工作线程，epfd 中注册的是各分片的 epfd */
+    pj_ioqueue_t       *parent;
+    pj_ioqueue_t      **shards;
+    unsigned		shard_cnt;
+    pj_thread_t	      **workers;
+    pj_atomic_t	       *quit;
+
+    /* 统计，在持有锁时更新 */
+    pj_uint32_t		poll_cnt;
+    pj_uint32_t		event_cnt;
 };
 
 /* 在声明pj_ioqueue_key_t和pj_ioqueue_t之后，包含公共抽象的实现。
@@ -126,7 +137,7 @@ PJ_DEF(pj_status_t) pj_ioqueue_create( pj_pool_t *pool,
     PJ_ASSERT_RETURN(sizeof(pj_ioqueue_op_key_t)-sizeof(void*) >=
                      sizeof(union operation_key), PJ_EBUG);
 
-    ioqueue = pj_pool_alloc(pool, sizeof(pj_ioqueue_t));
+    ioqueue = PJ_POOL_ZALLOC_T(pool, pj_ioqueue_t);
 
     ioqueue_init(ioqueue);
 
@@ -197,6 +208,193 @@ PJ_DEF(pj_status_t) pj_ioqueue_create( pj_pool_t *pool,
     return PJ_SUCCESS;
 }
 
+PJ_DEF(void) pj_ioqueue_cfg_default(pj_ioqueue_cfg *cfg)
+{
+    pj_bzero(cfg, sizeof(*cfg));
+    cfg->shard_cnt = 1;
+}
+
+/* 分片的工作线程 */
+static int shard_worker(void *arg)
+{
+    pj_ioqueue_t *shard = (pj_ioqueue_t*)arg;
+
+    while (!pj_atomic_get(shard->parent->quit)) {
+	pj_time_val timeout = { 0, 10 };
+	pj_ioqueue_poll(shard, &timeout);
+    }
+    return 0;
+}
+
+static void destroy_shards(pj_ioqueue_t *ioqueue)
+{
+    unsigned i;
+
+    if (ioqueue->quit)
+	pj_atomic_set(ioqueue->quit, 1);
+    for (i = 0; ioqueue->workers && i < ioqueue->shard_cnt; ++i) {
+	if (ioqueue->workers[i]) {
+	    pj_thread_join(ioqueue->workers[i]);
+	    pj_thread_destroy(ioqueue->workers[i]);
+	    ioqueue->workers[i] = NULL;
+	}
+    }
+
+    for (i = 0; i < ioqueue->shard_cnt; ++i) {
+	if (ioqueue->shards[i]) {
+	    pj_ioqueue_destroy(ioqueue->shards[i]);
+	    ioqueue->shards[i] = NULL;
+	}
+    }
+
+    if (ioqueue->quit) {
+	pj_atomic_destroy(ioqueue->quit);
+	ioqueue->quit = NULL;
+    }
+}
+
+/*
+ * pj_ioqueue_create2()
+ *
+ * 每个分片都是一个独立的 epoll 队列，有自己的锁和密钥。父队列的 epfd 中注册
+ * 各分片的 epfd，因此轮询父队列时只需要轮询有事件的分片，分发事件时不会经过
+ * 父队列的锁。
+ */
+PJ_DEF(pj_status_t) pj_ioqueue_create2( pj_pool_t *pool,
+					pj_size_t max_fd,
+					const pj_ioqueue_cfg *cfg,
+					pj_ioqueue_t **p_ioqueue)
+{
+    pj_ioqueue_cfg default_cfg;
+    pj_ioqueue_t *ioqueue;
+    pj_size_t shard_max;
+    pj_lock_t *lock;
+    pj_status_t rc;
+    unsigned i;
+
+    PJ_ASSERT_RETURN(pool && p_ioqueue && max_fd > 0, PJ_EINVAL);
+
+    if (!cfg) {
+	pj_ioqueue_cfg_default(&default_cfg);
+	cfg = &default_cfg;
+    }
+    PJ_ASSERT_RETURN(cfg->shard_cnt > 0 && cfg->shard_cnt <= max_fd,
+		     PJ_EINVAL);
+
+    if (cfg->shard_cnt == 1 && !cfg->start_workers)
+	return pj_ioqueue_create(pool, max_fd, p_ioqueue);
+
+    ioqueue = PJ_POOL_ZALLOC_T(pool, pj_ioqueue_t);
+    ioqueue_init(ioqueue);
+    ioqueue->max = max_fd;
+    pj_list_init(&ioqueue->active_list);
+
+    /* 父队列的锁只用于注册时选择分片 */
+    rc = pj_lock_create_simple_mutex(pool, "ioq%p", &lock);
+    if (rc != PJ_SUCCESS)
+	return rc;
+
+    rc = pj_ioqueue_set_lock(ioqueue, lock, PJ_TRUE);
+    if (rc != PJ_SUCCESS)
+	return rc;
+
+    ioqueue->epfd = os_epoll_create(cfg->shard_cnt);
+    if (ioqueue->epfd < 0) {
+	ioqueue_destroy(ioqueue);
+	return PJ_RETURN_OS_ERROR(pj_get_native_os_error());
+    }
+
+    ioqueue->shard_cnt = cfg->shard_cnt;
+    ioqueue->shards = (pj_ioqueue_t**)
+		      pj_pool_calloc(pool, cfg->shard_cnt, sizeof(void*));
+    shard_max = (max_fd + cfg->shard_cnt - 1) / cfg->shard_cnt;
+
+    for (i = 0; i < cfg->shard_cnt; ++i) {
+	pj_ioqueue_t *shard;
+	struct epoll_event ev;
+
+	rc = pj_ioqueue_create(pool, shard_max, &shard);
+	if (rc != PJ_SUCCESS)
+	    goto on_error;
+
+	shard->parent = ioqueue;
+	ioqueue->shards[i] = shard;
+
+	ev.events = EPOLLIN;
+	ev.epoll_data = (epoll_data_type)shard;
+	if (os_epoll_ctl(ioqueue->epfd, EPOLL_CTL_ADD, shard->epfd, &ev) < 0) {
+	    rc = pj_get_os_error();
+	    goto on_error;
+	}
+    }
+
+    if (cfg->start_workers) {
+	rc = pj_atomic_create(pool, 0, &ioqueue->quit);
+	if (rc != PJ_SUCCESS)
+	    goto on_error;
+
+	ioqueue->workers = (pj_thread_t**)
+			   pj_pool_calloc(pool, cfg->shard_cnt, sizeof(void*));
+	for (i = 0; i < cfg->shard_cnt; ++i) {
+	    rc = pj_thread_create(pool, "ioqw%p", &shard_worker,
+				  ioqueue->shards[i], 0, 0,
+				  &ioqueue->workers[i]);
+	    if (rc != PJ_SUCCESS)
+		goto on_error;
+	}
+    }
+
+    PJ_LOG(4, ("pjlib", "epoll I/O Queue created (%p) with %u shard(s)",
+	       ioqueue, ioqueue->shard_cnt));
+
+    *p_ioqueue = ioqueue;
+    return PJ_SUCCESS;
+
+on_error:
+    destroy_shards(ioqueue);
+    pj_lock_acquire(ioqueue->lock);
+    os_close(ioqueue->epfd);
+    ioqueue_destroy(ioqueue);
+    return rc;
+}
+
+PJ_DEF(unsigned) pj_ioqueue_get_shard_count(pj_ioqueue_t *ioqueue)
+{
+    PJ_ASSERT_RETURN(ioqueue, 0);
+    return ioqueue->shard_cnt ? ioqueue->shard_cnt : 1;
+}
+
+PJ_DEF(pj_ioqueue_t*) pj_ioqueue_get_shard(pj_ioqueue_t *ioqueue,
+					   unsigned idx)
+{
+    PJ_ASSERT_RETURN(ioqueue, NULL);
+
+    if (ioqueue->shard_cnt == 0)
+	return idx == 0 ? ioqueue : NULL;
+    return idx < ioqueue->shard_cnt ? ioqueue->shards[idx] : NULL;
+}
+
+PJ_DEF(pj_status_t) pj_ioqueue_get_stat(pj_ioqueue_t *ioqueue,
+					unsigned idx,
+					pj_ioqueue_stat *stat)
+{
+    pj_ioqueue_t *q;
+
+    PJ_ASSERT_RETURN(ioqueue && stat, PJ_EINVAL);
+
+    q = pj_ioqueue_get_shard(ioqueue, idx);
+    if (!q)
+	return PJ_EINVAL;
+
+    pj_lock_acquire(q->lock);
+    stat->poll_cnt = q->poll_cnt;
+    stat->event_cnt = q->event_cnt;
+    stat->key_cnt = q->count;
+    pj_lock_release(q->lock);
+
+    return PJ_SUCCESS;
+}
+
 /*
  * pj_ioqueue_destroy()
  *
@@ -209,6 +407,14 @@ PJ_DEF(pj_status_t) pj_ioqueue_destroy(pj_ioqueue_t *ioqueue)
     PJ_ASSERT_RETURN(ioqueue, PJ_EINVAL);
     PJ_ASSERT_RETURN(ioqueue->epfd > 0, PJ_EINVALIDOP);
 
+    if (ioqueue->shard_cnt) {
+	destroy_shards(ioqueue);
+	pj_lock_acquire(ioqueue->lock);
+	os_close(ioqueue->epfd);
+	ioqueue->epfd = 0;
+	return ioqueue_destroy(ioqueue);
+    }
+
     pj_lock_acquire(ioqueue->lock);
     os_close(ioqueue->epfd);
     ioqueue->epfd = 0;
@@ -238,6 +444,35 @@ PJ_DEF(pj_status_t) pj_ioqueue_destroy(pj_ioqueue_t *ioqueue)
     return ioqueue_destroy(ioqueue);
 }
 
+/*
+ * 在分片模式下，按套接字句柄选择分片，分片已满时依次尝试下一个分片
+ */
+static pj_status_t register_to_shard(pj_pool_t *pool,
+				     pj_ioqueue_t *ioqueue,
+				     pj_sock_t sock,
+				     pj_grp_lock_t *grp_lock,
+				     void *user_data,
+				     const pj_ioqueue_callback *cb,
+				     pj_ioqueue_key_t **p_key)
+{
+    unsigned i, start;
+    pj_status_t rc = PJ_ETOOMANY;
+
+    start = (unsigned)sock % ioqueue->shard_cnt;
+    for (i = 0; i < ioqueue->shard_cnt; ++i) {
+	pj_ioqueue_t *shard;
+
+	shard = ioqueue->shards[(start + i) % ioqueue->shard_cnt];
+	shard->default_concurrency = ioqueue->default_concurrency;
+
+	rc = pj_ioqueue_register_sock2(pool, shard, sock, grp_lock,
+				       user_data, cb, p_key);
+	if (rc != PJ_ETOOMANY)
+	    break;
+    }
+    return rc;
+}
+
 /*
  * pj_ioqueue_register_sock()
  *
@@ -260,6 +495,10 @@ PJ_DEF(pj_status_t) pj_ioqueue_register_sock2(pj_pool_t *pool,
     PJ_ASSERT_RETURN(pool && ioqueue && sock != PJ_INVALID_SOCKET &&
                      cb && p_key, PJ_EINVAL);
 
+    if (ioqueue->shard_cnt)
+	return register_to_shard(pool, ioqueue, sock, grp_lock, user_data,
+				 cb, p_key);
+
     pj_lock_acquire(ioqueue->lock);
 
     if (ioqueue->count >= ioqueue->max) {
@@ -541,6 +780,30 @@ static void scan_closing_keys(pj_ioqueue_t *ioqueue)
 }
 #endif
 
+/*
+ * 轮询分片模式的父队列：等待任一分片有事件，然后逐个轮询这些分片
+ */
+static int poll_shards(pj_ioqueue_t *ioqueue, int msec)
+{
+    enum { MAX_EVENTS = PJ_IOQUEUE_MAX_CAND_EVENTS };
+    struct epoll_event events[MAX_EVENTS];
+    pj_time_val zero = { 0, 0 };
+    int i, count, processed_cnt = 0;
+
+    count = os_epoll_wait(ioqueue->epfd, events, MAX_EVENTS, msec);
+    if (count < 0)
+	return -pj_get_netos_error();
+
+    for (i = 0; i < count; ++i) {
+	pj_ioqueue_t *shard = (pj_ioqueue_t*)(epoll_data_type)
+			      events[i].epoll_data;
+	int rc = pj_ioqueue_poll(shard, &zero);
+	if (rc > 0)
+	    processed_cnt += rc;
+    }
+    return processed_cnt;
+}
+
 /*
  * pj_ioqueue_poll()
  *
@@ -560,6 +823,9 @@ PJ_DEF(int) pj_ioqueue_poll( pj_ioqueue_t *ioqueue, const pj_time_val *timeout)
 
     msec = timeout ? PJ_TIME_VAL_MSEC(*timeout) : 9000;
 
+    if (ioqueue->shard_cnt)
+	return poll_shards(ioqueue, msec);
+
     TRACE_((THIS_FILE, "start os_epoll_wait, msec=%d", msec));
     pj_get_timestamp(&t1);
 
@@ -672,6 +938,9 @@ PJ_DEF(int) pj_ioqueue_poll( pj_ioqueue_t *ioqueue, const pj_time_val *timeout)
 	    pj_grp_lock_add_ref_dbg(queue[i].key->grp_lock, "ioqueue", 0);
     }
 
+    ++ioqueue->poll_cnt;
+    ioqueue->event_cnt += event_cnt;
+
     PJ_RACE_ME(5);
 
     pj_lock_release(ioqueue->lock);
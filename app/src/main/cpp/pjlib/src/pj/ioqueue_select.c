@@ -104,6 +104,9 @@ struct pj_ioqueue_t {
     pj_ioqueue_key_t closing_list;
     pj_ioqueue_key_t free_list;
 #endif
+
+    pj_uint32_t poll_cnt;   /* 统计，在持有锁时更新 */
+    pj_uint32_t event_cnt;
 };
 
 /* Proto */
@@ -185,6 +188,7 @@ PJ_DEF(pj_status_t) pj_ioqueue_create(pj_pool_t *pool,
 
     ioqueue->max = (unsigned) max_fd;
     ioqueue->count = 0;
+    ioqueue->poll_cnt = ioqueue->event_cnt = 0;
     PJ_FD_ZERO(&ioqueue->rfdset);
     PJ_FD_ZERO(&ioqueue->wfdset);
 #if PJ_HAS_TCP
@@ -249,6 +253,51 @@ PJ_DEF(pj_status_t) pj_ioqueue_create(pj_pool_t *pool,
     return PJ_SUCCESS;
 }
 
+PJ_DEF(void) pj_ioqueue_cfg_default(pj_ioqueue_cfg *cfg) {
+    pj_bzero(cfg, sizeof(*cfg));
+    cfg->shard_cnt = 1;
+}
+
+/*
+ * pj_ioqueue_create2()
+ *
+ * select() 队列不支持分片和工作线程
+ */
+PJ_DEF(pj_status_t) pj_ioqueue_create2(pj_pool_t *pool,
+                                       pj_size_t max_fd,
+                                       const pj_ioqueue_cfg *cfg,
+                                       pj_ioqueue_t **p_ioqueue) {
+    if (cfg && (cfg->shard_cnt > 1 || cfg->start_workers))
+        return PJ_ENOTSUP;
+
+    return pj_ioqueue_create(pool, max_fd, p_ioqueue);
+}
+
+PJ_DEF(unsigned) pj_ioqueue_get_shard_count(pj_ioqueue_t *ioqueue) {
+    PJ_UNUSED_ARG(ioqueue);
+    return 1;
+}
+
+PJ_DEF(pj_ioqueue_t *) pj_ioqueue_get_shard(pj_ioqueue_t *ioqueue,
+                                            unsigned idx) {
+    return idx == 0 ? ioqueue : NULL;
+}
+
+PJ_DEF(pj_status_t) pj_ioqueue_get_stat(pj_ioqueue_t *ioqueue,
+                                        unsigned idx,
+                                        pj_ioqueue_stat *stat) {
+    PJ_ASSERT_RETURN(ioqueue && stat, PJ_EINVAL);
+    PJ_ASSERT_RETURN(idx == 0, PJ_EINVAL);
+
+    pj_lock_acquire(ioqueue->lock);
+    stat->poll_cnt = ioqueue->poll_cnt;
+    stat->event_cnt = ioqueue->event_cnt;
+    stat->key_cnt = ioqueue->count;
+    pj_lock_release(ioqueue->lock);
+
+    return PJ_SUCCESS;
+}
+
 /*
  * pj_ioqueue_destroy()
  *
@@ -990,6 +1039,9 @@ PJ_DEF(int) pj_ioqueue_poll(pj_ioqueue_t *ioqueue, const pj_time_val *timeout) {
             pj_grp_lock_add_ref_dbg(event[i].key->grp_lock, "ioqueue", 0);
     }
 
+    ++ioqueue->poll_cnt;
+    ioqueue->event_cnt += event_cnt;
+
     PJ_RACE_ME(5);
 
     pj_lock_release(ioqueue->lock);
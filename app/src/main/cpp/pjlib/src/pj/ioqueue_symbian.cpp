@@ -473,6 +473,48 @@ PJ_DEF(pj_status_t) pj_ioqueue_create(	pj_pool_t *pool,
 }
 
 
+PJ_DEF(void) pj_ioqueue_cfg_default(pj_ioqueue_cfg *cfg)
+{
+    pj_bzero(cfg, sizeof(*cfg));
+    cfg->shard_cnt = 1;
+}
+
+/*
+ * Sharding and worker threads are only supported by the epoll backend.
+ */
+PJ_DEF(pj_status_t) pj_ioqueue_create2( pj_pool_t *pool,
+					pj_size_t max_fd,
+					const pj_ioqueue_cfg *cfg,
+					pj_ioqueue_t **p_ioqueue)
+{
+    if (cfg && (cfg->shard_cnt > 1 || cfg->start_workers))
+	return PJ_ENOTSUP;
+
+    return pj_ioqueue_create(pool, max_fd, p_ioqueue);
+}
+
+PJ_DEF(unsigned) pj_ioqueue_get_shard_count( pj_ioqueue_t *ioq )
+{
+    PJ_UNUSED_ARG(ioq);
+    return 1;
+}
+
+PJ_DEF(pj_ioqueue_t*) pj_ioqueue_get_shard( pj_ioqueue_t *ioq, unsigned idx )
+{
+    return idx == 0 ? ioq : NULL;
+}
+
+PJ_DEF(pj_status_t) pj_ioqueue_get_stat( pj_ioqueue_t *ioq,
+					 unsigned idx,
+					 pj_ioqueue_stat *stat )
+{
+    PJ_UNUSED_ARG(ioq);
+    PJ_UNUSED_ARG(idx);
+    PJ_UNUSED_ARG(stat);
+    return PJ_ENOTSUP;
+}
+
+
 /*
  * Destroy the I/O queue.
  */
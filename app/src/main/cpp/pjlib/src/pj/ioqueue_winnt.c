@@ -407,6 +407,47 @@ PJ_DEF(pj_status_t) pj_ioqueue_create( pj_pool_t *pool,
     return PJ_SUCCESS;
 }
 
+PJ_DEF(void) pj_ioqueue_cfg_default(pj_ioqueue_cfg *cfg)
+{
+    pj_bzero(cfg, sizeof(*cfg));
+    cfg->shard_cnt = 1;
+}
+
+/*
+ * Sharding and worker threads are only supported by the epoll backend.
+ */
+PJ_DEF(pj_status_t) pj_ioqueue_create2( pj_pool_t *pool,
+					pj_size_t max_fd,
+					const pj_ioqueue_cfg *cfg,
+					pj_ioqueue_t **p_ioqueue)
+{
+    if (cfg && (cfg->shard_cnt > 1 || cfg->start_workers))
+	return PJ_ENOTSUP;
+
+    return pj_ioqueue_create(pool, max_fd, p_ioqueue);
+}
+
+PJ_DEF(unsigned) pj_ioqueue_get_shard_count( pj_ioqueue_t *ioqueue )
+{
+    PJ_UNUSED_ARG(ioqueue);
+    return 1;
+}
+
+PJ_DEF(pj_ioqueue_t*) pj_ioqueue_get_shard( pj_ioqueue_t *ioqueue, unsigned idx )
+{
+    return idx == 0 ? ioqueue : NULL;
+}
+
+PJ_DEF(pj_status_t) pj_ioqueue_get_stat( pj_ioqueue_t *ioqueue,
+					 unsigned idx,
+					 pj_ioqueue_stat *stat )
+{
+    PJ_UNUSED_ARG(ioqueue);
+    PJ_UNUSED_ARG(idx);
+    PJ_UNUSED_ARG(stat);
+    return PJ_ENOTSUP;
+}
+
 /*
  * pj_ioqueue_destroy()
  */
@@ -49,6 +49,39 @@ static pj_size_t pool_sizes[PJ_CACHING_POOL_ARRAY_SIZE] =
  */
 #define START_SIZE  5
 
+/* Per-thread cache of released pools.
+ *
+ * Each thread that creates or releases a pool gets a "magazine" of up to
+ * magazine_size pools for each pool size, which is only accessed by that
+ * thread. Pools are created from and released to the magazine without
+ * taking the caching pool lock. The lock is only taken to refill an
+ * empty magazine from the shared free list, to flush half of a full
+ * magazine to it, and to erase a pool that was created on the slow path
+ * from the used list.
+ *
+ * Pools in the magazines, and pools created from them, stay in the used
+ * list, so that pj_caching_pool_destroy() finds them even if application
+ * never releases them. Only moving them between the magazines and the
+ * free lists changes the lists, with the lock held.
+ */
+typedef struct cpool_tcache
+{
+    struct cpool_tcache *next;
+    pj_size_t		 mem_size;
+
+    pj_uint32_t		 hit_cnt;
+    pj_uint32_t		 miss_cnt;
+    pj_uint32_t		 flush_cnt;
+
+    /* Pools created from this cache minus pools released to it without
+     * being in the used list.
+     */
+    pj_ssize_t		 used_delta;
+
+    unsigned		 cnt[PJ_CACHING_POOL_ARRAY_SIZE];
+    pj_pool_t	       **mag[PJ_CACHING_POOL_ARRAY_SIZE];
+} cpool_tcache;
+
 
 PJ_DEF(void) pj_caching_pool_init( pj_caching_pool *cp, 
 				   const pj_pool_factory_policy *policy,
@@ -79,6 +112,50 @@ PJ_DEF(void) pj_caching_pool_init( pj_caching_pool *cp,
 
     pool = pj_pool_create_on_buf("cachingpool", cp->pool_buf, sizeof(cp->pool_buf));
     pj_lock_create_simple_mutex(pool, "cachingpool", &cp->lock);
+
+    /* Pools must stay in the used list for PJ_SAFE_POOL check */
+    cp->magazine_size = PJ_SAFE_POOL ? 0 : PJ_CACHING_POOL_MAGAZINE_SIZE;
+    if (pj_thread_local_alloc(&cp->tls_id) != PJ_SUCCESS)
+	cp->tls_id = -1;
+}
+
+/* Get the cache of the calling thread, creating it if necessary */
+static cpool_tcache *get_tcache(pj_caching_pool *cp)
+{
+    cpool_tcache *tc;
+    pj_size_t mem_size;
+    unsigned i;
+
+    if (cp->magazine_size == 0 || cp->tls_id < 0)
+	return NULL;
+
+    tc = (cpool_tcache*) pj_thread_local_get(cp->tls_id);
+    if (tc)
+	return tc;
+
+    mem_size = sizeof(cpool_tcache) + sizeof(pj_pool_t*) *
+	       PJ_CACHING_POOL_ARRAY_SIZE * cp->magazine_size;
+    tc = (cpool_tcache*) (*cp->factory.policy.block_alloc)(&cp->factory,
+							    mem_size);
+    if (!tc)
+	return NULL;
+
+    pj_bzero(tc, mem_size);
+    tc->mem_size = mem_size;
+    for (i=0; i<PJ_CACHING_POOL_ARRAY_SIZE; ++i)
+	tc->mag[i] = (pj_pool_t**)(tc + 1) + i * cp->magazine_size;
+
+    if (pj_thread_local_set(cp->tls_id, tc) != PJ_SUCCESS) {
+	(*cp->factory.policy.block_free)(&cp->factory, tc, mem_size);
+	return NULL;
+    }
+
+    pj_lock_acquire(cp->lock);
+    tc->next = (cpool_tcache*) cp->thread_caches;
+    cp->thread_caches = tc;
+    pj_lock_release(cp->lock);
+
+    return tc;
 }
 
 PJ_DEF(void) pj_caching_pool_destroy( pj_caching_pool *cp )
@@ -99,6 +176,25 @@ PJ_DEF(void) pj_caching_pool_destroy( pj_caching_pool *cp )
 	}
     }
 
+    /* Delete the per-thread caches and the pools in them */
+    while (cp->thread_caches) {
+	cpool_tcache *tc = (cpool_tcache*) cp->thread_caches;
+
+	cp->thread_caches = tc->next;
+	for (i=0; i < PJ_CACHING_POOL_ARRAY_SIZE; ++i) {
+	    while (tc->cnt[i]) {
+		pool = tc->mag[i][--tc->cnt[i]];
+		pj_list_erase(pool);
+		pj_pool_destroy_int(pool);
+	    }
+	}
+	(*cp->factory.policy.block_free)(&cp->factory, tc, tc->mem_size);
+    }
+    if (cp->tls_id >= 0) {
+	pj_thread_local_free(cp->tls_id);
+	cp->tls_id = -1;
+    }
+
     /* Delete all pools in used list */
     pool = (pj_pool_t*) cp->used_list.next;
     while (pool != (pj_pool_t*) &cp->used_list) {
@@ -116,6 +212,32 @@ PJ_DEF(void) pj_caching_pool_destroy( pj_caching_pool *cp )
     }
 }
 
+/* Find the index of the smallest pool size that fits initial_size.
+ * We'll just do linear search to the size array, as the array size itself
+ * is only a few elements. Binary search I suspect will be less efficient
+ * for this purpose.
+ */
+static int get_size_index(pj_size_t initial_size)
+{
+    int idx;
+
+    if (initial_size <= pool_sizes[START_SIZE]) {
+	for (idx=START_SIZE-1; 
+	     idx >= 0 && pool_sizes[idx] >= initial_size;
+	     --idx)
+	    ;
+	++idx;
+    } else {
+	for (idx=START_SIZE+1; 
+	     idx < PJ_CACHING_POOL_ARRAY_SIZE && 
+		  pool_sizes[idx] < initial_size;
+	     ++idx)
+	    ;
+    }
+
+    return idx;
+}
+
 static pj_pool_t* cpool_create_pool(pj_pool_factory *pf, 
 					      const char *name, 
 					      pj_size_t initial_size, 
@@ -123,37 +245,33 @@ static pj_pool_t* cpool_create_pool(pj_pool_factory *pf,
 					      pj_pool_callback *callback)
 {
     pj_caching_pool *cp = (pj_caching_pool*)pf;
+    cpool_tcache *tc;
     pj_pool_t *pool;
     int idx;
 
     PJ_CHECK_STACK();
 
-    pj_lock_acquire(cp->lock);
-
     /* Use pool factory's policy when callback is NULL */
     if (callback == NULL) {
 	callback = pf->policy.callback;
     }
 
-    /* Search the suitable size for the pool. 
-     * We'll just do linear search to the size array, as the array size itself
-     * is only a few elements. Binary search I suspect will be less efficient
-     * for this purpose.
-     */
-    if (initial_size <= pool_sizes[START_SIZE]) {
-	for (idx=START_SIZE-1; 
-	     idx >= 0 && pool_sizes[idx] >= initial_size;
-	     --idx)
-	    ;
-	++idx;
-    } else {
-	for (idx=START_SIZE+1; 
-	     idx < PJ_CACHING_POOL_ARRAY_SIZE && 
-		  pool_sizes[idx] < initial_size;
-	     ++idx)
-	    ;
+    /* Search the suitable size for the pool. */
+    idx = get_size_index(initial_size);
+
+    /* Get one pool from the thread's cache without locking. */
+    tc = get_tcache(cp);
+    if (tc && idx < PJ_CACHING_POOL_ARRAY_SIZE && tc->cnt[idx]) {
+	pool = tc->mag[idx][--tc->cnt[idx]];
+	pj_pool_init_int(pool, name, increment_sz, callback);
+	pool->factory_data = (void*) (pj_ssize_t) idx;
+	++tc->hit_cnt;
+	++tc->used_delta;
+	return pool;
     }
 
+    pj_lock_acquire(cp->lock);
+
     /* Check whether there's a pool in the list. */
     if (idx==PJ_CACHING_POOL_ARRAY_SIZE || pj_list_empty(&cp->free_list[idx])) {
 	/* No pool is available. */
@@ -187,6 +305,25 @@ static pj_pool_t* cpool_create_pool(pj_pool_factory *pf,
 	PJ_LOG(6, (pool->obj_name, "pool reused, size=%u", pool->capacity));
     }
 
+    /* Refill the thread's cache with half a magazine. */
+    if (tc) {
+	++tc->miss_cnt;
+	while (idx < PJ_CACHING_POOL_ARRAY_SIZE &&
+	       tc->cnt[idx] < cp->magazine_size / 2 &&
+	       !pj_list_empty(&cp->free_list[idx]))
+	{
+	    pj_pool_t *p = (pj_pool_t*) cp->free_list[idx].next;
+
+	    pj_list_erase(p);
+	    pj_list_insert_before(&cp->used_list, p);
+	    if (cp->capacity > pj_pool_get_capacity(p))
+		cp->capacity -= pj_pool_get_capacity(p);
+	    else
+		cp->capacity = 0;
+	    tc->mag[idx][tc->cnt[idx]++] = p;
+	}
+    }
+
     /* Put in used list. */
     pj_list_insert_before( &cp->used_list, pool );
 
@@ -200,9 +337,74 @@ static pj_pool_t* cpool_create_pool(pj_pool_factory *pf,
     return pool;
 }
 
+/* Move half of a full magazine to the shared free list. */
+static void flush_tcache(pj_caching_pool *cp, cpool_tcache *tc, unsigned idx)
+{
+    pj_lock_acquire(cp->lock);
+
+    while (tc->cnt[idx] > cp->magazine_size / 2) {
+	pj_pool_t *pool = tc->mag[idx][--tc->cnt[idx]];
+	pj_size_t pool_capacity = pj_pool_get_capacity(pool);
+
+	pj_list_erase(pool);
+	if (cp->capacity + pool_capacity > cp->max_capacity) {
+	    pj_pool_destroy_int(pool);
+	} else {
+	    pj_list_insert_after(&cp->free_list[idx], pool);
+	    cp->capacity += pool_capacity;
+	}
+    }
+    ++tc->flush_cnt;
+
+    pj_lock_release(cp->lock);
+}
+
+/* Erase a pool from the used list and destroy it. */
+static void destroy_used_pool(pj_caching_pool *cp, pj_pool_t *pool)
+{
+    pj_lock_acquire(cp->lock);
+    pj_list_erase(pool);
+    pj_pool_destroy_int(pool);
+    pj_lock_release(cp->lock);
+}
+
+/* Release a pool to the thread's cache. The pool stays in the used list,
+ * and it is counted as released in the thread's cache, wherever it was
+ * created.
+ */
+static void release_to_tcache(pj_caching_pool *cp, cpool_tcache *tc,
+			      pj_pool_t *pool)
+{
+    unsigned i;
+
+    --tc->used_delta;
+
+    if (pj_pool_get_capacity(pool) > pool_sizes[PJ_CACHING_POOL_ARRAY_SIZE-1]) {
+	destroy_used_pool(cp, pool);
+	return;
+    }
+
+    pj_pool_reset(pool);
+
+    i = (unsigned) (unsigned long) (pj_ssize_t) pool->factory_data;
+
+    pj_assert(i<PJ_CACHING_POOL_ARRAY_SIZE);
+    if (i >= PJ_CACHING_POOL_ARRAY_SIZE ) {
+	/* Something has gone wrong with the pool. */
+	destroy_used_pool(cp, pool);
+	return;
+    }
+
+    if (tc->cnt[i] == cp->magazine_size)
+	flush_tcache(cp, tc, i);
+
+    tc->mag[i][tc->cnt[i]++] = pool;
+}
+
 static void cpool_release_pool( pj_pool_factory *pf, pj_pool_t *pool)
 {
     pj_caching_pool *cp = (pj_caching_pool*)pf;
+    cpool_tcache *tc;
     pj_size_t pool_capacity;
     unsigned i;
 
@@ -210,6 +412,12 @@ static void cpool_release_pool( pj_pool_factory *pf, pj_pool_t *pool)
 
     PJ_ASSERT_ON_FAIL(pf && pool, return);
 
+    tc = get_tcache(cp);
+    if (tc) {
+	release_to_tcache(cp, tc, pool);
+	return;
+    }
+
     pj_lock_acquire(cp->lock);
 
 #if PJ_SAFE_POOL
@@ -271,12 +479,28 @@ static void cpool_dump_status(pj_pool_factory *factory, pj_bool_t detail )
 {
 #if PJ_LOG_MAX_LEVEL >= 3
     pj_caching_pool *cp = (pj_caching_pool*)factory;
+    pj_caching_pool_stat stat;
+
+    pj_caching_pool_get_stat(cp, &stat);
 
     pj_lock_acquire(cp->lock);
 
     PJ_LOG(3,("cachpool", " Dumping caching pool:"));
     PJ_LOG(3,("cachpool", "   Capacity=%u, max_capacity=%u, used_cnt=%u", \
 			     cp->capacity, cp->max_capacity, cp->used_count));
+    if (cp->thread_caches) {
+	pj_size_t cached = 0;
+	unsigned i, total;
+
+	for (i=0; i<PJ_CACHING_POOL_ARRAY_SIZE; ++i)
+	    cached += stat.thread_cached[i];
+	total = stat.hit_cnt + stat.miss_cnt;
+	PJ_LOG(3,("cachpool", "   Thread caches: %u bytes, hit %u of %u "
+			      "(%u%%), %u flushes, total used_cnt=%u",
+			      cached, stat.hit_cnt, total,
+			      total ? stat.hit_cnt * 100 / total : 0,
+			      stat.flush_cnt, stat.used_count));
+    }
     if (detail) {
 	pj_pool_t *pool = (pj_pool_t*) cp->used_list.next;
 	pj_size_t total_used = 0, total_capacity = 0;
@@ -307,6 +531,44 @@ static void cpool_dump_status(pj_pool_factory *factory, pj_bool_t detail )
 }
 
 
+PJ_DEF(void) pj_caching_pool_get_stat( pj_caching_pool *cp,
+				       pj_caching_pool_stat *stat )
+{
+    cpool_tcache *tc;
+    pj_ssize_t used_count;
+    unsigned i;
+
+    PJ_ASSERT_ON_FAIL(cp && stat, return);
+
+    pj_bzero(stat, sizeof(*stat));
+
+    /* The caches are read while their threads use them, so the numbers
+     * are only a snapshot.
+     */
+    pj_lock_acquire(cp->lock);
+
+    used_count = cp->used_count;
+    for (tc = (cpool_tcache*) cp->thread_caches; tc; tc = tc->next) {
+	stat->hit_cnt += tc->hit_cnt;
+	stat->miss_cnt += tc->miss_cnt;
+	stat->flush_cnt += tc->flush_cnt;
+	used_count += tc->used_delta;
+	for (i=0; i<PJ_CACHING_POOL_ARRAY_SIZE; ++i)
+	    stat->thread_cached[i] += tc->cnt[i] * pool_sizes[i];
+    }
+    stat->used_count = used_count > 0 ? used_count : 0;
+
+    for (i=0; i<PJ_CACHING_POOL_ARRAY_SIZE; ++i) {
+	pj_pool_t *pool = (pj_pool_t*) cp->free_list[i].next;
+
+	for (; pool != (void*)&cp->free_list[i]; pool = pool->next)
+	    stat->shared_cached[i] += pj_pool_get_capacity(pool);
+    }
+
+    pj_lock_release(cp->lock);
+}
+
+
 static pj_bool_t cpool_on_block_alloc(pj_pool_factory *f, pj_size_t sz)
 {
     pj_caching_pool *cp = (pj_caching_pool*)f;
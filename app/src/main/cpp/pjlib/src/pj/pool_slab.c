@@ -0,0 +1,351 @@
+/**
+ * 已完成：
+ *
+ */
+#include <pj/pool_slab.h>
+#include <pj/assert.h>
+#include <pj/errno.h>
+#include <pj/list.h>
+#include <pj/log.h>
+#include <pj/string.h>
+
+#define THIS_FILE	"pool_slab.c"
+
+/* Object sizes of the classes, including the object header */
+#define SLAB_MIN_SHIFT	5
+#define SLAB_CLASS_CNT	8
+#define SLAB_OBJ_SIZE(c) ((pj_size_t)1 << (SLAB_MIN_SHIFT + (c)))
+
+/* Minimum size of a slab, and minimum number of objects in it */
+#define SLAB_MIN_BYTES	4096
+#define SLAB_MIN_OBJS	8
+
+struct slab;
+
+/* Header in front of every object. Objects larger than the largest
+ * class have a NULL slab and a large_hdr in front of the header.
+ */
+typedef union obj_hdr
+{
+    struct slab	*slab;
+    pj_uint64_t	 align;
+} obj_hdr;
+
+#define HDR_SIZE	sizeof(obj_hdr)
+
+typedef struct large_hdr
+{
+    PJ_DECL_LIST_MEMBER(struct large_hdr);
+    pj_size_t	 size;
+    obj_hdr	 hdr;
+} large_hdr;
+
+struct slab_class;
+
+typedef struct slab
+{
+    PJ_DECL_LIST_MEMBER(struct slab);
+    struct slab_class *cls;
+
+    /* Freed objects, linked through their first word */
+    void	*free_obj;
+
+    /* Objects that have never been allocated start here */
+    char	*next_obj;
+
+    unsigned	 used;
+} slab;
+
+/* Objects are placed after the slab header, keeping their alignment */
+#define SLAB_HDR_SIZE	((sizeof(slab) + HDR_SIZE - 1) & ~(HDR_SIZE - 1))
+
+typedef struct slab_class
+{
+    pj_size_t	 obj_size;
+    pj_size_t	 slab_size;
+    unsigned	 obj_per_slab;
+
+    /* Slabs with free objects, and full slabs */
+    slab	 partial;
+    slab	 full;
+
+    /* One empty slab kept to avoid thrashing */
+    slab	*spare;
+
+    unsigned	 slab_cnt;
+    pj_size_t	 obj_cnt;
+} slab_class;
+
+struct pj_slab_t
+{
+    char	    obj_name[PJ_MAX_OBJ_NAME];
+    pj_pool_factory *factory;
+    slab_class	    cls[SLAB_CLASS_CNT];
+    large_hdr	    large;
+    pj_slab_stat    stat;
+};
+
+
+PJ_DEF(pj_status_t) pj_slab_create(pj_pool_t *pool,
+				   const char *name,
+				   pj_slab_t **p_slab)
+{
+    pj_slab_t *sl;
+    unsigned c;
+
+    PJ_ASSERT_RETURN(pool && p_slab, PJ_EINVAL);
+
+    sl = PJ_POOL_ZALLOC_T(pool, pj_slab_t);
+    if (!sl)
+	return PJ_ENOMEM;
+
+    pj_ansi_strncpy(sl->obj_name, name ? name : "slab", PJ_MAX_OBJ_NAME);
+    sl->obj_name[PJ_MAX_OBJ_NAME-1] = '\0';
+    sl->factory = pool->factory;
+    pj_list_init(&sl->large);
+
+    for (c = 0; c < SLAB_CLASS_CNT; ++c) {
+	slab_class *cls = &sl->cls[c];
+
+	cls->obj_size = SLAB_OBJ_SIZE(c);
+	cls->obj_per_slab = (unsigned)(SLAB_MIN_BYTES / cls->obj_size);
+	if (cls->obj_per_slab < SLAB_MIN_OBJS)
+	    cls->obj_per_slab = SLAB_MIN_OBJS;
+	cls->slab_size = SLAB_HDR_SIZE + cls->obj_per_slab * cls->obj_size;
+	pj_list_init(&cls->partial);
+	pj_list_init(&cls->full);
+    }
+
+    *p_slab = sl;
+    return PJ_SUCCESS;
+}
+
+static void *block_alloc(pj_slab_t *sl, pj_size_t size)
+{
+    void *mem = (*sl->factory->policy.block_alloc)(sl->factory, size);
+
+    if (mem) {
+	sl->stat.reserved_size += size;
+	if (sl->stat.reserved_size > sl->stat.peak_reserved_size)
+	    sl->stat.peak_reserved_size = sl->stat.reserved_size;
+    }
+    return mem;
+}
+
+static void block_free(pj_slab_t *sl, void *mem, pj_size_t size)
+{
+    sl->stat.reserved_size -= size;
+    (*sl->factory->policy.block_free)(sl->factory, mem, size);
+}
+
+PJ_DEF(void) pj_slab_destroy(pj_slab_t *sl)
+{
+    unsigned c;
+
+    PJ_ASSERT_ON_FAIL(sl, return);
+
+    for (c = 0; c < SLAB_CLASS_CNT; ++c) {
+	slab_class *cls = &sl->cls[c];
+
+	while (!pj_list_empty(&cls->partial)) {
+	    slab *s = cls->partial.next;
+	    pj_list_erase(s);
+	    block_free(sl, s, cls->slab_size);
+	}
+	while (!pj_list_empty(&cls->full)) {
+	    slab *s = cls->full.next;
+	    pj_list_erase(s);
+	    block_free(sl, s, cls->slab_size);
+	}
+	if (cls->spare) {
+	    block_free(sl, cls->spare, cls->slab_size);
+	    cls->spare = NULL;
+	}
+	cls->slab_cnt = 0;
+	cls->obj_cnt = 0;
+    }
+
+    while (!pj_list_empty(&sl->large)) {
+	large_hdr *l = sl->large.next;
+	pj_list_erase(l);
+	block_free(sl, l, l->size);
+    }
+
+    sl->stat.obj_cnt = 0;
+    sl->stat.used_size = 0;
+}
+
+/* Smallest class that fits the object and its header */
+PJ_INLINE(int) get_class(pj_size_t size)
+{
+    pj_size_t total = size + HDR_SIZE;
+    int c = 0;
+
+    while (c < SLAB_CLASS_CNT && SLAB_OBJ_SIZE(c) < total)
+	++c;
+    return c;
+}
+
+static void *alloc_large(pj_slab_t *sl, pj_size_t size)
+{
+    pj_size_t total = sizeof(large_hdr) + size;
+    large_hdr *l;
+
+    l = (large_hdr*) block_alloc(sl, total);
+    if (!l)
+	return NULL;
+
+    l->size = total;
+    l->hdr.slab = NULL;
+    pj_list_insert_before(&sl->large, l);
+
+    ++sl->stat.obj_cnt;
+    sl->stat.used_size += total;
+    return l + 1;
+}
+
+PJ_DEF(void*) pj_slab_alloc(pj_slab_t *sl, pj_size_t size)
+{
+    slab_class *cls;
+    slab *s;
+    obj_hdr *hdr;
+    int c;
+
+    PJ_ASSERT_RETURN(sl, NULL);
+
+    ++sl->stat.alloc_cnt;
+
+    c = get_class(size);
+    if (c == SLAB_CLASS_CNT)
+	return alloc_large(sl, size);
+
+    cls = &sl->cls[c];
+    if (!pj_list_empty(&cls->partial)) {
+	s = cls->partial.next;
+    } else {
+	if (cls->spare) {
+	    s = cls->spare;
+	    cls->spare = NULL;
+	} else {
+	    s = (slab*) block_alloc(sl, cls->slab_size);
+	    if (!s)
+		return NULL;
+
+	    s->cls = cls;
+	    s->free_obj = NULL;
+	    s->next_obj = (char*)s + SLAB_HDR_SIZE;
+	    s->used = 0;
+	    ++cls->slab_cnt;
+	}
+	pj_list_insert_after(&cls->partial, s);
+    }
+
+    if (s->free_obj) {
+	hdr = (obj_hdr*) s->free_obj;
+	s->free_obj = *(void**)s->free_obj;
+    } else {
+	hdr = (obj_hdr*) s->next_obj;
+	s->next_obj += cls->obj_size;
+    }
+    hdr->slab = s;
+
+    if (++s->used == cls->obj_per_slab) {
+	pj_list_erase(s);
+	pj_list_insert_after(&cls->full, s);
+    }
+
+    ++cls->obj_cnt;
+    ++sl->stat.obj_cnt;
+    sl->stat.used_size += cls->obj_size;
+    return hdr + 1;
+}
+
+PJ_DEF(void*) pj_slab_zalloc(pj_slab_t *sl, pj_size_t size)
+{
+    void *mem = pj_slab_alloc(sl, size);
+    if (mem)
+	pj_bzero(mem, size);
+    return mem;
+}
+
+PJ_DEF(void) pj_slab_free(pj_slab_t *sl, void *mem)
+{
+    obj_hdr *hdr;
+    slab_class *cls;
+    slab *s;
+
+    PJ_ASSERT_ON_FAIL(sl, return);
+
+    if (!mem)
+	return;
+
+    ++sl->stat.free_cnt;
+    --sl->stat.obj_cnt;
+
+    hdr = (obj_hdr*)mem - 1;
+    s = hdr->slab;
+    if (!s) {
+	large_hdr *l = (large_hdr*)mem - 1;
+
+	sl->stat.used_size -= l->size;
+	pj_list_erase(l);
+	block_free(sl, l, l->size);
+	return;
+    }
+
+    cls = s->cls;
+    pj_assert(cls >= sl->cls && cls < sl->cls + SLAB_CLASS_CNT);
+
+    *(void**)hdr = s->free_obj;
+    s->free_obj = hdr;
+
+    if (s->used-- == cls->obj_per_slab) {
+	/* It was full */
+	pj_list_erase(s);
+	pj_list_insert_after(&cls->partial, s);
+    }
+
+    if (s->used == 0) {
+	pj_list_erase(s);
+	if (cls->spare) {
+	    --cls->slab_cnt;
+	    block_free(sl, s, cls->slab_size);
+	} else {
+	    cls->spare = s;
+	}
+    }
+
+    --cls->obj_cnt;
+    sl->stat.used_size -= cls->obj_size;
+}
+
+PJ_DEF(void) pj_slab_get_stat(pj_slab_t *sl, pj_slab_stat *stat)
+{
+    PJ_ASSERT_ON_FAIL(sl && stat, return);
+
+    pj_memcpy(stat, &sl->stat, sizeof(*stat));
+}
+
+PJ_DEF(void) pj_slab_dump(pj_slab_t *sl)
+{
+#if PJ_LOG_MAX_LEVEL >= 3
+    unsigned c;
+
+    PJ_ASSERT_ON_FAIL(sl, return);
+
+    PJ_LOG(3,(sl->obj_name, "Slab: %u objects, %u of %u bytes used, "
+			    "peak %u bytes", sl->stat.obj_cnt,
+			    sl->stat.used_size, sl->stat.reserved_size,
+			    sl->stat.peak_reserved_size));
+    for (c = 0; c < SLAB_CLASS_CNT; ++c) {
+	slab_class *cls = &sl->cls[c];
+
+	if (!cls->slab_cnt)
+	    continue;
+	PJ_LOG(3,(sl->obj_name, "  %5u bytes: %6u objects in %4u slab(s)",
+		  cls->obj_size, cls->obj_cnt, cls->slab_cnt));
+    }
+#else
+    PJ_UNUSED_ARG(sl);
+#endif
+}
@@ -89,6 +89,11 @@ PJ_EXPORT_SYMBOL(pj_hash_this)
  * ioqueue.h
  */
 PJ_EXPORT_SYMBOL(pj_ioqueue_create)
+PJ_EXPORT_SYMBOL(pj_ioqueue_cfg_default)
+PJ_EXPORT_SYMBOL(pj_ioqueue_create2)
+PJ_EXPORT_SYMBOL(pj_ioqueue_get_shard_count)
+PJ_EXPORT_SYMBOL(pj_ioqueue_get_shard)
+PJ_EXPORT_SYMBOL(pj_ioqueue_get_stat)
 PJ_EXPORT_SYMBOL(pj_ioqueue_destroy)
 PJ_EXPORT_SYMBOL(pj_ioqueue_set_lock)
 PJ_EXPORT_SYMBOL(pj_ioqueue_register_sock)
@@ -224,6 +229,18 @@ PJ_EXPORT_SYMBOL(pj_pool_init_int)
 PJ_EXPORT_SYMBOL(pj_pool_destroy_int)
 PJ_EXPORT_SYMBOL(pj_caching_pool_init)
 PJ_EXPORT_SYMBOL(pj_caching_pool_destroy)
+PJ_EXPORT_SYMBOL(pj_caching_pool_get_stat)
+
+/*
+ * pool_slab.h
+ */
+PJ_EXPORT_SYMBOL(pj_slab_create)
+PJ_EXPORT_SYMBOL(pj_slab_destroy)
+PJ_EXPORT_SYMBOL(pj_slab_alloc)
+PJ_EXPORT_SYMBOL(pj_slab_zalloc)
+PJ_EXPORT_SYMBOL(pj_slab_free)
+PJ_EXPORT_SYMBOL(pj_slab_get_stat)
+PJ_EXPORT_SYMBOL(pj_slab_dump)
 
 /*
  * rand.h
@@ -334,6 +351,8 @@ PJ_EXPORT_SYMBOL(pj_utoa_pad)
  */
 PJ_EXPORT_SYMBOL(pj_timer_heap_mem_size)
 PJ_EXPORT_SYMBOL(pj_timer_heap_create)
+PJ_EXPORT_SYMBOL(pj_timer_heap_cfg_default)
+PJ_EXPORT_SYMBOL(pj_timer_heap_create2)
 PJ_EXPORT_SYMBOL(pj_timer_entry_init)
 PJ_EXPORT_SYMBOL(pj_timer_heap_schedule)
 PJ_EXPORT_SYMBOL(pj_timer_heap_cancel)
@@ -106,6 +106,12 @@ struct pj_timer_heap_t
     /** Callback to be called when a timer expires. */
     pj_timer_heap_callback *callback;
 
+    /** Shards of the timing wheel, or NULL for the binary heap. */
+    struct wheel_shard *shards;
+
+    /** Number of shards. */
+    unsigned shard_cnt;
+
 };
 
 
@@ -360,6 +366,493 @@ static int cancel( pj_timer_heap_t *ht,
 }
 
 
+/*
+ * Hierarchical timing wheel.
+ *
+ * The wheel ticks every millisecond, the resolution of pj_time_val.
+ * Level 0 has a slot for each of the next 256 ticks, and each of the
+ * upper levels has 64 slots, each slot covering the whole range of the
+ * level below. An entry is linked to the slot of the lowest level that
+ * covers its expiry time, and is moved down ("cascaded") when the wheel
+ * reaches the beginning of that slot, so scheduling and cancelling are
+ * O(1). Entries beyond the range of the top level (about 49 days) are
+ * cascaded again until they are within range.
+ *
+ * An entry belongs to the shard selected by its address. Each shard is
+ * a wheel with its own lock and its own array of nodes, and the timer id
+ * of an entry is the index of its node in the shard plus one.
+ */
+
+#define WHEEL_L0_BITS	8
+#define WHEEL_LN_BITS	6
+#define WHEEL_LEVELS	5
+#define WHEEL_SLOTS	((1 << WHEEL_L0_BITS) + \
+			 (WHEEL_LEVELS - 1) * (1 << WHEEL_LN_BITS))
+#define WHEEL_EXPIRED	WHEEL_SLOTS	/* The list of expired entries */
+#define WHEEL_RANGE	((pj_uint64_t)1 << (WHEEL_L0_BITS + \
+			 (WHEEL_LEVELS - 1) * WHEEL_LN_BITS))
+#define WHEEL_NIL	(-1)
+
+/* Bit position of the slot index of a level in the tick value */
+#define LEVEL_SHIFT(l)	((l) == 0 ? 0 : \
+			 WHEEL_L0_BITS + ((l) - 1) * WHEEL_LN_BITS)
+#define LEVEL_MASK(l)	((l) == 0 ? (1 << WHEEL_L0_BITS) - 1 : \
+			 (1 << WHEEL_LN_BITS) - 1)
+#define LEVEL_FIRST(l)	((l) == 0 ? 0 : \
+			 (1 << WHEEL_L0_BITS) + ((l) - 1) * (1 << WHEEL_LN_BITS))
+#define SLOT_LEVEL(s)	((s) < (1 << WHEEL_L0_BITS) ? 0 : \
+			 1 + (((s) - (1 << WHEEL_L0_BITS)) >> WHEEL_LN_BITS))
+
+typedef struct wheel_node
+{
+    /** The entry, or NULL when the node is free. */
+    pj_timer_entry *entry;
+
+    /** Neighbours in the circular list of the slot. The next field also
+     *  links the free nodes. */
+    int prev, next;
+
+    /** The slot which list the node is in. */
+    int slot;
+
+} wheel_node;
+
+typedef struct wheel_shard
+{
+    /** Lock of the shard, when the heap has more than one shard. */
+    pj_lock_t *lock;
+
+    /** Pool to grow the node array from. */
+    pj_pool_t *pool;
+
+    /** Nodes of the scheduled entries, indexed by timer id minus one. */
+    wheel_node *nodes;
+    int node_max;
+    int free_node;
+
+    /** Number of scheduled entries. */
+    pj_size_t cur_size;
+
+    /** The last tick that has been processed, in msec. */
+    pj_uint64_t cur;
+
+    /** Number of entries in each level. */
+    pj_size_t level_cnt[WHEEL_LEVELS];
+
+    /** First node of each slot, and of the expired list. */
+    int head[WHEEL_SLOTS + 1];
+
+} wheel_shard;
+
+
+PJ_INLINE(pj_uint64_t) time_val_to_tick(const pj_time_val *t)
+{
+    return (pj_uint64_t)t->sec * 1000 + t->msec;
+}
+
+/* With a single shard the lock of the heap is used */
+PJ_INLINE(void) lock_shard(pj_timer_heap_t *ht, wheel_shard *sh)
+{
+    if (ht->shard_cnt > 1)
+	pj_lock_acquire(sh->lock);
+    else
+	lock_timer_heap(ht);
+}
+
+PJ_INLINE(void) unlock_shard(pj_timer_heap_t *ht, wheel_shard *sh)
+{
+    if (ht->shard_cnt > 1)
+	pj_lock_release(sh->lock);
+    else
+	unlock_timer_heap(ht);
+}
+
+PJ_INLINE(wheel_shard*) entry_shard(pj_timer_heap_t *ht,
+				    const pj_timer_entry *entry)
+{
+    pj_size_t addr = (pj_size_t)entry;
+    return &ht->shards[((addr >> 4) ^ (addr >> 12)) % ht->shard_cnt];
+}
+
+static void wheel_link(wheel_shard *sh, int n, int slot)
+{
+    wheel_node *node = &sh->nodes[n];
+    int head = sh->head[slot];
+
+    node->slot = slot;
+    if (head == WHEEL_NIL) {
+	node->prev = node->next = n;
+	sh->head[slot] = n;
+    } else {
+	/* Append, to keep the expired entries in order */
+	node->prev = sh->nodes[head].prev;
+	node->next = head;
+	sh->nodes[node->prev].next = n;
+	sh->nodes[head].prev = n;
+    }
+    if (slot != WHEEL_EXPIRED)
+	++sh->level_cnt[SLOT_LEVEL(slot)];
+}
+
+static void wheel_unlink(wheel_shard *sh, int n)
+{
+    wheel_node *node = &sh->nodes[n];
+
+    if (node->next == n) {
+	sh->head[node->slot] = WHEEL_NIL;
+    } else {
+	sh->nodes[node->prev].next = node->next;
+	sh->nodes[node->next].prev = node->prev;
+	if (sh->head[node->slot] == n)
+	    sh->head[node->slot] = node->next;
+    }
+    if (node->slot != WHEEL_EXPIRED)
+	--sh->level_cnt[SLOT_LEVEL(node->slot)];
+}
+
+/* Link the node to the slot of its expiry time */
+static void wheel_place(wheel_shard *sh, int n)
+{
+    pj_uint64_t tick = time_val_to_tick(&sh->nodes[n].entry->_timer_value);
+    pj_uint64_t delta;
+    unsigned level;
+
+    if (tick <= sh->cur) {
+	wheel_link(sh, n, WHEEL_EXPIRED);
+	return;
+    }
+
+    delta = tick - sh->cur;
+    if (delta >= WHEEL_RANGE) {
+	/* Cascaded again from the last slot of the top level */
+	delta = WHEEL_RANGE - 1;
+	tick = sh->cur + delta;
+    }
+
+    for (level = 0; level < WHEEL_LEVELS - 1; ++level) {
+	if (delta < ((pj_uint64_t)1 << LEVEL_SHIFT(level + 1)))
+	    break;
+    }
+
+    wheel_link(sh, n, LEVEL_FIRST(level) +
+		      (int)((tick >> LEVEL_SHIFT(level)) & LEVEL_MASK(level)));
+}
+
+/* Move the entries of a slot to the lower levels */
+static void wheel_cascade(wheel_shard *sh, int slot)
+{
+    while (sh->head[slot] != WHEEL_NIL) {
+	int n = sh->head[slot];
+	wheel_unlink(sh, n);
+	wheel_place(sh, n);
+    }
+}
+
+/* Process the ticks up to now, moving the expired entries to the
+ * expired list.
+ */
+static void wheel_advance(wheel_shard *sh, pj_uint64_t now)
+{
+    while (sh->cur < now) {
+	int slot;
+	unsigned level;
+
+	/* Skip to the next tick with something to do */
+	if (sh->level_cnt[0] == 0) {
+	    pj_uint64_t next;
+
+	    for (level = 1; level < WHEEL_LEVELS; ++level) {
+		if (sh->level_cnt[level])
+		    break;
+	    }
+	    if (level == WHEEL_LEVELS) {
+		sh->cur = now;
+		break;
+	    }
+
+	    /* The next cascade of the lowest non-empty level */
+	    next = (sh->cur | (((pj_uint64_t)1 << LEVEL_SHIFT(level)) - 1)) + 1;
+	    if (next > now) {
+		sh->cur = now;
+		break;
+	    }
+	    sh->cur = next - 1;
+	}
+
+	++sh->cur;
+
+	for (level = WHEEL_LEVELS - 1; level > 0; --level) {
+	    pj_uint64_t mask = ((pj_uint64_t)1 << LEVEL_SHIFT(level)) - 1;
+
+	    if ((sh->cur & mask) == 0) {
+		wheel_cascade(sh, LEVEL_FIRST(level) +
+			      (int)((sh->cur >> LEVEL_SHIFT(level)) &
+				    LEVEL_MASK(level)));
+	    }
+	}
+
+	slot = (int)(sh->cur & LEVEL_MASK(0));
+	while (sh->head[slot] != WHEEL_NIL) {
+	    int n = sh->head[slot];
+	    wheel_unlink(sh, n);
+	    wheel_link(sh, n, WHEEL_EXPIRED);
+	}
+    }
+}
+
+/* The next tick at which wheel_advance() has something to do */
+static pj_uint64_t wheel_next_tick(wheel_shard *sh)
+{
+    pj_uint64_t next = (pj_uint64_t)-1;
+    unsigned level, i;
+
+    if (sh->head[WHEEL_EXPIRED] != WHEEL_NIL)
+	return sh->cur;
+
+    for (level = 1; level < WHEEL_LEVELS; ++level) {
+	if (sh->level_cnt[level]) {
+	    next = (sh->cur | (((pj_uint64_t)1 << LEVEL_SHIFT(level)) - 1)) + 1;
+	    break;
+	}
+    }
+
+    if (sh->level_cnt[0]) {
+	for (i = 1; i <= LEVEL_MASK(0); ++i) {
+	    if (sh->head[(sh->cur + i) & LEVEL_MASK(0)] != WHEEL_NIL) {
+		if (sh->cur + i < next)
+		    next = sh->cur + i;
+		break;
+	    }
+	}
+    }
+
+    return next;
+}
+
+/* The earliest entry of a slot list */
+static pj_timer_entry *wheel_slot_earliest(wheel_shard *sh, int slot,
+					   pj_timer_entry *earliest)
+{
+    int n = sh->head[slot];
+
+    if (n == WHEEL_NIL)
+	return earliest;
+
+    do {
+	pj_timer_entry *e = sh->nodes[n].entry;
+	if (!earliest || PJ_TIME_VAL_LT(e->_timer_value, earliest->_timer_value))
+	    earliest = e;
+	n = sh->nodes[n].next;
+    } while (n != sh->head[slot]);
+
+    return earliest;
+}
+
+/* The entry with the earliest expiry time */
+static pj_timer_entry *wheel_earliest(wheel_shard *sh)
+{
+    pj_timer_entry *earliest;
+    unsigned level, i;
+
+    earliest = wheel_slot_earliest(sh, WHEEL_EXPIRED, NULL);
+
+    /* In each level, the first non-empty slot after the current one has
+     * the earliest entries of that level. The top level may also have
+     * entries beyond its range, so all of its slots are checked.
+     */
+    for (level = 0; level < WHEEL_LEVELS; ++level) {
+	pj_uint64_t idx = sh->cur >> LEVEL_SHIFT(level);
+
+	if (sh->level_cnt[level] == 0)
+	    continue;
+
+	for (i = 1; i <= LEVEL_MASK(level) + 1; ++i) {
+	    int slot = LEVEL_FIRST(level) +
+		       (int)((idx + i) & LEVEL_MASK(level));
+	    if (sh->head[slot] != WHEEL_NIL) {
+		earliest = wheel_slot_earliest(sh, slot, earliest);
+		if (level < WHEEL_LEVELS - 1)
+		    break;
+	    }
+	}
+    }
+
+    return earliest;
+}
+
+static pj_status_t wheel_grow(wheel_shard *sh)
+{
+    int new_max = sh->node_max * 2;
+    wheel_node *new_nodes;
+    int i;
+
+    new_nodes = (wheel_node*)
+		pj_pool_alloc(sh->pool, sizeof(wheel_node) * new_max);
+    if (!new_nodes)
+	return PJ_ENOMEM;
+
+    pj_memcpy(new_nodes, sh->nodes, sizeof(wheel_node) * sh->node_max);
+    for (i = sh->node_max; i < new_max; ++i) {
+	new_nodes[i].entry = NULL;
+	new_nodes[i].next = (i + 1 < new_max) ? i + 1 : sh->free_node;
+    }
+    sh->free_node = sh->node_max;
+    sh->nodes = new_nodes;
+    sh->node_max = new_max;
+
+    return PJ_SUCCESS;
+}
+
+static pj_status_t wheel_init(wheel_shard *sh, pj_pool_t *pool,
+			      pj_size_t count)
+{
+    pj_time_val now;
+    int i;
+
+    pj_bzero(sh, sizeof(*sh));
+    sh->pool = pool;
+    sh->node_max = (int)(count < 8 ? 8 : count);
+    sh->nodes = (wheel_node*)
+		pj_pool_alloc(pool, sizeof(wheel_node) * sh->node_max);
+    if (!sh->nodes)
+	return PJ_ENOMEM;
+
+    for (i = 0; i < sh->node_max; ++i) {
+	sh->nodes[i].entry = NULL;
+	sh->nodes[i].next = (i + 1 < sh->node_max) ? i + 1 : WHEEL_NIL;
+    }
+    sh->free_node = 0;
+
+    for (i = 0; i <= WHEEL_SLOTS; ++i)
+	sh->head[i] = WHEEL_NIL;
+
+    pj_gettickcount(&now);
+    sh->cur = time_val_to_tick(&now);
+
+    return PJ_SUCCESS;
+}
+
+static pj_status_t wheel_schedule(wheel_shard *sh,
+				  pj_timer_entry *entry,
+				  const pj_time_val *future_time)
+{
+    int n;
+
+    if (sh->free_node == WHEEL_NIL) {
+	pj_status_t status = wheel_grow(sh);
+	if (status != PJ_SUCCESS)
+	    return status;
+    }
+
+    n = sh->free_node;
+    sh->free_node = sh->nodes[n].next;
+    sh->nodes[n].entry = entry;
+
+    entry->_timer_id = n + 1;
+    entry->_timer_value = *future_time;
+    wheel_place(sh, n);
+    ++sh->cur_size;
+
+    return PJ_SUCCESS;
+}
+
+static void wheel_remove(wheel_shard *sh, int n)
+{
+    wheel_unlink(sh, n);
+    sh->nodes[n].entry->_timer_id = -1;
+    sh->nodes[n].entry = NULL;
+    sh->nodes[n].next = sh->free_node;
+    sh->free_node = n;
+    --sh->cur_size;
+}
+
+static int wheel_cancel(wheel_shard *sh,
+			pj_timer_entry *entry,
+			unsigned flags)
+{
+    int n = entry->_timer_id - 1;
+
+    // Check to see if the timer_id is out of range
+    if (n < 0 || n >= sh->node_max || !sh->nodes[n].entry) {
+	entry->_timer_id = -1;
+	return 0;
+    }
+
+    if (sh->nodes[n].entry != entry) {
+	if ((flags & F_DONT_ASSERT) == 0)
+	    pj_assert(sh->nodes[n].entry == entry);
+	entry->_timer_id = -1;
+	return 0;
+    }
+
+    wheel_remove(sh, n);
+    return 1;
+}
+
+static unsigned wheel_poll(pj_timer_heap_t *ht, pj_time_val *next_delay)
+{
+    pj_time_val now;
+    pj_uint64_t now_tick, next = (pj_uint64_t)-1;
+    unsigned i, count = 0;
+
+    pj_gettickcount(&now);
+    now_tick = time_val_to_tick(&now);
+
+    for (i = 0; i < ht->shard_cnt; ++i) {
+	wheel_shard *sh = &ht->shards[i];
+	pj_uint64_t shard_next;
+
+	lock_shard(ht, sh);
+
+	wheel_advance(sh, now_tick);
+
+	while (sh->head[WHEEL_EXPIRED] != WHEEL_NIL &&
+	       count < ht->max_entries_per_poll)
+	{
+	    pj_timer_entry *node = sh->nodes[sh->head[WHEEL_EXPIRED]].entry;
+	    pj_grp_lock_t *grp_lock;
+
+	    wheel_remove(sh, sh->head[WHEEL_EXPIRED]);
+	    ++count;
+
+	    grp_lock = node->_grp_lock;
+	    node->_grp_lock = NULL;
+
+	    unlock_shard(ht, sh);
+
+	    PJ_RACE_ME(5);
+
+	    if (node->cb)
+		(*node->cb)(ht, node);
+
+	    if (grp_lock)
+		pj_grp_lock_dec_ref(grp_lock);
+
+	    lock_shard(ht, sh);
+	}
+
+	shard_next = wheel_next_tick(sh);
+	if (shard_next < next)
+	    next = shard_next;
+
+	unlock_shard(ht, sh);
+    }
+
+    if (next_delay) {
+	if (next == (pj_uint64_t)-1) {
+	    next_delay->sec = next_delay->msec = PJ_MAXINT32;
+	} else if (next <= now_tick) {
+	    next_delay->sec = next_delay->msec = 0;
+	} else {
+	    next_delay->sec = (long)((next - now_tick) / 1000);
+	    next_delay->msec = (long)((next - now_tick) % 1000);
+	}
+    }
+
+    return count;
+}
+
+
 /*
  * Calculate memory size required to create a timer heap.
  */
@@ -379,19 +872,111 @@ PJ_DEF(pj_size_t) pj_timer_heap_mem_size(pj_size_t count)
 PJ_DEF(pj_status_t) pj_timer_heap_create( pj_pool_t *pool,
 					  pj_size_t size,
                                           pj_timer_heap_t **p_heap)
+{
+    pj_timer_heap_cfg cfg;
+
+    pj_timer_heap_cfg_default(&cfg);
+    cfg.count = size;
+
+    return pj_timer_heap_create2(pool, &cfg, p_heap);
+}
+
+PJ_DEF(void) pj_timer_heap_cfg_default(pj_timer_heap_cfg *cfg)
+{
+    pj_bzero(cfg, sizeof(*cfg));
+    cfg->type = PJ_TIMER_HEAP_USE_WHEEL ? PJ_TIMER_HEAP_WHEEL :
+					  PJ_TIMER_HEAP_BINARY;
+    cfg->count = 64;
+    cfg->shard_cnt = 1;
+}
+
+static pj_status_t create_wheel(pj_pool_t *pool,
+				const pj_timer_heap_cfg *cfg,
+				pj_timer_heap_t *ht)
+{
+    unsigned i;
+    pj_status_t status;
+
+    ht->shard_cnt = cfg->shard_cnt ? cfg->shard_cnt : 1;
+    ht->shards = (wheel_shard*)
+		 pj_pool_zalloc(pool, sizeof(wheel_shard) * ht->shard_cnt);
+    if (!ht->shards)
+	return PJ_ENOMEM;
+
+    if (ht->shard_cnt == 1)
+	return wheel_init(&ht->shards[0], pool, cfg->count);
+
+    /* Each shard grows from its own pool, under its own lock */
+    for (i = 0; i < ht->shard_cnt; ++i) {
+	pj_pool_t *shard_pool;
+	pj_lock_t *lock;
+
+	shard_pool = pj_pool_create(pool->factory, "tmrshard%p",
+				    512 + sizeof(wheel_node) *
+					  (cfg->count / ht->shard_cnt + 8),
+				    1024, NULL);
+	if (!shard_pool)
+	    return PJ_ENOMEM;
+
+	/* The pool is released by pj_timer_heap_destroy() on error */
+	status = wheel_init(&ht->shards[i], shard_pool,
+			    cfg->count / ht->shard_cnt);
+	if (status != PJ_SUCCESS)
+	    return status;
+
+	status = pj_lock_create_simple_mutex(shard_pool, "tmrshard%p", &lock);
+	if (status != PJ_SUCCESS)
+	    return status;
+	ht->shards[i].lock = lock;
+    }
+
+    return PJ_SUCCESS;
+}
+
+/*
+ * Create a new timer heap with the specified settings.
+ */
+PJ_DEF(pj_status_t) pj_timer_heap_create2( pj_pool_t *pool,
+					   const pj_timer_heap_cfg *cfg,
+					   pj_timer_heap_t **p_heap)
 {
     pj_timer_heap_t *ht;
+    pj_size_t size;
     pj_size_t i;
 
-    PJ_ASSERT_RETURN(pool && p_heap, PJ_EINVAL);
+    PJ_ASSERT_RETURN(pool && cfg && p_heap, PJ_EINVAL);
+    PJ_ASSERT_RETURN(cfg->type == PJ_TIMER_HEAP_WHEEL ||
+		     cfg->shard_cnt <= 1, PJ_EINVAL);
 
     *p_heap = NULL;
 
+    if (cfg->type == PJ_TIMER_HEAP_WHEEL) {
+	pj_status_t status;
+
+	ht = PJ_POOL_ZALLOC_T(pool, pj_timer_heap_t);
+	if (!ht)
+	    return PJ_ENOMEM;
+
+	ht->max_entries_per_poll = DEFAULT_MAX_TIMED_OUT_PER_POLL;
+	ht->pool = pool;
+
+	status = create_wheel(pool, cfg, ht);
+	if (status != PJ_SUCCESS) {
+	    pj_timer_heap_destroy(ht);
+	    return status;
+	}
+
+	*p_heap = ht;
+	return PJ_SUCCESS;
+    }
+
+    size = cfg->count;
+
     /* Magic? */
     size += 2;
 
     /* Allocate timer heap data structure from the pool */
-    ht = PJ_POOL_ALLOC_T(pool, pj_timer_heap_t);
+    ht = PJ_POOL_ZALLOC_T(pool, pj_timer_heap_t);
     if (!ht)
         return PJ_ENOMEM;
 
@@ -434,6 +1019,18 @@ PJ_DEF(void) pj_timer_heap_destroy( pj_timer_heap_t *ht )
         pj_lock_destroy(ht->lock);
         ht->lock = NULL;
     }
+
+    if (ht->shards && ht->shard_cnt > 1) {
+	unsigned i;
+
+	for (i = 0; i < ht->shard_cnt; ++i) {
+	    if (ht->shards[i].lock)
+		pj_lock_destroy(ht->shards[i].lock);
+	    if (ht->shards[i].pool)
+		pj_pool_release(ht->shards[i].pool);
+	}
+	ht->shards = NULL;
+    }
 }
 
 PJ_DEF(void) pj_timer_heap_set_lock(  pj_timer_heap_t *ht,
@@ -511,8 +1108,15 @@ static pj_status_t schedule_w_grp_lock(pj_timer_heap_t *ht,
     pj_gettickcount(&expires);
     PJ_TIME_VAL_ADD(expires, *delay);
     
-    lock_timer_heap(ht);
-    status = schedule_entry(ht, entry, &expires);
+    if (ht->shards) {
+	wheel_shard *sh = entry_shard(ht, entry);
+
+	lock_shard(ht, sh);
+	status = wheel_schedule(sh, entry, &expires);
+    } else {
+	lock_timer_heap(ht);
+	status = schedule_entry(ht, entry, &expires);
+    }
     if (status == PJ_SUCCESS) {
 	if (set_id)
 	    entry->id = id_val;
@@ -521,7 +1125,10 @@ static pj_status_t schedule_w_grp_lock(pj_timer_heap_t *ht,
 	    pj_grp_lock_add_ref(entry->_grp_lock);
 	}
     }
-    unlock_timer_heap(ht);
+    if (ht->shards)
+	unlock_shard(ht, entry_shard(ht, entry));
+    else
+	unlock_timer_heap(ht);
 
     return status;
 }
@@ -578,8 +1185,15 @@ static int cancel_timer(pj_timer_heap_t *ht,
 
     PJ_ASSERT_RETURN(ht && entry, PJ_EINVAL);
 
-    lock_timer_heap(ht);
-    count = cancel(ht, entry, flags | F_DONT_CALL);
+    if (ht->shards) {
+	wheel_shard *sh = entry_shard(ht, entry);
+
+	lock_shard(ht, sh);
+	count = wheel_cancel(sh, entry, flags);
+    } else {
+	lock_timer_heap(ht);
+	count = cancel(ht, entry, flags | F_DONT_CALL);
+    }
     if (flags & F_SET_ID) {
 	entry->id = id_val;
     }
@@ -588,7 +1202,10 @@ static int cancel_timer(pj_timer_heap_t *ht,
 	entry->_grp_lock = NULL;
 	pj_grp_lock_dec_ref(grp_lock);
     }
-    unlock_timer_heap(ht);
+    if (ht->shards)
+	unlock_shard(ht, entry_shard(ht, entry));
+    else
+	unlock_timer_heap(ht);
 
     return count;
 }
@@ -614,6 +1231,9 @@ PJ_DEF(unsigned) pj_timer_heap_poll( pj_timer_heap_t *ht,
 
     PJ_ASSERT_RETURN(ht, 0);
 
+    if (ht->shards)
+	return wheel_poll(ht, next_delay);
+
     lock_timer_heap(ht);
     if (!ht->cur_size && next_delay) {
 	next_delay->sec = next_delay->msec = PJ_MAXINT32;
@@ -669,12 +1289,43 @@ PJ_DEF(pj_size_t) pj_timer_heap_count( pj_timer_heap_t *ht )
 {
     PJ_ASSERT_RETURN(ht, 0);
 
+    if (ht->shards) {
+	pj_size_t count = 0;
+	unsigned i;
+
+	for (i = 0; i < ht->shard_cnt; ++i)
+	    count += ht->shards[i].cur_size;
+	return count;
+    }
+
     return ht->cur_size;
 }
 
 PJ_DEF(pj_status_t) pj_timer_heap_earliest_time( pj_timer_heap_t * ht,
 					         pj_time_val *timeval)
 {
+    if (ht->shards) {
+	pj_timer_entry *earliest = NULL;
+	unsigned i;
+
+	for (i = 0; i < ht->shard_cnt; ++i) {
+	    wheel_shard *sh = &ht->shards[i];
+	    pj_timer_entry *e;
+
+	    lock_shard(ht, sh);
+	    e = wheel_earliest(sh);
+	    if (e && (!earliest ||
+		      PJ_TIME_VAL_LT(e->_timer_value, *timeval)))
+	    {
+		earliest = e;
+		*timeval = e->_timer_value;
+	    }
+	    unlock_shard(ht, sh);
+	}
+
+	return earliest ? PJ_SUCCESS : PJ_ENOTFOUND;
+    }
+
     pj_assert(ht->cur_size != 0);
     if (ht->cur_size == 0)
         return PJ_ENOTFOUND;
@@ -687,8 +1338,52 @@ PJ_DEF(pj_status_t) pj_timer_heap_earliest_time( pj_timer_heap_t * ht,
 }
 
 #if PJ_TIMER_DEBUG
+static void dump_entry(pj_timer_entry *e, const pj_time_val *now)
+{
+    pj_time_val delta;
+
+    if (PJ_TIME_VAL_LTE(e->_timer_value, *now))
+	delta.sec = delta.msec = 0;
+    else {
+	delta = e->_timer_value;
+	PJ_TIME_VAL_SUB(delta, *now);
+    }
+
+    PJ_LOG(3,(THIS_FILE, "    %d\t%d\t%d.%03d\t%s:%d",
+	      e->_timer_id, e->id,
+	      (int)delta.sec, (int)delta.msec,
+	      e->src_file, e->src_line));
+}
+
 PJ_DEF(void) pj_timer_heap_dump(pj_timer_heap_t *ht)
 {
+    if (ht->shards) {
+	pj_time_val now;
+	unsigned i;
+	int n;
+
+	PJ_LOG(3,(THIS_FILE, "Dumping timer wheel:"));
+	PJ_LOG(3,(THIS_FILE, "  Cur size: %d entries, %d shard(s)",
+			     (int)pj_timer_heap_count(ht), ht->shard_cnt));
+	PJ_LOG(3,(THIS_FILE, "  Entries: "));
+	PJ_LOG(3,(THIS_FILE, "    _id\tId\tElapsed\tSource"));
+	PJ_LOG(3,(THIS_FILE, "    ----------------------------------"));
+
+	pj_gettickcount(&now);
+
+	for (i = 0; i < ht->shard_cnt; ++i) {
+	    wheel_shard *sh = &ht->shards[i];
+
+	    lock_shard(ht, sh);
+	    for (n = 0; n < sh->node_max; ++n) {
+		if (sh->nodes[n].entry)
+		    dump_entry(sh->nodes[n].entry, &now);
+	    }
+	    unlock_shard(ht, sh);
+	}
+	return;
+    }
+
     lock_timer_heap(ht);
 
     PJ_LOG(3,(THIS_FILE, "Dumping timer heap:"));
@@ -705,22 +1400,8 @@ PJ_DEF(void) pj_timer_heap_dump(pj_timer_heap_t *ht)
 
 	pj_gettickcount(&now);
 
-	for (i=0; i<(unsigned)ht->cur_size; ++i) {
-	    pj_timer_entry *e = ht->heap[i];
-	    pj_time_val delta;
-
-	    if (PJ_TIME_VAL_LTE(e->_timer_value, now))
-		delta.sec = delta.msec = 0;
-	    else {
-		delta = e->_timer_value;
-		PJ_TIME_VAL_SUB(delta, now);
-	    }
-
-	    PJ_LOG(3,(THIS_FILE, "    %d\t%d\t%d.%03d\t%s:%d",
-		      e->_timer_id, e->id,
-		      (int)delta.sec, (int)delta.msec,
-		      e->src_file, e->src_line));
-	}
+	for (i=0; i<(unsigned)ht->cur_size; ++i)
+	    dump_entry(ht->heap[i], &now);
     }
 
     unlock_timer_heap(ht);
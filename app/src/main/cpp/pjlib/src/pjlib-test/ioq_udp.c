@@ -615,6 +615,217 @@ static int many_handles_test(pj_bool_t allow_concur)
     return 0;
 }
 
+/*
+ * shard_test()
+ * Sockets are spread over the shards of a sharded ioqueue, one of them
+ * registered to a shard explicitly. A packet is sent to each socket and
+ * every one must be received, either by polling the ioqueue or by the
+ * shard worker threads. The per-shard statistics must add up.
+ */
+#define SHARD_CNT	    4
+#define SHARD_SOCK_CNT	    9
+
+struct shard_sock
+{
+    pj_sock_t		 sock;
+    pj_ioqueue_key_t	*key;
+    pj_ioqueue_op_key_t	 op_key;
+    char		 buf[16];
+};
+
+static void on_shard_read(pj_ioqueue_key_t *key,
+			  pj_ioqueue_op_key_t *op_key,
+			  pj_ssize_t bytes_read)
+{
+    pj_atomic_t *rx_cnt = (pj_atomic_t*) pj_ioqueue_get_user_data(key);
+
+    PJ_UNUSED_ARG(op_key);
+    if (bytes_read > 0)
+	pj_atomic_inc(rx_cnt);
+}
+
+static int shard_test_imp(pj_bool_t allow_concur, pj_bool_t start_workers)
+{
+    pj_pool_t *pool;
+    pj_ioqueue_t *ioqueue = NULL;
+    pj_ioqueue_cfg cfg;
+    pj_ioqueue_callback cb;
+    pj_atomic_t *rx_cnt = NULL;
+    struct shard_sock *ss;
+    pj_sock_t csock = PJ_INVALID_SOCKET;
+    pj_ioqueue_stat stat;
+    unsigned i, key_cnt, event_cnt;
+    pj_time_val timeout = { 0, 10 };
+    int loop, rc = 0;
+    pj_status_t status;
+
+    PJ_LOG(3,(THIS_FILE, "...shard test (%d shards, %s)", SHARD_CNT,
+	      start_workers ? "worker threads" : "polled"));
+
+    pool = pj_pool_create(mem, NULL, 4000, 4000, NULL);
+    if (!pool)
+	return PJ_ENOMEM;
+
+    ss = (struct shard_sock*)
+	 pj_pool_zalloc(pool, SHARD_SOCK_CNT * sizeof(struct shard_sock));
+    for (i=0; i<SHARD_SOCK_CNT; ++i)
+	ss[i].sock = PJ_INVALID_SOCKET;
+
+    pj_ioqueue_cfg_default(&cfg);
+    cfg.shard_cnt = SHARD_CNT;
+    cfg.start_workers = start_workers;
+    status = pj_ioqueue_create2(pool, SHARD_SOCK_CNT * 2, &cfg, &ioqueue);
+    if (status == PJ_ENOTSUP) {
+	PJ_LOG(3,(THIS_FILE, "....%s doesn't support sharding, skipped",
+		  pj_ioqueue_name()));
+	ioqueue = NULL;
+	goto on_return;
+    } else if (status != PJ_SUCCESS) {
+	app_perror("...error in pj_ioqueue_create2", status);
+	ioqueue = NULL;
+	rc = -300;
+	goto on_return;
+    }
+
+    if (pj_ioqueue_get_shard_count(ioqueue) != SHARD_CNT ||
+	pj_ioqueue_get_shard(ioqueue, SHARD_CNT) != NULL)
+    {
+	rc = -301;
+	goto on_return;
+    }
+
+    pj_ioqueue_set_default_concurrency(ioqueue, allow_concur);
+
+    status = pj_atomic_create(pool, 0, &rx_cnt);
+    if (status != PJ_SUCCESS) {
+	rc = -302;
+	goto on_return;
+    }
+
+    pj_bzero(&cb, sizeof(cb));
+    cb.on_read_complete = &on_shard_read;
+
+    for (i=0; i<SHARD_SOCK_CNT; ++i) {
+	pj_ioqueue_t *target = ioqueue;
+	pj_ssize_t len = sizeof(ss[i].buf);
+
+	status = app_socket(pj_AF_INET(), pj_SOCK_DGRAM(), 0, 0, &ss[i].sock);
+	if (status != PJ_SUCCESS) {
+	    rc = -310;
+	    goto on_return;
+	}
+
+	/* The last socket is placed explicitly */
+	if (i == SHARD_SOCK_CNT-1)
+	    target = pj_ioqueue_get_shard(ioqueue, SHARD_CNT-1);
+
+	status = pj_ioqueue_register_sock(pool, target, ss[i].sock, rx_cnt,
+					  &cb, &ss[i].key);
+	if (status != PJ_SUCCESS) {
+	    app_perror("...error in pj_ioqueue_register_sock", status);
+	    rc = -311;
+	    goto on_return;
+	}
+
+	pj_ioqueue_op_key_init(&ss[i].op_key, sizeof(ss[i].op_key));
+	status = pj_ioqueue_recv(ss[i].key, &ss[i].op_key, ss[i].buf, &len,
+				 0);
+	if (status != PJ_EPENDING) {
+	    rc = -312;
+	    goto on_return;
+	}
+    }
+
+    status = app_socket(pj_AF_INET(), pj_SOCK_DGRAM(), 0, 0, &csock);
+    if (status != PJ_SUCCESS) {
+	rc = -320;
+	goto on_return;
+    }
+
+    for (i=0; i<SHARD_SOCK_CNT; ++i) {
+	pj_sockaddr_in addr;
+	int addrlen = sizeof(addr);
+	pj_ssize_t len = 8;
+
+	pj_sock_getsockname(ss[i].sock, &addr, &addrlen);
+	addr.sin_addr = pj_inet_addr2("127.0.0.1");
+	status = pj_sock_sendto(csock, "shardtst", &len, 0, &addr,
+				sizeof(addr));
+	if (status != PJ_SUCCESS) {
+	    rc = -321;
+	    goto on_return;
+	}
+    }
+
+    for (loop=0; loop<200 && pj_atomic_get(rx_cnt) < SHARD_SOCK_CNT; ++loop) {
+	if (start_workers)
+	    pj_thread_sleep(10);
+	else
+	    pj_ioqueue_poll(ioqueue, &timeout);
+    }
+
+    if (pj_atomic_get(rx_cnt) != SHARD_SOCK_CNT) {
+	PJ_LOG(3,(THIS_FILE, "....only %d of %d packets received",
+		  pj_atomic_get(rx_cnt), SHARD_SOCK_CNT));
+	rc = -330;
+	goto on_return;
+    }
+
+    key_cnt = event_cnt = 0;
+    for (i=0; i<SHARD_CNT; ++i) {
+	status = pj_ioqueue_get_stat(ioqueue, i, &stat);
+	if (status != PJ_SUCCESS) {
+	    rc = -340;
+	    goto on_return;
+	}
+	PJ_LOG(3,(THIS_FILE, "....shard %d: %u keys, %u polls, %u events",
+		  i, stat.key_cnt, stat.poll_cnt, stat.event_cnt));
+	key_cnt += stat.key_cnt;
+	event_cnt += stat.event_cnt;
+	if (i == SHARD_CNT-1 && stat.key_cnt == 0) {
+	    rc = -341;
+	    goto on_return;
+	}
+    }
+    if (key_cnt != SHARD_SOCK_CNT || event_cnt != SHARD_SOCK_CNT) {
+	rc = -342;
+	goto on_return;
+    }
+
+on_return:
+    for (i=0; i<SHARD_SOCK_CNT; ++i) {
+	if (ss[i].key)
+	    pj_ioqueue_unregister(ss[i].key);
+	else if (ss[i].sock != PJ_INVALID_SOCKET)
+	    pj_sock_close(ss[i].sock);
+    }
+    if (csock != PJ_INVALID_SOCKET)
+	pj_sock_close(csock);
+    if (ioqueue)
+	pj_ioqueue_destroy(ioqueue);
+    if (rx_cnt)
+	pj_atomic_destroy(rx_cnt);
+    pj_pool_release(pool);
+    return rc;
+}
+
+static int shard_test(pj_bool_t allow_concur)
+{
+    int rc;
+
+    rc = shard_test_imp(allow_concur, PJ_FALSE);
+    if (rc != 0)
+	return rc;
+
+#if PJ_HAS_THREADS
+    rc = shard_test_imp(allow_concur, PJ_TRUE);
+    if (rc != 0)
+	return rc;
+#endif
+
+    return 0;
+}
+
 /*
  * Multi-operation test.
  */
@@ -895,6 +1106,10 @@ static int udp_ioqueue_test_imp(pj_bool_t allow_concur)
     if ((status=many_handles_test(allow_concur)) != 0) {
 	return status;
     }
+
+    if ((status=shard_test(allow_concur)) != 0) {
+	return status;
+    }
     
     //return 0;
 
@@ -19,9 +19,12 @@
  */
 #include <pj/pool.h>
 #include <pj/pool_buf.h>
+#include <pj/pool_slab.h>
 #include <pj/rand.h>
 #include <pj/log.h>
 #include <pj/except.h>
+#include <pj/os.h>
+#include <pj/string.h>
 #include "test.h"
 
 /**
@@ -277,6 +280,206 @@ static int pool_buf_test(void)
     return 0;
 }
 
+/* Test the slab allocator: objects churning in random order must reuse
+ * the memory, and the memory must be returned once they are freed.
+ */
+static int slab_test(void)
+{
+    enum { COUNT = 500, LOOP = 20000 };
+    pj_pool_t *pool;
+    pj_slab_t *slab;
+    pj_slab_stat stat;
+    void *obj[COUNT];
+    pj_size_t peak;
+    unsigned i;
+    int rc = 0;
+
+    PJ_LOG(3,("test", "...slab test"));
+
+    pool = pj_pool_create(mem, NULL, 1000, 1000, NULL);
+    if (pj_slab_create(pool, "slabtest", &slab) != PJ_SUCCESS) {
+	pj_pool_release(pool);
+	return -600;
+    }
+
+    /* Each object holds its own size class in its first and last byte */
+    for (i=0; i<COUNT; ++i) {
+	pj_size_t size = 1 + (pj_rand() % 1500);
+
+	if (i % 100 == 0)
+	    size = PJ_SLAB_MAX_SIZE + 1 + (pj_rand() % 5000);
+	obj[i] = pj_slab_zalloc(slab, size);
+	if (!obj[i] || ((pj_ssize_t)obj[i] & 7) != 0) {
+	    rc = -610;
+	    goto on_return;
+	}
+	((pj_uint8_t*)obj[i])[0] = (pj_uint8_t)i;
+	((pj_uint8_t*)obj[i])[size-1] = (pj_uint8_t)i;
+    }
+
+    pj_slab_get_stat(slab, &stat);
+    peak = stat.reserved_size;
+    if (stat.obj_cnt != COUNT || stat.used_size > stat.reserved_size) {
+	rc = -620;
+	goto on_return;
+    }
+
+    /* Churn: memory stays bounded by the number of live objects */
+    for (i=0; i<LOOP; ++i) {
+	unsigned idx = pj_rand() % COUNT;
+
+	if (((pj_uint8_t*)obj[idx])[0] != (pj_uint8_t)idx) {
+	    rc = -630;
+	    goto on_return;
+	}
+	pj_slab_free(slab, obj[idx]);
+	obj[idx] = pj_slab_alloc(slab, 1 + (pj_rand() % 1500));
+	if (!obj[idx]) {
+	    rc = -640;
+	    goto on_return;
+	}
+	((pj_uint8_t*)obj[idx])[0] = (pj_uint8_t)idx;
+    }
+
+    pj_slab_get_stat(slab, &stat);
+    if (stat.obj_cnt != COUNT || stat.reserved_size > peak * 2) {
+	rc = -650;
+	goto on_return;
+    }
+
+    for (i=0; i<COUNT; ++i)
+	pj_slab_free(slab, obj[i]);
+
+    /* At most one spare slab per class is kept */
+    pj_slab_get_stat(slab, &stat);
+    if (stat.obj_cnt != 0 || stat.used_size != 0 ||
+	stat.reserved_size > 8 * 8 * 1024 ||
+	stat.alloc_cnt != stat.free_cnt)
+    {
+	rc = -660;
+	goto on_return;
+    }
+
+on_return:
+    if (rc != 0) {
+	PJ_LOG(3,("test", "....error %d", rc));
+	pj_slab_dump(slab);
+    }
+    pj_slab_destroy(slab);
+    pj_pool_release(pool);
+    return rc;
+}
+
+/* Test the per-thread caches of the caching pool */
+static pj_pool_t *other_thread_pool;
+
+static int release_thread(void *arg)
+{
+    pj_pool_release(other_thread_pool);
+    other_thread_pool = pj_pool_create((pj_pool_factory*)arg, "other",
+				       1000, 1000, NULL);
+    return 0;
+}
+
+static int caching_pool_test(void)
+{
+    enum { COUNT = 20 };
+    pj_caching_pool cp;
+    pj_caching_pool_stat stat;
+    pj_pool_t *pools[COUNT];
+    pj_pool_t *tmp;
+    pj_thread_t *thread;
+    unsigned i;
+    int rc = 0;
+
+    PJ_LOG(3,("test", "...caching pool thread cache test"));
+
+    pj_caching_pool_init(&cp, NULL, 64 * 1024);
+    if (PJ_SAFE_POOL) {
+	/* The caches can't be used with PJ_SAFE_POOL */
+	pj_caching_pool_destroy(&cp);
+	return 0;
+    }
+    cp.magazine_size = 8;
+
+    for (i=0; i<COUNT; ++i)
+	pools[i] = pj_pool_create(&cp.factory, NULL, 1000, 1000, NULL);
+    for (i=0; i<COUNT; ++i)
+	pj_pool_release(pools[i]);
+
+    /* Full magazines have been flushed to the shared list */
+    pj_caching_pool_get_stat(&cp, &stat);
+    if (stat.used_count != 0 || stat.miss_cnt != COUNT || stat.flush_cnt == 0 ||
+	stat.thread_cached[2] == 0 || stat.shared_cached[2] == 0)
+    {
+	rc = -500;
+	goto on_return;
+    }
+
+    /* Creating again is served from the thread's cache, with the pools
+     * being reused and the memory being usable.
+     */
+    for (i=0; i<COUNT; ++i) {
+	pools[i] = pj_pool_create(&cp.factory, "reuse", 1000, 1000, NULL);
+	pj_memset(pj_pool_alloc(pools[i], 2000), 0, 2000);
+    }
+    pj_caching_pool_get_stat(&cp, &stat);
+    if (stat.used_count != COUNT || stat.hit_cnt < cp.magazine_size ||
+	stat.hit_cnt + stat.miss_cnt != 2 * COUNT ||
+	stat.thread_cached[2] != 0)
+    {
+	rc = -510;
+	goto on_return;
+    }
+
+    /* Pools may be released by another thread, and created there */
+    other_thread_pool = pools[0];
+    if (pj_thread_create(pools[1], "release", &release_thread, &cp.factory,
+			 0, 0, &thread) != PJ_SUCCESS)
+    {
+	rc = -520;
+	goto on_return;
+    }
+    pj_thread_join(thread);
+    pj_thread_destroy(thread);
+    tmp = other_thread_pool;
+
+    for (i=1; i<COUNT; ++i)
+	pj_pool_release(pools[i]);
+    pj_pool_release(tmp);
+
+    pj_caching_pool_get_stat(&cp, &stat);
+    if (stat.used_count != 0) {
+	rc = -530;
+	goto on_return;
+    }
+
+    /* A pool larger than the largest size is not cached */
+    tmp = pj_pool_create(&cp.factory, NULL, 100000, 1000, NULL);
+    pj_pool_release(tmp);
+    pj_caching_pool_get_stat(&cp, &stat);
+    if (stat.used_count != 0) {
+	rc = -540;
+	goto on_return;
+    }
+
+    /* A pool from the thread's cache that is not released is counted,
+     * and freed when the caching pool is destroyed.
+     */
+    tmp = pj_pool_create(&cp.factory, "leak", 1000, 1000, NULL);
+    pj_caching_pool_get_stat(&cp, &stat);
+    if (stat.used_count != 1 || stat.hit_cnt + stat.miss_cnt != 2*COUNT+3) {
+	rc = -550;
+	goto on_return;
+    }
+
+on_return:
+    pj_caching_pool_destroy(&cp);
+    if (rc == 0 && cp.used_size != 0)
+	rc = -560;
+    return rc;
+}
+
 
 int pool_test(void)
 {
@@ -309,6 +512,14 @@ int pool_test(void)
     if (rc != 0)
 	return rc;
 
+    rc = caching_pool_test();
+    if (rc != 0)
+	return rc;
+
+    rc = slab_test();
+    if (rc != 0)
+	return rc;
+
 
     return 0;
 }
@@ -118,6 +118,77 @@ static int pool_test_malloc_free()
 
 #endif /* PJ_SYMBIAN */
 
+/*
+ * Create and release short-lived pools from many threads, with and
+ * without the per-thread caches of the caching pool.
+ */
+#define MT_THREAD_CNT	8
+#define MT_LOOP		20000
+#define MT_MAGAZINE_SIZE	8
+
+static int mt_pool_thread(void *arg)
+{
+    pj_pool_factory *pf = (pj_pool_factory*)arg;
+    unsigned i;
+
+    for (i=0; i<MT_LOOP; ++i) {
+	pj_pool_t *pool1, *pool2;
+
+	pool1 = pj_pool_create(pf, NULL, 512 << (i % 4), 512, NULL);
+	pool2 = pj_pool_create(pf, NULL, 1000, 1000, NULL);
+	if (!pool1 || !pool2)
+	    return -1;
+	pj_pool_alloc(pool1, 100);
+	pj_pool_alloc(pool2, 200);
+	pj_pool_release(pool2);
+	pj_pool_release(pool1);
+    }
+
+    return 0;
+}
+
+static int mt_pool_bench(unsigned magazine_size, pj_uint32_t *usec)
+{
+    pj_caching_pool cp;
+    pj_caching_pool_stat stat;
+    pj_thread_t *threads[MT_THREAD_CNT];
+    pj_pool_t *pool;
+    pj_timestamp start, end;
+    unsigned i, total;
+    int rc = 0;
+
+    pj_caching_pool_init(&cp, NULL, 1024 * 1024);
+    cp.magazine_size = magazine_size;
+    pool = pj_pool_create(mem, NULL, 4000, 4000, NULL);
+
+    pj_get_timestamp(&start);
+    for (i=0; i<MT_THREAD_CNT; ++i) {
+	if (pj_thread_create(pool, "poolperf", &mt_pool_thread, &cp.factory,
+			     0, 0, &threads[i]) != PJ_SUCCESS)
+	{
+	    rc = -10;
+	    break;
+	}
+    }
+    while (i > 0) {
+	--i;
+	pj_thread_join(threads[i]);
+	pj_thread_destroy(threads[i]);
+    }
+    pj_get_timestamp(&end);
+    *usec = pj_elapsed_usec(&start, &end);
+
+    pj_caching_pool_get_stat(&cp, &stat);
+    total = stat.hit_cnt + stat.miss_cnt;
+    PJ_LOG(3, (THIS_FILE, "..%d threads, magazine size %2u: %8u usec, "
+			  "hit rate %u%%", MT_THREAD_CNT, magazine_size,
+			  *usec, total ? stat.hit_cnt * 100 / total : 0));
+
+    pj_pool_release(pool);
+    pj_caching_pool_destroy(&cp);
+    return rc;
+}
+
 int pool_perf_test()
 {
     unsigned i;
@@ -186,6 +257,22 @@ int pool_perf_test()
     PJ_LOG(3, (THIS_FILE, "..pool speedup over malloc best=%dx, worst=%dx", 
 			  (int)(malloc_time/best),
 			  (int)(malloc_time/worst)));
+
+    PJ_LOG(3, (THIS_FILE, "Benchmarking caching pool with threads.."));
+    {
+	pj_uint32_t locked_usec, cached_usec;
+
+	if (mt_pool_bench(0, &locked_usec) ||
+	    mt_pool_bench(MT_MAGAZINE_SIZE, &cached_usec))
+	{
+	    return 8;
+	}
+	if (cached_usec == 0) cached_usec = 1;
+	PJ_LOG(3, (THIS_FILE, "..thread cache speedup: %u.%02ux",
+			      locked_usec / cached_usec,
+			      locked_usec * 100 / cached_usec % 100));
+    }
+
     return 0;
 }
 
@@ -23,7 +23,8 @@
  * \page page_pjlib_timer_test Test: Timer
  *
  * This file provides implementation of \b timer_test(). It tests the
- * functionality of the timer heap.
+ * functionality of the timer heap, with the binary heap and with the
+ * timing wheel, single and sharded.
  *
  *
  * This file is <b>pjlib-test/timer.c</b>
@@ -51,7 +52,7 @@ static void timer_callback(pj_timer_heap_t *ht, pj_timer_entry *e)
     PJ_UNUSED_ARG(e);
 }
 
-static int test_timer_heap(void)
+static int test_timer_heap(const pj_timer_heap_cfg *cfg)
 {
     int i, j;
     pj_timer_entry *entry;
@@ -78,7 +79,7 @@ static int test_timer_heap(void)
     for (i=0; i<MAX_COUNT; ++i) {
 	entry[i].cb = &timer_callback;
     }
-    status = pj_timer_heap_create(pool, MAX_COUNT, &timer);
+    status = pj_timer_heap_create2(pool, cfg, &timer);
     if (status != PJ_SUCCESS) {
         app_perror("...error: unable to create timer heap", status);
 	return -30;
@@ -178,14 +179,159 @@ static int test_timer_heap(void)
 	    break;
     }
 
+    pj_timer_heap_destroy(timer);
     pj_pool_release(pool);
     return err;
 }
 
 
+/*
+ * Timers must never fire early, the earliest time must be the one of the
+ * earliest scheduled entry, and the next delay returned by poll must not
+ * make the caller wake up late.
+ */
+#define ACC_COUNT	200
+#define ACC_MAX_DELAY	300	/* msec */
+
+static int acc_early;
+
+static void acc_callback(pj_timer_heap_t *ht, pj_timer_entry *e)
+{
+    pj_time_val now;
+
+    PJ_UNUSED_ARG(ht);
+
+    pj_gettickcount(&now);
+    if (PJ_TIME_VAL_LT(now, e->_timer_value))
+	++acc_early;
+}
+
+static int test_timer_accuracy(const pj_timer_heap_cfg *cfg)
+{
+    pj_pool_t *pool;
+    pj_timer_heap_t *timer;
+    pj_timer_entry *entry;
+    pj_time_val delay, expire, now;
+    pj_status_t status;
+    int i, loop, rc = 0;
+
+    pool = pj_pool_create(mem, NULL, 4000, 4000, NULL);
+    entry = (pj_timer_entry*)pj_pool_calloc(pool, ACC_COUNT, sizeof(*entry));
+
+    status = pj_timer_heap_create2(pool, cfg, &timer);
+    if (status != PJ_SUCCESS) {
+        app_perror("...error: unable to create timer heap", status);
+	pj_pool_release(pool);
+	return -100;
+    }
+
+    acc_early = 0;
+    for (i=0; i<ACC_COUNT; ++i) {
+	pj_timer_entry_init(&entry[i], i, NULL, &acc_callback);
+	delay.sec = 0;
+	delay.msec = pj_rand() % ACC_MAX_DELAY;
+	if (i % 20 == 0)
+	    delay.sec = 100 + pj_rand() % 100000;
+	pj_timer_heap_schedule(timer, &entry[i], &delay);
+    }
+
+    pj_gettickcount(&expire);
+    expire.msec += ACC_MAX_DELAY + 500;
+    pj_time_val_normalize(&expire);
+
+    for (loop=0; ; ++loop) {
+	pj_time_val earliest, min, next;
+	pj_bool_t found = PJ_FALSE;
+
+	/* Cancel the long ones after a while */
+	if (loop >= 100)
+	    pj_timer_heap_cancel_if_active(timer,
+					   &entry[(loop % (ACC_COUNT/20)) * 20],
+					   0);
+
+	for (i=0; i<ACC_COUNT; ++i) {
+	    if (!pj_timer_entry_running(&entry[i]))
+		continue;
+	    if (!found || PJ_TIME_VAL_LT(entry[i]._timer_value, min))
+		min = entry[i]._timer_value;
+	    found = PJ_TRUE;
+	}
+
+	status = pj_timer_heap_earliest_time(timer, &earliest);
+	if (found != (status == PJ_SUCCESS) ||
+	    (found && !PJ_TIME_VAL_EQ(earliest, min)))
+	{
+	    rc = -110;
+	    break;
+	}
+
+	pj_timer_heap_poll(timer, &next);
+	pj_gettickcount(&now);
+	if (found && pj_timer_heap_count(timer) &&
+	    PJ_TIME_VAL_LT(now, min))
+	{
+	    /* Allow for the time spent since the poll */
+	    PJ_TIME_VAL_SUB(min, now);
+	    if (PJ_TIME_VAL_MSEC(next) > PJ_TIME_VAL_MSEC(min) + 10) {
+		rc = -120;
+		break;
+	    }
+	}
+
+	if (!pj_timer_heap_count(timer) || !PJ_TIME_VAL_LT(now, expire))
+	    break;
+	pj_thread_sleep(1);
+    }
+
+    if (rc == 0 && pj_timer_heap_count(timer) != 0)
+	rc = -130;
+    if (rc == 0 && acc_early)
+	rc = -140;
+
+    if (rc != 0) {
+	PJ_LOG(3, (THIS_FILE, "...error: accuracy test failed, rc=%d, "
+		   "early=%d", rc, acc_early));
+    }
+
+    pj_timer_heap_destroy(timer);
+    pj_pool_release(pool);
+    return rc;
+}
+
 int timer_test()
 {
-    return test_timer_heap();
+    static const struct {
+	const char *name;
+	pj_timer_heap_type type;
+	unsigned shard_cnt;
+    } tests[] = {
+	{ "binary heap", PJ_TIMER_HEAP_BINARY, 1 },
+	{ "timing wheel", PJ_TIMER_HEAP_WHEEL, 1 },
+	{ "sharded timing wheel", PJ_TIMER_HEAP_WHEEL, 4 }
+    };
+    unsigned i;
+    int rc;
+
+    for (i=0; i<PJ_ARRAY_SIZE(tests); ++i) {
+	pj_timer_heap_cfg cfg;
+
+	PJ_LOG(3, (THIS_FILE, "...%s", tests[i].name));
+
+	pj_timer_heap_cfg_default(&cfg);
+	cfg.type = tests[i].type;
+	cfg.count = MAX_COUNT;
+	cfg.shard_cnt = tests[i].shard_cnt;
+
+	rc = test_timer_heap(&cfg);
+	if (rc != 0)
+	    return rc;
+
+	rc = test_timer_accuracy(&cfg);
+	if (rc != 0)
+	    return rc;
+    }
+
+    return 0;
 }
 
 #else
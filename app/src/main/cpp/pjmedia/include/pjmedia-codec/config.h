@@ -518,6 +518,19 @@
 #endif
 
 
+/**
+ * OPUS default single owner setting. When enabled, each Opus codec
+ * instance is created without a mutex and the application must make sure
+ * that the codec is only used by one thread at a time. See the
+ * \a single_owner field of #pjmedia_codec_opus_config.
+ *
+ * Default: PJ_FALSE
+ */
+#ifndef PJMEDIA_CODEC_OPUS_DEFAULT_SINGLE_OWNER
+#   define PJMEDIA_CODEC_OPUS_DEFAULT_SINGLE_OWNER	PJ_FALSE
+#endif
+
+
 /**
  * Enable G.729 codec using BCG729 backend.
  *
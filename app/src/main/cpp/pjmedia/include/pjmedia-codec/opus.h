@@ -90,6 +90,22 @@ PJ_BEGIN_DECL
     pjmedia_codec_opus_set_default_param(&opus_cfg, &param);
  \endcode
  *
+ *
+ * \section codec_single_owner Single Owner Codecs
+ *
+ * By default each Opus codec instance has a mutex which is locked for
+ * every frame, because a stream may parse incoming packets, decode and
+ * encode from different threads. When the application makes sure that a
+ * codec is only used by one thread at a time, for example a conference
+ * or transcoding engine which runs all of its legs from one media thread,
+ * it can set the \a single_owner field of #pjmedia_codec_opus_config
+ * before the codecs are allocated, so that they are created without
+ * a mutex.
+ *
+ * Such application can also use #pjmedia_codec_opus_encode_batch() and
+ * #pjmedia_codec_opus_decode_batch() to process the frames of several
+ * codecs in one call.
+ *
  */
 
 /**
@@ -104,6 +120,9 @@ typedef struct pjmedia_codec_opus_config
     unsigned   packet_loss; /**< Encoder's expected packet loss pct.	*/
     unsigned   complexity;  /**< Encoder complexity, 0-10(10 is highest)*/
     pj_bool_t  cbr;         /**< Constant bit rate?			*/
+    pj_bool_t  single_owner;/**< Codec is used by one thread at a time,
+				 so it needs no mutex. Default is
+				 #PJMEDIA_CODEC_OPUS_DEFAULT_SINGLE_OWNER */
 } pjmedia_codec_opus_config;
 
 
@@ -151,6 +170,56 @@ PJ_DECL(pj_status_t)
 pjmedia_codec_opus_set_default_param(const pjmedia_codec_opus_config *cfg,
 				     pjmedia_codec_param *param );
 
+/**
+ * Encode one frame for each of several Opus codecs. This is equivalent to
+ * calling #pjmedia_codec_encode() for each codec, without going through
+ * the codec operation table and, for single owner codecs, without any
+ * locking. The codecs must be different codec instances.
+ *
+ * @param codec		Array of Opus codecs.
+ * @param count		Number of codecs.
+ * @param input		Array of input frames, one for each codec.
+ * @param output_buf_len The size of each output buffer.
+ * @param output	Array of output frames, one for each codec. If a
+ *			codec fails to encode, its output frame will be
+ *			empty and the rest of the codecs are still processed.
+ *
+ * @return		PJ_SUCCESS, or the error of the first codec which
+ *			failed.
+ */
+PJ_DECL(pj_status_t)
+pjmedia_codec_opus_encode_batch(pjmedia_codec *codec[],
+				unsigned count,
+				const pjmedia_frame input[],
+				unsigned output_buf_len,
+				pjmedia_frame output[]);
+
+/**
+ * Decode one frame for each of several Opus codecs. This is equivalent to
+ * calling #pjmedia_codec_decode() for each codec, or
+ * #pjmedia_codec_recover() for codecs whose input frame type is not
+ * PJMEDIA_FRAME_TYPE_AUDIO, without going through the codec operation
+ * table and, for single owner codecs, without any locking. The input
+ * frames must have been returned by #pjmedia_codec_parse().
+ *
+ * @param codec		Array of Opus codecs.
+ * @param count		Number of codecs.
+ * @param input		Array of input frames, one for each codec.
+ * @param output_buf_len The size of each output buffer.
+ * @param output	Array of output frames, one for each codec. If a
+ *			codec fails to decode, its output frame will be
+ *			empty and the rest of the codecs are still processed.
+ *
+ * @return		PJ_SUCCESS, or the error of the first codec which
+ *			failed.
+ */
+PJ_DECL(pj_status_t)
+pjmedia_codec_opus_decode_batch(pjmedia_codec *codec[],
+				unsigned count,
+				const pjmedia_frame input[],
+				unsigned output_buf_len,
+				pjmedia_frame output[]);
+
 PJ_END_DECL
 
 /**
@@ -243,6 +243,34 @@ PJ_BEGIN_DECL
 #endif
 
 
+/**
+ * Number of received NAL units that can be queued between the socket
+ * receive thread and the decode thread of the Hytera camera device. When
+ * the queue is full, non-key units are dropped by the receive thread.
+ *
+ * Default: 16
+ */
+#ifndef PJMEDIA_VID_DEV_HYTERA_QUEUE_SIZE
+#   define PJMEDIA_VID_DEV_HYTERA_QUEUE_SIZE	16
+#endif
+
+
+/**
+ * Default maximum number of NAL units waiting for the decoder of the Hytera
+ * camera device. When more units are waiting, the decode thread drops the
+ * oldest non-key units (anything but IDR slices, SPS and PPS), and the
+ * following ones up to the next IDR slice, so the latency of the camera
+ * feed stays bounded when the decoder stalls. Zero disables dropping, and
+ * units are then only dropped when the queue is full. It can be changed at
+ * run time with pjmedia_hytera_set_max_queue_depth().
+ *
+ * Default: 4
+ */
+#ifndef PJMEDIA_VID_DEV_HYTERA_MAX_QUEUE_DEPTH
+#   define PJMEDIA_VID_DEV_HYTERA_MAX_QUEUE_DEPTH	4
+#endif
+
+
 /**
  * Specify the SDL library name to be linked with Visual Studio project. 
  * By default, the name is autodetected based on SDL version ("sdl.lib" or 
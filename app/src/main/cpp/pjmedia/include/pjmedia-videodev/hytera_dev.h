@@ -0,0 +1,84 @@
+//
+// Created by SH Qiu on 2020-09-07.
+//
+
+#ifndef __PJMEDIA_VIDEODEV_HYTERA_DEV_H__
+#define __PJMEDIA_VIDEODEV_HYTERA_DEV_H__
+
+/**
+ * @file hytera_dev.h
+ * @brief Hytera camera socket device
+ */
+#include <pjmedia-videodev/videodev.h>
+
+PJ_BEGIN_DECL
+
+/**
+ * Statistics of the queue between the socket receive thread and the
+ * decode thread of the Hytera camera device.
+ */
+typedef struct pjmedia_hytera_queue_stat
+{
+    unsigned	depth;		/**< Units currently queued.		    */
+    unsigned	max_depth;	/**< Highest number of queued units.	    */
+    pj_uint32_t	queued;		/**< Units queued by the receive thread.    */
+    pj_uint32_t	decoded;	/**< Units passed to the decoder.	    */
+    pj_uint32_t	full_drops;	/**< Units dropped by the receive thread
+				     because the queue was full, and the
+				     non-key units dropped after that
+				     until the next IDR slice.		    */
+    pj_uint32_t	late_drops;	/**< Old units dropped by the decode thread,
+				     and the non-key units dropped after
+				     that until the next IDR slice.	    */
+} pjmedia_hytera_queue_stat;
+
+
+/**
+ * Create the Hytera camera device factory.
+ *
+ * @param pf	The pool factory.
+ *
+ * @return	The factory, or NULL on failure.
+ */
+pjmedia_vid_dev_factory* pjmedia_hytera_factory(pj_pool_factory *pf);
+
+
+/**
+ * Get the statistics of the receive/decode queue of the Hytera camera
+ * device. The counters are reset when the device starts receiving.
+ *
+ * @param stat	Receives the statistics.
+ *
+ * @return	PJ_SUCCESS on success.
+ */
+PJ_DECL(pj_status_t) pjmedia_hytera_get_queue_stat(pjmedia_hytera_queue_stat *stat);
+
+
+/**
+ * Set the maximum number of NAL units waiting for the decoder of the
+ * Hytera camera device. When more units are waiting, the decode thread
+ * drops the oldest non-key units, and the rest of their GOP, to keep the
+ * latency of the feed bounded. The setting takes effect immediately, also
+ * for a running stream. The default is
+ * PJMEDIA_VID_DEV_HYTERA_MAX_QUEUE_DEPTH.
+ *
+ * @param max_depth	The maximum depth, or zero to disable dropping (units
+ *			are then only dropped when the queue is full).
+ *
+ * @return		PJ_SUCCESS on success.
+ */
+PJ_DECL(pj_status_t) pjmedia_hytera_set_max_queue_depth(unsigned max_depth);
+
+
+/**
+ * Get the maximum number of NAL units waiting for the decoder of the
+ * Hytera camera device, see #pjmedia_hytera_set_max_queue_depth().
+ *
+ * @return		The maximum depth, zero when dropping is disabled.
+ */
+PJ_DECL(unsigned) pjmedia_hytera_get_max_queue_depth(void);
+
+
+PJ_END_DECL
+
+#endif	/* __PJMEDIA_VIDEODEV_HYTERA_DEV_H__ */
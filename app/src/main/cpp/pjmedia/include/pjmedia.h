@@ -25,6 +25,7 @@
  * @brief PJMEDIA main header file.
  */
 #include <pjmedia/alaw_ulaw.h>
+#include <pjmedia/annexb.h>
 #include <pjmedia/avi_stream.h>
 #include <pjmedia/bidirectional.h>
 #include <pjmedia/circbuf.h>
@@ -44,6 +45,7 @@
 #include <pjmedia/jbuf.h>
 #include <pjmedia/master_port.h>
 #include <pjmedia/mem_port.h>
+#include <pjmedia/mp4_writer.h>
 #include <pjmedia/null_port.h>
 #include <pjmedia/plc.h>
 #include <pjmedia/port.h>
@@ -0,0 +1,90 @@
+/* $Id$ */
+/*
+ * Copyright (C) 2008-2011 Teluu Inc. (http://www.teluu.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#ifndef __PJMEDIA_ANNEXB_H__
+#define __PJMEDIA_ANNEXB_H__
+
+/**
+ * @file annexb.h
+ * @brief H.264/H.265 Annex-B byte stream scanner.
+ */
+#include <pjmedia/types.h>
+
+
+PJ_BEGIN_DECL
+
+
+/**
+ * @defgroup PJMEDIA_ANNEXB Annex-B Byte Stream Scanner
+ * @ingroup PJMEDIA_FRAME_OP
+ * @brief Find start codes and emulation prevention bytes
+ * @{
+ *
+ * An Annex-B byte stream separates NAL units with 00 00 01 start codes,
+ * optionally preceded by one more zero byte. Inside a NAL unit, any
+ * 00 00 0x sequence with x <= 3 is escaped by inserting an emulation
+ * prevention byte 03 after the two zeros, so these sequences can only
+ * appear at the start codes and at the emulation prevention bytes.
+ *
+ * The scanner looks for such sequences 16 bytes at a time with ARM NEON
+ * or x86 SSE2 when the compiler targets these instruction sets and
+ * #PJMEDIA_ANNEXB_USE_SIMD is enabled, or with a scalar loop that skips
+ * up to three bytes per step otherwise.
+ */
+
+
+/**
+ * Find the first 00 00 01 start code in the specified buffer. The three
+ * bytes of the start code must all be inside the buffer. Note that the
+ * zero byte of a four byte start code comes before the returned position.
+ *
+ * @param start		Start of the buffer.
+ * @param end		End of the buffer.
+ *
+ * @return		The position of the start code, or NULL if there
+ *			is no start code in the buffer.
+ */
+PJ_DECL(pj_uint8_t*) pjmedia_annexb_find_start_code(const pj_uint8_t *start,
+						     const pj_uint8_t *end);
+
+
+/**
+ * Find the first 00 00 0x sequence with x <= 3 in the specified buffer,
+ * which is either a start code, the zero byte of a four byte start code,
+ * a trailing zero or an emulation prevention byte. The three bytes of
+ * the sequence must all be inside the buffer.
+ *
+ * @param start		Start of the buffer.
+ * @param end		End of the buffer.
+ *
+ * @return		The position of the sequence, or NULL if there is
+ *			no such sequence in the buffer.
+ */
+PJ_DECL(pj_uint8_t*) pjmedia_annexb_find_escape(const pj_uint8_t *start,
+						 const pj_uint8_t *end);
+
+
+/**
+ * @}
+ */
+
+
+PJ_END_DECL
+
+
+#endif	/* __PJMEDIA_ANNEXB_H__ */
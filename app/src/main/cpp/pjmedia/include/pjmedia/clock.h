@@ -75,6 +75,12 @@
  * the clock <b>tick</b> expires. When it is run synchronously, 
  * application must continuously polls the clock generator to synchronize
  * the timing.
+ *
+ * Asynchronous clocks are driven by a small set of shared scheduler
+ * threads (see #PJMEDIA_CLOCK_SCHED_THREAD_CNT), rather than by a thread
+ * per clock. On Linux and Android the scheduler waits for the absolute
+ * deadline of the next tick with a timerfd, so the ticks are not subject
+ * to the millisecond rounding of #pj_thread_sleep().
  */
 
 PJ_BEGIN_DECL
@@ -177,7 +183,14 @@ enum pjmedia_clock_options
     /**
      * Prevent the clock from setting it's thread to highest priority.
      */
-    PJMEDIA_CLOCK_NO_HIGHEST_PRIO = 2
+    PJMEDIA_CLOCK_NO_HIGHEST_PRIO = 2,
+
+    /**
+     * Run the clock with its own thread instead of the shared clock
+     * scheduler threads (see #PJMEDIA_CLOCK_SCHED_THREAD_CNT). Use this
+     * when the callback may block, so it doesn't delay the other clocks.
+     */
+    PJMEDIA_CLOCK_OWN_THREAD = 4
 };
 
 
@@ -194,6 +207,25 @@ typedef struct pjmedia_clock_param
     unsigned clock_rate;
 } pjmedia_clock_param;
 
+/**
+ * Media clock statistics. The lateness of a tick is the time between the
+ * moment the tick should have happened and the moment its callback is
+ * called.
+ */
+typedef struct pjmedia_clock_stat
+{
+    pj_uint32_t	tick_cnt;	/**< Number of ticks so far.		    */
+    pj_uint32_t	overrun_cnt;	/**< Number of ticks that were late by one
+					 interval or more, i.e. the previous
+					 callback overran the next tick.    */
+    pj_uint32_t	resync_cnt;	/**< Number of times the clock was too late
+					 to catch up, and the missed ticks
+					 were skipped.			    */
+    pj_uint32_t	last_late_usec;	/**< Lateness of the last tick, in usec.    */
+    pj_uint32_t	avg_late_usec;	/**< Average lateness, in usec.		    */
+    pj_uint32_t	max_late_usec;	/**< Maximum lateness, in usec.		    */
+} pjmedia_clock_stat;
+
 /**
  * Type of media clock callback.
  *
@@ -313,6 +345,18 @@ PJ_DECL(pj_bool_t) pjmedia_clock_wait(pjmedia_clock *clock,
 				      pj_timestamp *ts);
 
 
+/**
+ * Get the timing statistics of the clock.
+ *
+ * @param clock		    The media clock.
+ * @param stat		    Pointer to receive the statistics.
+ *
+ * @return		    PJ_SUCCES on success.
+ */
+PJ_DECL(pj_status_t) pjmedia_clock_get_stat(const pjmedia_clock *clock,
+					    pjmedia_clock_stat *stat);
+
+
 /**
  * Destroy the clock.
  *
@@ -88,7 +88,9 @@ enum pjmedia_conf_option
     PJMEDIA_CONF_NO_MIC  = 1,	/**< 禁用麦克风设备的音频流		    */
     PJMEDIA_CONF_NO_DEVICE = 2,	/**< 不要创建声音设备	    */
     PJMEDIA_CONF_SMALL_FILTER=4,/**< 重采样时使用SMALL 滤波器*/
-    PJMEDIA_CONF_USE_LINEAR=8	/**< 使用线性重采样而不是基于滤波器    */
+    PJMEDIA_CONF_USE_LINEAR=8,	/**< 使用线性重采样而不是基于滤波器    */
+    PJMEDIA_CONF_NO_SIMD_MIX=16	/**< 不使用 SIMD 混音内核，总是使用标量实现。
+				     参见 PJMEDIA_CONF_USE_SIMD_MIX	    */
 };
 
 
@@ -129,6 +131,106 @@ PJ_DECL(pj_status_t) pjmedia_conf_create( pj_pool_t *pool,
 					  pjmedia_conf **p_conf );
 
 
+/**
+ * 会议桥创建参数。使用 pjmedia_conf_param_default() 初始化此结构。
+ */
+typedef struct pjmedia_conf_param
+{
+    /**
+     * 要在网桥中创建的最大插槽/端口数
+     */
+    unsigned	max_slots;
+
+    /**
+     * 网桥的采样率
+     */
+    unsigned	sampling_rate;
+
+    /**
+     * PCM 流中的通道数目
+     */
+    unsigned	channel_count;
+
+    /**
+     * 每帧的采样数
+     */
+    unsigned	samples_per_frame;
+
+    /**
+     * 每个样本的位数，目前仅支持16位
+     */
+    unsigned	bits_per_sample;
+
+    /**
+     * 由 pjmedia_conf_option 构造的位掩码选项
+     */
+    unsigned	options;
+
+    /**
+     * 工作线程数。如果非零，网桥在每个时钟周期中会把各个源端口的读取
+     * （包括解码、重采样及 RX 电平调整）分派到这些工作线程和时钟线程
+     * 并行执行，只有最后的混音和写入阶段是顺序执行的。
+     *
+     * 注意在此模式下端口的 get_frame() 可能在工作线程中被调用，因此
+     * 不允许在 get_frame() 中调用会议桥的 API。
+     *
+     * 默认值: PJMEDIA_CONF_WORKER_THREADS (0, 即不使用工作线程)
+     */
+    unsigned	worker_threads;
+
+    /**
+     * 启用语音激活检测（VAD）门控混音。启用后网桥为每个端口创建一个静音
+     * 检测器（参见 pjmedia_silence_det_create()），当前处于静音状态的端口
+     * 的帧将不参与混音，这可以减少大型会议中的混音开销，并降低混音后的
+     * 底噪。
+     *
+     * 默认值: PJMEDIA_CONF_VAD_GATE (0, 即禁用)
+     */
+    pj_bool_t	vad_gate;
+
+    /**
+     * VAD 门控混音使用的静音阈值（平均信号电平）。如果为 -1，则静音检测器
+     * 以自适应模式运行，初始阈值为 PJMEDIA_SILENCE_DET_THRESHOLD；否则使用
+     * 此固定阈值。仅在 vad_gate 启用时有效。
+     *
+     * 默认值: -1
+     */
+    int		vad_threshold;
+
+    /**
+     * 每帧最多混入的发言端口数。当同时发言的端口数超过此值时，只混入电平
+     * 最高的端口。0 表示不限制。仅在 vad_gate 启用时有效。
+     *
+     * 默认值: PJMEDIA_CONF_MAX_SPEAKERS (0)
+     */
+    unsigned	max_speakers;
+
+} pjmedia_conf_param;
+
+
+/**
+ * 使用默认值初始化 pjmedia_conf_param
+ *
+ * @param param		    参数
+ */
+PJ_DECL(void) pjmedia_conf_param_default(pjmedia_conf_param *param);
+
+
+/**
+ * 使用指定的参数创建会议桥，与 pjmedia_conf_create() 相同，但可以指定
+ * 额外的参数（例如工作线程数）
+ *
+ * @param pool		    用于分配网桥的池
+ * @param param		    会议桥参数
+ * @param p_conf	    接收会议桥实例的指针
+ *
+ * @return		    会议桥成功创建则返回 PJ_SUCCESS
+ */
+PJ_DECL(pj_status_t) pjmedia_conf_create2(pj_pool_t *pool,
+					  const pjmedia_conf_param *param,
+					  pjmedia_conf **p_conf);
+
+
 /**
  * 销毁会议桥
  *
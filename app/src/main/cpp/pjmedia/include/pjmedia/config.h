@@ -84,6 +84,58 @@
 #   define PJMEDIA_CONF_USE_AGC    	    1
 #endif
 
+/**
+ * Specify whether the conference bridge may use the SIMD (ARM NEON or
+ * x86 SSE2) mixing kernel for the level adjustment, mixing and clipping
+ * of audio samples, when the compiler targets such instruction set.
+ * The kernel is selected when the bridge is created; the portable scalar
+ * kernel is used when this is disabled or when the bridge is created
+ * with PJMEDIA_CONF_NO_SIMD_MIX option.
+ *
+ * Default: 1 (enabled)
+ */
+#ifndef PJMEDIA_CONF_USE_SIMD_MIX
+#   define PJMEDIA_CONF_USE_SIMD_MIX	    1
+#endif
+
+/**
+ * Default number of worker threads of the conference bridge, used to read
+ * (and decode/resample) the frames of the source ports in parallel. The
+ * value can be changed per bridge with the worker_threads field of
+ * pjmedia_conf_param. Zero means all ports are read by the thread that
+ * clocks the bridge.
+ *
+ * Default: 0
+ */
+#ifndef PJMEDIA_CONF_WORKER_THREADS
+#   define PJMEDIA_CONF_WORKER_THREADS	    0
+#endif
+
+/**
+ * Default setting of the VAD-gated mixing of the conference bridge. When
+ * enabled, each port of the bridge has its own silence detector, and the
+ * frames of ports which are currently silent are not mixed at all. The
+ * value can be changed per bridge with the vad_gate field of
+ * pjmedia_conf_param.
+ *
+ * Default: 0 (disabled)
+ */
+#ifndef PJMEDIA_CONF_VAD_GATE
+#   define PJMEDIA_CONF_VAD_GATE	    0
+#endif
+
+/**
+ * Default maximum number of ports (speakers) mixed in one frame when
+ * VAD-gated mixing is enabled. When more ports are talking, only the
+ * loudest ones are mixed. The value can be changed per bridge with the
+ * max_speakers field of pjmedia_conf_param. Zero means no limit.
+ *
+ * Default: 0
+ */
+#ifndef PJMEDIA_CONF_MAX_SPEAKERS
+#   define PJMEDIA_CONF_MAX_SPEAKERS	    0
+#endif
+
 
 /*
  * Types of sound stream backends.
@@ -351,6 +403,8 @@
 						     using libsamplerate 
 						     (a.k.a Secret Rabbit Code)
 						 */
+#define PJMEDIA_RESAMPLE_POLYPHASE	    5	/**< Built-in fixed point
+						     polyphase filter bank.  */
 
 /**
  * Select which resample implementation to use. Currently pjmedia supports:
@@ -360,6 +414,11 @@
  *    (a.k.a. Secret Rabbit Code).
  *  - #PJMEDIA_RESAMPLE_SPEEX, to use experimental sample rate conversion in
  *    Speex library.
+ *  - #PJMEDIA_RESAMPLE_POLYPHASE, to use the built-in polyphase filter bank,
+ *    which needs no third party library and uses NEON or SSE2 when available
+ *    (see #PJMEDIA_RESAMPLE_POLYPHASE_USE_SIMD). It only supports frame
+ *    sizes that convert to a whole number of output samples, such as the
+ *    10ms multiples used by the conference bridge.
  *  - #PJMEDIA_RESAMPLE_NONE, to disable sample rate conversion. Any calls to
  *    resample function will return error.
  *
@@ -370,6 +429,18 @@
 #endif
 
 
+/**
+ * Specify whether the polyphase resampler (#PJMEDIA_RESAMPLE_POLYPHASE)
+ * may use ARM NEON or x86 SSE2 for the filter inner products, when the
+ * compiler targets such instruction set.
+ *
+ * Default: 1 (enabled)
+ */
+#ifndef PJMEDIA_RESAMPLE_POLYPHASE_USE_SIMD
+#   define PJMEDIA_RESAMPLE_POLYPHASE_USE_SIMD	1
+#endif
+
+
 /**
  * Specify whether libsamplerate, when used, should be linked statically
  * into the application. This option is only useful for Visual Studio
@@ -385,6 +456,72 @@
 #endif
 
 
+/**
+ * Specify whether the Annex-B byte stream scanner (see annexb.h) may use
+ * ARM NEON or x86 SSE2 to search for start codes, when the compiler
+ * targets such instruction set. The scanner is used by the H.264
+ * packetizer, the MP4 writer and the video devices which receive Annex-B
+ * streams.
+ *
+ * Default: 1 (enabled)
+ */
+#ifndef PJMEDIA_ANNEXB_USE_SIMD
+#   define PJMEDIA_ANNEXB_USE_SIMD		1
+#endif
+
+
+/**
+ * Specify whether the fragmented MP4 writer (see mp4_writer.h) should be
+ * built. It is enabled when the application's config_site.h enables
+ * NDK_MUXER_MP4_ENABLE.
+ *
+ * Default: NDK_MUXER_MP4_ENABLE, or 0 when that is not defined
+ */
+#ifndef PJMEDIA_HAS_MP4_WRITER
+#   if defined(NDK_MUXER_MP4_ENABLE) && NDK_MUXER_MP4_ENABLE != 0
+#	define PJMEDIA_HAS_MP4_WRITER		1
+#   else
+#	define PJMEDIA_HAS_MP4_WRITER		0
+#   endif
+#endif
+
+
+/**
+ * Default duration of a fragment of the MP4 writer, in msec. With video,
+ * a fragment is only closed at a key frame, so it may be longer.
+ *
+ * Default: 1000
+ */
+#ifndef PJMEDIA_MP4_WRITER_FRAG_DURATION
+#   define PJMEDIA_MP4_WRITER_FRAG_DURATION	1000
+#endif
+
+
+/**
+ * Size of the buffers of the MP4 writer holding the samples of the
+ * current fragment, in bytes, for the video and the audio track. A
+ * fragment is closed early when a buffer is full.
+ *
+ * Default: 2 MB for video, 64 KB for audio
+ */
+#ifndef PJMEDIA_MP4_WRITER_VID_BUF_SIZE
+#   define PJMEDIA_MP4_WRITER_VID_BUF_SIZE	(2 * 1024 * 1024)
+#endif
+#ifndef PJMEDIA_MP4_WRITER_AUD_BUF_SIZE
+#   define PJMEDIA_MP4_WRITER_AUD_BUF_SIZE	(64 * 1024)
+#endif
+
+
+/**
+ * Maximum number of samples per track in one fragment of the MP4 writer.
+ *
+ * Default: 256
+ */
+#ifndef PJMEDIA_MP4_WRITER_MAX_SAMPLES
+#   define PJMEDIA_MP4_WRITER_MAX_SAMPLES	256
+#endif
+
+
 /**
  * Maximum frame duration (in msec) to be supported.
  * This (among other thing) will affect the size of buffers to be allocated
@@ -1140,6 +1277,27 @@
 #endif
 
 
+/**
+ * Maximum number of RTP packets the UDP media transport reads with one
+ * recvmmsg() call, or writes with one sendmmsg() call (see
+ * #pjmedia_transport_udp_send_rtp_batch()). Each transport allocates a
+ * receive buffer of PJMEDIA_MAX_MRU bytes for every packet of a batch.
+ * Set to zero to read and write one packet at a time through the ioqueue.
+ *
+ * The batched socket calls are only available on Linux and Android.
+ *
+ * Default: 16 on Linux and Android, otherwise 0
+ */
+#ifndef PJMEDIA_TRANSPORT_UDP_BATCH_SIZE
+#   if (defined(PJ_LINUX) && PJ_LINUX != 0) || \
+       (defined(PJ_ANDROID) && PJ_ANDROID != 0)
+#	define PJMEDIA_TRANSPORT_UDP_BATCH_SIZE	    16
+#   else
+#	define PJMEDIA_TRANSPORT_UDP_BATCH_SIZE	    0
+#   endif
+#endif
+
+
 /**
  * Transport info (pjmedia_transport_info) contains a socket info and list
  * of transport specific info, since transports can be chained together 
@@ -1350,6 +1508,25 @@
 #endif
 
 
+/**
+ * Number of shared scheduler threads for the asynchronous media clocks,
+ * for each of the two thread priorities (highest priority, and normal
+ * priority for clocks created with PJMEDIA_CLOCK_NO_HIGHEST_PRIO). A
+ * clock is assigned to the thread that has the fewest clocks, and the
+ * callbacks of the clocks of a thread are called one after another, so
+ * more threads are only useful when the callbacks are expensive. The
+ * threads are started with the first clock, and stopped when the last
+ * clock is destroyed.
+ *
+ * Set to zero to give each clock its own thread.
+ *
+ * Default: 1
+ */
+#ifndef PJMEDIA_CLOCK_SCHED_THREAD_CNT
+#   define PJMEDIA_CLOCK_SCHED_THREAD_CNT	    1
+#endif
+
+
 /**
  * Minimum gap between two consecutive discards in jitter buffer,
  * in milliseconds.
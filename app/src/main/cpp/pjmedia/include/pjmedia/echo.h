@@ -100,9 +100,10 @@ typedef enum pjmedia_echo_flag
     PJMEDIA_ECHO_NO_LOCK = 16,
 
     /**
-     * If PJMEDIA_ECHO_USE_SIMPLE_FIFO flag is specified, the delay buffer
-     * created for the echo canceller will use simple FIFO mechanism, i.e.
-     * without using WSOLA to expand and shrink audio samples.
+     * This flag is kept for compatibility and has no effect. The reference
+     * buffer of the echo canceller always compensates clock drift by
+     * repeating or skipping whole frames, without using WSOLA to expand
+     * and shrink audio samples.
      */
     PJMEDIA_ECHO_USE_SIMPLE_FIFO = 32,
 
@@ -156,6 +157,45 @@ typedef enum pjmedia_echo_flag
 
 
 
+/**
+ * Statistics of the far-end reference buffer, which is used when the
+ * echo canceller backend doesn't handle playback and capture itself.
+ */
+typedef struct pjmedia_echo_stat
+{
+    /**
+     * Number of reference frames used by #pjmedia_echo_capture().
+     */
+    unsigned	frame_cnt;
+
+    /**
+     * Number of played frames dropped because capture has fallen behind
+     * and the reference buffer was full.
+     */
+    unsigned	drop_cnt;
+
+    /**
+     * Number of times capture has run ahead of playback. The last
+     * reference frame is then repeated until the configured latency has
+     * been built up again.
+     */
+    unsigned	underrun_cnt;
+
+    /**
+     * Number of times playback has run ahead of capture and capture has
+     * skipped reference frames to return to the configured latency.
+     */
+    unsigned	overrun_cnt;
+
+    /**
+     * Smoothed time between a frame being passed to
+     * #pjmedia_echo_playback() and being used as the reference, in usec.
+     */
+    unsigned	delay_usec;
+
+} pjmedia_echo_stat;
+
+
 /**
  * Create the echo canceller. 
  *
@@ -232,11 +272,29 @@ PJ_DECL(pj_status_t) pjmedia_echo_destroy(pjmedia_echo_state *echo );
 PJ_DECL(pj_status_t) pjmedia_echo_reset(pjmedia_echo_state *echo );
 
 
+/**
+ * Get the statistics of the far-end reference buffer. All values are zero
+ * if the backend handles playback and capture itself.
+ *
+ * @param echo		The Echo Canceller.
+ * @param stat		Pointer to receive the statistics.
+ *
+ * @return		PJ_SUCCESS on success.
+ */
+PJ_DECL(pj_status_t) pjmedia_echo_get_stat(pjmedia_echo_state *echo,
+					   pjmedia_echo_stat *stat);
+
+
 /**
  * Let the Echo Canceller know that a frame has been played to the speaker.
  * The Echo Canceller will keep the frame in its internal buffer, to be used
  * when cancelling the echo with #pjmedia_echo_capture().
  *
+ * The internal buffer is a single producer, single consumer ring without
+ * locks: this function may be called from the playback thread while
+ * #pjmedia_echo_capture() is called from the capture thread, but each of
+ * them must only be called from one thread at a time.
+ *
  * @param echo		The Echo Canceller.
  * @param play_frm	Sample buffer containing frame to be played
  *			(or has been played) to the playback device.
@@ -85,6 +85,12 @@ typedef enum pjmedia_format_id
     /** Internet Low Bit-Rate Codec (ILBC) */
     PJMEDIA_FORMAT_ILBC	    = PJMEDIA_FORMAT_PACK('I', 'L', 'B', 'C'),
 
+    /** MPEG-4 AAC */
+    PJMEDIA_FORMAT_AAC	    = PJMEDIA_FORMAT_PACK('A', 'A', 'C', ' '),
+
+    /** Opus */
+    PJMEDIA_FORMAT_OPUS	    = PJMEDIA_FORMAT_PACK('O', 'P', 'U', 'S'),
+
 
     /*
      * Video formats.
@@ -86,6 +86,31 @@ typedef struct pjmedia_jb_state
 } pjmedia_jb_state;
 
 
+/**
+ * 视频包的标志，用于 pjmedia_jbuf_put_frame4()
+ */
+enum pjmedia_jb_vid_flag
+{
+    PJMEDIA_JB_VID_MARKER   = 1,    /**< 包的 RTP marker 位已设置，即帧的最后一个包 */
+    PJMEDIA_JB_VID_KEYFRAME = 2	    /**< 包属于关键帧			    */
+};
+
+
+/**
+ * 此结构描述视频帧索引中最旧的帧，见 pjmedia_jbuf_peek_vid_frame()
+ */
+typedef struct pjmedia_jb_vid_frame
+{
+    pj_uint32_t	ts;		    /**< 帧的时间戳			    */
+    int		first_seq;	    /**< 已收到的第一个包的序列号	    */
+    int		last_seq;	    /**< 已收到的最后一个包的序列号	    */
+    unsigned	pkt_cnt;	    /**< 帧占用的包数，包括丢失的包。即 pjmedia_jbuf_peek_frame() 的 offset 范围，
+					 也是取出该帧时 pjmedia_jbuf_remove_frame() 的参数 */
+    pj_bool_t	complete;	    /**< 帧的所有包都已收到		    */
+    pj_bool_t	keyframe;	    /**< 帧中有带 PJMEDIA_JB_VID_KEYFRAME 标志的包 */
+} pjmedia_jb_vid_frame;
+
+
 /**
  * 常量 PJMEDIA_JB_DEFAULT_INIT_DELAY 指定抖动缓冲区创建期间的默认抖动缓冲区预取计数
  */
@@ -247,6 +272,28 @@ PJ_DECL(void) pjmedia_jbuf_put_frame3( pjmedia_jbuf *jb,
 				       int frame_seq,
 				       pj_uint32_t frame_ts,
 				       pj_bool_t *discarded);
+
+/**
+ * 将一帧放入抖动缓冲区，与 pjmedia_jbuf_put_frame3() 相同，另外带有视频包的标志。
+ * 如果启用了视频帧索引，包会被记入其所属的帧（见 pjmedia_jbuf_enable_vid_index()）
+ *
+ * @param jb		抖动buf
+ * @param frame		指向要存储在抖动缓冲区中的帧缓冲区的指针
+ * @param size		帧大小
+ * @param bit_info	帧的位精确信息
+ * @param frame_seq	帧的序列号
+ * @param frame_ts	帧的时间戳
+ * @param vid_flags	视频包的标志，pjmedia_jb_vid_flag 的组合
+ * @param discarded	标记该帧是否被抖动buf丢弃
+ */
+PJ_DECL(void) pjmedia_jbuf_put_frame4( pjmedia_jbuf *jb, 
+				       const void *frame, 
+				       pj_size_t size, 
+				       pj_uint32_t bit_info,
+				       int frame_seq,
+				       pj_uint32_t frame_ts,
+				       unsigned vid_flags,
+				       pj_bool_t *discarded);
 /**
  * 从抖动缓冲区获取一帧。抖动缓冲区将返回最早的帧从它的缓冲区，当它是可用的。
  *
@@ -342,6 +389,36 @@ PJ_DECL(void) pjmedia_jbuf_peek_frame(pjmedia_jbuf *jb,
 PJ_DECL(unsigned) pjmedia_jbuf_remove_frame(pjmedia_jbuf *jb, 
 					    unsigned frame_cnt);
 
+/**
+ * 启用视频帧索引。放入包时，抖动缓冲区按时间戳把包归入帧，记录帧的序列号范围、
+ * marker 和关键帧标志，这样不需要逐个 peek 包就能知道最旧的帧是否可以取出。
+ * 缓冲区中已有的包会被丢弃。
+ *
+ * @param jb		抖动buf
+ * @param pool		用于分配索引的内存池
+ *
+ * @return		成功返回 PJ_SUCCESS
+ */
+PJ_DECL(pj_status_t) pjmedia_jbuf_enable_vid_index(pjmedia_jbuf *jb,
+						   pj_pool_t *pool);
+
+
+/**
+ * 获取视频帧索引中最旧的帧的信息，不会修改抖动缓冲区状态。帧完整时（以 marker 包结束、
+ * 紧接在上一个完整的帧之后且没有丢包）立即可以取出；否则要等到下一帧的包到达。
+ * 帧的包可以用 pjmedia_jbuf_peek_frame() 依次获取，offset 为 0 到 pkt_cnt - 1，
+ * 之后用 pjmedia_jbuf_remove_frame() 移除 pkt_cnt 个包。
+ *
+ * @param jb		抖动buf
+ * @param info		接收帧信息
+ *
+ * @return		有可以取出的帧时返回 PJ_SUCCESS，没有时返回 PJ_ENOTFOUND，
+ *			未启用视频帧索引时返回 PJ_EINVALIDOP
+ */
+PJ_DECL(pj_status_t) pjmedia_jbuf_peek_vid_frame(pjmedia_jbuf *jb,
+						 pjmedia_jb_vid_frame *info);
+
+
 /**
  * 检查抖动缓冲区是否已满
  *
@@ -0,0 +1,207 @@
+/* $Id$ */
+/*
+ * Copyright (C) 2008-2011 Teluu Inc. (http://www.teluu.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#ifndef __PJMEDIA_MP4_WRITER_H__
+#define __PJMEDIA_MP4_WRITER_H__
+
+/**
+ * @file mp4_writer.h
+ * @brief Fragmented MP4 file writer.
+ */
+#include <pjmedia/port.h>
+
+
+PJ_BEGIN_DECL
+
+
+/**
+ * @defgroup PJMEDIA_MP4_WRITER Fragmented MP4 Writer
+ * @ingroup PJMEDIA_PORT
+ * @brief Record encoded audio and video into a fragmented MP4 file
+ * @{
+ *
+ * The MP4 writer muxes already encoded frames into a fragmented MP4 file,
+ * without decoding or re-encoding them. It has one media port per track:
+ * the video port takes H.264 access units in Annex-B format, with the
+ * timestamp in 90 kHz units, and the audio port takes AAC (raw or with
+ * ADTS header) or Opus packets, with the timestamp in samples. The
+ * samples are written to the file one fragment at a time, so the file is
+ * playable up to the last complete fragment even when recording stops
+ * unexpectedly.
+ *
+ * The frames are given to the ports with #pjmedia_port_put_frame(). The
+ * ports may be called from different threads.
+ */
+
+/**
+ * Audio codec of the audio track.
+ */
+typedef enum pjmedia_mp4_audio_codec
+{
+    /** No audio track. */
+    PJMEDIA_MP4_AUDIO_NONE,
+
+    /** MPEG-4 AAC LC. */
+    PJMEDIA_MP4_AUDIO_AAC,
+
+    /** Opus. */
+    PJMEDIA_MP4_AUDIO_OPUS
+
+} pjmedia_mp4_audio_codec;
+
+
+/**
+ * MP4 writer settings.
+ */
+typedef struct pjmedia_mp4_writer_param
+{
+    /**
+     * Record a H.264 video track.
+     *
+     * Default: PJ_TRUE
+     */
+    pj_bool_t		    has_video;
+
+    /**
+     * Video frame size.
+     */
+    pjmedia_rect_size	    size;
+
+    /**
+     * Video frame rate. It is only used for frames without a usable
+     * timestamp.
+     *
+     * Default: 15 fps
+     */
+    pjmedia_ratio	    fps;
+
+    /**
+     * Codec of the audio track.
+     *
+     * Default: PJMEDIA_MP4_AUDIO_AAC
+     */
+    pjmedia_mp4_audio_codec audio_codec;
+
+    /**
+     * Audio clock rate, which is also the unit of the audio timestamps.
+     *
+     * Default: 16000
+     */
+    unsigned		    clock_rate;
+
+    /**
+     * Number of audio channels.
+     *
+     * Default: 1
+     */
+    unsigned		    channel_count;
+
+    /**
+     * Number of samples (per channel) in one encoded audio frame. It is
+     * only used for frames without a usable timestamp.
+     *
+     * Default: 1024 (AAC)
+     */
+    unsigned		    samples_per_frame;
+
+    /**
+     * Target duration of a fragment, in msec.
+     *
+     * Default: PJMEDIA_MP4_WRITER_FRAG_DURATION
+     */
+    unsigned		    frag_duration;
+
+} pjmedia_mp4_writer_param;
+
+
+/**
+ * Opaque declaration of the MP4 writer.
+ */
+typedef struct pjmedia_mp4_writer pjmedia_mp4_writer;
+
+
+/**
+ * Initialize the MP4 writer settings with the default values.
+ *
+ * @param param		The settings to be initialized.
+ */
+PJ_DECL(void) pjmedia_mp4_writer_param_default(pjmedia_mp4_writer_param *param);
+
+
+/**
+ * Create a MP4 writer, and open the file for writing. The file header is
+ * written once the first video key frame with its SPS and PPS has been
+ * received (or with the first audio frame when there is no video track).
+ *
+ * @param pool		Pool to allocate memory.
+ * @param filename	File name.
+ * @param param		The settings, or NULL for the default settings.
+ * @param p_writer	Pointer to receive the MP4 writer instance.
+ *
+ * @return		PJ_SUCCESS on success.
+ */
+PJ_DECL(pj_status_t) pjmedia_mp4_writer_create(pj_pool_t *pool,
+					       const char *filename,
+					       const pjmedia_mp4_writer_param *param,
+					       pjmedia_mp4_writer **p_writer);
+
+
+/**
+ * Get the media port of a track of the MP4 writer.
+ *
+ * @param writer	The MP4 writer.
+ * @param type		PJMEDIA_TYPE_VIDEO or PJMEDIA_TYPE_AUDIO.
+ *
+ * @return		The media port, or NULL when the writer doesn't
+ *			have such track.
+ */
+PJ_DECL(pjmedia_port*) pjmedia_mp4_writer_get_port(pjmedia_mp4_writer *writer,
+						   pjmedia_type type);
+
+
+/**
+ * Get the number of bytes written to the file so far.
+ *
+ * @param writer	The MP4 writer.
+ *
+ * @return		The file size.
+ */
+PJ_DECL(pj_off_t) pjmedia_mp4_writer_get_size(pjmedia_mp4_writer *writer);
+
+
+/**
+ * Write the pending samples as the last fragment, and close the file.
+ * The media ports must not be used anymore after this function returns;
+ * destroying them is not needed.
+ *
+ * @param writer	The MP4 writer.
+ *
+ * @return		PJ_SUCCESS on success.
+ */
+PJ_DECL(pj_status_t) pjmedia_mp4_writer_destroy(pjmedia_mp4_writer *writer);
+
+
+/**
+ * @}
+ */
+
+
+PJ_END_DECL
+
+
+#endif	/* __PJMEDIA_MP4_WRITER_H__ */
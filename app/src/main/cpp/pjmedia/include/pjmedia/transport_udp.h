@@ -149,6 +149,32 @@ PJ_DECL(pj_status_t) pjmedia_transport_udp_attach(pjmedia_endpt *endpt,
 						  pjmedia_transport **p_tp);
 
 
+/**
+ * Send several RTP packets to the remote RTP address at once, for example
+ * all packets of a packetized video frame. When batching is available
+ * (see PJMEDIA_TRANSPORT_UDP_BATCH_SIZE) the packets are written with one
+ * sendmmsg() call, or as one UDP GSO write when the kernel supports it
+ * and the packets have equal size (the last one may be shorter). Packets
+ * that can't be written immediately are sent one by one as with
+ * #pjmedia_transport_send_rtp().
+ *
+ * The transport must be a UDP media transport, not one that wraps it
+ * (such as SRTP or ICE).
+ *
+ * @param tp	    The UDP media transport.
+ * @param count	    Number of packets.
+ * @param pkt	    Array of RTP packets.
+ * @param size	    Array of packet sizes.
+ *
+ * @return	    PJ_SUCCESS on success.
+ */
+PJ_DECL(pj_status_t) pjmedia_transport_udp_send_rtp_batch(
+						pjmedia_transport *tp,
+						unsigned count,
+						const void *pkt[],
+						const pj_size_t size[]);
+
+
 PJ_END_DECL
 
 
@@ -45,6 +45,9 @@
  * there is no specific order of which destination port will receive a frame
  * from the video tee.
  *
+ * Destination ports with the same format share a single conversion of each
+ * frame, and receive the same buffer unless they process it in place.
+ *
  * The video tee is not thread-safe, so it is application responsibility
  * to synchronize video tee operations, e.g: make sure the source port is
  * paused during adding or removing a destination port.
@@ -61,8 +64,10 @@ typedef enum pjmedia_vid_tee_flag
     /**
      * Tell the video tee that the destination port will do in-place
      * processing, so the delivered data may be modified by this port.
-     * If this flag is used, buffer will be copied before being given to
-     * the destination port.
+     * Destination ports without this flag share the same buffer. Ports
+     * with this flag get the frame after them, in a private copy unless
+     * the buffer is a conversion made by the tee that no other port
+     * needs anymore.
      */
     PJMEDIA_VID_TEE_DST_DO_IN_PLACE_PROC    = 4,
 
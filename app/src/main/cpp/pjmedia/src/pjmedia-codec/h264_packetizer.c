@@ -17,6 +17,7 @@
  * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA 
  */
 #include <pjmedia-codec/h264_packetizer.h>
+#include <pjmedia/annexb.h>
 #include <pjmedia/types.h>
 #include <pj/assert.h>
 #include <pj/errno.h>
@@ -62,13 +63,11 @@ enum
 static pj_uint8_t* find_next_nal_unit(pj_uint8_t *start,
                                       pj_uint8_t *end)
 {
-    pj_uint8_t *p = start;
+    pj_uint8_t *p;
 
     /* Simply lookup "0x000001" pattern */
-    while (p <= end-3 && (p[0] || p[1] || p[2]!=1))
-        ++p;
-
-    if (p > end-3)
+    p = pjmedia_annexb_find_start_code(start, end);
+    if (!p)
 	/* No more NAL unit in this bitstream */
         return NULL;
 
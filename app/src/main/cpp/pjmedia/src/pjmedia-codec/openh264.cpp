@@ -18,6 +18,7 @@
  */
 #include <pjmedia-codec/openh264.h>
 #include <pjmedia-codec/h264_packetizer.h>
+#include <pjmedia/annexb.h>
 #include <pjmedia/vid_codec_util.h>
 #include <pjmedia/errno.h>
 #include <pj/log.h>
@@ -1045,24 +1046,18 @@ static pj_status_t oh264_codec_decode(pjmedia_vid_codec *codec,
     buf_pos = 0;
     for ( frm_cnt=0; ; ++frm_cnt) {
 	unsigned frm_size;
-	unsigned char *start;
+	unsigned char *start, *next;
 
-	for (i = 0; buf_pos + i < whole_len; i++) {
-	    if (oh264_data->dec_buf[buf_pos + i] == 0 &&
-		oh264_data->dec_buf[buf_pos + i + 1] == 0 &&
-		oh264_data->dec_buf[buf_pos + i + 2] == 1 &&
-		i > 1)
-	    {
-		break;
-	    }
-	}
-	frm_size = i;
+	/* The next NAL unit, the dummy sentinel ends the last one */
+	start = oh264_data->dec_buf + buf_pos;
+	next = pjmedia_annexb_find_start_code(start + 2,
+					      oh264_data->dec_buf + whole_len +
+					      sizeof(nal_start));
+	frm_size = next ? (unsigned)(next - start) : whole_len - buf_pos;
 
 	pj_bzero( pData, sizeof(pData));
 	pj_bzero( &sDstBufInfo, sizeof (SBufferInfo));
 
-	start = oh264_data->dec_buf + buf_pos;
-
 	/* Decode */
 	oh264_data->dec->DecodeFrame2( start, frm_size, pData, &sDstBufInfo);
 
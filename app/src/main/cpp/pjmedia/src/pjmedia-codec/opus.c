@@ -154,6 +154,17 @@ struct opus_data {
     int dec_frame_index;
 };
 
+/* The mutex is not created for single owner codecs */
+PJ_INLINE(void) opus_lock(struct opus_data *opus_data) {
+    if (opus_data->mutex)
+        pj_mutex_lock(opus_data->mutex);
+}
+
+PJ_INLINE(void) opus_unlock(struct opus_data *opus_data) {
+    if (opus_data->mutex)
+        pj_mutex_unlock(opus_data->mutex);
+}
+
 /* Codec factory instance */
 static struct opus_codec_factory opus_codec_factory;
 
@@ -167,6 +178,7 @@ static pjmedia_codec_opus_config opus_cfg =
                 30,                        /* Expected packet loss */
                 10,//PJMEDIA_CODEC_OPUS_DEFAULT_COMPLEXITY,    /* Complexity           */
                 PJMEDIA_CODEC_OPUS_DEFAULT_CBR,        /* Constant bit rate    */
+                PJMEDIA_CODEC_OPUS_DEFAULT_SINGLE_OWNER, /* Single owner     */
         };
 
 
@@ -449,6 +461,7 @@ pjmedia_codec_opus_set_default_param(const pjmedia_codec_opus_config *cfg,
     opus_cfg.complexity = cfg->complexity;
 
     opus_cfg.cbr = cfg->cbr;
+    opus_cfg.single_owner = cfg->single_owner;
 
     generate_fmtp(param);
 
@@ -568,10 +581,13 @@ static pj_status_t factory_alloc_codec(pjmedia_codec_factory *factory,
     opus_data = PJ_POOL_ZALLOC_T(pool, struct opus_data);
     codec = PJ_POOL_ZALLOC_T(pool, pjmedia_codec);
 
-    status = pj_mutex_create_simple(pool, "opus_mutex", &opus_data->mutex);
-    if (status != PJ_SUCCESS) {
-        pj_pool_release(pool);
-        return status;
+    if (!opus_cfg.single_owner) {
+        status = pj_mutex_create_simple(pool, "opus_mutex",
+                                        &opus_data->mutex);
+        if (status != PJ_SUCCESS) {
+            pj_pool_release(pool);
+            return status;
+        }
     }
 
     pj_memcpy(&opus_data->cfg, &opus_cfg, sizeof(pjmedia_codec_opus_config));
@@ -597,8 +613,10 @@ static pj_status_t factory_dealloc_codec(pjmedia_codec_factory *factory,
 
     opus_data = (struct opus_data *) codec->codec_data;
     if (opus_data) {
-        pj_mutex_destroy(opus_data->mutex);
-        opus_data->mutex = NULL;
+        if (opus_data->mutex) {
+            pj_mutex_destroy(opus_data->mutex);
+            opus_data->mutex = NULL;
+        }
         pj_pool_release(opus_data->pool);
     }
 
@@ -628,7 +646,7 @@ static pj_status_t codec_open(pjmedia_codec *codec,
 
     PJ_ASSERT_RETURN(codec && attr && opus_data, PJ_EINVAL);
 
-    pj_mutex_lock(opus_data->mutex);
+    opus_lock(opus_data);
 
     TRACE_((THIS_FILE, "%s:%d: - TRACE", __FUNCTION__, __LINE__));
 
@@ -658,7 +676,7 @@ static pj_status_t codec_open(pjmedia_codec *codec,
     if (!opus_data->enc || !opus_data->dec ||
         !opus_data->enc_packer || !opus_data->dec_packer) {
         PJ_LOG(2, (THIS_FILE, "Unable to allocate memory for the codec"));
-        pj_mutex_unlock(opus_data->mutex);
+        opus_unlock(opus_data);
         return PJ_ENOMEM;
     }
 
@@ -715,6 +733,7 @@ static pj_status_t codec_open(pjmedia_codec *codec,
                             OPUS_APPLICATION_VOIP);
     if (err != OPUS_OK) {
         PJ_LOG(2, (THIS_FILE, "Unable to create encoder"));
+        opus_unlock(opus_data);
         return PJMEDIA_CODEC_EFAILED;
     }
 
@@ -759,6 +778,7 @@ static pj_status_t codec_open(pjmedia_codec *codec,
                             attr->info.channel_cnt);
     if (err != OPUS_OK) {
         PJ_LOG(2, (THIS_FILE, "Unable to initialize decoder"));
+        opus_unlock(opus_data);
         return PJMEDIA_CODEC_EFAILED;
     }
 
@@ -779,7 +799,7 @@ static pj_status_t codec_open(pjmedia_codec *codec,
     opus_repacketizer_init(opus_data->enc_packer);
     opus_repacketizer_init(opus_data->dec_packer);
 
-    pj_mutex_unlock(opus_data->mutex);
+    opus_unlock(opus_data);
     return PJ_SUCCESS;
 }
 
@@ -800,7 +820,7 @@ static pj_status_t codec_modify(pjmedia_codec *codec,
                                 const pjmedia_codec_param *attr) {
     struct opus_data *opus_data = (struct opus_data *) codec->codec_data;
 
-    pj_mutex_lock(opus_data->mutex);
+    opus_lock(opus_data);
 
     TRACE_((THIS_FILE, "%s:%d: - TRACE", __FUNCTION__, __LINE__));
 
@@ -815,7 +835,7 @@ static pj_status_t codec_modify(pjmedia_codec *codec,
     opus_encoder_ctl(opus_data->enc,
                      OPUS_SET_INBAND_FEC(attr->setting.plc ? 1 : 0));
 
-    pj_mutex_unlock(opus_data->mutex);
+    opus_unlock(opus_data);
     return PJ_SUCCESS;
 }
 
@@ -838,33 +858,43 @@ static pj_status_t codec_parse(pjmedia_codec *codec,
     int bw;
 #endif
 
-    pj_mutex_lock(opus_data->mutex);
-
     if (pkt_size > sizeof(tmp_buf)) {
         PJ_LOG(5, (THIS_FILE, "Encoded size bigger than buffer"));
-        pj_mutex_unlock(opus_data->mutex);
         return PJMEDIA_CODEC_EFRMTOOSHORT;
     }
 
-    pj_memcpy(tmp_buf, pkt, pkt_size);
+    opus_lock(opus_data);
 
-    opus_repacketizer_init(opus_data->dec_packer);
-    opus_repacketizer_cat(opus_data->dec_packer, tmp_buf, pkt_size);
+    if (pkt_size > 0 && (*(unsigned char *) pkt & 0x3) == 0) {
+        /* Code 0 packet has exactly one frame and is used as it is */
+        num_frames = 1;
+        frames[0].buf = pkt;
+        frames[0].size = pkt_size;
+    } else {
+        pj_memcpy(tmp_buf, pkt, pkt_size);
+
+        opus_repacketizer_init(opus_data->dec_packer);
+        opus_repacketizer_cat(opus_data->dec_packer, tmp_buf, pkt_size);
+
+        num_frames = opus_repacketizer_get_nb_frames(opus_data->dec_packer);
+        out_pos = 0;
+        for (i = 0; i < num_frames; ++i) {
+            size = opus_repacketizer_out_range(opus_data->dec_packer, i, i + 1,
+                                               ((unsigned char *) pkt) + out_pos,
+                                               sizeof(tmp_buf));
+            if (size < 0) {
+                PJ_LOG(5, (THIS_FILE, "Parse failed! (%d)", pkt_size));
+                opus_unlock(opus_data);
+                return PJMEDIA_CODEC_EFAILED;
+            }
+            frames[i].buf = ((char *) pkt) + out_pos;
+            frames[i].size = size;
+            out_pos += size;
+        }
+    }
 
-    num_frames = opus_repacketizer_get_nb_frames(opus_data->dec_packer);
-    out_pos = 0;
     for (i = 0; i < num_frames; ++i) {
-        size = opus_repacketizer_out_range(opus_data->dec_packer, i, i + 1,
-                                           ((unsigned char *) pkt) + out_pos,
-                                           sizeof(tmp_buf));
-        if (size < 0) {
-            PJ_LOG(5, (THIS_FILE, "Parse failed! (%d)", pkt_size));
-            pj_mutex_unlock(opus_data->mutex);
-            return PJMEDIA_CODEC_EFAILED;
-        }
         frames[i].type = PJMEDIA_FRAME_TYPE_AUDIO;
-        frames[i].buf = ((char *) pkt) + out_pos;
-        frames[i].size = size;
         frames[i].bit_info = opus_packet_get_nb_samples(frames[i].buf,
                                                         frames[i].size, opus_data->cfg.sample_rate);
 
@@ -885,107 +915,132 @@ static pj_status_t codec_parse(pjmedia_codec *codec,
         }
 
         frames[i].timestamp.u64 = ts->u64 + i * samples_per_frame;
-        out_pos += size;
     }
     *frame_cnt = num_frames;
 
-    pj_mutex_unlock(opus_data->mutex);
+    opus_unlock(opus_data);
     return PJ_SUCCESS;
 }
 
 
 /*
- * Encode frame.
+ * Encode the frames directly into the output packet. A single frame is
+ * already a complete packet. Several frames are encoded after the room
+ * reserved for the largest packet header and then moved into place by the
+ * repacketizer, which never writes ahead of the frame it is moving.
  */
-static pj_status_t codec_encode(pjmedia_codec *codec,
-                                const struct pjmedia_frame *input,
-                                unsigned output_buf_len,
-                                struct pjmedia_frame *output) {
-    struct opus_data *opus_data = (struct opus_data *) codec->codec_data;
-    opus_int32 size = 0;
-    unsigned in_pos = 0;
-    unsigned out_pos = 0;
+static pj_status_t encode_frames(struct opus_data *opus_data,
+                                 const struct pjmedia_frame *input,
+                                 unsigned output_buf_len,
+                                 struct pjmedia_frame *output) {
+    unsigned char *out = (unsigned char *) output->buf;
+    opus_int32 size;
+    unsigned in_pos;
+    unsigned out_pos;
     unsigned frame_size;
     unsigned samples_per_frame;
-    unsigned char tmp_buf[MAX_ENCODED_PACKET_SIZE];
-    unsigned tmp_bytes_left = sizeof(tmp_buf);
-
-
-    pj_mutex_lock(opus_data->mutex);
+    unsigned frame_cnt;
+    unsigned hdr_size;
 
     samples_per_frame = (opus_data->cfg.sample_rate *
                          opus_data->enc_ptime) / 1000;
     frame_size = samples_per_frame * opus_data->cfg.channel_cnt *
                  sizeof(opus_int16);
+    frame_cnt = (unsigned) input->size / frame_size;
+
+    output->size = 0;
+    output->type = PJMEDIA_FRAME_TYPE_NONE;
+    output->timestamp = input->timestamp;
+
+    if (frame_cnt == 0)
+        return PJ_SUCCESS;
+
+    /* TOC, frame count and two bytes of length for each frame */
+    hdr_size = (frame_cnt == 1) ? 0 : 2 + 2 * frame_cnt;
+    if (output_buf_len <= hdr_size)
+        return PJMEDIA_CODEC_EFRMTOOSHORT;
+
+    if (frame_cnt > 1)
+        opus_repacketizer_init(opus_data->enc_packer);
+
+    out_pos = hdr_size;
+    for (in_pos = 0; frame_cnt--; in_pos += frame_size) {
+        unsigned bytes_left = output_buf_len - out_pos;
 
-    opus_repacketizer_init(opus_data->enc_packer);
-    while (input->size - in_pos >= frame_size) {
         size = opus_encode(opus_data->enc,
                            (const opus_int16 *) (((char *) input->buf) + in_pos),
                            samples_per_frame,
-                           tmp_buf + out_pos,
-                           (tmp_bytes_left < frame_size ?
-                            tmp_bytes_left : frame_size));
+                           out + out_pos,
+                           (bytes_left < frame_size ?
+                            bytes_left : frame_size));
         if (size < 0) {
             PJ_LOG(4, (THIS_FILE, "Encode failed! (%d)", size));
-            pj_mutex_unlock(opus_data->mutex);
             return PJMEDIA_CODEC_EFAILED;
-        } else if (size > 0) {
-            /* Only add packets containing more than the TOC */
-            opus_repacketizer_cat(opus_data->enc_packer,
-                                  tmp_buf + out_pos,
-                                  size);
-            out_pos += size;
-            tmp_bytes_left -= size;
         }
-        in_pos += frame_size;
-    }
-
-    if (!opus_repacketizer_get_nb_frames(opus_data->enc_packer)) {
-        /* Empty packet */
-        output->size = 0;
-        output->type = PJMEDIA_FRAME_TYPE_NONE;
-        output->timestamp = input->timestamp;
+        if (hdr_size &&
+            opus_repacketizer_cat(opus_data->enc_packer, out + out_pos,
+                                  size) != OPUS_OK)
+        {
+            /* Frame configuration has changed within the packet */
+            PJ_LOG(5, (THIS_FILE, "Encoded frame dropped"));
+            continue;
+        }
+        out_pos += size;
     }
 
-    if (size) {
-        size = opus_repacketizer_out(opus_data->enc_packer,
-                                     output->buf,
+    if (hdr_size) {
+        if (!opus_repacketizer_get_nb_frames(opus_data->enc_packer)) {
+            /* Empty packet */
+            return PJ_SUCCESS;
+        }
+        size = opus_repacketizer_out(opus_data->enc_packer, out,
                                      output_buf_len);
         if (size < 0) {
             PJ_LOG(4, (THIS_FILE, "Encode failed! (%d), out_size: %u",
                     size, output_buf_len));
-            pj_mutex_unlock(opus_data->mutex);
             return PJMEDIA_CODEC_EFAILED;
         }
+    } else {
+        size = out_pos;
     }
 
     output->size = (unsigned) size;
     output->type = PJMEDIA_FRAME_TYPE_AUDIO;
-    output->timestamp = input->timestamp;
 
-    pj_mutex_unlock(opus_data->mutex);
     return PJ_SUCCESS;
 }
 
 
 /*
- * Decode frame.
+ * Encode frame.
  */
-static pj_status_t codec_decode(pjmedia_codec *codec,
+static pj_status_t codec_encode(pjmedia_codec *codec,
                                 const struct pjmedia_frame *input,
                                 unsigned output_buf_len,
                                 struct pjmedia_frame *output) {
     struct opus_data *opus_data = (struct opus_data *) codec->codec_data;
+    pj_status_t status;
+
+    opus_lock(opus_data);
+    status = encode_frames(opus_data, input, output_buf_len, output);
+    opus_unlock(opus_data);
+
+    return status;
+}
+
+
+/*
+ * Decode one frame, delaying it by one frame so that the next frame
+ * can be used for FEC.
+ */
+static pj_status_t decode_frame(struct opus_data *opus_data,
+                                const struct pjmedia_frame *input,
+                                struct pjmedia_frame *output) {
     int decoded_samples;
     pjmedia_frame *inframe;
     int fec = 0;
     int frm_size;
 
-    PJ_UNUSED_ARG(output_buf_len);
-
-    pj_mutex_lock(opus_data->mutex);
-
     if (opus_data->dec_frame_index == -1) {
         /* First packet, buffer it. */
         opus_data->dec_frame[0].type = input->type;
@@ -993,7 +1048,6 @@ static pj_status_t codec_decode(pjmedia_codec *codec,
         opus_data->dec_frame[0].timestamp = input->timestamp;
         pj_memcpy(opus_data->dec_frame[0].buf, input->buf, input->size);
         opus_data->dec_frame_index = 0;
-        pj_mutex_unlock(opus_data->mutex);
 
         /* Return zero decoded bytes */
         output->size = 0;
@@ -1057,7 +1111,6 @@ static pj_status_t codec_decode(pjmedia_codec *codec,
 
     if (decoded_samples < 0) {
         PJ_LOG(4, (THIS_FILE, "Decode failed!"));
-        pj_mutex_unlock(opus_data->mutex);
         return PJMEDIA_CODEC_EFAILED;
     }
 
@@ -1065,25 +1118,39 @@ static pj_status_t codec_decode(pjmedia_codec *codec,
                    opus_data->cfg.channel_cnt;
     output->type = PJMEDIA_FRAME_TYPE_AUDIO;
 
-    pj_mutex_unlock(opus_data->mutex);
     return PJ_SUCCESS;
 }
 
 
 /*
- * Recover lost frame.
+ * Decode frame.
  */
-static pj_status_t codec_recover(pjmedia_codec *codec,
-                                 unsigned output_buf_len,
-                                 struct pjmedia_frame *output) {
+static pj_status_t codec_decode(pjmedia_codec *codec,
+                                const struct pjmedia_frame *input,
+                                unsigned output_buf_len,
+                                struct pjmedia_frame *output) {
     struct opus_data *opus_data = (struct opus_data *) codec->codec_data;
+    pj_status_t status;
+
+    PJ_UNUSED_ARG(output_buf_len);
+
+    opus_lock(opus_data);
+    status = decode_frame(opus_data, input, output);
+    opus_unlock(opus_data);
+
+    return status;
+}
+
+
+/*
+ * Conceal one lost frame, using the buffered frame if there is one.
+ */
+static pj_status_t recover_frame(struct opus_data *opus_data,
+                                 struct pjmedia_frame *output) {
     int decoded_samples;
     pjmedia_frame *inframe;
     int frm_size;
 
-    PJ_UNUSED_ARG(output_buf_len);
-    pj_mutex_lock(opus_data->mutex);
-
     if (opus_data->dec_frame_index == -1) {
         /* Recover the first packet? Don't think so, fill it with zeroes. */
         unsigned samples_per_frame;
@@ -1092,7 +1159,6 @@ static pj_status_t codec_recover(pjmedia_codec *codec,
         output->type = PJMEDIA_FRAME_TYPE_AUDIO;
         output->size = samples_per_frame << 1;
         pjmedia_zero_samples((pj_int16_t *) output->buf, samples_per_frame);
-        pj_mutex_unlock(opus_data->mutex);
 
         return PJ_SUCCESS;
     }
@@ -1126,7 +1192,6 @@ static pj_status_t codec_recover(pjmedia_codec *codec,
 
     if (decoded_samples < 0) {
         PJ_LOG(4, (THIS_FILE, "Recover failed!"));
-        pj_mutex_unlock(opus_data->mutex);
         return PJMEDIA_CODEC_EFAILED;
     }
 
@@ -1135,10 +1200,112 @@ static pj_status_t codec_recover(pjmedia_codec *codec,
     output->type = PJMEDIA_FRAME_TYPE_AUDIO;
     output->timestamp = inframe->timestamp;
 
-    pj_mutex_unlock(opus_data->mutex);
     return PJ_SUCCESS;
 }
 
+
+/*
+ * Recover lost frame.
+ */
+static pj_status_t codec_recover(pjmedia_codec *codec,
+                                 unsigned output_buf_len,
+                                 struct pjmedia_frame *output) {
+    struct opus_data *opus_data = (struct opus_data *) codec->codec_data;
+    pj_status_t status;
+
+    PJ_UNUSED_ARG(output_buf_len);
+
+    opus_lock(opus_data);
+    status = recover_frame(opus_data, output);
+    opus_unlock(opus_data);
+
+    return status;
+}
+
+
+/*
+ * Encode one frame for each codec.
+ */
+PJ_DEF(pj_status_t)
+pjmedia_codec_opus_encode_batch(pjmedia_codec *codec[],
+                                unsigned count,
+                                const pjmedia_frame input[],
+                                unsigned output_buf_len,
+                                pjmedia_frame output[]) {
+    pj_status_t first_err = PJ_SUCCESS;
+    unsigned i;
+
+    PJ_ASSERT_RETURN(codec && input && output, PJ_EINVAL);
+
+    for (i = 0; i < count; ++i) {
+        struct opus_data *opus_data;
+        pj_status_t status;
+
+        PJ_ASSERT_RETURN(codec[i]->factory == &opus_codec_factory.base,
+                         PJ_EINVAL);
+
+        opus_data = (struct opus_data *) codec[i]->codec_data;
+        opus_lock(opus_data);
+        status = encode_frames(opus_data, &input[i], output_buf_len,
+                               &output[i]);
+        opus_unlock(opus_data);
+
+        if (status != PJ_SUCCESS) {
+            output[i].size = 0;
+            output[i].type = PJMEDIA_FRAME_TYPE_NONE;
+            if (first_err == PJ_SUCCESS)
+                first_err = status;
+        }
+    }
+
+    return first_err;
+}
+
+
+/*
+ * Decode or recover one frame for each codec.
+ */
+PJ_DEF(pj_status_t)
+pjmedia_codec_opus_decode_batch(pjmedia_codec *codec[],
+                                unsigned count,
+                                const pjmedia_frame input[],
+                                unsigned output_buf_len,
+                                pjmedia_frame output[]) {
+    pj_status_t first_err = PJ_SUCCESS;
+    unsigned i;
+
+    PJ_ASSERT_RETURN(codec && input && output, PJ_EINVAL);
+
+    for (i = 0; i < count; ++i) {
+        struct opus_data *opus_data;
+        pj_status_t status;
+
+        PJ_ASSERT_RETURN(codec[i]->factory == &opus_codec_factory.base,
+                         PJ_EINVAL);
+
+        opus_data = (struct opus_data *) codec[i]->codec_data;
+
+        /* The decoder takes the number of samples from the output size */
+        output[i].size = output_buf_len;
+
+        opus_lock(opus_data);
+        if (input[i].type == PJMEDIA_FRAME_TYPE_AUDIO)
+            status = decode_frame(opus_data, &input[i], &output[i]);
+        else
+            status = recover_frame(opus_data, &output[i]);
+        opus_unlock(opus_data);
+
+        if (status != PJ_SUCCESS) {
+            output[i].size = 0;
+            output[i].type = PJMEDIA_FRAME_TYPE_NONE;
+            if (first_err == PJ_SUCCESS)
+                first_err = status;
+        }
+    }
+
+    return first_err;
+}
+
 #if defined(_MSC_VER)
 #   pragma comment(lib, "libopus.a")
 #endif
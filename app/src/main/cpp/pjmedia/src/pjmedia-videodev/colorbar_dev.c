@@ -496,7 +496,8 @@ static pj_status_t cbar_factory_create_stream(
         clock_param.usec_interval = PJMEDIA_PTIME(&vfd->fps);
         clock_param.clock_rate = param->clock_rate;
         status = pjmedia_clock_create2(pool, &clock_param,
-                                       PJMEDIA_CLOCK_NO_HIGHEST_PRIO,
+                                       PJMEDIA_CLOCK_NO_HIGHEST_PRIO |
+                                       PJMEDIA_CLOCK_OWN_THREAD,
                                        &clock_cb,
                                        strm, &strm->clock);
 	if (status != PJ_SUCCESS) {
@@ -3,6 +3,7 @@
 //
 
 #include "util.h"
+#include <pjmedia-videodev/hytera_dev.h>
 #include <pjmedia-videodev/videodev_imp.h>
 #include <pj/assert.h>
 #include <pj/log.h>
@@ -12,6 +13,7 @@
 #if defined(PJMEDIA_HAS_VIDEO) && PJMEDIA_HAS_VIDEO != 0
 
 #include <jni.h>
+#include <pjmedia/annexb.h>
 #include <pjmedia/transport.h>
 #include <endian.h>
 #include <linux/in.h>
@@ -25,6 +27,8 @@
 #include <sys/time.h>
 
 #include <pthread.h>
+#include <semaphore.h>
+#include <errno.h>
 #include <pjsua-lib/pjsua.h>
 #include <pjsua-lib/pjsua_internal.h>
 
@@ -136,6 +140,66 @@ typedef struct hytera_stream
     unsigned fps_num; // 帧率
 } hytera_stream;
 
+/* Streaming Annex-B framer. The socket data is received straight into
+ * buf, and a NAL unit is handed to the decoder in place once the start
+ * code of the next one has arrived. Data before head has been consumed;
+ * the partial unit at [head, tail) is only moved to the front of buf
+ * when the free space at the end runs low.
+ */
+typedef struct hytera_annexb_framer
+{
+    pj_uint8_t	*buf;		/**< Receive/assembly buffer	    */
+    unsigned	 cap;		/**< Size of buf		    */
+    unsigned	 head;		/**< Start of the current unit	    */
+    unsigned	 tail;		/**< End of received data	    */
+    unsigned	 scan;		/**< Next offset to search	    */
+    pj_bool_t	 resync;	/**< Drop data until a start code   */
+} hytera_annexb_framer;
+
+/* One queued NAL unit. The buffer is owned by the slot and only grows, so
+ * after the first key frame the queue doesn't allocate anymore.
+ */
+typedef struct hytera_queue_slot
+{
+    pj_uint8_t	*buf;		/**< Unit data, with start code	    */
+    unsigned	 size;		/**< Size of buf		    */
+    unsigned	 len;		/**< Length of the unit		    */
+    pj_bool_t	 key;		/**< IDR slice, SPS or PPS?	    */
+    pj_bool_t	 idr;		/**< IDR slice?			    */
+} hytera_queue_slot;
+
+/* Single-producer single-consumer queue between the receive thread and
+ * the decode thread. The receive thread only writes tail, the decode
+ * thread only writes head; both are free running and the slot index is
+ * taken modulo the queue size. Each counter is only written by one of
+ * the threads.
+ *
+ * Once a unit has been dropped, the following slices may reference it, so
+ * each thread then drops every non-key unit until the next IDR slice.
+ */
+typedef struct hytera_frame_queue
+{
+    hytera_queue_slot slot[PJMEDIA_VID_DEV_HYTERA_QUEUE_SIZE];
+    unsigned	 head;		/**< Next unit to decode	    */
+    unsigned	 tail;		/**< Next slot to fill		    */
+    sem_t	 sem;		/**< Posted for every queued unit   */
+    pj_bool_t	 sem_created;	/**< sem has been initialized	    */
+    pj_bool_t	 quit;		/**< Decode thread should quit	    */
+    pj_bool_t	 put_wait_key;	/**< Receive thread waits for IDR   */
+    pj_bool_t	 get_wait_key;	/**< Decode thread waits for IDR    */
+
+    unsigned	 max_depth;	/**< Highest depth seen		    */
+    pj_uint32_t	 queued;	/**< Units queued		    */
+    pj_uint32_t	 decoded;	/**< Units passed to the decoder    */
+    pj_uint32_t	 full_drops;	/**< Dropped by the receive thread  */
+    pj_uint32_t	 late_drops;	/**< Dropped by the decode thread   */
+} hytera_frame_queue;
+
+/* Late drop threshold, see pjmedia_hytera_set_max_queue_depth(). Kept
+ * outside of the camera data, which is cleared for every stream.
+ */
+static unsigned hytera_max_queue_depth = PJMEDIA_VID_DEV_HYTERA_MAX_QUEUE_DEPTH;
+
 typedef struct hytera_camera_data {
 
     pj_sock_t server_socket_fd;
@@ -146,12 +210,15 @@ typedef struct hytera_camera_data {
     pj_uint8_t	*dec_buf;
     unsigned	dec_buf_size;
 
-    pj_uint8_t *rec_whole_frame_buf;     // 一帧完整视频 buf
-    unsigned   rec_whole_frame_buf_size;
+    hytera_annexb_framer framer;         // 一帧完整视频 buf
 
     pj_bool_t   first_h264_frame;
 
+    hytera_frame_queue queue;            // 接收线程与解码线程之间的队列
+
     pthread_t hytera_thread;
+    pthread_t decode_thread;
+    pj_bool_t decode_thread_running;
 } hytera_camera_data;
 
 static hytera_camera_data camera_data_var;
@@ -206,6 +273,22 @@ static pj_status_t hytera_camera_data_deinit();
 static pj_status_t hytera_camera_data_socket_accept(pj_sock_t serverfd, pj_sock_t *clientfd);
 static void hytera_camera_data_socket_server_recv_handle(hytera_stream *strm);
 
+/**
+ * Annex-B framer
+ */
+static pj_status_t hytera_annexb_framer_init(hytera_annexb_framer *fr, unsigned cap);
+static pj_uint8_t *hytera_annexb_framer_get_space(hytera_annexb_framer *fr, unsigned *avail);
+static pj_bool_t hytera_annexb_framer_next_unit(hytera_annexb_framer *fr, pj_uint8_t **unit, unsigned *unit_len);
+static void hytera_annexb_framer_deinit(hytera_annexb_framer *fr);
+
+/**
+ * Receive/decode queue
+ */
+static pj_status_t hytera_frame_queue_init(hytera_frame_queue *q);
+static void hytera_frame_queue_put(hytera_frame_queue *q, const pj_uint8_t *unit, unsigned unit_len);
+static void hytera_frame_queue_deinit(hytera_frame_queue *q);
+static void *hytera_camera_data_decode_thread(void *userData);
+
 /**
  * NDK decodec  AMediaCodec
  */
@@ -1047,6 +1130,22 @@ static int hytera_camera_data_call_back(void *userData) {
         goto on_return;
     }
 
+    status = hytera_frame_queue_init(&camera_data_var.queue);
+    if (status != PJ_SUCCESS) {
+
+        HYTERA_DEV_LOG("hytera_frame_queue_init failed");
+        goto on_return;
+    }
+
+    // 解码放在单独的线程，避免解码阻塞 socket 接收
+    if (pthread_create(&camera_data_var.decode_thread, NULL,
+                       &hytera_camera_data_decode_thread, strm) != 0)
+    {
+        HYTERA_DEV_LOG("decode thread create failed");
+        goto on_return;
+    }
+    camera_data_var.decode_thread_running = PJ_TRUE;
+
     hytera_camera_data_socket_server_recv_handle(strm);
 
 on_return:
@@ -1069,9 +1168,7 @@ static pj_status_t hytera_camera_data_init() {
     camera_data_var.dec_buf      = NULL;
     camera_data_var.dec_buf_size = 0;
 
-    camera_data_var.rec_whole_frame_buf      = NULL;
-    camera_data_var.rec_whole_frame_buf_size = 0;
-    camera_data_var.first_h264_frame         = PJ_TRUE;
+    camera_data_var.first_h264_frame = PJ_TRUE;
 
     return status;
 }
@@ -1164,6 +1261,15 @@ static pj_status_t hytera_camera_data_deinit() {
 
     camera_data_var.first_h264_frame = PJ_FALSE;
 
+    if (camera_data_var.decode_thread_running) {
+
+        __atomic_store_n(&camera_data_var.queue.quit, PJ_TRUE, __ATOMIC_RELEASE);
+        sem_post(&camera_data_var.queue.sem);
+        pthread_join(camera_data_var.decode_thread, NULL);
+        camera_data_var.decode_thread_running = PJ_FALSE;
+    }
+    hytera_frame_queue_deinit(&camera_data_var.queue);
+
     hytera_camera_data_socket_deinit();
     hytera_camera_data_mediacodec_decoder_deinit();
     return PJ_SUCCESS;
@@ -1208,59 +1314,356 @@ static pj_status_t hytera_camera_data_socket_accept(pj_sock_t serverfd, pj_sock_
 
 static void hytera_camera_data_socket_server_recv_handle(hytera_stream *strm) {
 
+    PJ_UNUSED_ARG(strm);
+
+    hytera_annexb_framer *fr = &camera_data_var.framer;
     pj_status_t status;
 
-    pj_ssize_t frameBufSize = strm->cam_size.w * strm->cam_size.h * 3 / 2;
-    pj_uint8_t  *frameBuf = malloc(frameBufSize);
-    if (frameBuf == NULL) {
+    while (!camera_data_var.socket_server_quit_flag) {
+
+        pj_uint8_t *unit;
+        unsigned unit_len, avail;
+        pj_ssize_t bufLen;
+        pj_uint8_t *space = hytera_annexb_framer_get_space(fr, &avail);
 
-        HYTERA_DEV_LOG("frameBuf malloc failed");
-        return;
+        bufLen = avail;
+        status = pj_sock_recv(camera_data_var.client_socket_fd, space, &bufLen, 0);
+        if (status != PJ_SUCCESS) {
+            HYTERA_DEV_LOG("pj_sock_recv data failed, please check it out!");
+            continue;
+        }
+
+        if (camera_data_var.first_h264_frame == PJ_TRUE) { // 首次读取的数据为单独的 SPS PPS 信息
+            camera_data_var.first_h264_frame = PJ_FALSE;
+            continue;
+        }
+
+        fr->tail += (unsigned)bufLen;
+
+        // 一帧的开始，上一帧的结束 00 00 00 01
+        while (hytera_annexb_framer_next_unit(fr, &unit, &unit_len)) {
+            hytera_frame_queue_put(&camera_data_var.queue, unit, unit_len);
+        }
     }
+}
 
-    memset(frameBuf, 0, frameBufSize);
+/**
+ * Annex-B framer
+ */
+static pj_status_t hytera_annexb_framer_init(hytera_annexb_framer *fr, unsigned cap) {
 
-    while (!camera_data_var.socket_server_quit_flag) {
+    pj_bzero(fr, sizeof(*fr));
 
-        pj_ssize_t bufLen = frameBufSize;
+    fr->buf = malloc(cap);
+    if (fr->buf == NULL) {
+        return PJ_ENOMEM;
+    }
 
-        status = pj_sock_recv(camera_data_var.client_socket_fd, frameBuf, &bufLen, 0);
-        if (status == PJ_SUCCESS) {
+    fr->cap = cap;
+    return PJ_SUCCESS;
+}
 
-            if (camera_data_var.first_h264_frame == PJ_TRUE) { // 首次读取的数据为单独的 SPS PPS 信息
-                camera_data_var.first_h264_frame = PJ_FALSE;
-                continue;
-            }
+/*
+ * Get the free space at the end of the buffer to receive into. The partial
+ * unit is moved to the front of the buffer only when less than a quarter
+ * of the buffer is free, so a unit is moved at most a few times while it
+ * is being received. A unit which doesn't fit in the whole buffer is
+ * dropped, and the framer waits for the next start code.
+ */
+static pj_uint8_t *hytera_annexb_framer_get_space(hytera_annexb_framer *fr, unsigned *avail) {
 
-            for (int pos = 0; pos < bufLen; pos++) {
+    if (fr->cap - fr->tail < (fr->cap >> 2) && fr->head > 0) {
 
-                if (pos + 4 < bufLen) {
+        unsigned len = fr->tail - fr->head;
 
-                    if (frameBuf[pos] == 0x00
-                        && frameBuf[pos + 1] == 0x00
-                        && frameBuf[pos + 2] == 0x00
-                        && frameBuf[pos + 3] == 0x01) { // 一帧的开始，上一帧的结束 00 00 00 01
+        pj_memmove(fr->buf, fr->buf + fr->head, len);
+        fr->scan -= fr->head;
+        fr->tail = len;
+        fr->head = 0;
+    }
 
-                        if (camera_data_var.rec_whole_frame_buf_size > 0) {
-                            hytera_camera_data_mediacodec_decode(strm, (char *)camera_data_var.rec_whole_frame_buf, camera_data_var.rec_whole_frame_buf_size);
-                            camera_data_var.rec_whole_frame_buf_size = 0;
-                        }
-                    }
-                }
+    if (fr->tail == fr->cap) {
 
-                camera_data_var.rec_whole_frame_buf[camera_data_var.rec_whole_frame_buf_size] = frameBuf[pos];
-                camera_data_var.rec_whole_frame_buf_size++;
-            }
-        } else {
-            HYTERA_DEV_LOG("pj_sock_recv data failed, please check it out!");
+        HYTERA_DEV_LOG("NAL unit larger than %u bytes, dropped", fr->cap);
+        fr->head = fr->tail = fr->scan = 0;
+        fr->resync = PJ_TRUE;
+    }
+
+    *avail = fr->cap - fr->tail;
+    return fr->buf + fr->tail;
+}
+
+/*
+ * Find the next 00 00 00 01 start code after the current unit. The search
+ * for the 00 00 01 part starts two bytes before the first unsearched
+ * position and the extra zero is checked afterwards, so start codes split
+ * across two recv() calls are found as well. On success, the unit before
+ * the start code is returned in place and the start code becomes the
+ * beginning of the next unit.
+ */
+static pj_bool_t hytera_annexb_framer_next_unit(hytera_annexb_framer *fr, pj_uint8_t **unit, unsigned *unit_len) {
+
+    unsigned pos = fr->scan;
+    unsigned first;
+
+    /* The start code of the next unit has to begin after head. After a
+     * resync there is no current unit, and the data received since may
+     * begin with the start code itself.
+     */
+    first = fr->head + (fr->resync ? 3 : 4);
+    if (pos < first) {
+        pos = first;
+    }
+
+    while (pos < fr->tail) {
+
+        /* pos is where the 0x01 byte may be */
+        pj_uint8_t *p = pjmedia_annexb_find_start_code(fr->buf + pos - 2, fr->buf + fr->tail);
+        unsigned start;
+
+        if (p == NULL) {
+            break;
+        }
+
+        pos = (unsigned)(p - fr->buf) + 2;
+        if (p[-1] != 0x00) {
+            pos++;
+            continue;
+        }
+
+        start = pos - 3;
+        *unit = fr->buf + fr->head;
+        *unit_len = start - fr->head;
+        fr->head = start;
+        fr->scan = pos + 1;
+
+        if (fr->resync) {
+            fr->resync = PJ_FALSE;
+            pos++;
+            continue;
         }
+
+        return PJ_TRUE;
     }
 
-    if (frameBuf != NULL) {
+    fr->scan = (fr->tail > pos) ? fr->tail : pos;
+    return PJ_FALSE;
+}
+
+static void hytera_annexb_framer_deinit(hytera_annexb_framer *fr) {
 
-        free(frameBuf);
-        frameBuf = NULL;
+    if (fr->buf != NULL) {
+
+        free(fr->buf);
+        fr->buf = NULL;
     }
+
+    fr->cap = fr->head = fr->tail = fr->scan = 0;
+}
+
+/**
+ * Receive/decode queue
+ */
+static pj_status_t hytera_frame_queue_init(hytera_frame_queue *q) {
+
+    pj_bzero(q, sizeof(*q));
+
+    if (sem_init(&q->sem, 0, 0) != 0) {
+        return PJ_RETURN_OS_ERROR(errno);
+    }
+
+    q->sem_created = PJ_TRUE;
+    return PJ_SUCCESS;
+}
+
+/* NAL unit type of a unit starting with a 4 byte start code */
+static unsigned hytera_nal_type(const pj_uint8_t *unit, unsigned unit_len) {
+
+    if (unit_len < 5) {
+        return 0;
+    }
+
+    return unit[4] & 0x1F;
+}
+
+/* IDR slices, SPS and PPS must never be dropped, or nothing can be decoded
+ * until the next key frame.
+ */
+static pj_bool_t hytera_nal_is_key(unsigned type) {
+
+    return type == 5 || type == 7 || type == 8;
+}
+
+static void hytera_frame_queue_full_drop(hytera_frame_queue *q) {
+
+    q->put_wait_key = PJ_TRUE;
+    __atomic_store_n(&q->full_drops, q->full_drops + 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * Called by the receive thread. When the queue is full, a non-key unit is
+ * dropped, while a key unit waits for the decode thread to free a slot.
+ * After a drop, non-key units are dropped until the next IDR slice.
+ */
+static void hytera_frame_queue_put(hytera_frame_queue *q, const pj_uint8_t *unit, unsigned unit_len) {
+
+    unsigned type = hytera_nal_type(unit, unit_len);
+    pj_bool_t key = hytera_nal_is_key(type);
+    hytera_queue_slot *slot;
+    unsigned head, depth;
+
+    if (q->put_wait_key) {
+
+        if (!key) {
+            __atomic_store_n(&q->full_drops, q->full_drops + 1, __ATOMIC_RELAXED);
+            return;
+        }
+
+        if (type == 5)
+            q->put_wait_key = PJ_FALSE;
+    }
+
+    for (;;) {
+
+        head = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+        depth = q->tail - head;
+        if (depth < PJMEDIA_VID_DEV_HYTERA_QUEUE_SIZE)
+            break;
+
+        if (!key || camera_data_var.socket_server_quit_flag) {
+            hytera_frame_queue_full_drop(q);
+            return;
+        }
+
+        pj_thread_sleep(1);
+    }
+
+    slot = &q->slot[q->tail % PJMEDIA_VID_DEV_HYTERA_QUEUE_SIZE];
+    if (slot->size < unit_len) {
+
+        pj_uint8_t *buf = realloc(slot->buf, unit_len);
+        if (buf == NULL) {
+            hytera_frame_queue_full_drop(q);
+            return;
+        }
+
+        slot->buf = buf;
+        slot->size = unit_len;
+    }
+
+    pj_memcpy(slot->buf, unit, unit_len);
+    slot->len = unit_len;
+    slot->key = key;
+    slot->idr = (type == 5);
+
+    if (depth + 1 > q->max_depth)
+        __atomic_store_n(&q->max_depth, depth + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&q->queued, q->queued + 1, __ATOMIC_RELAXED);
+
+    __atomic_store_n(&q->tail, q->tail + 1, __ATOMIC_RELEASE);
+    sem_post(&q->sem);
+}
+
+static void hytera_frame_queue_deinit(hytera_frame_queue *q) {
+
+    unsigned i;
+
+    for (i = 0; i < PJMEDIA_VID_DEV_HYTERA_QUEUE_SIZE; ++i) {
+
+        if (q->slot[i].buf != NULL) {
+
+            free(q->slot[i].buf);
+            q->slot[i].buf = NULL;
+            q->slot[i].size = 0;
+        }
+    }
+
+    if (q->sem_created) {
+
+        sem_destroy(&q->sem);
+        q->sem_created = PJ_FALSE;
+    }
+}
+
+/*
+ * Decode thread. Before decoding a unit, the oldest non-key units are
+ * dropped as long as more than the maximum queue depth units are waiting,
+ * so a decoder stall doesn't add up to a delayed feed. The rest of the
+ * GOP is dropped with them, up to the next IDR slice.
+ */
+static void *hytera_camera_data_decode_thread(void *userData) {
+
+    hytera_stream *strm = (hytera_stream *) userData;
+    hytera_frame_queue *q = &camera_data_var.queue;
+
+    for (;;) {
+
+        hytera_queue_slot *slot;
+        unsigned tail, max_depth;
+        pj_bool_t drop;
+
+        if (sem_wait(&q->sem) != 0)
+            continue;
+
+        if (__atomic_load_n(&q->quit, __ATOMIC_ACQUIRE))
+            break;
+
+        tail = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+        if (tail == q->head)
+            continue;
+
+        slot = &q->slot[q->head % PJMEDIA_VID_DEV_HYTERA_QUEUE_SIZE];
+        max_depth = __atomic_load_n(&hytera_max_queue_depth, __ATOMIC_RELAXED);
+
+        if (q->get_wait_key) {
+            drop = !slot->key;
+            if (slot->idr)
+                q->get_wait_key = PJ_FALSE;
+        } else {
+            drop = (max_depth > 0 && tail - q->head > max_depth && !slot->key);
+            q->get_wait_key = drop;
+        }
+
+        if (drop) {
+            __atomic_store_n(&q->late_drops, q->late_drops + 1, __ATOMIC_RELAXED);
+        } else {
+            hytera_camera_data_mediacodec_decode(strm, (char *)slot->buf, slot->len);
+            __atomic_store_n(&q->decoded, q->decoded + 1, __ATOMIC_RELAXED);
+        }
+
+        __atomic_store_n(&q->head, q->head + 1, __ATOMIC_RELEASE);
+    }
+
+    return NULL;
+}
+
+PJ_DEF(pj_status_t) pjmedia_hytera_get_queue_stat(pjmedia_hytera_queue_stat *stat) {
+
+    hytera_frame_queue *q = &camera_data_var.queue;
+
+    PJ_ASSERT_RETURN(stat, PJ_EINVAL);
+
+    stat->depth = __atomic_load_n(&q->tail, __ATOMIC_RELAXED) -
+                  __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+    stat->max_depth = __atomic_load_n(&q->max_depth, __ATOMIC_RELAXED);
+    stat->queued = __atomic_load_n(&q->queued, __ATOMIC_RELAXED);
+    stat->decoded = __atomic_load_n(&q->decoded, __ATOMIC_RELAXED);
+    stat->full_drops = __atomic_load_n(&q->full_drops, __ATOMIC_RELAXED);
+    stat->late_drops = __atomic_load_n(&q->late_drops, __ATOMIC_RELAXED);
+
+    return PJ_SUCCESS;
+}
+
+PJ_DEF(pj_status_t) pjmedia_hytera_set_max_queue_depth(unsigned max_depth) {
+
+    __atomic_store_n(&hytera_max_queue_depth, max_depth, __ATOMIC_RELAXED);
+
+    return PJ_SUCCESS;
+}
+
+PJ_DEF(unsigned) pjmedia_hytera_get_max_queue_depth(void) {
+
+    return __atomic_load_n(&hytera_max_queue_depth, __ATOMIC_RELAXED);
 }
 
 /**
@@ -1316,9 +1719,7 @@ static pj_status_t hytera_camera_data_mediacodec_decoder_init(unsigned width, un
         goto  on_error;
     }
 
-    camera_data_var.rec_whole_frame_buf_size = 0;
-    camera_data_var.rec_whole_frame_buf = malloc(camera_data_var.dec_buf_size);
-    if (camera_data_var.rec_whole_frame_buf == NULL) {
+    if (hytera_annexb_framer_init(&camera_data_var.framer, camera_data_var.dec_buf_size) != PJ_SUCCESS) {
         goto on_error;
     }
 
@@ -1356,7 +1757,6 @@ static pj_status_t hytera_camera_data_mediacodec_decode(hytera_stream *strm, cha
                 return PJ_EINVAL;
             }
 
-            pj_memset(inputBuf, 0, inBufSize);
             pj_memcpy(inputBuf, inBuf, inBufSize);
 
             // 将数据传递进解码器解码
@@ -1429,14 +1829,10 @@ static pj_status_t hytera_camera_data_mediacodec_decoder_deinit() {
     if (camera_data_var.dec_buf != NULL) {
 
         free(camera_data_var.dec_buf);
-        camera_data_var.dec = NULL;
+        camera_data_var.dec_buf = NULL;
     }
 
-    if (camera_data_var.rec_whole_frame_buf != NULL) {
-
-        free(camera_data_var.rec_whole_frame_buf);
-        camera_data_var.rec_whole_frame_buf = NULL;
-    }
+    hytera_annexb_framer_deinit(&camera_data_var.framer);
 }
 
 
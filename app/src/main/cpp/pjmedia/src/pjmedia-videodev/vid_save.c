@@ -5,6 +5,7 @@
 #include <pjmedia-videodev/vid_save.h>
 #include <third_party/libpng/png.h>
 #include <stdbool.h>
+#include <pthread.h>
 
 
 #if defined(PJMEDIA_HAS_VIDEO) && PJMEDIA_HAS_VIDEO != 0 && \
@@ -18,26 +19,85 @@ static pj_bool_t is_take_pic = PJ_FALSE;
 
 extern JavaVM *pj_jni_jvm;
 jobject jvid_recoder;
-jbyte *vid_buf;
-jbyteArray vid_output;
 
 pj_bool_t quit;
 
-jbyte *aud_buf;
-jbyteArray aud_output;
-
 #define VIDEO_RECODER_CLASS_PATH "org/pjsip/recorder/VideoRecorder"
 
-
+/* Number of direct buffers per media type, and number of frames handed to
+ * Java in one call.
+ */
+#define VID_SAVE_BUF_CNT        4
+#define VID_SAVE_VID_BATCH      4
+#define VID_SAVE_AUD_BATCH      8
+
+/* Frame size limits used when vid_save_set_vid_param() or
+ * vid_save_set_aud_param() hasn't been called.
+ */
+#define VID_SAVE_DEF_VID_FRAME  115200
+#define VID_SAVE_DEF_AUD_FRAME  2048
+
+/* Frame types, as passed to VideoRecorder.releaseBuffer() */
+#define VID_SAVE_TYPE_VID       0
+#define VID_SAVE_TYPE_AUD       1
+
+/*
+ * Native memory wrapped by a direct ByteBuffer. Frames are packed into it
+ * as a 4 byte little endian length followed by the frame data, and the
+ * whole batch is handed to Java with addVideoFrames()/addAudioFrames()
+ * (ByteBuffer buf, int index, int count). Java hands the buffer back with
+ * the native releaseBuffer(type, index) once it's done with it; until
+ * then the buffer is neither written again nor freed. A region that is
+ * still busy when the pool is cleared is marked stale, and freed by
+ * releaseBuffer().
+ */
+typedef struct vid_save_region {
+    pj_uint8_t *buf;
+    unsigned    size;
+    unsigned    used;
+    unsigned    cnt;
+    jobject     jbuf;
+    pj_bool_t   busy;
+    pj_bool_t   stale;
+} vid_save_region;
+
+/*
+ * Record buffers of one media type. The mutex is recursive, since Java
+ * may call releaseBuffer() from inside addVideoFrames()/addAudioFrames().
+ * Older recorder classes only have addVideoData()/addAudioData()
+ * (byte[] data, int size); with those, m_add_frames is NULL and each frame
+ * is copied to jarr and handed over on its own.
+ */
+typedef struct vid_save_pool {
+    const char      *name;
+    pthread_mutex_t  mutex;
+    vid_save_region  region[VID_SAVE_BUF_CNT];
+    int              cur;        /* Region being filled, -1 if none */
+    unsigned         frame_max;  /* Set from the negotiated format  */
+    unsigned         batch;
+    pj_uint32_t      drops;
+    jmethodID        m_add_frames;
+    jmethodID        m_add_data;
+    jbyteArray       jarr;
+} vid_save_pool;
+
+static vid_save_pool vid_pool = { "video", PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP,
+                                  {{0}}, -1, VID_SAVE_DEF_VID_FRAME,
+                                  VID_SAVE_VID_BATCH };
+static vid_save_pool aud_pool = { "audio", PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP,
+                                  {{0}}, -1, VID_SAVE_DEF_AUD_FRAME,
+                                  VID_SAVE_AUD_BATCH };
 
 struct jni_objs_t{
     jclass cls;
-    jmethodID m_add_aud_data;
-    jmethodID m_add_vid_data;
     jmethodID m_start;
     jmethodID m_stop;
 } vid_recoder;
 
+static void vid_save_pool_flush(JNIEnv *env, vid_save_pool *pool);
+static void vid_save_pool_clear(JNIEnv *env, vid_save_pool *pool);
+static void vid_save_pool_destroy(JNIEnv *env, vid_save_pool *pool);
+
 static char* jstringTostring(JNIEnv* env, jstring jstr)
 {
     char* rtn = NULL;
@@ -179,6 +239,11 @@ static void JNICALL start(JNIEnv *env, jobject obj,jint type) {
 
 static void JNICALL stop(JNIEnv *env, jobject obj) {
     video_record_running = PJ_FALSE;
+
+    /* Hand over the frames of the partial batches before stopping */
+    vid_save_pool_flush(env, &vid_pool);
+    vid_save_pool_flush(env, &aud_pool);
+
     (*env)->CallVoidMethod(env, obj,
                           vid_recoder.m_stop);
 
@@ -220,10 +285,26 @@ static pj_status_t jni_init_ids() {
 //                  vid_recoder.m_set_aud_param);
 //    GET_METHOD_ID(vid_recoder.cls, "VideoRecorder", "setVidParams", "(IIII)V",
 //                  vid_recoder.m_set_vid_param);
-    GET_METHOD_ID(vid_recoder.cls, "VideoRecorder", "addAudioData", "([BI)V",
-                  vid_recoder.m_add_aud_data);
-    GET_METHOD_ID(vid_recoder.cls, "VideoRecorder", "addVideoData", "([BI)V",
-                  vid_recoder.m_add_vid_data);
+
+    /* Batches if the recorder supports them, single frames otherwise */
+    aud_pool.m_add_frames = (*jni_env)->GetMethodID(jni_env, vid_recoder.cls,
+            "addAudioFrames", "(Ljava/nio/ByteBuffer;II)V");
+    if (aud_pool.m_add_frames == 0) {
+        (*jni_env)->ExceptionClear(jni_env);
+        GET_METHOD_ID(vid_recoder.cls, "VideoRecorder", "addAudioData", "([BI)V",
+                      aud_pool.m_add_data);
+        PJ_LOG(4, (THIS_FILE, "VideoRecorder has no addAudioFrames(), "
+                              "audio frames are handed over one by one"));
+    }
+    vid_pool.m_add_frames = (*jni_env)->GetMethodID(jni_env, vid_recoder.cls,
+            "addVideoFrames", "(Ljava/nio/ByteBuffer;II)V");
+    if (vid_pool.m_add_frames == 0) {
+        (*jni_env)->ExceptionClear(jni_env);
+        GET_METHOD_ID(vid_recoder.cls, "VideoRecorder", "addVideoData", "([BI)V",
+                      vid_pool.m_add_data);
+        PJ_LOG(4, (THIS_FILE, "VideoRecorder has no addVideoFrames(), "
+                              "video frames are handed over one by one"));
+    }
     GET_METHOD_ID(vid_recoder.cls, "VideoRecorder", "start", "()V",
                   vid_recoder.m_start);
     GET_METHOD_ID(vid_recoder.cls, "VideoRecorder", "stop", "()V",
@@ -245,6 +326,9 @@ static void jni_deinit_ids() {
     JNIEnv *jni_env;
     pj_bool_t with_attach = jni_get_env(&jni_env);
 
+    vid_save_pool_destroy(jni_env, &vid_pool);
+    vid_save_pool_destroy(jni_env, &aud_pool);
+
     if (vid_recoder.cls) {
         (*jni_env)->DeleteGlobalRef(jni_env, vid_recoder.cls);
         vid_recoder.cls = NULL;
@@ -276,71 +360,311 @@ pj_bool_t get_vid_record_state(){
     return video_record_running;
 }
 
+/* Allocate the direct buffer of a region. Called with the mutex held. */
+static pj_status_t vid_save_region_alloc(JNIEnv *env, vid_save_pool *pool,
+                                         vid_save_region *r) {
+    unsigned size = pool->batch * (pool->frame_max + 4);
+    jobject jbuf;
+
+    r->buf = malloc(size);
+    if (!r->buf)
+        goto on_error;
+
+    jbuf = (*env)->NewDirectByteBuffer(env, r->buf, size);
+    if (!jbuf)
+        goto on_error;
+    r->jbuf = (*env)->NewGlobalRef(env, jbuf);
+    (*env)->DeleteLocalRef(env, jbuf);
+    if (!r->jbuf)
+        goto on_error;
+
+    r->size = size;
+    r->used = r->cnt = 0;
+    PJ_LOG(4, (THIS_FILE, "Created %s record buffer %d of %u bytes",
+               pool->name, (int)(r - pool->region), size));
+    return PJ_SUCCESS;
+
+on_error:
+    PJ_LOG(3, (THIS_FILE, "Unable to create %s record buffer", pool->name));
+    free(r->buf);
+    r->buf = NULL;
+    return PJ_ENOMEM;
+}
+
+/* Free the direct buffer of a region that Java doesn't hold. */
+static void vid_save_region_free(JNIEnv *env, vid_save_region *r) {
+    if (r->jbuf) {
+        (*env)->DeleteGlobalRef(env, r->jbuf);
+        r->jbuf = NULL;
+    }
+    if (r->buf) {
+        free(r->buf);
+        r->buf = NULL;
+    }
+    r->size = r->used = r->cnt = 0;
+    r->stale = PJ_FALSE;
+}
+
+/*
+ * Free the buffers, except those that Java still holds, which are freed
+ * when they are released. Called with the mutex held.
+ */
+static void vid_save_pool_clear(JNIEnv *env, vid_save_pool *pool) {
+    unsigned i;
+
+    for (i = 0; i < VID_SAVE_BUF_CNT; ++i) {
+        vid_save_region *r = &pool->region[i];
+
+        if (r->busy)
+            r->stale = (r->buf != NULL);
+        else
+            vid_save_region_free(env, r);
+    }
+    if (pool->jarr) {
+        (*env)->DeleteGlobalRef(env, pool->jarr);
+        pool->jarr = NULL;
+    }
+    if (pool->drops) {
+        PJ_LOG(4, (THIS_FILE, "%u %s frames dropped while recording",
+                   pool->drops, pool->name));
+        pool->drops = 0;
+    }
+    pool->cur = -1;
+}
+
+static void vid_save_pool_destroy(JNIEnv *env, vid_save_pool *pool) {
+    pthread_mutex_lock(&pool->mutex);
+    vid_save_pool_clear(env, pool);
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+/* Hand the region being filled to Java. Called with the mutex held. */
+static void vid_save_pool_submit(JNIEnv *env, vid_save_pool *pool) {
+    vid_save_region *r;
+
+    if (pool->cur < 0)
+        return;
+
+    r = &pool->region[pool->cur];
+    pool->cur = -1;
+    if (r->cnt == 0)
+        return;
+
+    r->busy = PJ_TRUE;
+    (*env)->CallVoidMethod(env, jvid_recoder, pool->m_add_frames, r->jbuf,
+                           (jint)(r - pool->region), (jint)r->cnt);
+}
+
+static void vid_save_pool_flush(JNIEnv *env, vid_save_pool *pool) {
+    pthread_mutex_lock(&pool->mutex);
+    vid_save_pool_submit(env, pool);
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+/*
+ * Hand a single frame to a recorder without batch support, through a
+ * byte array that is reused for every frame. Called with the mutex held.
+ */
+static pj_status_t vid_save_pool_add_single(JNIEnv *env, vid_save_pool *pool,
+                                            const void *buf, unsigned size) {
+    if (!pool->jarr) {
+        jbyteArray jarr = (*env)->NewByteArray(env, (jsize)pool->frame_max);
+
+        if (!jarr) {
+            (*env)->ExceptionClear(env);
+            ++pool->drops;
+            return PJ_ENOMEM;
+        }
+        pool->jarr = (jbyteArray)(*env)->NewGlobalRef(env, jarr);
+        (*env)->DeleteLocalRef(env, jarr);
+        if (!pool->jarr) {
+            ++pool->drops;
+            return PJ_ENOMEM;
+        }
+    }
+
+    (*env)->SetByteArrayRegion(env, pool->jarr, 0, (jsize)size,
+                               (const jbyte*)buf);
+    (*env)->CallVoidMethod(env, jvid_recoder, pool->m_add_data, pool->jarr,
+                           (jint)size);
+    return PJ_SUCCESS;
+}
+
+/*
+ * Append a frame to the current batch. The frame is copied once, straight
+ * into memory that Java reads through the direct ByteBuffer. When all
+ * regions are still owned by Java, the frame is dropped.
+ */
+static pj_status_t vid_save_pool_add(JNIEnv *env, vid_save_pool *pool,
+                                     const void *buf, unsigned size) {
+    vid_save_region *r;
+    pj_status_t status = PJ_SUCCESS;
+
+    pthread_mutex_lock(&pool->mutex);
+
+    if (size > pool->frame_max) {
+        PJ_LOG(4, (THIS_FILE, "%s frame of %u bytes too large, dropped",
+                   pool->name, size));
+        ++pool->drops;
+        status = PJ_ETOOBIG;
+        goto on_return;
+    }
+
+    if (!pool->m_add_frames) {
+        status = vid_save_pool_add_single(env, pool, buf, size);
+        goto on_return;
+    }
+
+    /* Current region is full */
+    if (pool->cur >= 0 && pool->region[pool->cur].used + size + 4 >
+                          pool->region[pool->cur].size)
+    {
+        vid_save_pool_submit(env, pool);
+    }
+
+    if (pool->cur < 0) {
+        unsigned i;
+
+        for (i = 0; i < VID_SAVE_BUF_CNT; ++i) {
+            if (!pool->region[i].busy)
+                break;
+        }
+        if (i == VID_SAVE_BUF_CNT) {
+            ++pool->drops;
+            status = PJ_EBUSY;
+            goto on_return;
+        }
+        if (!pool->region[i].buf &&
+            vid_save_region_alloc(env, pool, &pool->region[i]) != PJ_SUCCESS)
+        {
+            ++pool->drops;
+            status = PJ_ENOMEM;
+            goto on_return;
+        }
+        pool->cur = (int)i;
+        pool->region[i].used = pool->region[i].cnt = 0;
+    }
+
+    r = &pool->region[pool->cur];
+    r->buf[r->used + 0] = (pj_uint8_t)(size);
+    r->buf[r->used + 1] = (pj_uint8_t)(size >> 8);
+    r->buf[r->used + 2] = (pj_uint8_t)(size >> 16);
+    r->buf[r->used + 3] = (pj_uint8_t)(size >> 24);
+    pj_memcpy(r->buf + r->used + 4, buf, size);
+    r->used += size + 4;
+
+    if (++r->cnt >= pool->batch)
+        vid_save_pool_submit(env, pool);
+
+on_return:
+    pthread_mutex_unlock(&pool->mutex);
+    return status;
+}
+
+static void JNICALL release_buffer(JNIEnv *env, jobject obj, jint type, jint index) {
+    vid_save_pool *pool = (type == VID_SAVE_TYPE_AUD) ? &aud_pool : &vid_pool;
+    vid_save_region *r;
+
+    if (index < 0 || index >= VID_SAVE_BUF_CNT)
+        return;
+
+    pthread_mutex_lock(&pool->mutex);
+    r = &pool->region[index];
+    r->busy = PJ_FALSE;
+    if (r->stale)
+        vid_save_region_free(env, r);
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+/*
+ * The negotiated formats determine the largest frame, and so the size of
+ * the record buffers. The buffers are (re)created when they are needed.
+ */
+pj_status_t vid_save_set_aud_param(unsigned int bitRate,unsigned int sampleRate,unsigned int channel,
+                                   unsigned int sample_bit,unsigned int format){
+    JNIEnv *env;
+    pj_bool_t with_attach;
+    unsigned frame_max;
+
+    PJ_UNUSED_ARG(bitRate);
+    PJ_UNUSED_ARG(format);
+
+    /* Up to 100 ms of PCM per frame */
+    frame_max = sampleRate * channel * (sample_bit / 8) / 10;
+    if (frame_max < VID_SAVE_DEF_AUD_FRAME)
+        frame_max = VID_SAVE_DEF_AUD_FRAME;
+
+    with_attach = jni_get_env(&env);
+    if (!env)
+        return PJMEDIA_EVID_SYSERR;
+
+    pthread_mutex_lock(&aud_pool.mutex);
+    vid_save_pool_clear(env, &aud_pool);
+    aud_pool.frame_max = frame_max;
+    pthread_mutex_unlock(&aud_pool.mutex);
+
+    if (with_attach)
+        (*pj_jni_jvm)->DetachCurrentThread(pj_jni_jvm);
+    return PJ_SUCCESS;
+}
+
+pj_status_t vid_save_set_vid_param(unsigned int width,unsigned int height,
+                                   unsigned int bitRate,unsigned int fps){
+    JNIEnv *env;
+    pj_bool_t with_attach;
+    unsigned frame_max;
+
+    PJ_UNUSED_ARG(bitRate);
+    PJ_UNUSED_ARG(fps);
+
+    /* A raw I420 frame, which also bounds an encoded one */
+    frame_max = width * height * 3 / 2;
+    if (frame_max == 0)
+        frame_max = VID_SAVE_DEF_VID_FRAME;
+
+    with_attach = jni_get_env(&env);
+    if (!env)
+        return PJMEDIA_EVID_SYSERR;
+
+    pthread_mutex_lock(&vid_pool.mutex);
+    vid_save_pool_clear(env, &vid_pool);
+    vid_pool.frame_max = frame_max;
+    pthread_mutex_unlock(&vid_pool.mutex);
+
+    if (with_attach)
+        (*pj_jni_jvm)->DetachCurrentThread(pj_jni_jvm);
+    return PJ_SUCCESS;
+}
+
 pj_status_t vid_save_add_vid_data(void *buf,int size){
-    static pj_bool_t inited = PJ_FALSE;
     static JNIEnv *vid_env;
     if(!vid_env) {
         jni_get_env(&vid_env);
     }
     if(quit){
-        if(vid_buf && vid_output && vid_env){
-            (*vid_env)->ReleaseByteArrayElements(vid_env,vid_output,vid_buf,0);
-            (*vid_env)->DeleteLocalRef(vid_env, vid_output);
+        if(vid_env){
+            vid_save_pool_destroy(vid_env, &vid_pool);
             jni_detach_env();
         }
         return PJ_FALSE;
     }
-    if(!inited){
-        inited = PJ_TRUE;
-//        if(get_vid_record_state() == SDK_UP_19){
-            vid_output =(*vid_env)->NewByteArray(vid_env,115200);
-            vid_buf = (*vid_env)->GetByteArrayElements(vid_env,vid_output,0);
-            pj_bzero(vid_buf,115200);
-//        } else if(get_vid_record_state() == SDK_BELOW_19){
-//            vid_output =(*vid_env)->NewByteArray(vid_env,1024);
-//            vid_buf = (*vid_env)->GetByteArrayElements(vid_env,vid_output,0);
-//            pj_bzero(vid_buf,1024);
-//        }
-    }
-    pj_memcpy(vid_buf,buf,size);
-    (*vid_env)->ReleaseByteArrayElements(vid_env,vid_output,vid_buf,JNI_COMMIT);
-    (*vid_env)->CallVoidMethod(vid_env,jvid_recoder,vid_recoder.m_add_vid_data,vid_output,size);
 
-    return PJ_SUCCESS;
+    return vid_save_pool_add(vid_env, &vid_pool, buf, (unsigned)size);
 }
 
-//pj_status_t vid_save_add_aud_data(jbyteArray outputBuffer,int size){
-//    JNIEnv *env;
-//    jni_get_env(&env);
-//    (*env)->CallVoidMethod(env, jvid_recoder,
-//                              vid_recoder.m_add_aud_data, outputBuffer,size);
-//}
-
 pj_status_t vid_save_add_aud_data(void *buf,int size){
-    static pj_bool_t aud_inited = PJ_FALSE;
     static JNIEnv* aud_env;
     if(!aud_env) {
         jni_get_env(&aud_env);
     }
     if(quit){
-        if(aud_buf && aud_output && aud_env){
-            (*aud_env)->ReleaseByteArrayElements(aud_env,aud_output,aud_buf,0);
-            (*aud_env)->DeleteLocalRef(aud_env, aud_output);
+        if(aud_env){
+            vid_save_pool_destroy(aud_env, &aud_pool);
         }
         return PJ_FALSE;
     }
 
-    if(!aud_inited){
-        aud_inited = PJ_TRUE;
-        aud_output =(*aud_env)->NewByteArray(aud_env,2048);
-        aud_buf = (*aud_env)->GetByteArrayElements(aud_env,aud_output,0);
-        pj_bzero(aud_buf,2048);
-    }
-    pj_memcpy(aud_buf,buf,size);
-    (*aud_env)->ReleaseByteArrayElements(aud_env,aud_output,aud_buf,JNI_COMMIT);
-    (*aud_env)->CallVoidMethod(aud_env, jvid_recoder,
-                             vid_recoder.m_add_aud_data, aud_output,size);
-    return PJ_SUCCESS;
+    return vid_save_pool_add(aud_env, &aud_pool, buf, (unsigned)size);
 }
 
 /* Register native function */
@@ -372,10 +696,19 @@ pj_bool_t vid_save_register(){
             {"start_record", "(I)V", (void *) &start},
             {"stop_record", "()V", (void *) &stop},
             {"destroy", "()V", (void *) &destroy}};
-    if ((*jni_env)->RegisterNatives(jni_env, vid_recoder.cls, m, 5)) {
+    JNINativeMethod m_release[] = {
+            {"releaseBuffer", "(II)V", (void *) &release_buffer}};
+    if ((*jni_env)->RegisterNatives(jni_env, vid_recoder.cls, m, PJ_ARRAY_SIZE(m))) {
         PJ_LOG(3, (THIS_FILE, "[JNI] Failed in registering native "
                               "function 'OnGetFrame()'"));
     }
+    /* Only recorders with batch support declare releaseBuffer() */
+    if ((*jni_env)->RegisterNatives(jni_env, vid_recoder.cls, m_release,
+                                    PJ_ARRAY_SIZE(m_release)))
+    {
+        (*jni_env)->ExceptionClear(jni_env);
+        PJ_LOG(4, (THIS_FILE, "[JNI] VideoRecorder has no releaseBuffer()"));
+    }
 
     return PJ_TRUE;
 }
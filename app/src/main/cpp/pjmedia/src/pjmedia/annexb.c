@@ -0,0 +1,122 @@
+/* $Id$ */
+/*
+ * Copyright (C) 2008-2011 Teluu Inc. (http://www.teluu.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include <pjmedia/annexb.h>
+#include <pjmedia/config.h>
+
+#if PJMEDIA_ANNEXB_USE_SIMD
+#   if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#	include <arm_neon.h>
+#	define ANNEXB_HAS_NEON	1
+#   elif defined(__SSE2__) || defined(_M_X64) || \
+	 (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	include <emmintrin.h>
+#	define ANNEXB_HAS_SSE2	1
+#   endif
+#endif
+
+/* Bytes processed per SIMD step. The step also reads the byte after the
+ * block and the third byte of a sequence starting at its last position.
+ */
+#define BLOCK		16
+
+
+/*
+ * Find the first 00 00 x sequence with lo <= x <= hi, where hi is less
+ * than 0x80. When the third byte is above hi it is not zero either, so
+ * no sequence can start at any of the three positions and they are all
+ * skipped at once; this is the common case in coded slice data.
+ */
+static pj_uint8_t *scalar_find(const pj_uint8_t *p, const pj_uint8_t *end,
+			       pj_uint8_t lo, pj_uint8_t hi)
+{
+    while (p + 3 <= end) {
+	if (p[2] > hi)
+	    p += 3;
+	else if (p[1])
+	    p += 2;
+	else if (p[0] || p[2] < lo)
+	    p += 1;
+	else
+	    return (pj_uint8_t*)p;
+    }
+    return NULL;
+}
+
+
+#if defined(ANNEXB_HAS_NEON) || defined(ANNEXB_HAS_SSE2)
+
+#if defined(ANNEXB_HAS_NEON)
+/* Non-zero when there is a pair of zero bytes starting in the block */
+PJ_INLINE(pj_bool_t) block_has_zero_pair(const pj_uint8_t *p)
+{
+    uint8x16_t both = vorrq_u8(vld1q_u8(p), vld1q_u8(p + 1));
+    uint64x2_t z = vreinterpretq_u64_u8(vceqq_u8(both, vdupq_n_u8(0)));
+
+    return (vgetq_lane_u64(z, 0) | vgetq_lane_u64(z, 1)) != 0;
+}
+#else
+PJ_INLINE(pj_bool_t) block_has_zero_pair(const pj_uint8_t *p)
+{
+    __m128i both = _mm_or_si128(_mm_loadu_si128((const __m128i*)p),
+				_mm_loadu_si128((const __m128i*)(p + 1)));
+
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(both, _mm_setzero_si128())) != 0;
+}
+#endif
+
+/*
+ * Skip blocks without any pair of zero bytes, then let the scalar code
+ * check the block which has one.
+ */
+static pj_uint8_t *simd_find(const pj_uint8_t *p, const pj_uint8_t *end,
+			     pj_uint8_t lo, pj_uint8_t hi)
+{
+    while (end - p >= BLOCK + 2) {
+	if (block_has_zero_pair(p)) {
+	    pj_uint8_t *found = scalar_find(p, p + BLOCK + 2, lo, hi);
+	    if (found)
+		return found;
+	}
+	p += BLOCK;
+    }
+    return scalar_find(p, end, lo, hi);
+}
+
+#   define annexb_find	simd_find
+#else
+#   define annexb_find	scalar_find
+#endif
+
+
+PJ_DEF(pj_uint8_t*) pjmedia_annexb_find_start_code(const pj_uint8_t *start,
+						    const pj_uint8_t *end)
+{
+    if (!start || end - start < 3)
+	return NULL;
+    return annexb_find(start, end, 1, 1);
+}
+
+
+PJ_DEF(pj_uint8_t*) pjmedia_annexb_find_escape(const pj_uint8_t *start,
+					        const pj_uint8_t *end)
+{
+    if (!start || end - start < 3)
+	return NULL;
+    return annexb_find(start, end, 0, 3);
+}
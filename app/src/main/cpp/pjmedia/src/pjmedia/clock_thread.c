@@ -26,6 +26,20 @@
 #include <pj/string.h>
 #include <pj/compat/high_precision.h>
 
+#if (defined(PJ_LINUX) && PJ_LINUX != 0) || \
+    (defined(PJ_ANDROID) && PJ_ANDROID != 0)
+#   define CLOCK_HAS_TIMERFD	1
+#   define CLOCK_HAS_PTHREAD	1
+#   include <errno.h>
+#   include <pthread.h>
+#   include <sys/timerfd.h>
+#   include <time.h>
+#   include <unistd.h>
+#else
+#   define CLOCK_HAS_TIMERFD	0
+#   define CLOCK_HAS_PTHREAD	0
+#endif
+
 /* API: Init clock source */
 PJ_DEF(pj_status_t) pjmedia_clock_src_init( pjmedia_clock_src *clocksrc,
                                             pjmedia_type media_type,
@@ -104,9 +118,19 @@ pjmedia_clock_src_get_time_msec( const pjmedia_clock_src *clocksrc )
 
 
 /*
- * Implementation of media clock with OS thread.
+ * Implementation of media clock with scheduler threads.
+ *
+ * A scheduler is a thread with a heap of the clocks it drives, ordered by
+ * their next tick. The thread waits for the earliest tick, calls the
+ * callback of that clock, and puts the clock back into the heap with its
+ * following tick. The scheduler threads are shared by the clocks, unless
+ * the clock is created with PJMEDIA_CLOCK_OWN_THREAD option (or
+ * PJMEDIA_CLOCK_SCHED_THREAD_CNT is zero), in which case the clock gets a
+ * scheduler of its own.
  */
 
+typedef struct clock_sched clock_sched;
+
 struct pjmedia_clock
 {
     pj_pool_t		    *pool;
@@ -119,17 +143,595 @@ struct pjmedia_clock
     pj_uint64_t		     max_jump;
     pjmedia_clock_callback  *cb;
     void		    *user_data;
-    pj_thread_t		    *thread;
+    clock_sched		    *sched;	/* Scheduler driving the clock.	    */
+    int			     heap_idx;	/* Index in the heap, or -1.	    */
     pj_bool_t		     running;
+
+    pjmedia_clock_stat	     stat;
+    pj_uint64_t		     late_last;	/* Lateness of last tick, in ticks. */
+    pj_uint64_t		     late_sum;	/* Total lateness, in ticks.	    */
+    pj_uint64_t		     late_max;	/* Maximum lateness, in ticks.	    */
+};
+
+struct clock_sched
+{
+    pj_pool_t		    *pool;
+    pj_timestamp	     freq;
+    pj_bool_t		     high_prio;
+    pj_thread_t		    *thread;
+    int			     tfd;	/* timerfd, or -1.		    */
+
+    pj_mutex_t		    *mutex;	/* Protects the fields below.	    */
+    pj_mutex_t		    *cb_mutex;	/* Held while calling a callback.   */
+    pjmedia_clock	   **heap;	/* Min-heap of clocks by next_tick. */
+    unsigned		     heap_cnt;
+    unsigned		     heap_max;
+    unsigned		     clock_cnt;	/* Clocks assigned to the scheduler.*/
+    pjmedia_clock	    *cur;	/* Clock whose callback is running. */
+    pj_uint64_t		     armed;	/* Deadline the thread waits for.   */
     pj_bool_t		     quitting;
-    pj_lock_t		    *lock;
+    pj_bool_t		     self_release; /* Thread releases the pool.   */
 };
 
+#if PJMEDIA_CLOCK_SCHED_THREAD_CNT > 0
+/* The shared schedulers, for highest and for normal thread priority */
+static struct sched_mgr
+{
+    pj_pool_t		    *pool;
+    unsigned		     clock_cnt;
+    clock_sched		    *sched[2][PJMEDIA_CLOCK_SCHED_THREAD_CNT];
+} sched_mgr;
+#endif
 
-static int clock_thread(void *arg);
 
 #define MAX_JUMP_MSEC	500
 #define USEC_IN_SEC	(pj_uint64_t)1000000
+#define NSEC_IN_SEC	(pj_uint64_t)1000000000
+#define NO_DEADLINE	((pj_uint64_t)-1)
+
+/* Without timerfd, the scheduler sleeps at most this long at a time, so
+ * that it notices new deadlines.
+ */
+#define SCHED_POLL_MSEC	10
+
+
+/* Convert timestamp ticks to another unit (e.g. usec) without overflow */
+static pj_uint64_t ticks_to(pj_uint64_t ticks, const pj_timestamp *freq,
+			    pj_uint64_t unit)
+{
+    return ticks / freq->u64 * unit + ticks % freq->u64 * unit / freq->u64;
+}
+
+static void heap_up(clock_sched *sched, unsigned i)
+{
+    pjmedia_clock *clock = sched->heap[i];
+
+    while (i > 0) {
+	unsigned parent = (i - 1) / 2;
+
+	if (sched->heap[parent]->next_tick.u64 <= clock->next_tick.u64)
+	    break;
+	sched->heap[i] = sched->heap[parent];
+	sched->heap[i]->heap_idx = i;
+	i = parent;
+    }
+    sched->heap[i] = clock;
+    clock->heap_idx = i;
+}
+
+static void heap_down(clock_sched *sched, unsigned i)
+{
+    pjmedia_clock *clock = sched->heap[i];
+
+    for (;;) {
+	unsigned child = i * 2 + 1;
+
+	if (child >= sched->heap_cnt)
+	    break;
+	if (child + 1 < sched->heap_cnt &&
+	    sched->heap[child + 1]->next_tick.u64 <
+	    sched->heap[child]->next_tick.u64)
+	{
+	    ++child;
+	}
+	if (clock->next_tick.u64 <= sched->heap[child]->next_tick.u64)
+	    break;
+	sched->heap[i] = sched->heap[child];
+	sched->heap[i]->heap_idx = i;
+	i = child;
+    }
+    sched->heap[i] = clock;
+    clock->heap_idx = i;
+}
+
+static void heap_insert(clock_sched *sched, pjmedia_clock *clock)
+{
+    pj_assert(sched->heap_cnt < sched->heap_max);
+    sched->heap[sched->heap_cnt] = clock;
+    heap_up(sched, sched->heap_cnt++);
+}
+
+static void heap_erase(clock_sched *sched, pjmedia_clock *clock)
+{
+    unsigned i = clock->heap_idx;
+    pjmedia_clock *last = sched->heap[--sched->heap_cnt];
+
+    clock->heap_idx = -1;
+    if (last == clock)
+	return;
+
+    sched->heap[i] = last;
+    last->heap_idx = i;
+    heap_up(sched, i);
+    heap_down(sched, last->heap_idx);
+}
+
+/* Make room in the heap for cnt clocks */
+static pj_status_t heap_reserve(clock_sched *sched, unsigned cnt)
+{
+    pjmedia_clock **heap;
+    unsigned max;
+
+    if (cnt <= sched->heap_max)
+	return PJ_SUCCESS;
+
+    max = sched->heap_max? sched->heap_max * 2 : 4;
+    heap = (pjmedia_clock**) pj_pool_calloc(sched->pool, max, sizeof(*heap));
+    if (!heap)
+	return PJ_ENOMEM;
+
+    if (sched->heap_cnt)
+	pj_memcpy(heap, sched->heap, sched->heap_cnt * sizeof(*heap));
+    sched->heap = heap;
+    sched->heap_max = max;
+    return PJ_SUCCESS;
+}
+
+/* Set the deadline that the scheduler thread waits for, with the mutex
+ * held. A deadline in the past wakes the thread up immediately.
+ */
+static void sched_arm(clock_sched *sched, pj_uint64_t deadline)
+{
+    sched->armed = deadline;
+
+#if CLOCK_HAS_TIMERFD
+    if (sched->tfd >= 0) {
+	struct itimerspec its;
+
+	pj_bzero(&its, sizeof(its));
+	if (deadline != NO_DEADLINE) {
+	    struct timespec mono;
+	    pj_timestamp now;
+	    pj_uint64_t nsec = 0;
+
+	    /* The timestamp may not be CLOCK_MONOTONIC based, so convert
+	     * the time until the deadline.
+	     */
+	    pj_get_timestamp(&now);
+	    clock_gettime(CLOCK_MONOTONIC, &mono);
+	    if (deadline > now.u64)
+		nsec = ticks_to(deadline - now.u64, &sched->freq, NSEC_IN_SEC);
+	    nsec += mono.tv_nsec;
+	    its.it_value.tv_sec = mono.tv_sec + (time_t)(nsec / NSEC_IN_SEC);
+	    its.it_value.tv_nsec = (long)(nsec % NSEC_IN_SEC);
+	}
+	timerfd_settime(sched->tfd, TFD_TIMER_ABSTIME, &its, NULL);
+    }
+#endif
+}
+
+/* Wait until the deadline, or until woken up by sched_arm() */
+static void sched_wait(clock_sched *sched, pj_uint64_t deadline)
+{
+    pj_timestamp now, end;
+    unsigned msec = SCHED_POLL_MSEC;
+
+#if CLOCK_HAS_TIMERFD
+    if (sched->tfd >= 0) {
+	pj_uint64_t expirations;
+
+	/* Interrupted read is fine, the caller checks the time again */
+	if (read(sched->tfd, &expirations, sizeof(expirations)) >= 0 ||
+	    errno == EINTR)
+	{
+	    return;
+	}
+    }
+#endif
+
+    if (deadline != NO_DEADLINE) {
+	pj_get_timestamp(&now);
+	end.u64 = deadline;
+	if (end.u64 <= now.u64)
+	    return;
+	msec = pj_elapsed_msec(&now, &end);
+	if (msec > SCHED_POLL_MSEC)
+	    msec = SCHED_POLL_MSEC;
+    }
+    pj_thread_sleep(msec);
+}
+
+/* Update the statistics and call the callback of the tick that is due */
+static void clock_tick(pjmedia_clock *clock, const pj_timestamp *now)
+{
+    pj_uint64_t late = 0;
+
+    if (now->u64 > clock->next_tick.u64)
+	late = now->u64 - clock->next_tick.u64;
+
+    ++clock->stat.tick_cnt;
+    if (late >= clock->interval.u64)
+	++clock->stat.overrun_cnt;
+    clock->late_last = late;
+    clock->late_sum += late;
+    if (late > clock->late_max)
+	clock->late_max = late;
+
+    if (clock->cb)
+	(*clock->cb)(&clock->timestamp, clock->user_data);
+}
+
+/* Calculate next tick */
+PJ_INLINE(void) clock_calc_next_tick(pjmedia_clock *clock,
+				     pj_timestamp *now)
+{
+    if (clock->next_tick.u64+clock->max_jump < now->u64) {
+	/* Timestamp has made large jump, adjust next_tick */
+	clock->next_tick.u64 = now->u64;
+	++clock->stat.resync_cnt;
+    }
+    clock->next_tick.u64 += clock->interval.u64;
+
+}
+
+/* Release the scheduler of a clock with its own thread, which has been
+ * destroyed from its callback. Called by the thread itself, after its loop
+ * has exited, as nobody else can join it.
+ */
+static void sched_release_self(clock_sched *sched)
+{
+    pj_pool_t *pool = sched->pool;
+
+#if CLOCK_HAS_TIMERFD
+    if (sched->tfd >= 0)
+	close(sched->tfd);
+#endif
+    pj_mutex_destroy(sched->cb_mutex);
+    pj_mutex_destroy(sched->mutex);
+    pj_thread_destroy(sched->thread);
+
+#if CLOCK_HAS_PTHREAD
+    /* The pool holds the thread record too, so the thread must not return
+     * to pjlib once the pool is gone.
+     */
+    pthread_detach(pthread_self());
+    pj_pool_release(pool);
+    pthread_exit(NULL);
+#else
+    /* Without a way to end the thread here, keep the pool (it still holds
+     * the thread record).
+     */
+    PJ_UNUSED_ARG(pool);
+#endif
+}
+
+/*
+ * Scheduler thread
+ */
+static int sched_thread(void *arg)
+{
+    clock_sched *sched = (clock_sched*) arg;
+
+    /* Set thread priority to maximum unless not wanted. */
+    if (sched->high_prio) {
+	int max = pj_thread_get_prio_max(pj_thread_this());
+	if (max > 0)
+	    pj_thread_set_prio(pj_thread_this(), max);
+    }
+
+    pj_mutex_lock(sched->mutex);
+
+    while (!sched->quitting) {
+	pjmedia_clock *clock;
+	pj_uint64_t deadline = NO_DEADLINE;
+	pj_timestamp now;
+	pj_bool_t skip;
+
+	/* Wait for the next tick to happen */
+	if (sched->heap_cnt)
+	    deadline = sched->heap[0]->next_tick.u64;
+	pj_get_timestamp(&now);
+	if (now.u64 < deadline) {
+	    sched_arm(sched, deadline);
+	    pj_mutex_unlock(sched->mutex);
+	    sched_wait(sched, deadline);
+	    pj_mutex_lock(sched->mutex);
+	    continue;
+	}
+
+	/* Keep the clock out of the heap while its callback runs */
+	clock = sched->heap[0];
+	heap_erase(sched, clock);
+	sched->cur = clock;
+	pj_mutex_unlock(sched->mutex);
+
+	/* Stopping the clock waits for the callback mutex. The clock may
+	 * have been stopped before we got it.
+	 */
+	pj_mutex_lock(sched->cb_mutex);
+	pj_mutex_lock(sched->mutex);
+	skip = (sched->cur != clock || !clock->running);
+	pj_mutex_unlock(sched->mutex);
+
+	if (!skip)
+	    clock_tick(clock, &now);
+
+	pj_mutex_unlock(sched->cb_mutex);
+	pj_mutex_lock(sched->mutex);
+
+	/* The clock may have been destroyed in the callback */
+	if (sched->cur != clock)
+	    continue;
+	sched->cur = NULL;
+
+	if (!skip) {
+	    /* Increment timestamp */
+	    clock->timestamp.u64 += clock->timestamp_inc;
+
+	    /* Calculate next tick */
+	    clock_calc_next_tick(clock, &now);
+	}
+
+	/* The clock may also have been restarted */
+	if (clock->running && clock->heap_idx < 0)
+	    heap_insert(sched, clock);
+    }
+
+    pj_mutex_unlock(sched->mutex);
+
+    if (sched->self_release)
+	sched_release_self(sched);
+
+    return 0;
+}
+
+static void sched_destroy(clock_sched *sched)
+{
+    if (sched->thread) {
+	pj_mutex_lock(sched->mutex);
+	sched->quitting = PJ_TRUE;
+	sched_arm(sched, 0);
+	pj_mutex_unlock(sched->mutex);
+
+	pj_thread_join(sched->thread);
+	pj_thread_destroy(sched->thread);
+	sched->thread = NULL;
+    }
+
+#if CLOCK_HAS_TIMERFD
+    if (sched->tfd >= 0) {
+	close(sched->tfd);
+	sched->tfd = -1;
+    }
+#endif
+
+    if (sched->cb_mutex) {
+	pj_mutex_destroy(sched->cb_mutex);
+	sched->cb_mutex = NULL;
+    }
+    if (sched->mutex) {
+	pj_mutex_destroy(sched->mutex);
+	sched->mutex = NULL;
+    }
+}
+
+static pj_status_t sched_create(pj_pool_t *pool, pj_bool_t high_prio,
+				clock_sched **p_sched)
+{
+    clock_sched *sched;
+    pj_status_t status;
+
+    sched = PJ_POOL_ZALLOC_T(pool, clock_sched);
+    sched->pool = pool;
+    sched->high_prio = high_prio;
+    sched->armed = NO_DEADLINE;
+    sched->tfd = -1;
+
+    status = pj_get_timestamp_freq(&sched->freq);
+    if (status != PJ_SUCCESS)
+	return status;
+
+#if CLOCK_HAS_TIMERFD
+    /* Fall back to sleeping when timerfd is not supported */
+    sched->tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+#endif
+
+    status = pj_mutex_create_simple(pool, "clksched", &sched->mutex);
+    if (status == PJ_SUCCESS)
+	status = pj_mutex_create_simple(pool, "clkcb", &sched->cb_mutex);
+    if (status == PJ_SUCCESS)
+	status = pj_thread_create(pool, "clock", &sched_thread, sched,
+				  0, 0, &sched->thread);
+    if (status != PJ_SUCCESS) {
+	sched_destroy(sched);
+	return status;
+    }
+
+    *p_sched = sched;
+
+    return PJ_SUCCESS;
+}
+
+/* Assign a scheduler to an asynchronous clock */
+static pj_status_t clock_attach_sched(pjmedia_clock *clock,
+				      pj_pool_factory *factory)
+{
+    pj_bool_t high_prio;
+    clock_sched *sched = NULL;
+    pj_status_t status;
+
+    high_prio = (clock->options & PJMEDIA_CLOCK_NO_HIGHEST_PRIO) == 0;
+
+#if PJMEDIA_CLOCK_SCHED_THREAD_CNT > 0
+    if ((clock->options & PJMEDIA_CLOCK_OWN_THREAD) == 0) {
+	clock_sched **group = sched_mgr.sched[high_prio? 0 : 1];
+	unsigned i, empty = PJMEDIA_CLOCK_SCHED_THREAD_CNT;
+
+	pj_enter_critical_section();
+
+	if (!sched_mgr.pool) {
+	    sched_mgr.pool = pj_pool_create(factory, "clocksched", 512, 512,
+					    NULL);
+	    if (!sched_mgr.pool) {
+		pj_leave_critical_section();
+		return PJ_ENOMEM;
+	    }
+	}
+
+	/* Use the thread with the fewest clocks, or start another one */
+	for (i = 0; i < PJMEDIA_CLOCK_SCHED_THREAD_CNT; ++i) {
+	    if (!group[i]) {
+		if (empty == PJMEDIA_CLOCK_SCHED_THREAD_CNT)
+		    empty = i;
+	    } else if (!sched || group[i]->clock_cnt < sched->clock_cnt) {
+		sched = group[i];
+	    }
+	}
+	status = PJ_SUCCESS;
+	if (empty < PJMEDIA_CLOCK_SCHED_THREAD_CNT &&
+	    (!sched || sched->clock_cnt > 0))
+	{
+	    status = sched_create(sched_mgr.pool, high_prio, &group[empty]);
+	    if (status == PJ_SUCCESS)
+		sched = group[empty];
+	    else if (sched)
+		status = PJ_SUCCESS;
+	}
+
+	if (sched) {
+	    pj_mutex_lock(sched->mutex);
+	    status = heap_reserve(sched, sched->clock_cnt + 1);
+	    if (status == PJ_SUCCESS)
+		++sched->clock_cnt;
+	    pj_mutex_unlock(sched->mutex);
+	}
+	if (status == PJ_SUCCESS) {
+	    ++sched_mgr.clock_cnt;
+	    clock->sched = sched;
+	}
+
+	pj_leave_critical_section();
+
+	return status;
+    }
+#else
+    PJ_UNUSED_ARG(factory);
+#endif
+
+    status = sched_create(clock->pool, high_prio, &sched);
+    if (status != PJ_SUCCESS)
+	return status;
+
+    status = heap_reserve(sched, 1);
+    if (status != PJ_SUCCESS) {
+	sched_destroy(sched);
+	return status;
+    }
+    sched->clock_cnt = 1;
+    clock->sched = sched;
+
+    return PJ_SUCCESS;
+}
+
+/* Take the clock out of its scheduler, and wait until its callback has
+ * returned (unless called from the callback). Returns PJ_FALSE when the
+ * scheduler is still using the clock's pool.
+ */
+static pj_bool_t clock_detach_sched(pjmedia_clock *clock)
+{
+    clock_sched *sched = clock->sched;
+    pj_bool_t in_cb = PJ_FALSE, wait_cb = PJ_FALSE;
+
+    pj_mutex_lock(sched->mutex);
+    clock->running = PJ_FALSE;
+    if (clock->heap_idx >= 0)
+	heap_erase(sched, clock);
+    if (sched->cur == clock) {
+	/* Tell the scheduler not to touch the clock anymore */
+	sched->cur = NULL;
+	in_cb = (pj_thread_this() == sched->thread);
+	wait_cb = !in_cb;
+    }
+    --sched->clock_cnt;
+    pj_mutex_unlock(sched->mutex);
+
+    if (wait_cb) {
+	pj_mutex_lock(sched->cb_mutex);
+	pj_mutex_unlock(sched->cb_mutex);
+    }
+
+    clock->sched = NULL;
+
+    if (sched->pool == clock->pool) {
+	if (in_cb) {
+	    /* Let the thread quit by itself after the callback, and release
+	     * the clock's pool along with its own resources.
+	     */
+	    pj_mutex_lock(sched->mutex);
+	    sched->quitting = PJ_TRUE;
+	    sched->self_release = PJ_TRUE;
+	    pj_mutex_unlock(sched->mutex);
+	    return PJ_FALSE;
+	}
+	sched_destroy(sched);
+	return PJ_TRUE;
+    }
+
+#if PJMEDIA_CLOCK_SCHED_THREAD_CNT > 0
+    {
+	clock_sched *idle[2][PJMEDIA_CLOCK_SCHED_THREAD_CNT];
+	pj_pool_t *pool = NULL;
+	unsigned i, j;
+
+	pj_bzero(idle, sizeof(idle));
+
+	/* Stop the shared threads with the last clock, unless it is being
+	 * destroyed from a callback (the threads are then kept for the next
+	 * clock).
+	 */
+	pj_enter_critical_section();
+	if (--sched_mgr.clock_cnt == 0) {
+	    for (i = 0; i < 2; ++i) {
+		for (j = 0; j < PJMEDIA_CLOCK_SCHED_THREAD_CNT; ++j) {
+		    if (sched_mgr.sched[i][j] &&
+			sched_mgr.sched[i][j]->thread == pj_thread_this())
+		    {
+			in_cb = PJ_TRUE;
+		    }
+		}
+	    }
+	}
+	if (sched_mgr.clock_cnt == 0 && !in_cb) {
+	    pj_memcpy(idle, sched_mgr.sched, sizeof(idle));
+	    pj_bzero(sched_mgr.sched, sizeof(sched_mgr.sched));
+	    pool = sched_mgr.pool;
+	    sched_mgr.pool = NULL;
+	}
+	pj_leave_critical_section();
+
+	for (i = 0; i < 2; ++i) {
+	    for (j = 0; j < PJMEDIA_CLOCK_SCHED_THREAD_CNT; ++j) {
+		if (idle[i][j])
+		    sched_destroy(idle[i][j]);
+	    }
+	}
+	if (pool)
+	    pj_pool_release(pool);
+    }
+#endif
+
+    return PJ_TRUE;
+}
 
 /*
  * Create media clock.
@@ -165,12 +767,12 @@ PJ_DEF(pj_status_t) pjmedia_clock_create2(pj_pool_t *pool,
     PJ_ASSERT_RETURN(pool && param->usec_interval && param->clock_rate &&
                      p_clock, PJ_EINVAL);
 
-    clock = PJ_POOL_ALLOC_T(pool, pjmedia_clock);
+    clock = PJ_POOL_ZALLOC_T(pool, pjmedia_clock);
     clock->pool = pj_pool_create(pool->factory, "clock%p", 512, 512, NULL);
 
     status = pj_get_timestamp_freq(&clock->freq);
     if (status != PJ_SUCCESS)
-	return status;
+	goto on_error;
 
     clock->interval.u64 = param->usec_interval * clock->freq.u64 /
                           USEC_IN_SEC;
@@ -183,73 +785,97 @@ PJ_DEF(pj_status_t) pjmedia_clock_create2(pj_pool_t *pool,
     clock->options = options;
     clock->cb = cb;
     clock->user_data = user_data;
-    clock->thread = NULL;
+    clock->heap_idx = -1;
     clock->running = PJ_FALSE;
-    clock->quitting = PJ_FALSE;
-    
-    /* I don't think we need a mutex, so we'll use null. */
-    status = pj_lock_create_null_mutex(pool, "clock", &clock->lock);
-    if (status != PJ_SUCCESS)
-	return status;
+
+    if ((options & PJMEDIA_CLOCK_NO_ASYNC) == 0) {
+	status = clock_attach_sched(clock, pool->factory);
+	if (status != PJ_SUCCESS)
+	    goto on_error;
+    }
 
     *p_clock = clock;
 
     return PJ_SUCCESS;
+
+on_error:
+    pj_pool_safe_release(&clock->pool);
+    return status;
 }
 
 
 /*
- * Start the clock. 
+ * Start the clock.
  */
 PJ_DEF(pj_status_t) pjmedia_clock_start(pjmedia_clock *clock)
 {
+    clock_sched *sched;
     pj_timestamp now;
     pj_status_t status;
 
     PJ_ASSERT_RETURN(clock != NULL, PJ_EINVAL);
 
-    if (clock->running)
-	return PJ_SUCCESS;
-
     status = pj_get_timestamp(&now);
     if (status != PJ_SUCCESS)
 	return status;
 
-    clock->next_tick.u64 = now.u64 + clock->interval.u64;
-    clock->running = PJ_TRUE;
-    clock->quitting = PJ_FALSE;
+    sched = clock->sched;
+    if (!sched) {
+	if (!clock->running) {
+	    clock->next_tick.u64 = now.u64 + clock->interval.u64;
+	    clock->running = PJ_TRUE;
+	}
+	return PJ_SUCCESS;
+    }
 
-    if ((clock->options & PJMEDIA_CLOCK_NO_ASYNC) == 0 && !clock->thread) {
-	status = pj_thread_create(clock->pool, "clock", &clock_thread, clock,
-				  0, 0, &clock->thread);
-	if (status != PJ_SUCCESS) {
-	    clock->running = PJ_FALSE;
-	    return status;
+    pj_mutex_lock(sched->mutex);
+    if (!clock->running) {
+	clock->next_tick.u64 = now.u64 + clock->interval.u64;
+	clock->running = PJ_TRUE;
+
+	/* If the callback is running, the scheduler puts the clock back
+	 * into the heap when the callback returns.
+	 */
+	if (clock->heap_idx < 0 && sched->cur != clock) {
+	    heap_insert(sched, clock);
+	    if (clock->next_tick.u64 < sched->armed)
+		sched_arm(sched, clock->next_tick.u64);
 	}
     }
+    pj_mutex_unlock(sched->mutex);
 
     return PJ_SUCCESS;
 }
 
 
 /*
- * Stop the clock. 
+ * Stop the clock.
  */
 PJ_DEF(pj_status_t) pjmedia_clock_stop(pjmedia_clock *clock)
 {
+    clock_sched *sched;
+    pj_bool_t wait_cb = PJ_FALSE;
+
     PJ_ASSERT_RETURN(clock != NULL, PJ_EINVAL);
 
+    sched = clock->sched;
+    if (!sched) {
+	clock->running = PJ_FALSE;
+	return PJ_SUCCESS;
+    }
+
+    pj_mutex_lock(sched->mutex);
     clock->running = PJ_FALSE;
-    clock->quitting = PJ_TRUE;
-
-    if (clock->thread) {
-	if (pj_thread_join(clock->thread) == PJ_SUCCESS) {
-	    pj_thread_destroy(clock->thread);
-	    clock->thread = NULL;
-	    pj_pool_reset(clock->pool);
-	} else {
-	    clock->quitting = PJ_FALSE;
-	}
+    if (clock->heap_idx >= 0)
+	heap_erase(sched, clock);
+    if (sched->cur == clock && pj_thread_this() != sched->thread)
+	wait_cb = PJ_TRUE;
+    pj_mutex_unlock(sched->mutex);
+
+    /* Make sure the callback is not running when we return */
+    if (wait_cb) {
+	pj_mutex_lock(sched->cb_mutex);
+	pj_mutex_unlock(sched->cb_mutex);
     }
 
     return PJ_SUCCESS;
@@ -257,7 +883,7 @@ PJ_DEF(pj_status_t) pjmedia_clock_stop(pjmedia_clock *clock)
 
 
 /*
- * Update the clock. 
+ * Update the clock.
  */
 PJ_DEF(pj_status_t) pjmedia_clock_modify(pjmedia_clock *clock,
                                          const pjmedia_clock_param *param)
@@ -272,26 +898,14 @@ PJ_DEF(pj_status_t) pjmedia_clock_modify(pjmedia_clock *clock,
 }
 
 
-/* Calculate next tick */
-PJ_INLINE(void) clock_calc_next_tick(pjmedia_clock *clock,
-				     pj_timestamp *now)
-{
-    if (clock->next_tick.u64+clock->max_jump < now->u64) {
-	/* Timestamp has made large jump, adjust next_tick */
-	clock->next_tick.u64 = now->u64;
-    }
-    clock->next_tick.u64 += clock->interval.u64;
-
-}
-
 /*
- * Poll the clock. 
+ * Poll the clock.
  */
 PJ_DEF(pj_bool_t) pjmedia_clock_wait( pjmedia_clock *clock,
 				      pj_bool_t wait,
 				      pj_timestamp *ts)
 {
-    pj_timestamp now;
+    pj_timestamp now, tick_time;
     pj_status_t status;
 
     PJ_ASSERT_RETURN(clock != NULL, PJ_FALSE);
@@ -304,6 +918,7 @@ PJ_DEF(pj_bool_t) pjmedia_clock_wait( pjmedia_clock *clock,
 	return PJ_FALSE;
 
     /* Wait for the next tick to happen */
+    tick_time = now;
     if (now.u64 < clock->next_tick.u64) {
 	unsigned msec;
 
@@ -312,11 +927,11 @@ PJ_DEF(pj_bool_t) pjmedia_clock_wait( pjmedia_clock *clock,
 
 	msec = pj_elapsed_msec(&now, &clock->next_tick);
 	pj_thread_sleep(msec);
+	pj_get_timestamp(&tick_time);
     }
 
     /* Call callback, if any */
-    if (clock->cb)
-	(*clock->cb)(&clock->timestamp, clock->user_data);
+    clock_tick(clock, &tick_time);
 
     /* Report timestamp to caller */
     if (ts)
@@ -334,90 +949,46 @@ PJ_DEF(pj_bool_t) pjmedia_clock_wait( pjmedia_clock *clock,
 
 
 /*
- * Clock thread
+ * Get the clock statistics.
  */
-static int clock_thread(void *arg)
+PJ_DEF(pj_status_t) pjmedia_clock_get_stat(const pjmedia_clock *clock,
+					   pjmedia_clock_stat *stat)
 {
-    pj_timestamp now;
-    pjmedia_clock *clock = (pjmedia_clock*) arg;
-
-    /* Set thread priority to maximum unless not wanted. */
-    if ((clock->options & PJMEDIA_CLOCK_NO_HIGHEST_PRIO) == 0) {
-	int max = pj_thread_get_prio_max(pj_thread_this());
-	if (max > 0)
-	    pj_thread_set_prio(pj_thread_this(), max);
-    }
-
-    /* Get the first tick */
-    pj_get_timestamp(&clock->next_tick);
-    clock->next_tick.u64 += clock->interval.u64;
-
-
-    while (!clock->quitting) {
-
-	pj_get_timestamp(&now);
-
-	/* Wait for the next tick to happen */
-	if (now.u64 < clock->next_tick.u64) {
-	    unsigned msec;
-	    msec = pj_elapsed_msec(&now, &clock->next_tick);
-	    pj_thread_sleep(msec);
-	}
-
-	/* Skip if not running */
-	if (!clock->running) {
-	    /* Calculate next tick */
-	    clock_calc_next_tick(clock, &now);
-	    continue;
-	}
+    PJ_ASSERT_RETURN(clock && stat, PJ_EINVAL);
+
+    pj_memcpy(stat, &clock->stat, sizeof(*stat));
+    stat->last_late_usec = (pj_uint32_t)
+			   ticks_to(clock->late_last, &clock->freq,
+				    USEC_IN_SEC);
+    stat->max_late_usec = (pj_uint32_t)
+			  ticks_to(clock->late_max, &clock->freq,
+				   USEC_IN_SEC);
+    stat->avg_late_usec = 0;
+    if (clock->stat.tick_cnt)
+	stat->avg_late_usec = (pj_uint32_t)
+			      ticks_to(clock->late_sum /
+				       clock->stat.tick_cnt,
+				       &clock->freq, USEC_IN_SEC);
 
-	pj_lock_acquire(clock->lock);
-
-	/* Call callback, if any */
-	if (clock->cb)
-	    (*clock->cb)(&clock->timestamp, clock->user_data);
-
-	/* Best effort way to detect if we've been destroyed in the callback */
-	if (clock->quitting)
-	    break;
-
-	/* Increment timestamp */
-	clock->timestamp.u64 += clock->timestamp_inc;
-
-	/* Calculate next tick */
-	clock_calc_next_tick(clock, &now);
-
-	pj_lock_release(clock->lock);
-    }
-
-    return 0;
+    return PJ_SUCCESS;
 }
 
 
 /*
- * Destroy the clock. 
+ * Destroy the clock.
  */
 PJ_DEF(pj_status_t) pjmedia_clock_destroy(pjmedia_clock *clock)
 {
     PJ_ASSERT_RETURN(clock != NULL, PJ_EINVAL);
 
-    clock->running = PJ_FALSE;
-    clock->quitting = PJ_TRUE;
-
-    if (clock->thread) {
-	pj_thread_join(clock->thread);
-	pj_thread_destroy(clock->thread);
-	clock->thread = NULL;
-    }
-
-    if (clock->lock) {
-	pj_lock_destroy(clock->lock);
-	clock->lock = NULL;
+    if (clock->sched && !clock_detach_sched(clock)) {
+	/* The clock's own thread is still in the callback, it releases the
+	 * pool when the callback returns.
+	 */
+	return PJ_SUCCESS;
     }
 
     pj_pool_safe_release(&clock->pool);
 
     return PJ_SUCCESS;
 }
-
-
@@ -0,0 +1,477 @@
+/* $Id$ */
+/*
+ * Copyright (C) 2008-2011 Teluu Inc. (http://www.teluu.com)
+ * Copyright (C) 2003-2008 Benny Prijono <benny@prijono.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include "conf_mix.h"
+#include <pjmedia/config.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#   include <arm_neon.h>
+#   define CONF_MIX_HAS_NEON	1
+#elif defined(__SSE2__) || defined(_M_X64) || \
+      (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#   include <emmintrin.h>
+#   define CONF_MIX_HAS_SSE2	1
+#endif
+
+#define NORMAL_LEVEL	    128
+#define MAX_LEVEL	    (32767)
+#define MIN_LEVEL	    (-32768)
+
+/* The SIMD kernels multiply the 16bit samples with a 16bit level. Larger
+ * levels (only possible when application sets level above +127 "at its
+ * own risk") are handled by the scalar code.
+ */
+#define SIMD_MAX_ADJ_LEVEL  32767
+
+#define CLIP(s)		    ((s) > MAX_LEVEL ? MAX_LEVEL : \
+			     ((s) < MIN_LEVEL ? MIN_LEVEL : (s)))
+#define ABS(s)		    ((s) >= 0 ? (s) : -(s))
+
+
+/****************************************************************************
+ * Scalar kernel. Also used to process the tail of the SIMD kernels.
+ */
+static pj_int32_t scalar_adjust_level(pj_int16_t *dst, const pj_int16_t *src,
+				      unsigned count, unsigned adj_level)
+{
+    pj_int32_t level = 0;
+    unsigned i;
+
+    for (i=0; i<count; ++i) {
+	pj_int32_t itemp = src[i];
+
+	itemp = (itemp * (pj_int32_t)adj_level) >> 7;
+	itemp = CLIP(itemp);
+
+	dst[i] = (pj_int16_t) itemp;
+	level += ABS(itemp);
+    }
+
+    return level;
+}
+
+static pj_int32_t scalar_sum_abs(const pj_int16_t *src, unsigned count)
+{
+    pj_int32_t level = 0;
+    unsigned i;
+
+    for (i=0; i<count; ++i) {
+	pj_int32_t itemp = src[i];
+	level += ABS(itemp);
+    }
+
+    return level;
+}
+
+static void scalar_accumulate(pj_int32_t *mix_buf, const pj_int16_t *src,
+			      unsigned count, pj_int32_t *p_min,
+			      pj_int32_t *p_max)
+{
+    pj_int32_t mix_min = *p_min, mix_max = *p_max;
+    unsigned i;
+
+    for (i=0; i<count; ++i) {
+	mix_buf[i] += src[i];
+	if (mix_buf[i] < mix_min)
+	    mix_min = mix_buf[i];
+	if (mix_buf[i] > mix_max)
+	    mix_max = mix_buf[i];
+    }
+
+    *p_min = mix_min;
+    *p_max = mix_max;
+}
+
+static void scalar_copy(pj_int32_t *mix_buf, const pj_int16_t *src,
+			unsigned count)
+{
+    unsigned i;
+
+    for (i=0; i<count; ++i)
+	mix_buf[i] = src[i];
+}
+
+static pj_int32_t scalar_write_back(pj_int16_t *dst, const pj_int32_t *mix_buf,
+				    unsigned count, unsigned adj_level)
+{
+    pj_int32_t level = 0;
+    unsigned i;
+
+    /* Note that dst may alias mix_buf, so mix_buf[i] must be read before
+     * dst[i] is written (dst[i] never overwrites mix_buf[j] for j > i).
+     */
+    if (adj_level != NORMAL_LEVEL) {
+	for (i=0; i<count; ++i) {
+	    pj_int32_t itemp = mix_buf[i];
+
+	    itemp = (itemp * (pj_int32_t)adj_level) >> 7;
+	    itemp = CLIP(itemp);
+
+	    dst[i] = (pj_int16_t) itemp;
+	    level += ABS(itemp);
+	}
+    } else {
+	for (i=0; i<count; ++i) {
+	    pj_int32_t itemp = mix_buf[i];
+
+	    itemp = CLIP(itemp);
+
+	    dst[i] = (pj_int16_t) itemp;
+	    level += ABS(itemp);
+	}
+    }
+
+    return level;
+}
+
+static const pjmedia_conf_mix_kernel scalar_kernel =
+{
+    "scalar",
+    &scalar_adjust_level,
+    &scalar_sum_abs,
+    &scalar_accumulate,
+    &scalar_copy,
+    &scalar_write_back
+};
+
+
+#if defined(CONF_MIX_HAS_NEON)
+/****************************************************************************
+ * ARM NEON kernel.
+ */
+static pj_int32_t neon_hsum(uint32x4_t acc)
+{
+    uint64x2_t sum = vpaddlq_u32(acc);
+    return (pj_int32_t)(vgetq_lane_u64(sum, 0) + vgetq_lane_u64(sum, 1));
+}
+
+static pj_int32_t neon_adjust_level(pj_int16_t *dst, const pj_int16_t *src,
+				    unsigned count, unsigned adj_level)
+{
+    uint32x4_t acc = vdupq_n_u32(0);
+    unsigned i = 0;
+
+    if (adj_level > SIMD_MAX_ADJ_LEVEL)
+	return scalar_adjust_level(dst, src, count, adj_level);
+
+    for (; i+8 <= count; i+=8) {
+	int16x8_t x = vld1q_s16(src+i);
+	int32x4_t lo = vmull_n_s16(vget_low_s16(x), (pj_int16_t)adj_level);
+	int32x4_t hi = vmull_n_s16(vget_high_s16(x), (pj_int16_t)adj_level);
+	int16x8_t y;
+
+	/* Shift and saturate to 16bit */
+	y = vcombine_s16(vqmovn_s32(vshrq_n_s32(lo, 7)),
+			 vqmovn_s32(vshrq_n_s32(hi, 7)));
+	vst1q_s16(dst+i, y);
+
+	/* vabsq_s16(-32768) is 0x8000, which is 32768 as unsigned */
+	acc = vpadalq_u16(acc, vreinterpretq_u16_s16(vabsq_s16(y)));
+    }
+
+    return neon_hsum(acc) +
+	   scalar_adjust_level(dst+i, src+i, count-i, adj_level);
+}
+
+static pj_int32_t neon_sum_abs(const pj_int16_t *src, unsigned count)
+{
+    uint32x4_t acc = vdupq_n_u32(0);
+    unsigned i = 0;
+
+    for (; i+8 <= count; i+=8) {
+	int16x8_t x = vld1q_s16(src+i);
+	acc = vpadalq_u16(acc, vreinterpretq_u16_s16(vabsq_s16(x)));
+    }
+
+    return neon_hsum(acc) + scalar_sum_abs(src+i, count-i);
+}
+
+static void neon_accumulate(pj_int32_t *mix_buf, const pj_int16_t *src,
+			    unsigned count, pj_int32_t *p_min,
+			    pj_int32_t *p_max)
+{
+    int32x4_t vmin = vdupq_n_s32(*p_min), vmax = vdupq_n_s32(*p_max);
+    pj_int32_t tmp[4];
+    unsigned i = 0, k;
+
+    for (; i+8 <= count; i+=8) {
+	int16x8_t x = vld1q_s16(src+i);
+	int32x4_t m0 = vaddw_s16(vld1q_s32(mix_buf+i), vget_low_s16(x));
+	int32x4_t m1 = vaddw_s16(vld1q_s32(mix_buf+i+4), vget_high_s16(x));
+
+	vst1q_s32(mix_buf+i, m0);
+	vst1q_s32(mix_buf+i+4, m1);
+
+	vmin = vminq_s32(vmin, vminq_s32(m0, m1));
+	vmax = vmaxq_s32(vmax, vmaxq_s32(m0, m1));
+    }
+
+    vst1q_s32(tmp, vmin);
+    for (k=0; k<4; ++k)
+	if (tmp[k] < *p_min) *p_min = tmp[k];
+    vst1q_s32(tmp, vmax);
+    for (k=0; k<4; ++k)
+	if (tmp[k] > *p_max) *p_max = tmp[k];
+
+    scalar_accumulate(mix_buf+i, src+i, count-i, p_min, p_max);
+}
+
+static void neon_copy(pj_int32_t *mix_buf, const pj_int16_t *src,
+		      unsigned count)
+{
+    unsigned i = 0;
+
+    for (; i+8 <= count; i+=8) {
+	int16x8_t x = vld1q_s16(src+i);
+	vst1q_s32(mix_buf+i, vmovl_s16(vget_low_s16(x)));
+	vst1q_s32(mix_buf+i+4, vmovl_s16(vget_high_s16(x)));
+    }
+
+    scalar_copy(mix_buf+i, src+i, count-i);
+}
+
+static pj_int32_t neon_write_back(pj_int16_t *dst, const pj_int32_t *mix_buf,
+				  unsigned count, unsigned adj_level)
+{
+    uint32x4_t acc = vdupq_n_u32(0);
+    unsigned i = 0;
+
+    /* Both vectors are loaded before the store, so the in-place
+     * conversion (dst aliasing mix_buf) is safe.
+     */
+    for (; i+8 <= count; i+=8) {
+	int32x4_t m0 = vld1q_s32(mix_buf+i);
+	int32x4_t m1 = vld1q_s32(mix_buf+i+4);
+	int16x8_t y;
+
+	if (adj_level != NORMAL_LEVEL) {
+	    m0 = vshrq_n_s32(vmulq_n_s32(m0, (pj_int32_t)adj_level), 7);
+	    m1 = vshrq_n_s32(vmulq_n_s32(m1, (pj_int32_t)adj_level), 7);
+	}
+
+	y = vcombine_s16(vqmovn_s32(m0), vqmovn_s32(m1));
+	vst1q_s16(dst+i, y);
+
+	acc = vpadalq_u16(acc, vreinterpretq_u16_s16(vabsq_s16(y)));
+    }
+
+    return neon_hsum(acc) +
+	   scalar_write_back(dst+i, mix_buf+i, count-i, adj_level);
+}
+
+static const pjmedia_conf_mix_kernel simd_kernel =
+{
+    "neon",
+    &neon_adjust_level,
+    &neon_sum_abs,
+    &neon_accumulate,
+    &neon_copy,
+    &neon_write_back
+};
+
+#elif defined(CONF_MIX_HAS_SSE2)
+/****************************************************************************
+ * x86 SSE2 kernel.
+ */
+static pj_int32_t sse2_hsum(__m128i acc)
+{
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1,0,3,2)));
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2,3,0,1)));
+    return _mm_cvtsi128_si32(acc);
+}
+
+/* Add |x| of eight 16bit samples to the four 32bit lanes of acc. */
+static __m128i sse2_add_abs(__m128i acc, __m128i x)
+{
+    const __m128i zero = _mm_setzero_si128();
+
+    /* max(-32768, 32768) wraps to 0x8000, which is 32768 as unsigned, so
+     * zero-extending the result gives the correct magnitude.
+     */
+    x = _mm_max_epi16(x, _mm_sub_epi16(zero, x));
+    acc = _mm_add_epi32(acc, _mm_unpacklo_epi16(x, zero));
+    return _mm_add_epi32(acc, _mm_unpackhi_epi16(x, zero));
+}
+
+/* SSE2 has no 32bit signed min/max/multiply (these are SSE4.1). */
+static __m128i sse2_min_epi32(__m128i a, __m128i b)
+{
+    __m128i gt = _mm_cmpgt_epi32(a, b);
+    return _mm_or_si128(_mm_and_si128(gt, b), _mm_andnot_si128(gt, a));
+}
+
+static __m128i sse2_max_epi32(__m128i a, __m128i b)
+{
+    __m128i gt = _mm_cmpgt_epi32(a, b);
+    return _mm_or_si128(_mm_and_si128(gt, a), _mm_andnot_si128(gt, b));
+}
+
+static __m128i sse2_mullo_epi32(__m128i a, __m128i b)
+{
+    __m128i even = _mm_mul_epu32(a, b);
+    __m128i odd = _mm_mul_epu32(_mm_srli_si128(a, 4), _mm_srli_si128(b, 4));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0,0,2,0)),
+			      _mm_shuffle_epi32(odd, _MM_SHUFFLE(0,0,2,0)));
+}
+
+static pj_int32_t sse2_adjust_level(pj_int16_t *dst, const pj_int16_t *src,
+				    unsigned count, unsigned adj_level)
+{
+    __m128i acc = _mm_setzero_si128();
+    __m128i vadj;
+    unsigned i = 0;
+
+    if (adj_level > SIMD_MAX_ADJ_LEVEL)
+	return scalar_adjust_level(dst, src, count, adj_level);
+
+    vadj = _mm_set1_epi16((short)adj_level);
+
+    for (; i+8 <= count; i+=8) {
+	__m128i x = _mm_loadu_si128((const __m128i*)(src+i));
+	__m128i plo = _mm_mullo_epi16(x, vadj);
+	__m128i phi = _mm_mulhi_epi16(x, vadj);
+	__m128i p0 = _mm_srai_epi32(_mm_unpacklo_epi16(plo, phi), 7);
+	__m128i p1 = _mm_srai_epi32(_mm_unpackhi_epi16(plo, phi), 7);
+	__m128i y = _mm_packs_epi32(p0, p1);
+
+	_mm_storeu_si128((__m128i*)(dst+i), y);
+	acc = sse2_add_abs(acc, y);
+    }
+
+    return sse2_hsum(acc) +
+	   scalar_adjust_level(dst+i, src+i, count-i, adj_level);
+}
+
+static pj_int32_t sse2_sum_abs(const pj_int16_t *src, unsigned count)
+{
+    __m128i acc = _mm_setzero_si128();
+    unsigned i = 0;
+
+    for (; i+8 <= count; i+=8) {
+	__m128i x = _mm_loadu_si128((const __m128i*)(src+i));
+	acc = sse2_add_abs(acc, x);
+    }
+
+    return sse2_hsum(acc) + scalar_sum_abs(src+i, count-i);
+}
+
+static void sse2_accumulate(pj_int32_t *mix_buf, const pj_int16_t *src,
+			    unsigned count, pj_int32_t *p_min,
+			    pj_int32_t *p_max)
+{
+    __m128i vmin = _mm_set1_epi32(*p_min), vmax = _mm_set1_epi32(*p_max);
+    pj_int32_t tmp[4];
+    unsigned i = 0, k;
+
+    for (; i+8 <= count; i+=8) {
+	__m128i x = _mm_loadu_si128((const __m128i*)(src+i));
+	__m128i x0 = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+	__m128i x1 = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+	__m128i m0 = _mm_loadu_si128((const __m128i*)(mix_buf+i));
+	__m128i m1 = _mm_loadu_si128((const __m128i*)(mix_buf+i+4));
+
+	m0 = _mm_add_epi32(m0, x0);
+	m1 = _mm_add_epi32(m1, x1);
+	_mm_storeu_si128((__m128i*)(mix_buf+i), m0);
+	_mm_storeu_si128((__m128i*)(mix_buf+i+4), m1);
+
+	vmin = sse2_min_epi32(vmin, sse2_min_epi32(m0, m1));
+	vmax = sse2_max_epi32(vmax, sse2_max_epi32(m0, m1));
+    }
+
+    _mm_storeu_si128((__m128i*)tmp, vmin);
+    for (k=0; k<4; ++k)
+	if (tmp[k] < *p_min) *p_min = tmp[k];
+    _mm_storeu_si128((__m128i*)tmp, vmax);
+    for (k=0; k<4; ++k)
+	if (tmp[k] > *p_max) *p_max = tmp[k];
+
+    scalar_accumulate(mix_buf+i, src+i, count-i, p_min, p_max);
+}
+
+static void sse2_copy(pj_int32_t *mix_buf, const pj_int16_t *src,
+		      unsigned count)
+{
+    unsigned i = 0;
+
+    for (; i+8 <= count; i+=8) {
+	__m128i x = _mm_loadu_si128((const __m128i*)(src+i));
+	_mm_storeu_si128((__m128i*)(mix_buf+i),
+			 _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16));
+	_mm_storeu_si128((__m128i*)(mix_buf+i+4),
+			 _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16));
+    }
+
+    scalar_copy(mix_buf+i, src+i, count-i);
+}
+
+static pj_int32_t sse2_write_back(pj_int16_t *dst, const pj_int32_t *mix_buf,
+				  unsigned count, unsigned adj_level)
+{
+    __m128i acc = _mm_setzero_si128();
+    __m128i vadj = _mm_set1_epi32((int)adj_level);
+    unsigned i = 0;
+
+    /* Both vectors are loaded before the store, so the in-place
+     * conversion (dst aliasing mix_buf) is safe.
+     */
+    for (; i+8 <= count; i+=8) {
+	__m128i m0 = _mm_loadu_si128((const __m128i*)(mix_buf+i));
+	__m128i m1 = _mm_loadu_si128((const __m128i*)(mix_buf+i+4));
+	__m128i y;
+
+	if (adj_level != NORMAL_LEVEL) {
+	    m0 = _mm_srai_epi32(sse2_mullo_epi32(m0, vadj), 7);
+	    m1 = _mm_srai_epi32(sse2_mullo_epi32(m1, vadj), 7);
+	}
+
+	y = _mm_packs_epi32(m0, m1);
+	_mm_storeu_si128((__m128i*)(dst+i), y);
+	acc = sse2_add_abs(acc, y);
+    }
+
+    return sse2_hsum(acc) +
+	   scalar_write_back(dst+i, mix_buf+i, count-i, adj_level);
+}
+
+static const pjmedia_conf_mix_kernel simd_kernel =
+{
+    "sse2",
+    &sse2_adjust_level,
+    &sse2_sum_abs,
+    &sse2_accumulate,
+    &sse2_copy,
+    &sse2_write_back
+};
+
+#endif	/* CONF_MIX_HAS_SSE2 */
+
+
+PJ_DEF(const pjmedia_conf_mix_kernel*)
+pjmedia_conf_mix_get_kernel(pj_bool_t allow_simd)
+{
+#if defined(CONF_MIX_HAS_NEON) || defined(CONF_MIX_HAS_SSE2)
+    if (allow_simd)
+	return &simd_kernel;
+#else
+    PJ_UNUSED_ARG(allow_simd);
+#endif
+
+    return &scalar_kernel;
+}
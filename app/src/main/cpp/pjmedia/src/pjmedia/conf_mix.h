@@ -0,0 +1,79 @@
+/* $Id$ */
+/*
+ * Copyright (C) 2008-2011 Teluu Inc. (http://www.teluu.com)
+ * Copyright (C) 2003-2008 Benny Prijono <benny@prijono.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#ifndef __PJMEDIA_CONF_MIX_H__
+#define __PJMEDIA_CONF_MIX_H__
+
+/*
+ * Internal mixing kernels used by the conference bridge (conference.c).
+ *
+ * All level values are normalized to 128 (no adjustment), i.e. a sample
+ * is adjusted as (sample * level) >> 7 and then clipped to 16bit.
+ */
+#include <pjmedia/types.h>
+
+PJ_BEGIN_DECL
+
+typedef struct pjmedia_conf_mix_kernel
+{
+    /* Kernel name, for logging. */
+    const char *name;
+
+    /* dst[i] = clip((src[i] * adj_level) >> 7). The dst may be the same
+     * buffer as src. Returns the sum of the absolute value of the
+     * adjusted samples.
+     */
+    pj_int32_t (*adjust_level)(pj_int16_t *dst, const pj_int16_t *src,
+			       unsigned count, unsigned adj_level);
+
+    /* Returns the sum of the absolute value of the samples. */
+    pj_int32_t (*sum_abs)(const pj_int16_t *src, unsigned count);
+
+    /* mix_buf[i] += src[i]. The minimum and maximum value of the mixed
+     * samples are merged into *p_min and *p_max.
+     */
+    void       (*accumulate)(pj_int32_t *mix_buf, const pj_int16_t *src,
+			     unsigned count, pj_int32_t *p_min,
+			     pj_int32_t *p_max);
+
+    /* mix_buf[i] = src[i] */
+    void       (*copy)(pj_int32_t *mix_buf, const pj_int16_t *src,
+		       unsigned count);
+
+    /* dst[i] = clip((mix_buf[i] * adj_level) >> 7). The dst may point to
+     * the start of mix_buf itself (in-place conversion to 16bit). Returns
+     * the sum of the absolute value of the resulting samples.
+     */
+    pj_int32_t (*write_back)(pj_int16_t *dst, const pj_int32_t *mix_buf,
+			     unsigned count, unsigned adj_level);
+
+} pjmedia_conf_mix_kernel;
+
+
+/*
+ * Get the best mixing kernel available for this build. When allow_simd
+ * is PJ_FALSE, the portable scalar kernel is always returned.
+ */
+PJ_DECL(const pjmedia_conf_mix_kernel*)
+pjmedia_conf_mix_get_kernel(pj_bool_t allow_simd);
+
+
+PJ_END_DECL
+
+#endif	/* __PJMEDIA_CONF_MIX_H__ */
@@ -210,6 +210,35 @@ static pj_status_t create_sound_port( pj_pool_t *pool,
     return PJ_SUCCESS;
 }
 
+/*
+ * Initialize conference bridge parameter with default values.
+ */
+PJ_DEF(void) pjmedia_conf_param_default(pjmedia_conf_param *param)
+{
+    pj_bzero(param, sizeof(*param));
+    param->bits_per_sample = 16;
+    param->worker_threads = PJMEDIA_CONF_WORKER_THREADS;
+    param->vad_gate = PJMEDIA_CONF_VAD_GATE;
+    param->vad_threshold = -1;
+    param->max_speakers = PJMEDIA_CONF_MAX_SPEAKERS;
+}
+
+/*
+ * Create conference bridge with the specified parameter. The switch board
+ * doesn't mix audio, so the worker threads and VAD gate settings are
+ * ignored.
+ */
+PJ_DEF(pj_status_t) pjmedia_conf_create2( pj_pool_t *pool,
+					  const pjmedia_conf_param *param,
+					  pjmedia_conf **p_conf )
+{
+    PJ_ASSERT_RETURN(pool && param && p_conf, PJ_EINVAL);
+
+    return pjmedia_conf_create(pool, param->max_slots, param->sampling_rate,
+			       param->channel_count, param->samples_per_frame,
+			       param->bits_per_sample, param->options, p_conf);
+}
+
 /*
  * Create conference bridge.
  */
@@ -29,9 +29,11 @@
 #include <pj/array.h>
 #include <pj/assert.h>
 #include <pj/log.h>
+#include <pj/os.h>
 #include <pj/pool.h>
 #include <pj/string.h>
 #include <pjlib-util/sound_record.h>
+#include "conf_mix.h"
 
 #if !defined(PJMEDIA_CONF_USE_SWITCH_BOARD) || PJMEDIA_CONF_USE_SWITCH_BOARD==0
 
@@ -173,6 +175,22 @@ struct conf_port
     int			 last_mix_adj;	/**< Last adjustment level.	    */
     pj_int32_t		*mix_buf;	/**< Total sum of signal.	    */
 
+    /* When the bridge has worker threads, the frame of this port is read
+     * by one of the workers into this buffer before the mixing starts.
+     * The buffer contains samples at bridge's clock rate, and its size
+     * is equal to samples per frame of the bridge.
+     */
+    pj_int16_t		*rx_frame_buf;	/**< Frame read by the worker.	    */
+    pj_bool_t		 rx_frame_ok;	/**< rx_frame_buf has audio.	    */
+
+    /* Silence detector, only created when the bridge does VAD-gated
+     * mixing. The frame read from this port is only mixed when rx_voiced
+     * is set.
+     */
+    pjmedia_silence_det	*vad;		/**< Silence detector, or NULL.	    */
+    pj_int32_t		 rx_avg_level;	/**< Average level of last frame.   */
+    pj_bool_t		 rx_voiced;	/**< Last frame is to be mixed.	    */
+
     /* Tx buffer is a temporary buffer to be used when there's mismatch 
      * between port's clock rate or ptime with conference's sample rate
      * or ptime. This buffer is used as the source of the sampling rate
@@ -244,6 +262,38 @@ struct pjmedia_conf
     unsigned		  channel_count;/**< Number of channels (1=mono).   */
     unsigned		  samples_per_frame;	/**< Samples per frame.	    */
     unsigned		  bits_per_sample;	/**< Bits per sample.	    */
+    const pjmedia_conf_mix_kernel *mix;	/**< Mixing kernel.		    */
+
+    /* Worker threads, to read the source ports in parallel. */
+    unsigned		  worker_cnt;	/**< Number of worker threads.	    */
+    pj_thread_t		**workers;	/**< Worker threads.		    */
+    pj_sem_t		 *worker_sem;	/**< Wakes up the workers.	    */
+    pj_sem_t		 *done_sem;	/**< Workers have finished.	    */
+    pj_atomic_t		 *rx_next;	/**< Next index in rx_slots.	    */
+    SLOT_TYPE		 *rx_slots;	/**< Ports to read in this tick.    */
+    unsigned		  rx_cnt;	/**< Number of ports in rx_slots.   */
+    pj_bool_t		  quit;		/**< Workers should quit.	    */
+
+    /* VAD-gated mixing. When the number of speakers is limited, or when
+     * there are worker threads, all frames are read into the ports'
+     * rx_frame_buf before any of them is mixed.
+     */
+    pj_bool_t		  vad_gate;	/**< Skip silent ports from mixing. */
+    int			  vad_threshold;/**< Fixed threshold, -1: adaptive. */
+    unsigned		  max_speakers;	/**< Max ports mixed, 0: no limit.  */
+    SLOT_TYPE		 *speaker_slots;/**< The loudest ports in a tick.   */
+    pj_bool_t		  defer_mix;	/**< Read all frames before mixing. */
+
+    /* Dense lists of the ports in use and of the ports that have
+     * listeners (transmitters), so that the clock tick doesn't need to
+     * scan all max_ports slots. The lists are marked as changed whenever
+     * the topology changes, and rebuilt at the start of the next tick.
+     */
+    pj_bool_t		  topology_changed;/**< Lists must be rebuilt.	    */
+    SLOT_TYPE		 *active_slots;	/**< Slots of all ports.	    */
+    unsigned		  active_cnt;	/**< Number of active_slots.	    */
+    SLOT_TYPE		 *tx_slots;	/**< Slots of the transmitters.	    */
+    unsigned		  tx_cnt;	/**< Number of tx_slots.	    */
 
 	void			(*pause_sound)();
 	void			(*resume_sound)();
@@ -424,6 +474,29 @@ static pj_status_t create_conf_port( pj_pool_t *pool,
     PJ_ASSERT_RETURN(conf_port->mix_buf, PJ_ENOMEM);
     conf_port->last_mix_adj = NORMAL_LEVEL;
 
+    /* Create buffer for the frame read before mixing. */
+    if (conf->defer_mix) {
+	conf_port->rx_frame_buf = (pj_int16_t*)
+				  pj_pool_alloc(pool, conf->samples_per_frame *
+					      sizeof(conf_port->rx_frame_buf[0]));
+	PJ_ASSERT_RETURN(conf_port->rx_frame_buf, PJ_ENOMEM);
+    }
+
+    /* Create silence detector for VAD-gated mixing. */
+    conf_port->rx_voiced = PJ_TRUE;
+    if (conf->vad_gate) {
+	status = pjmedia_silence_det_create(pool, conf->clock_rate,
+					    conf->samples_per_frame,
+					    &conf_port->vad);
+	if (status != PJ_SUCCESS)
+	    return status;
+
+	pjmedia_silence_det_set_name(conf_port->vad, "confvad%p");
+
+	if (conf->vad_threshold >= 0)
+	    pjmedia_silence_det_set_fixed(conf_port->vad, conf->vad_threshold);
+    }
+
 
     /* Done */
     *p_conf_port = conf_port;
@@ -533,10 +606,27 @@ static pj_status_t create_sound_port( pj_pool_t *pool,
      /* Add the port to the bridge */
     conf->ports[0] = conf_port;
     conf->port_cnt++;
+    conf->topology_changed = PJ_TRUE;
 
     return PJ_SUCCESS;
 }
 
+/* Forward declaration */
+static int conf_worker_thread(void *arg);
+
+/*
+ * Initialize conference bridge parameter with default values.
+ */
+PJ_DEF(void) pjmedia_conf_param_default(pjmedia_conf_param *param)
+{
+    pj_bzero(param, sizeof(*param));
+    param->bits_per_sample = 16;
+    param->worker_threads = PJMEDIA_CONF_WORKER_THREADS;
+    param->vad_gate = PJMEDIA_CONF_VAD_GATE;
+    param->vad_threshold = -1;
+    param->max_speakers = PJMEDIA_CONF_MAX_SPEAKERS;
+}
+
 /*
  * Create conference bridge.
  */
@@ -548,16 +638,48 @@ PJ_DEF(pj_status_t) pjmedia_conf_create( pj_pool_t *pool,
 					 unsigned bits_per_sample,
 					 unsigned options,
 					 pjmedia_conf **p_conf )
+{
+    pjmedia_conf_param param;
+
+    pjmedia_conf_param_default(&param);
+    param.max_slots = max_ports;
+    param.sampling_rate = clock_rate;
+    param.channel_count = channel_count;
+    param.samples_per_frame = samples_per_frame;
+    param.bits_per_sample = bits_per_sample;
+    param.options = options;
+
+    return pjmedia_conf_create2(pool, &param, p_conf);
+}
+
+/*
+ * Create conference bridge with the specified parameter.
+ */
+PJ_DEF(pj_status_t) pjmedia_conf_create2( pj_pool_t *pool,
+					  const pjmedia_conf_param *param,
+					  pjmedia_conf **p_conf )
 {
     pjmedia_conf *conf;
     const pj_str_t name = { "Conf", 4 };
+    unsigned max_ports, clock_rate, channel_count, samples_per_frame;
+    unsigned bits_per_sample, options, i;
     pj_status_t status;
 
+    PJ_ASSERT_RETURN(pool && param && p_conf, PJ_EINVAL);
+
+    max_ports = param->max_slots;
+    clock_rate = param->sampling_rate;
+    channel_count = param->channel_count;
+    samples_per_frame = param->samples_per_frame;
+    bits_per_sample = param->bits_per_sample;
+    options = param->options;
+
     /* Can only accept 16bits per sample, for now.. */
     PJ_ASSERT_RETURN(bits_per_sample == 16, PJ_EINVAL);
 
-    PJ_LOG(5,(THIS_FILE, "Creating conference bridge with %d ports",
-	      max_ports));
+    PJ_LOG(5,(THIS_FILE, "Creating conference bridge with %d ports, "
+			 "%d worker threads",
+	      max_ports, param->worker_threads));
 
     /* Create and init conf structure. */
     conf = PJ_POOL_ZALLOC_T(pool, pjmedia_conf);
@@ -567,12 +689,44 @@ PJ_DEF(pj_status_t) pjmedia_conf_create( pj_pool_t *pool,
 		  pj_pool_zalloc(pool, max_ports*sizeof(void*));
     PJ_ASSERT_RETURN(conf->ports, PJ_ENOMEM);
 
+    conf->active_slots = (SLOT_TYPE*)
+			 pj_pool_calloc(pool, max_ports, sizeof(SLOT_TYPE));
+    PJ_ASSERT_RETURN(conf->active_slots, PJ_ENOMEM);
+
+    conf->tx_slots = (SLOT_TYPE*)
+		     pj_pool_calloc(pool, max_ports, sizeof(SLOT_TYPE));
+    PJ_ASSERT_RETURN(conf->tx_slots, PJ_ENOMEM);
+
     conf->options = options;
     conf->max_ports = max_ports;
     conf->clock_rate = clock_rate;
     conf->channel_count = channel_count;
     conf->samples_per_frame = samples_per_frame;
     conf->bits_per_sample = bits_per_sample;
+    conf->worker_cnt = param->worker_threads;
+    conf->vad_gate = param->vad_gate;
+    conf->vad_threshold = param->vad_threshold;
+    conf->max_speakers = param->vad_gate ? param->max_speakers : 0;
+    conf->defer_mix = (conf->worker_cnt || conf->max_speakers);
+
+    if (conf->defer_mix) {
+	conf->rx_slots = (SLOT_TYPE*)
+			 pj_pool_calloc(pool, max_ports, sizeof(SLOT_TYPE));
+	PJ_ASSERT_RETURN(conf->rx_slots, PJ_ENOMEM);
+    }
+
+    if (conf->max_speakers) {
+	conf->speaker_slots = (SLOT_TYPE*)
+			      pj_pool_calloc(pool, conf->max_speakers,
+					     sizeof(SLOT_TYPE));
+	PJ_ASSERT_RETURN(conf->speaker_slots, PJ_ENOMEM);
+    }
+
+    /* Select mixing kernel. */
+    conf->mix = pjmedia_conf_mix_get_kernel(
+			PJMEDIA_CONF_USE_SIMD_MIX &&
+			(options & PJMEDIA_CONF_NO_SIMD_MIX) == 0);
+    PJ_LOG(5,(THIS_FILE, "Using %s mixing kernel", conf->mix->name));
 
     
     /* Create and initialize the master port interface. */
@@ -605,6 +759,31 @@ PJ_DEF(pj_status_t) pjmedia_conf_create( pj_pool_t *pool,
 	return status;
     }
 
+    /* Create worker threads. */
+    if (conf->worker_cnt) {
+	conf->workers = (pj_thread_t**)
+			pj_pool_calloc(pool, conf->worker_cnt,
+				       sizeof(pj_thread_t*));
+
+	status = pj_sem_create(pool, "confw", 0, conf->worker_cnt,
+			       &conf->worker_sem);
+	if (status == PJ_SUCCESS)
+	    status = pj_sem_create(pool, "confd", 0, conf->worker_cnt,
+				   &conf->done_sem);
+	if (status == PJ_SUCCESS)
+	    status = pj_atomic_create(pool, 0, &conf->rx_next);
+
+	for (i=0; i<conf->worker_cnt && status==PJ_SUCCESS; ++i) {
+	    status = pj_thread_create(pool, "confw%p", &conf_worker_thread,
+				      conf, 0, 0, &conf->workers[i]);
+	}
+
+	if (status != PJ_SUCCESS) {
+	    pjmedia_conf_destroy(conf);
+	    return status;
+	}
+    }
+
     /* If sound device was created, connect sound device to the
      * master port.
      */
@@ -666,6 +845,34 @@ PJ_DEF(pj_status_t) pjmedia_conf_destroy( pjmedia_conf *conf )
 	conf->snd_dev_port = NULL;
     }
 
+    /* Stop worker threads. */
+    if (conf->workers) {
+	conf->quit = PJ_TRUE;
+	for (i=0; i<conf->worker_cnt; ++i) {
+	    if (conf->workers[i])
+		pj_sem_post(conf->worker_sem);
+	}
+	for (i=0; i<conf->worker_cnt; ++i) {
+	    if (conf->workers[i]) {
+		pj_thread_join(conf->workers[i]);
+		pj_thread_destroy(conf->workers[i]);
+		conf->workers[i] = NULL;
+	    }
+	}
+    }
+    if (conf->worker_sem) {
+	pj_sem_destroy(conf->worker_sem);
+	conf->worker_sem = NULL;
+    }
+    if (conf->done_sem) {
+	pj_sem_destroy(conf->done_sem);
+	conf->done_sem = NULL;
+    }
+    if (conf->rx_next) {
+	pj_atomic_destroy(conf->rx_next);
+	conf->rx_next = NULL;
+    }
+
     /* Destroy delay buf of all (passive) ports. */
     for (i=0, ci=0; i<conf->max_ports && ci<conf->port_cnt; ++i) {
 	struct conf_port *cport;
@@ -810,6 +1017,7 @@ PJ_DEF(pj_status_t) pjmedia_conf_add_port( pjmedia_conf *conf,
     /* Put the port. */
     conf->ports[index] = conf_port;
     conf->port_cnt++;
+    conf->topology_changed = PJ_TRUE;
 
     /* Done. */
     if (p_port) {
@@ -912,6 +1120,7 @@ PJ_DEF(pj_status_t) pjmedia_conf_add_passive_port( pjmedia_conf *conf,
     /* Put the port. */
     conf->ports[index] = conf_port;
     conf->port_cnt++;
+    conf->topology_changed = PJ_TRUE;
 
     /* Done. */
     if (p_slot)
@@ -1008,6 +1217,7 @@ PJ_DEF(pj_status_t) pjmedia_conf_connect_port( pjmedia_conf *conf,
 	++conf->connect_cnt;
 	++src_port->listener_cnt;
 	++dst_port->transmitter_cnt;
+	conf->topology_changed = PJ_TRUE;
 
         PJ_LOG(4,(THIS_FILE,
         "conf->connect_cnt=%d, src_port->listener_cnt=%d, dst_port->transmitter_cnt=%d",
@@ -1078,9 +1288,12 @@ PJ_DEF(pj_status_t) pjmedia_conf_disconnect_port( pjmedia_conf *conf,
 		  dst_port->transmitter_cnt < conf->max_ports);
 	pj_array_erase(src_port->listener_slots, sizeof(SLOT_TYPE), 
 		       src_port->listener_cnt, i);
+	pj_array_erase(src_port->listener_adj_level, sizeof(unsigned),
+		       src_port->listener_cnt, i);
 	--conf->connect_cnt;
 	--src_port->listener_cnt;
 	--dst_port->transmitter_cnt;
+	conf->topology_changed = PJ_TRUE;
 
 	if(src_slot == 0 && src_port->listener_cnt == 0)
         stop_sound = PJ_TRUE;
@@ -1172,6 +1385,8 @@ PJ_DEF(pj_status_t) pjmedia_conf_remove_port( pjmedia_conf *conf,
 	    if (src_port->listener_slots[j] == port) {
 		pj_array_erase(src_port->listener_slots, sizeof(SLOT_TYPE),
 			       src_port->listener_cnt, j);
+		pj_array_erase(src_port->listener_adj_level, sizeof(unsigned),
+			       src_port->listener_cnt, j);
 		pj_assert(conf->connect_cnt > 0);
 		--conf->connect_cnt;
 		--src_port->listener_cnt;
@@ -1206,6 +1421,7 @@ PJ_DEF(pj_status_t) pjmedia_conf_remove_port( pjmedia_conf *conf,
     /* Remove the port. */
     conf->ports[port] = NULL;
     --conf->port_cnt;
+    conf->topology_changed = PJ_TRUE;
 
     pj_mutex_unlock(conf->mutex);
 
@@ -1639,7 +1855,7 @@ static pj_status_t write_port(pjmedia_conf *conf, struct conf_port *cport,
 			      pjmedia_frame_type *frm_type)
 {
     pj_int16_t *buf;
-    unsigned j, ts;
+    unsigned ts;
     pj_status_t status;
     pj_int32_t adj_level;
     pj_int32_t tx_level;
@@ -1724,31 +1940,9 @@ static pj_status_t write_port(pjmedia_conf *conf, struct conf_port *cport,
     adj_level = cport->tx_adj_level * cport->mix_adj;
     adj_level >>= 7;
 
-    tx_level = 0;
-
-    if (adj_level != NORMAL_LEVEL) {
-	for (j=0; j<conf->samples_per_frame; ++j) {
-	    pj_int32_t itemp = cport->mix_buf[j];
-
-	    /* Adjust the level */
-	    /*itemp = itemp * adj_level / NORMAL_LEVEL;*/
-	    itemp = (itemp * adj_level) >> 7;
-
-	    /* Clip the signal if it's too loud */
-	    if (itemp > MAX_LEVEL) itemp = MAX_LEVEL;
-	    else if (itemp < MIN_LEVEL) itemp = MIN_LEVEL;
-
-	    /* Put back in the buffer. */
-	    buf[j] = (pj_int16_t) itemp;
-
-	    tx_level += (buf[j]>=0? buf[j] : -buf[j]);
-	}
-    } else {
-	for (j=0; j<conf->samples_per_frame; ++j) {
-	    buf[j] = (pj_int16_t) cport->mix_buf[j];
-	    tx_level += (buf[j]>=0? buf[j] : -buf[j]);
-	}
-    }
+    /* Adjust the level, clip and put back in the buffer. */
+    tx_level = conf->mix->write_back(buf, cport->mix_buf,
+				     conf->samples_per_frame, adj_level);
 
     tx_level /= conf->samples_per_frame;
 
@@ -1871,6 +2065,347 @@ static pj_status_t write_port(pjmedia_conf *conf, struct conf_port *cport,
 }
 
 
+/*
+ * Get a frame from the port in the specified slot into buf, and adjust
+ * its RX level. Returns PJ_TRUE if there is audio frame to be mixed.
+ *
+ * When the bridge has worker threads, this is called by the workers (and
+ * the clock thread) in parallel, each for different ports.
+ */
+static pj_bool_t get_rx_frame(pjmedia_conf *conf, unsigned slot,
+			      pj_int16_t *buf)
+{
+    struct conf_port *conf_port = conf->ports[slot];
+    pj_int32_t level = 0;
+
+    /* Get frame from this port.
+     * For passive ports, get the frame from the delay_buf.
+     * For other ports, get the frame from the port.
+     */
+    if (conf_port->delay_buf != NULL) {
+	pj_status_t status;
+
+	status = pjmedia_delay_buf_get(conf_port->delay_buf, buf);
+	if (status != PJ_SUCCESS) {
+	    conf_port->rx_level = 0;
+	    return PJ_FALSE;
+	}
+
+    } else {
+
+	pj_status_t status;
+	pjmedia_frame_type frame_type;
+
+	status = read_port(conf, conf_port, buf,
+			   conf->samples_per_frame, &frame_type);
+
+	if (status != PJ_SUCCESS) {
+	    /* bennylp: why do we need this????
+	     * Also see comments on similar issue with write_port().
+	    PJ_LOG(4,(THIS_FILE, "Port %.*s get_frame() returned %d. "
+				 "Port is now disabled",
+				 (int)conf_port->name.slen,
+				 conf_port->name.ptr,
+				 status));
+	    conf_port->rx_setting = PJMEDIA_PORT_DISABLE;
+	     */
+	    conf_port->rx_level = 0;
+	    return PJ_FALSE;
+	}
+
+	/* Check that the port is not removed when we call get_frame() */
+	if (conf->ports[slot] == NULL) {
+	    conf_port->rx_level = 0;
+	    return PJ_FALSE;
+	}
+
+
+	/* Ignore if we didn't get any frame */
+	if (frame_type != PJMEDIA_FRAME_TYPE_AUDIO) {
+	    conf_port->rx_level = 0;
+	    return PJ_FALSE;
+	}
+    }
+
+    /* Adjust the RX level from this port
+     * and calculate the average level at the same time.
+     */
+    if (conf_port->rx_adj_level != NORMAL_LEVEL) {
+	level = conf->mix->adjust_level(buf, buf,
+					conf->samples_per_frame,
+					conf_port->rx_adj_level);
+    } else {
+	level = conf->mix->sum_abs(buf, conf->samples_per_frame);
+    }
+
+    level /= conf->samples_per_frame;
+
+    /* With VAD-gated mixing, only mix the frame if the port is talking. */
+    conf_port->rx_avg_level = level;
+    if (conf_port->vad)
+	conf_port->rx_voiced = !pjmedia_silence_det_apply(conf_port->vad,
+							  level);
+
+    /* Convert level to 8bit complement ulaw */
+    level = pjmedia_linear2ulaw(level) ^ 0xff;
+
+    /* Put this level to port's last RX level. */
+    conf_port->rx_level = level;
+
+    // Ticket #671: Skipping very low audio signal may cause noise
+    // to be generated in the remote end by some hardphones.
+    /* Skip processing frame if level is zero */
+    //if (level == 0)
+    //    return PJ_FALSE;
+
+    return PJ_TRUE;
+}
+
+
+/*
+ * Add the frame received from the port to the mix buffer of all its
+ * listeners.
+ */
+static void mix_rx_frame(pjmedia_conf *conf, struct conf_port *conf_port,
+			 const pj_int16_t *p_in)
+{
+    unsigned cj;
+
+    for (cj=0; cj < conf_port->listener_cnt; ++cj)
+    {
+	struct conf_port *listener;
+	pj_int32_t *mix_buf;
+	const pj_int16_t *p_in_conn_leveled;
+
+	listener = conf->ports[conf_port->listener_slots[cj]];
+
+	/* Skip if this listener doesn't want to receive audio */
+	if (listener->tx_setting != PJMEDIA_PORT_ENABLE)
+	    continue;
+
+	mix_buf = listener->mix_buf;
+
+	/* apply connection level, if not normal */
+	if (conf_port->listener_adj_level[cj] != NORMAL_LEVEL) {
+	    conf->mix->adjust_level(conf_port->adj_level_buf, p_in,
+				    conf->samples_per_frame,
+				    conf_port->listener_adj_level[cj]);
+
+	    /* take the leveled frame */
+	    p_in_conn_leveled = conf_port->adj_level_buf;
+	} else {
+	    /* take the frame as-is */
+	    p_in_conn_leveled = p_in;
+	}
+
+	if (listener->transmitter_cnt > 1) {
+	    /* Mixing signals,
+	     * and calculate appropriate level adjustment if there is
+	     * any overflowed level in the mixed signal.
+	     */
+	    pj_int32_t mix_buf_min = 0;
+	    pj_int32_t mix_buf_max = 0;
+
+	    conf->mix->accumulate(mix_buf, p_in_conn_leveled,
+				  conf->samples_per_frame,
+				  &mix_buf_min, &mix_buf_max);
+
+	    /* Check if normalization adjustment needed. */
+	    if (mix_buf_min < MIN_LEVEL || mix_buf_max > MAX_LEVEL) {
+		int tmp_adj;
+
+		if (-mix_buf_min > mix_buf_max)
+		    mix_buf_max = -mix_buf_min;
+
+		/* NORMAL_LEVEL * MAX_LEVEL / mix_buf_max; */
+		tmp_adj = (MAX_LEVEL<<7) / mix_buf_max;
+		if (tmp_adj < listener->mix_adj)
+		    listener->mix_adj = tmp_adj;
+	    }
+	} else {
+	    /* Only 1 transmitter:
+	     * just copy the samples to the mix buffer
+	     * no mixing and level adjustment needed
+	     */
+	    conf->mix->copy(mix_buf, p_in_conn_leveled,
+			    conf->samples_per_frame);
+	}
+    } /* loop the listeners of conf port */
+}
+
+
+/*
+ * Read the ports listed in conf->rx_slots until there is none left.
+ * Called by the worker threads and the clock thread.
+ */
+static void read_rx_slots(pjmedia_conf *conf)
+{
+    for (;;) {
+	unsigned idx, slot;
+	struct conf_port *conf_port;
+
+	idx = (unsigned)pj_atomic_inc_and_get(conf->rx_next) - 1;
+	if (idx >= conf->rx_cnt)
+	    break;
+
+	slot = conf->rx_slots[idx];
+	conf_port = conf->ports[slot];
+	conf_port->rx_frame_ok = get_rx_frame(conf, slot,
+					      conf_port->rx_frame_buf);
+    }
+}
+
+
+/*
+ * Worker thread.
+ */
+static int conf_worker_thread(void *arg)
+{
+    pjmedia_conf *conf = (pjmedia_conf*) arg;
+
+    for (;;) {
+	pj_sem_wait(conf->worker_sem);
+
+	if (conf->quit)
+	    break;
+
+	read_rx_slots(conf);
+
+	pj_sem_post(conf->done_sem);
+    }
+
+    return 0;
+}
+
+
+/*
+ * Read the ports listed in conf->rx_slots using the worker threads, and
+ * wait until all of them have been read.
+ */
+static void read_rx_slots_parallel(pjmedia_conf *conf)
+{
+    unsigned i, wake_cnt;
+
+    pj_atomic_set(conf->rx_next, 0);
+
+    /* The clock thread reads too, so don't wake up more workers than
+     * needed.
+     */
+    wake_cnt = conf->rx_cnt - 1;
+    if (wake_cnt > conf->worker_cnt)
+	wake_cnt = conf->worker_cnt;
+
+    for (i=0; i<wake_cnt; ++i)
+	pj_sem_post(conf->worker_sem);
+
+    read_rx_slots(conf);
+
+    for (i=0; i<wake_cnt; ++i)
+	pj_sem_wait(conf->done_sem);
+}
+
+
+/*
+ * Read the ports listed in conf->rx_slots into their rx_frame_buf.
+ */
+static void read_rx_slots_deferred(pjmedia_conf *conf)
+{
+    unsigned i;
+
+    if (conf->worker_cnt) {
+	read_rx_slots_parallel(conf);
+	return;
+    }
+
+    for (i=0; i<conf->rx_cnt; ++i) {
+	struct conf_port *conf_port = conf->ports[conf->rx_slots[i]];
+
+	/* The port may be removed by get_frame() of previous port */
+	if (!conf_port) 
+	    continue;
+
+	conf_port->rx_frame_ok = get_rx_frame(conf, conf->rx_slots[i],
+					      conf_port->rx_frame_buf);
+    }
+}
+
+
+/*
+ * Limit the number of ports to be mixed to the max_speakers loudest
+ * ports, by clearing rx_voiced of the others. When levels are equal, the
+ * port with lower slot number wins.
+ */
+static void select_speakers(pjmedia_conf *conf)
+{
+    unsigned i, j, cnt = 0;
+
+    for (i=0; i<conf->rx_cnt; ++i) {
+	SLOT_TYPE slot = conf->rx_slots[i];
+	struct conf_port *conf_port = conf->ports[slot];
+
+	if (!conf_port || !conf_port->rx_frame_ok || !conf_port->rx_voiced)
+	    continue;
+
+	/* Full and not louder than the quietest speaker so far. */
+	if (cnt == conf->max_speakers) {
+	    struct conf_port *last;
+
+	    last = conf->ports[conf->speaker_slots[cnt-1]];
+	    if (conf_port->rx_avg_level <= last->rx_avg_level) {
+		conf_port->rx_voiced = PJ_FALSE;
+		continue;
+	    }
+
+	    /* Drop the quietest one. */
+	    last->rx_voiced = PJ_FALSE;
+	    --cnt;
+	}
+
+	/* Insert, keeping speaker_slots sorted by level, loudest first. */
+	for (j=cnt; j>0; --j) {
+	    struct conf_port *prev = conf->ports[conf->speaker_slots[j-1]];
+
+	    if (prev->rx_avg_level >= conf_port->rx_avg_level)
+		break;
+	    conf->speaker_slots[j] = conf->speaker_slots[j-1];
+	}
+	conf->speaker_slots[j] = slot;
+	++cnt;
+    }
+}
+
+
+/*
+ * Rebuild the list of active ports and transmitters after the topology
+ * has changed. Must be called with the mutex held.
+ */
+static void update_port_lists(pjmedia_conf *conf)
+{
+    unsigned i, ci;
+
+    conf->active_cnt = 0;
+    conf->tx_cnt = 0;
+
+    for (i=0, ci=0; i<conf->max_ports && ci<conf->port_cnt; ++i) {
+	struct conf_port *conf_port = conf->ports[i];
+
+	if (!conf_port)
+	    continue;
+
+	++ci;
+
+	conf->active_slots[conf->active_cnt++] = i;
+
+	if (conf_port->listener_cnt)
+	    conf->tx_slots[conf->tx_cnt++] = i;
+	else
+	    conf_port->rx_level = 0;
+    }
+
+    conf->topology_changed = PJ_FALSE;
+}
+
+
 /*
  * Player callback.
  */
@@ -1879,8 +2414,7 @@ static pj_status_t get_frame(pjmedia_port *this_port,
 {
     pjmedia_conf *conf = (pjmedia_conf*) this_port->port_data.pdata;
     pjmedia_frame_type speaker_frame_type = PJMEDIA_FRAME_TYPE_NONE;
-    unsigned ci, cj, i, j;
-    pj_int16_t *p_in;
+    unsigned i;
     
     TRACE_((THIS_FILE, "- clock -"));
 
@@ -1891,19 +2425,23 @@ static pj_status_t get_frame(pjmedia_port *this_port,
     /* Must lock mutex */
     pj_mutex_lock(conf->mutex);
 
+    /* Rebuild the port lists if ports or connections have changed. This
+     * is only done here, so the lists are not modified while we iterate
+     * them below (e.g. when a port callback calls the bridge API).
+     */
+    if (conf->topology_changed)
+	update_port_lists(conf);
+
     /* Reset port source count. We will only reset port's mix
      * buffer when we have someone transmitting to it.
      */
-    for (i=0, ci=0; i<conf->max_ports && ci < conf->port_cnt; ++i) {
-	struct conf_port *conf_port = conf->ports[i];
+    for (i=0; i<conf->active_cnt; ++i) {
+	struct conf_port *conf_port = conf->ports[conf->active_slots[i]];
 
-	/* Skip empty port. */
+	/* Skip port removed during this tick. */
 	if (!conf_port)
 	    continue;
 
-	/* Var "ci" is to count how many ports have been visited so far. */
-	++ci;
-
 	/* Reset buffer (only necessary if the port has transmitter) and
 	 * reset auto adjustment level for mixed signal.
 	 */
@@ -1917,17 +2455,15 @@ static pj_status_t get_frame(pjmedia_port *this_port,
     /* Get frames from all ports, and "mix" the signal 
      * to mix_buf of all listeners of the port.
      */
-    for (i=0, ci=0; i < conf->max_ports && ci < conf->port_cnt; ++i) {
-	struct conf_port *conf_port = conf->ports[i];
-	pj_int32_t level = 0;
+    conf->rx_cnt = 0;
+    for (i=0; i<conf->tx_cnt; ++i) {
+	SLOT_TYPE slot = conf->tx_slots[i];
+	struct conf_port *conf_port = conf->ports[slot];
 
-	/* Skip empty port. */
+	/* Skip port removed during this tick. */
 	if (!conf_port)
 	    continue;
 
-	/* Var "ci" is to count how many ports have been visited so far. */
-	++ci;
-
 	/* Skip if we're not allowed to receive from this port. */
 	if (conf_port->rx_setting == PJMEDIA_PORT_DISABLE) {
 	    conf_port->rx_level = 0;
@@ -1940,208 +2476,50 @@ static pj_status_t get_frame(pjmedia_port *this_port,
 	    continue;
 	}
 
-	/* Get frame from this port.
-	 * For passive ports, get the frame from the delay_buf.
-	 * For other ports, get the frame from the port.
-	 */
-	if (conf_port->delay_buf != NULL) {
-	    pj_status_t status;
-
-	    status = pjmedia_delay_buf_get(conf_port->delay_buf,
-				  (pj_int16_t*)frame->buf);
-	    if (status != PJ_SUCCESS) {
-		conf_port->rx_level = 0;
-		continue;
-	    }
-
-	} else {
-
-	    pj_status_t status;
-	    pjmedia_frame_type frame_type;
-
-	    status = read_port(conf, conf_port, (pj_int16_t*)frame->buf,
-			       conf->samples_per_frame, &frame_type);
-
-	    if (status != PJ_SUCCESS) {
-		/* bennylp: why do we need this????
-		 * Also see comments on similar issue with write_port().
-		PJ_LOG(4,(THIS_FILE, "Port %.*s get_frame() returned %d. "
-				     "Port is now disabled",
-				     (int)conf_port->name.slen,
-				     conf_port->name.ptr,
-				     status));
-		conf_port->rx_setting = PJMEDIA_PORT_DISABLE;
-		 */
-		conf_port->rx_level = 0;
-		continue;
-	    }
-
-	    /* Check that the port is not removed when we call get_frame() */
-	    if (conf->ports[i] == NULL) {
-		conf_port->rx_level = 0;
-		continue;
-	    }
-
-
-	    /* Ignore if we didn't get any frame */
-	    if (frame_type != PJMEDIA_FRAME_TYPE_AUDIO) {
-		conf_port->rx_level = 0;
-		continue;
-	    }
-	}
-
-	p_in = (pj_int16_t*) frame->buf;
-
-	/* Adjust the RX level from this port
-	 * and calculate the average level at the same time.
-	 */
-	if (conf_port->rx_adj_level != NORMAL_LEVEL) {
-	    for (j=0; j<conf->samples_per_frame; ++j) {
-		/* For the level adjustment, we need to store the sample to
-		 * a temporary 32bit integer value to avoid overflowing the
-		 * 16bit sample storage.
-		 */
-		pj_int32_t itemp;
-
-		itemp = p_in[j];
-		/*itemp = itemp * adj / NORMAL_LEVEL;*/
-		/* bad code (signed/unsigned badness):
-		 *  itemp = (itemp * conf_port->rx_adj_level) >> 7;
-		 */
-		itemp *= conf_port->rx_adj_level;
-		itemp >>= 7;
-
-		/* Clip the signal if it's too loud */
-		if (itemp > MAX_LEVEL) itemp = MAX_LEVEL;
-		else if (itemp < MIN_LEVEL) itemp = MIN_LEVEL;
-
-		p_in[j] = (pj_int16_t) itemp;
-		level += (p_in[j]>=0? p_in[j] : -p_in[j]);
-	    }
-	} else {
-	    for (j=0; j<conf->samples_per_frame; ++j) {
-		level += (p_in[j]>=0? p_in[j] : -p_in[j]);
-	    }
+	/* The port is read later, before mixing starts. */
+	if (conf->defer_mix) {
+	    conf->rx_slots[conf->rx_cnt++] = slot;
+	    continue;
 	}
 
-	level /= conf->samples_per_frame;
-
-	/* Convert level to 8bit complement ulaw */
-	level = pjmedia_linear2ulaw(level) ^ 0xff;
-
-	/* Put this level to port's last RX level. */
-	conf_port->rx_level = level;
-
-	// Ticket #671: Skipping very low audio signal may cause noise
-	// to be generated in the remote end by some hardphones.
-	/* Skip processing frame if level is zero */
-	//if (level == 0)
-	//    continue;
-
-	/* Add the signal to all listeners. */
-	for (cj=0; cj < conf_port->listener_cnt; ++cj)
+	if (get_rx_frame(conf, slot, (pj_int16_t*)frame->buf) &&
+	    conf_port->rx_voiced)
 	{
-	    struct conf_port *listener;
-	    pj_int32_t *mix_buf;
-	    pj_int16_t *p_in_conn_leveled;
-
-	    listener = conf->ports[conf_port->listener_slots[cj]];
-
-	    /* Skip if this listener doesn't want to receive audio */
-	    if (listener->tx_setting != PJMEDIA_PORT_ENABLE)
-		continue;
+	    mix_rx_frame(conf, conf_port, (pj_int16_t*)frame->buf);
+	}
 
-	    mix_buf = listener->mix_buf;
-
-	    /* apply connection level, if not normal */
-	    if (conf_port->listener_adj_level[cj] != NORMAL_LEVEL) {
-		unsigned k = 0;
-		for (; k < conf->samples_per_frame; ++k) {
-		    /* For the level adjustment, we need to store the sample to
-		     * a temporary 32bit integer value to avoid overflowing the
-		     * 16bit sample storage.
-		     */
-		    pj_int32_t itemp;
-
-		    itemp = p_in[k];
-		    /*itemp = itemp * adj / NORMAL_LEVEL;*/
-		    /* bad code (signed/unsigned badness):
-		     *  itemp = (itemp * conf_port->listsener_adj_level) >> 7;
-		     */
-		    itemp *= conf_port->listener_adj_level[cj];
-		    itemp >>= 7;
-
-		    /* Clip the signal if it's too loud */
-		    if (itemp > MAX_LEVEL) itemp = MAX_LEVEL;
-		    else if (itemp < MIN_LEVEL) itemp = MIN_LEVEL;
-
-		    conf_port->adj_level_buf[k] = (pj_int16_t)itemp;
-		}
+    } /* loop of transmitting ports */
 
-		/* take the leveled frame */
-		p_in_conn_leveled = conf_port->adj_level_buf;
-	    } else {
-		/* take the frame as-is */
-		p_in_conn_leveled = p_in;
-	    }
-
-	    if (listener->transmitter_cnt > 1) {
-		/* Mixing signals,
-		 * and calculate appropriate level adjustment if there is
-		 * any overflowed level in the mixed signal.
-		 */
-		unsigned k, samples_per_frame = conf->samples_per_frame;
-		pj_int32_t mix_buf_min = 0;
-		pj_int32_t mix_buf_max = 0;
-
-		for (k = 0; k < samples_per_frame; ++k) {
-		    mix_buf[k] += p_in_conn_leveled[k];
-		    if (mix_buf[k] < mix_buf_min)
-			mix_buf_min = mix_buf[k];
-		    if (mix_buf[k] > mix_buf_max)
-			mix_buf_max = mix_buf[k];
-		}
+    /* Read the ports (in parallel when there are worker threads), pick
+     * the loudest speakers, then mix the frames in the order of the ports.
+     */
+    if (conf->rx_cnt) {
+	read_rx_slots_deferred(conf);
 
-		/* Check if normalization adjustment needed. */
-		if (mix_buf_min < MIN_LEVEL || mix_buf_max > MAX_LEVEL) {
-		    int tmp_adj;
+	if (conf->max_speakers)
+	    select_speakers(conf);
 
-		    if (-mix_buf_min > mix_buf_max)
-			mix_buf_max = -mix_buf_min;
+	for (i=0; i<conf->rx_cnt; ++i) {
+	    struct conf_port *conf_port = conf->ports[conf->rx_slots[i]];
 
-		    /* NORMAL_LEVEL * MAX_LEVEL / mix_buf_max; */
-		    tmp_adj = (MAX_LEVEL<<7) / mix_buf_max;
-		    if (tmp_adj < listener->mix_adj)
-			listener->mix_adj = tmp_adj;
-		}
-	    } else {
-		/* Only 1 transmitter:
-		 * just copy the samples to the mix buffer
-		 * no mixing and level adjustment needed
-		 */
-		unsigned k, samples_per_frame = conf->samples_per_frame;
-
-		for (k = 0; k < samples_per_frame; ++k) {
-		    mix_buf[k] = p_in_conn_leveled[k];
-		}
-	    }
-	} /* loop the listeners of conf port */
-    } /* loop of all conf ports */
+	    if (conf_port && conf_port->rx_frame_ok && conf_port->rx_voiced)
+		mix_rx_frame(conf, conf_port, conf_port->rx_frame_buf);
+	}
+    }
 
     /* Time for all ports to transmit whetever they have in their
      * buffer. 
      */
-    for (i=0, ci=0; i<conf->max_ports && ci<conf->port_cnt; ++i) {
-	struct conf_port *conf_port = conf->ports[i];
+    for (i=0; i<conf->active_cnt; ++i) {
+	SLOT_TYPE slot = conf->active_slots[i];
+	struct conf_port *conf_port = conf->ports[slot];
 	pjmedia_frame_type frm_type;
 	pj_status_t status;
 
+	/* Skip port removed during this tick. */
 	if (!conf_port)
 	    continue;
 
-	/* Var "ci" is to count how many ports have been visited. */
-	++ci;
-
 	status = write_port( conf, conf_port, &frame->timestamp,
 			     &frm_type);
 	if (status != PJ_SUCCESS) {
@@ -2164,7 +2542,7 @@ static pj_status_t get_frame(pjmedia_port *this_port,
 	/* Set the type of frame to be returned to sound playback
 	 * device.
 	 */
-	if (i == 0)
+	if (slot == 0)
 	    speaker_frame_type = frm_type;
     }
 
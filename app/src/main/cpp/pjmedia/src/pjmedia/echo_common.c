@@ -19,25 +19,31 @@
  */
 
 #include <pjmedia/echo.h>
-#include <pjmedia/delaybuf.h>
 #include <pjmedia/frame.h>
 #include <pjmedia/errno.h>
 #include <pj/assert.h>
-#include <pj/list.h>
 #include <pj/log.h>
 #include <pj/math.h>
+#include <pj/os.h>
 #include <pj/pool.h>
+#include <pj/string.h>
 #include "echo_internal.h"
 
 #define THIS_FILE   "echo_common.c"
 
-typedef struct ec_operations ec_operations;
+/* The reference ring indices are shared by the playback and the capture
+ * thread, each index is only written by one of them. The reset request
+ * is written by any thread and cleared by capture.
+ */
+#if defined(__GNUC__)
+#   define REF_LOAD(p)	    __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#   define REF_STORE(p, v)  __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#else
+#   define REF_LOAD(p)	    (*(volatile pj_uint32_t*)(p))
+#   define REF_STORE(p, v)  (*(volatile pj_uint32_t*)(p) = (v))
+#endif
 
-struct frame
-{
-    PJ_DECL_LIST_MEMBER(struct frame);
-    short   buf[1];
-};
+typedef struct ec_operations ec_operations;
 
 struct pjmedia_echo_state
 {
@@ -47,12 +53,25 @@ struct pjmedia_echo_state
     void	    *state;
     ec_operations   *op;
 
-    pj_bool_t	     lat_ready;	    /* lat_buf has been filled in.	    */
-    struct frame     lat_buf;	    /* Frame queue for delayed playback	    */
-    struct frame     lat_free;	    /* Free frame list.			    */
-
-    pjmedia_delay_buf	*delay_buf;
-    pj_int16_t	    *frm_buf;
+    /* Far-end reference ring, written by pjmedia_echo_playback() and
+     * read in place by pjmedia_echo_capture().
+     */
+    pj_int16_t	    *ref_buf;	    /* ref_cnt frames			    */
+    pj_timestamp    *ref_ts;	    /* When each frame was played	    */
+    unsigned	     ref_cnt;	    /* Number of frames, power of two	    */
+    unsigned	     ref_latency;   /* Target read distance, in frames	    */
+    unsigned	     ref_drift;	    /* Tolerated distance drift, in frames  */
+    pj_uint32_t	     ref_wr;	    /* Only written by playback		    */
+    pj_uint32_t	     ref_rd;	    /* Only written by capture, oldest
+				       frame still used by capture	    */
+    pj_uint32_t	     ref_reset;	    /* Reset requested, cleared by capture  */
+
+    /* Only used by capture */
+    pj_uint32_t	     ref_next;	    /* Next frame to read		    */
+    pj_bool_t	     ref_held;	    /* Frame ref_next-1 can be repeated	    */
+    pj_bool_t	     ref_ready;	    /* Latency has been built up	    */
+
+    pjmedia_echo_stat stat;
 };
 
 
@@ -183,7 +202,6 @@ PJ_DEF(pj_status_t) pjmedia_echo_create2(pj_pool_t *pool,
 					 pjmedia_echo_state **p_echo )
 {
     unsigned ptime, lat_cnt;
-    unsigned delay_buf_opt = 0;
     pjmedia_echo_state *ec;
     pj_status_t status;
 
@@ -193,9 +211,6 @@ PJ_DEF(pj_status_t) pjmedia_echo_create2(pj_pool_t *pool,
     ec->pool = pool;
     ec->obj_name = pool->obj_name;
     ec->samples_per_frame = samples_per_frame;
-    ec->frm_buf = (pj_int16_t*)pj_pool_alloc(pool, samples_per_frame<<1);
-    pj_list_init(&ec->lat_buf);
-    pj_list_init(&ec->lat_free);
 
     /* Select the backend algorithm */
     if (0) {
@@ -251,7 +266,7 @@ PJ_DEF(pj_status_t) pjmedia_echo_create2(pj_pool_t *pool,
     }
 
     /* If EC algo does not have playback and capture callbakcs,
-     * create latency buffer and delay buffer to handle drift.
+     * create the reference ring to handle latency and drift.
      */
     if (ec->op->ec_playback && ec->op->ec_capture) {
 	latency_ms = 0;
@@ -267,24 +282,26 @@ PJ_DEF(pj_status_t) pjmedia_echo_create2(pj_pool_t *pool,
 	    latency_ms = ptime;
 	}
 	lat_cnt = latency_ms / ptime;
-	while (lat_cnt--)  {
-	    struct frame *frm;
-
-	    frm = (struct frame*) pj_pool_alloc(pool, (samples_per_frame<<1) +
-						      sizeof(struct frame));
-	    pj_list_push_back(&ec->lat_free, frm);
-	}
 
-	/* Create delay buffer to compensate drifts */
-	if (options & PJMEDIA_ECHO_USE_SIMPLE_FIFO)
-	    delay_buf_opt |= PJMEDIA_DELAY_BUF_SIMPLE_FIFO;
-	status = pjmedia_delay_buf_create(ec->pool, ec->obj_name, clock_rate, 
-					  samples_per_frame, channel_count,
-					  (PJMEDIA_SOUND_BUFFER_COUNT+1) * ptime,
-					  delay_buf_opt, &ec->delay_buf);
-	if (status != PJ_SUCCESS) {
+	/* The ring must hold the latency plus the drift the sound device
+	 * buffers may introduce, so that playback never has to wait, and
+	 * the last frame read by capture, which it may repeat.
+	 */
+	ec->ref_latency = lat_cnt;
+	ec->ref_drift = PJMEDIA_SOUND_BUFFER_COUNT;
+	ec->ref_cnt = 1;
+	while (ec->ref_cnt < lat_cnt + ec->ref_drift + 2)
+	    ec->ref_cnt <<= 1;
+
+	ec->ref_buf = (pj_int16_t*)
+		      pj_pool_zalloc(pool, ec->ref_cnt * samples_per_frame *
+					   sizeof(pj_int16_t));
+	ec->ref_ts = (pj_timestamp*)
+		     pj_pool_zalloc(pool, ec->ref_cnt * sizeof(pj_timestamp));
+	if (!ec->ref_buf || !ec->ref_ts) {
+	    (*ec->op->ec_destroy)(ec->state);
 	    pj_pool_release(pool);
-	    return status;
+	    return PJ_ENOMEM;
 	}
     }
 
@@ -309,84 +326,69 @@ PJ_DEF(pj_status_t) pjmedia_echo_destroy(pjmedia_echo_state *echo )
 {
     (*echo->op->ec_destroy)(echo->state);
 
-    if (echo->delay_buf) {
-	pjmedia_delay_buf_destroy(echo->delay_buf);
-	echo->delay_buf = NULL;
-    }
-
     pj_pool_release(echo->pool);
     return PJ_SUCCESS;
 }
 
 
 /*
- * Reset the echo canceller.
+ * Reset the echo canceller. The reference ring is reset by the next
+ * pjmedia_echo_capture(), since only capture may move the read side.
  */
 PJ_DEF(pj_status_t) pjmedia_echo_reset(pjmedia_echo_state *echo )
 {
-    while (!pj_list_empty(&echo->lat_buf)) {
-	struct frame *frm;
-	frm = echo->lat_buf.next;
-	pj_list_erase(frm);
-	pj_list_push_back(&echo->lat_free, frm);
-    }
-    echo->lat_ready = PJ_FALSE;
-    if (echo->delay_buf)
-	pjmedia_delay_buf_reset(echo->delay_buf);
+    if (echo->ref_cnt)
+	REF_STORE(&echo->ref_reset, 1);
     echo->op->ec_reset(echo->state);
     return PJ_SUCCESS;
 }
 
 
+/*
+ * Get the reference buffer statistics.
+ */
+PJ_DEF(pj_status_t) pjmedia_echo_get_stat(pjmedia_echo_state *echo,
+					  pjmedia_echo_stat *stat)
+{
+    PJ_ASSERT_RETURN(echo && stat, PJ_EINVAL);
+
+    pj_memcpy(stat, &echo->stat, sizeof(*stat));
+    return PJ_SUCCESS;
+}
+
+
 /*
  * Let the Echo Canceller know that a frame has been played to the speaker.
  */
 PJ_DEF(pj_status_t) pjmedia_echo_playback( pjmedia_echo_state *echo,
 					   pj_int16_t *play_frm )
 {
+    pj_uint32_t wr;
+    unsigned slot;
+
     /* If EC algo has playback handler, just pass the frame. */
     if (echo->op->ec_playback) {
 	return (*echo->op->ec_playback)(echo->state, play_frm);
     }
 
-    /* Playing frame should be stored, as it will be used by echo_capture() 
-     * as reference frame, delay buffer is used for storing the playing frames
-     * as in case there was clock drift between mic & speaker.
-     *
-     * Ticket #830:
-     * Note that pjmedia_delay_buf_put() may modify the input frame and those
-     * modified frames may not be smooth, i.e: if there were two or more
-     * consecutive pjmedia_delay_buf_get() before next pjmedia_delay_buf_put(),
-     * so we'll just feed the delay buffer with the copy of playing frame,
-     * instead of the original playing frame. However this will cause the EC 
-     * uses slight 'different' frames (for reference) than actually played 
-     * by the speaker.
+    /* Store the frame in the reference ring, it will be used by
+     * echo_capture() as the reference frame. This is the only copy, the
+     * capture side reads the frame in place. If capture has fallen so far
+     * behind that the ring is full, the frame is dropped and capture will
+     * resynchronize.
      */
-    pjmedia_copy_samples(echo->frm_buf, play_frm, 
-			 echo->samples_per_frame);
-    pjmedia_delay_buf_put(echo->delay_buf, echo->frm_buf);
-
-    if (!echo->lat_ready) {
-        /* We've not built enough latency in the buffer, so put this frame
-        * in the latency buffer list.
-        */
-        struct frame *frm;
-
-        if (pj_list_empty(&echo->lat_free)) {
-            echo->lat_ready = PJ_TRUE;
-            PJ_LOG(5,(echo->obj_name, "Latency bufferring complete"));
-            return PJ_SUCCESS;
-        }
-            
-        frm = echo->lat_free.prev;
-        pj_list_erase(frm);
-
-        /* Move one frame from delay buffer to the latency buffer. */
-        pjmedia_delay_buf_get(echo->delay_buf, echo->frm_buf);
-        pjmedia_copy_samples(frm->buf, echo->frm_buf, echo->samples_per_frame);
-        pj_list_push_back(&echo->lat_buf, frm);
+    wr = echo->ref_wr;
+    if (wr - REF_LOAD(&echo->ref_rd) >= echo->ref_cnt) {
+	++echo->stat.drop_cnt;
+	return PJ_SUCCESS;
     }
 
+    slot = wr & (echo->ref_cnt - 1);
+    pjmedia_copy_samples(echo->ref_buf + slot * echo->samples_per_frame,
+			 play_frm, echo->samples_per_frame);
+    pj_get_timestamp(&echo->ref_ts[slot]);
+    REF_STORE(&echo->ref_wr, wr + 1);
+
     return PJ_SUCCESS;
 }
 
@@ -399,38 +401,89 @@ PJ_DEF(pj_status_t) pjmedia_echo_capture( pjmedia_echo_state *echo,
 					  pj_int16_t *rec_frm,
 					  unsigned options )
 {
-    struct frame *oldest_frm;
-    pj_status_t status, rc;
+    pj_uint32_t wr, rd, lag;
+    const pj_int16_t *ref_frm;
+    pj_timestamp now;
+    unsigned slot, delay;
+    pj_status_t status;
 
     /* If EC algo has capture handler, just pass the frame. */
     if (echo->op->ec_capture) {
 	return (*echo->op->ec_capture)(echo->state, rec_frm, options);
     }
 
-    if (!echo->lat_ready) {
-        /* Prefetching to fill in the desired latency */
-        PJ_LOG(5,(echo->obj_name, "Prefetching.."));
-        return PJ_SUCCESS;
+    wr = REF_LOAD(&echo->ref_wr);
+    rd = echo->ref_next;
+
+    /* Drop the frames played so far */
+    if (REF_LOAD(&echo->ref_reset)) {
+	REF_STORE(&echo->ref_reset, 0);
+	echo->ref_ready = PJ_FALSE;
+	echo->ref_held = PJ_FALSE;
+	rd = wr;
+	echo->ref_next = rd;
+	REF_STORE(&echo->ref_rd, rd);
     }
 
-    /* Retrieve oldest frame from the latency buffer */
-    oldest_frm = echo->lat_buf.next;
-    pj_list_erase(oldest_frm);
-
-    /* Cancel echo using this reference frame */
-    status = pjmedia_echo_cancel(echo, rec_frm, oldest_frm->buf, 
-                    options, NULL);
-
-    /* Move one frame from delay buffer to the latency buffer. */
-    rc = pjmedia_delay_buf_get(echo->delay_buf, oldest_frm->buf);
-    if (rc != PJ_SUCCESS) {
-        /* Ooops.. no frame! */
-        PJ_LOG(5,(echo->obj_name, 
-                "No frame from delay buffer. This will upset EC later"));
-        pjmedia_zero_samples(oldest_frm->buf, echo->samples_per_frame);
+    /* Compensate clock drift between mic & speaker. When playback has
+     * drifted too far ahead, skip frames to return to the desired latency.
+     * When capture has caught up with playback, wait for the latency to
+     * build up again. The read position only moves forward, so playback
+     * never gets back a frame that it may have overwritten.
+     */
+    if (echo->ref_ready) {
+	lag = wr - rd;
+	if (lag == 0 || lag + echo->ref_drift < echo->ref_latency) {
+	    PJ_LOG(5,(echo->obj_name, "Capture is ahead of playback, "
+		      "waiting for %d frames", echo->ref_latency - lag));
+	    echo->ref_ready = PJ_FALSE;
+	    ++echo->stat.underrun_cnt;
+	} else if (lag > echo->ref_latency + echo->ref_drift) {
+	    PJ_LOG(5,(echo->obj_name, "Playback is ahead of capture, "
+		      "skipping %d frames", lag - echo->ref_latency));
+	    rd = wr - echo->ref_latency;
+	    ++echo->stat.overrun_cnt;
+	}
     }
-    pj_list_push_back(&echo->lat_buf, oldest_frm);
-    
+
+    if (!echo->ref_ready) {
+	if (wr - rd < echo->ref_latency) {
+	    if (!echo->ref_held) {
+		/* Prefetching to fill in the desired latency */
+		PJ_LOG(5,(echo->obj_name, "Prefetching.."));
+		return PJ_SUCCESS;
+	    }
+
+	    /* Repeat the last frame, which capture still holds */
+	    slot = (rd - 1) & (echo->ref_cnt - 1);
+	    ref_frm = echo->ref_buf + slot * echo->samples_per_frame;
+	    ++echo->stat.frame_cnt;
+	    return pjmedia_echo_cancel(echo, rec_frm, ref_frm, options, NULL);
+	}
+	echo->ref_ready = PJ_TRUE;
+	rd = wr - echo->ref_latency;
+	PJ_LOG(5,(echo->obj_name, "Latency bufferring complete"));
+    }
+
+    /* Cancel echo using the reference frame in place */
+    slot = rd & (echo->ref_cnt - 1);
+    ref_frm = echo->ref_buf + slot * echo->samples_per_frame;
+
+    pj_get_timestamp(&now);
+    delay = pj_elapsed_usec(&echo->ref_ts[slot], &now);
+    echo->stat.delay_usec = echo->stat.frame_cnt ?
+			    (echo->stat.delay_usec * 7 + delay) / 8 : delay;
+    ++echo->stat.frame_cnt;
+
+    status = pjmedia_echo_cancel(echo, rec_frm, ref_frm, options, NULL);
+
+    /* Release the frames before this one to playback, and keep this one
+     * in case it has to be repeated.
+     */
+    echo->ref_next = rd + 1;
+    echo->ref_held = PJ_TRUE;
+    REF_STORE(&echo->ref_rd, rd);
+
     return status;
 }
 
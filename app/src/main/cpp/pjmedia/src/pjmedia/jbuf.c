@@ -41,26 +41,65 @@
 
 
 /*
- * JB内部缓冲区的结构，用包含帧内容、帧类型、帧长度和帧位信息的循环缓冲区表示
+ * JB 帧列表的一个槽位，一个帧的全部元数据放在一起，以便一次访问只触及一条缓存行
+ */
+typedef struct jb_slot_t {
+    pj_uint32_t tag;        /**< 槽位所属的位置计数，与当前窗口不符即为空槽 */
+    int type;        /**< 帧类型		    */
+    pj_uint32_t len;        /**< 帧长度		    */
+    pj_uint32_t bit_info;        /**< 帧位信息	    */
+    pj_uint32_t ts;        /**< 时间戳		    */
+} jb_slot_t;
+
+
+/* 视频帧索引的内部标志：帧头部的包已被移出缓冲区 */
+#define JB_VID_TRUNCATED    0x80000000
+
+/*
+ * 视频帧索引的一项，描述时间戳相同的一组包。索引项按序列号排列，在放入包时更新
+ */
+typedef struct jb_vid_frame_t {
+    pj_uint32_t ts;        /**< 帧的时间戳		    */
+    int first_seq;        /**< 已收到的第一个包的序列号    */
+    int last_seq;        /**< 已收到的最后一个包的序列号    */
+    unsigned pkt_cnt;        /**< 已收到的包数		    */
+    unsigned flags;        /**< 包的 PJMEDIA_JB_VID_* 标志之和    */
+} jb_vid_frame_t;
+
+
+/*
+ * JB内部缓冲区的结构。元数据保存在长度为2的幂的槽位环中，用掩码计算索引；帧内容保存在
+ * max_count 个帧的内容环中，内存占用与配置容量一致。
+ *
+ * 槽位不在删除时清空：head 是自由递增的位置计数，槽位的 tag 等于其在窗口中的位置计数时才有效，
+ * 因此删除头部帧和重置缓冲区都只需移动 head。被丢弃的帧另外记录在位图中，以便批量删除时按字统计。
  */
 typedef struct jb_framelist_t {
     /* 设置 */
     unsigned frame_size;    /**< 帧的最大长度	    */
     unsigned max_count;        /**< 最大的帧数	    */
+    unsigned mask;        /**< 槽位环掩码（槽位数 - 1）	    */
 
     /* 缓存 */
-    char *content;        /**< 帧内容数组	    */
-    int *frame_type;    /**< 帧类型数组		    */
-    pj_size_t *content_len;    /**< 帧长度数组		    */
-    pj_uint32_t *bit_info;        /**< 帧位信息数组	    */
-    pj_uint32_t *ts;        /**< 时间戳数组		    */
+    char *content;        /**< 帧内容环		    */
+    jb_slot_t *slot;        /**< 槽位环		    */
+    pj_uint32_t *disc_map;    /**< 丢弃帧位图，每个槽位一位	    */
 
     /* 状态 */
-    unsigned head;        /**< 头的索引号，下一次GET 获取到的帧的指针 0 ~ (max_count-1)  */
+    unsigned head;        /**< 头的位置计数，下一次GET 获取到的帧为 slot[head & mask]  */
+    unsigned content_head;    /**< 头帧在内容环中的索引 0 ~ (max_count-1) */
     unsigned size;        /**< 帧列表的当前大小，包括丢弃的帧    */
     unsigned discarded_num;    /**< 当前丢弃的帧数		    */
     int origin;        /**< 在 flist_head中的原始索引：帧序列 */
 
+    /* 视频帧索引，未启用时 vid 为 NULL */
+    jb_vid_frame_t *vid;    /**< 视频帧索引环		    */
+    unsigned vid_mask;        /**< 索引环掩码（项数 - 1）	    */
+    unsigned vid_head;        /**< 最旧的视频帧的位置计数	    */
+    unsigned vid_cnt;        /**< 索引中的视频帧数		    */
+    int vid_prev_seq;        /**< 上一个已移出的帧的最后序列号，INVALID_OFFSET 为未知 */
+    pj_bool_t vid_prev_marker;    /**< 上一个已移出的帧是否以 marker 结束 */
+
 } jb_framelist_t;
 
 
@@ -140,38 +179,35 @@ static pj_status_t jb_framelist_reset(jb_framelist_t *framelist);
 
 static unsigned jb_framelist_remove_head(jb_framelist_t *framelist, unsigned count);
 
+static void jb_vid_reset(jb_framelist_t *framelist);
+
 static pj_status_t jb_framelist_init(pj_pool_t *pool,
                                      jb_framelist_t *framelist,
                                      unsigned frame_size,
                                      unsigned max_count) {
+    unsigned slot_cnt;
+
     PJ_ASSERT_RETURN(pool && framelist, PJ_EINVAL);
 
     pj_bzero(framelist, sizeof(jb_framelist_t));
 
+    /* 槽位数取不小于 max_count 的2的幂，至少为一个位图字 */
+    slot_cnt = 32;
+    while (slot_cnt < max_count)
+        slot_cnt <<= 1;
+
     framelist->frame_size = frame_size;
     framelist->max_count = max_count;
+    framelist->mask = slot_cnt - 1;
     framelist->content = (char *)
             pj_pool_alloc(pool,
                           framelist->frame_size *
                           framelist->max_count);
-    framelist->frame_type = (int *)
-            pj_pool_alloc(pool,
-                          sizeof(framelist->frame_type[0]) *
-                          framelist->max_count);
-    framelist->content_len = (pj_size_t *)
-            pj_pool_alloc(pool,
-                          sizeof(framelist->content_len[0]) *
-                          framelist->max_count);
-    framelist->bit_info = (pj_uint32_t *)
-            pj_pool_alloc(pool,
-                          sizeof(framelist->bit_info[0]) *
-                          framelist->max_count);
-    framelist->ts = (pj_uint32_t *)
-            pj_pool_alloc(pool,
-                          sizeof(framelist->ts[0]) *
-                          framelist->max_count);
+    framelist->slot = (jb_slot_t *)
+            pj_pool_calloc(pool, slot_cnt, sizeof(jb_slot_t));
+    framelist->disc_map = (pj_uint32_t *)
+            pj_pool_calloc(pool, slot_cnt / 32, sizeof(pj_uint32_t));
 
-    PJ_LOG(5, (THIS_FILE, "JB missing frame: jb_lost=%d", 2));
     return jb_framelist_reset(framelist);
 
 }
@@ -182,28 +218,17 @@ static pj_status_t jb_framelist_destroy(jb_framelist_t *framelist) {
 }
 
 static pj_status_t jb_framelist_reset(jb_framelist_t *framelist) {
-    framelist->head = 0;
+    /* 所有旧槽位的 tag 都小于 head + max_count，移过去即全部作废 */
+    framelist->head += framelist->max_count;
+    framelist->content_head = 0;
     framelist->origin = INVALID_OFFSET;
     framelist->size = 0;
     framelist->discarded_num = 0;
 
+    pj_bzero(framelist->disc_map,
+             (framelist->mask + 1) / 32 * sizeof(framelist->disc_map[0]));
 
-    //pj_bzero(framelist->content,
-    //	     framelist->frame_size *
-    //	     framelist->max_count);
-
-    pj_memset(framelist->frame_type,
-              PJMEDIA_JB_MISSING_FRAME,
-              sizeof(framelist->frame_type[0]) *
-              framelist->max_count);
-
-    pj_bzero(framelist->content_len,
-             sizeof(framelist->content_len[0]) *
-             framelist->max_count);
-
-    //pj_bzero(framelist->bit_info,
-    //	     sizeof(framelist->bit_info[0]) *
-    //	     framelist->max_count);
+    jb_vid_reset(framelist);
 
     return PJ_SUCCESS;
 }
@@ -223,6 +248,66 @@ static int jb_framelist_origin(const jb_framelist_t *framelist) {
 }
 
 
+/* 距头 distance 个位置的槽位，distance < max_count */
+PJ_INLINE(jb_slot_t *) jb_framelist_slot(const jb_framelist_t *framelist,
+                                         unsigned distance) {
+    return &framelist->slot[(framelist->head + distance) & framelist->mask];
+}
+
+/* 槽位中的帧类型，空槽为 PJMEDIA_JB_MISSING_FRAME */
+PJ_INLINE(int) jb_framelist_type(const jb_framelist_t *framelist,
+                                 unsigned distance) {
+    const jb_slot_t *slot = jb_framelist_slot(framelist, distance);
+
+    return (slot->tag == framelist->head + distance) ?
+           slot->type : PJMEDIA_JB_MISSING_FRAME;
+}
+
+/* 距头 distance 个位置的帧内容 */
+PJ_INLINE(char *) jb_framelist_content(const jb_framelist_t *framelist,
+                                       unsigned distance) {
+    unsigned idx = framelist->content_head + distance;
+
+    if (idx >= framelist->max_count)
+        idx -= framelist->max_count;
+    return framelist->content + idx * framelist->frame_size;
+}
+
+/* 统计从位置 start 开始 count 个槽位的丢弃标志，clear 为真时同时清除 */
+static unsigned jb_framelist_count_discarded(jb_framelist_t *framelist,
+                                             unsigned start,
+                                             unsigned count,
+                                             pj_bool_t clear) {
+    unsigned n = 0;
+
+    while (count) {
+        unsigned pos = start & framelist->mask;
+        unsigned bit = pos & 31;
+        unsigned len = PJ_MIN(32 - bit, count);
+        pj_uint32_t *word = &framelist->disc_map[pos >> 5];
+        pj_uint32_t m = (len == 32) ? 0xFFFFFFFF :
+                        (((pj_uint32_t) 1 << len) - 1) << bit;
+
+#if defined(__GNUC__)
+        n += __builtin_popcount(*word & m);
+#else
+        {
+            pj_uint32_t v = *word & m;
+            for (; v; v &= v - 1)
+                ++n;
+        }
+#endif
+        if (clear)
+            *word &= ~m;
+
+        start += len;
+        count -= len;
+    }
+
+    return n;
+}
+
+
 static pj_bool_t jb_framelist_get(jb_framelist_t *framelist,
                                   void *frame, pj_size_t *size,
                                   pjmedia_jb_frame_type *p_type,
@@ -233,14 +318,17 @@ static pj_bool_t jb_framelist_get(jb_framelist_t *framelist,
         pj_bool_t prev_discarded = PJ_FALSE;
 
         /* 跳过丢弃的帧 */
-        while (framelist->frame_type[framelist->head] ==
-               PJMEDIA_JB_DISCARDED_FRAME) {
+        while (framelist->size &&
+               jb_framelist_type(framelist, 0) == PJMEDIA_JB_DISCARDED_FRAME) {
             jb_framelist_remove_head(framelist, 1);
             prev_discarded = PJ_TRUE;
         }
 
         /* 如有，返回头帧 */
         if (framelist->size) {
+            const jb_slot_t *slot = jb_framelist_slot(framelist, 0);
+            pj_bool_t valid = (slot->tag == framelist->head);
+
             if (prev_discarded) {
                 /*
                  * #1188：当前一帧被丢弃时，返回 missing 帧以触发PLC以获得更平滑的信号。
@@ -254,7 +342,7 @@ static pj_bool_t jb_framelist_get(jb_framelist_t *framelist,
                 //PJ_LOG(5, (THIS_FILE, "JB missing frame: prev_discarded"));
 
             } else {
-                pj_size_t frm_size = framelist->content_len[framelist->head];
+                pj_size_t frm_size = valid ? slot->len : 0;
                 pj_size_t max_size = size ? *size : frm_size;
                 pj_size_t copy_size = PJ_MIN(max_size, frm_size);
 
@@ -264,32 +352,25 @@ static pj_bool_t jb_framelist_get(jb_framelist_t *framelist,
                     PJ_LOG(4, (THIS_FILE, "JB Warning: buffer too small for the retrieved frame!"));
                 }
 
-                pj_memcpy(frame,
-                          framelist->content +
-                          framelist->head * framelist->frame_size,
+                pj_memcpy(frame, jb_framelist_content(framelist, 0),
                           copy_size);
                 *p_type = (pjmedia_jb_frame_type)
-                        framelist->frame_type[framelist->head];//for now
+                        (valid ? slot->type : PJMEDIA_JB_MISSING_FRAME);//for now
                 if (size)
                     *size = copy_size;
                 if (bit_info)
-                    *bit_info = framelist->bit_info[framelist->head];
+                    *bit_info = valid ? slot->bit_info : 0;
             }
             if (ts)
-                *ts = framelist->ts[framelist->head];
+                *ts = valid ? slot->ts : 0;
             if (seq)
                 *seq = framelist->origin;
 
-            //pj_bzero(framelist->content +
-            //	 framelist->head * framelist->frame_size,
-            //	 framelist->frame_size);
-            framelist->frame_type[framelist->head] = PJMEDIA_JB_MISSING_FRAME;//for next,reset
-            framelist->content_len[framelist->head] = 0;
-            framelist->bit_info[framelist->head] = 0;
-            framelist->ts[framelist->head] = 0;
-
+            /* 移动头即可，旧槽位的 tag 随之失效 */
             framelist->origin++;
-            framelist->head = (framelist->head + 1) % framelist->max_count;
+            framelist->head++;
+            if (++framelist->content_head == framelist->max_count)
+                framelist->content_head = 0;
             framelist->size--;
 
             //PJ_LOG(5, (THIS_FILE, "JB missing frame: prev_discarded=%d(0.1), framelist:origin=%d, size=%d", prev_discarded, framelist->origin, framelist->size));//print too many
@@ -313,37 +394,47 @@ static pj_bool_t jb_framelist_peek(jb_framelist_t *framelist,  //for  vid_stream
                                    pj_uint32_t *bit_info,
                                    pj_uint32_t *ts,
                                    int *seq) {
-    unsigned pos, idx;
+    const jb_slot_t *slot;
+    unsigned dist;
+    pj_bool_t valid;
 
     if (offset >= jb_framelist_eff_size(framelist))
         return PJ_FALSE;
 
-    pos = framelist->head;
-    idx = offset;
-
-    /* 找到实际的peek位置，注意可能有丢弃的帧 */
-    while (1) {
-        if (framelist->frame_type[pos] != PJMEDIA_JB_DISCARDED_FRAME) {
-            if (idx == 0)
-                break;
-            else
-                --idx;
+    if (framelist->discarded_num == 0) {
+        /* 没有丢弃的帧，直接定位 */
+        dist = offset;
+    } else {
+        unsigned idx = offset;
+
+        /* 找到实际的peek位置，注意可能有丢弃的帧 */
+        for (dist = 0;; ++dist) {
+            if (jb_framelist_type(framelist, dist) !=
+                PJMEDIA_JB_DISCARDED_FRAME)
+            {
+                if (idx == 0)
+                    break;
+                else
+                    --idx;
+            }
         }
-        pos = (pos + 1) % framelist->max_count;
     }
 
+    slot = jb_framelist_slot(framelist, dist);
+    valid = (slot->tag == framelist->head + dist);
+
     /* 返回帧指针 */
     if (frame)
-        *frame = framelist->content + pos * framelist->frame_size;
+        *frame = jb_framelist_content(framelist, dist);
     if (type)
         *type = (pjmedia_jb_frame_type)
-                framelist->frame_type[pos];
+                (valid ? slot->type : PJMEDIA_JB_MISSING_FRAME);
     if (size)
-        *size = framelist->content_len[pos];
+        *size = valid ? slot->len : 0;
     if (bit_info)
-        *bit_info = framelist->bit_info[pos];
+        *bit_info = valid ? slot->bit_info : 0;
     if (ts)
-        *ts = framelist->ts[pos];
+        *ts = valid ? slot->ts : 0;
     if (seq)
         *seq = framelist->origin + offset;
 
@@ -351,60 +442,26 @@ static pj_bool_t jb_framelist_peek(jb_framelist_t *framelist,  //for  vid_stream
 }
 
 
-/* 删除 count 个最旧的帧 */
+/* 删除 count 个最旧的帧，只移动头，不逐帧清理槽位 */
 static unsigned jb_framelist_remove_head(jb_framelist_t *framelist, unsigned count) {
     if (count > framelist->size)
         count = framelist->size;
 
     if (count) {
-        /* 如果重叠，可分两步进行 */
-        unsigned step1, step2;
-        unsigned tmp = framelist->head + count;
-        unsigned i;
-
-        if (tmp > framelist->max_count) {
-            step1 = framelist->max_count - framelist->head;
-            step2 = count - step1;
-        } else {
-            step1 = count;
-            step2 = 0;
-        }
-
-        for (i = framelist->head; i < (framelist->head + step1); ++i) {
-            if (framelist->frame_type[i] == PJMEDIA_JB_DISCARDED_FRAME) {
-                pj_assert(framelist->discarded_num > 0);
-                framelist->discarded_num--;
-            }
-        }
-
-        //pj_bzero(framelist->content +
-        //	    framelist->head * framelist->frame_size,
-        //          step1*framelist->frame_size);
-        pj_memset(framelist->frame_type + framelist->head,
-                  PJMEDIA_JB_MISSING_FRAME,
-                  step1 * sizeof(framelist->frame_type[0]));
-        pj_bzero(framelist->content_len + framelist->head,
-                 step1 * sizeof(framelist->content_len[0]));
-
-        if (step2) {
-            for (i = 0; i < step2; ++i) {
-                if (framelist->frame_type[i] == PJMEDIA_JB_DISCARDED_FRAME) {
-                    pj_assert(framelist->discarded_num > 0);
-                    framelist->discarded_num--;
-                }
-            }
-            //pj_bzero( framelist->content,
-            //	      step2*framelist->frame_size);
-            pj_memset(framelist->frame_type,
-                      PJMEDIA_JB_MISSING_FRAME,
-                      step2 * sizeof(framelist->frame_type[0]));
-            pj_bzero(framelist->content_len,
-                     step2 * sizeof(framelist->content_len[0]));
+        if (framelist->discarded_num) {
+            unsigned n = jb_framelist_count_discarded(framelist,
+                                                      framelist->head,
+                                                      count, PJ_TRUE);
+            pj_assert(n <= framelist->discarded_num);
+            framelist->discarded_num -= n;
         }
 
         /* 更新状态 */
         framelist->origin += count;
-        framelist->head = (framelist->head + count) % framelist->max_count;
+        framelist->head += count;
+        framelist->content_head += count;
+        if (framelist->content_head >= framelist->max_count)
+            framelist->content_head -= framelist->max_count;
         framelist->size -= count;
     }
 
@@ -420,7 +477,7 @@ static pj_status_t jb_framelist_put_at(jb_framelist_t *framelist,
                                        pj_uint32_t ts,
                                        unsigned frame_type) {
     int distance;
-    unsigned pos;
+    jb_slot_t *slot;
     enum {
         MAX_MISORDER = 100
     };
@@ -448,6 +505,8 @@ static pj_status_t jb_framelist_put_at(jb_framelist_t *framelist,
                     framelist->size));
             framelist->origin = index - framelist->size;
             distance = framelist->size;
+            /* 序列号已改变，索引作废 */
+            jb_vid_reset(framelist);
         } else {
             /* 跳得太远，重置缓冲区 */
             /*TRACE__(*/PJ_LOG(4, (THIS_FILE, "JB Put frame #%d: far jump (distance=%d)",
@@ -484,20 +543,19 @@ static pj_status_t jb_framelist_put_at(jb_framelist_t *framelist,
         }
     }
 
-    /* 获取slot 位置 */
-    pos = (framelist->head + distance) % framelist->max_count;
-
     /* 如果slot被占用，它必须是复制帧，忽略它 */
-    if (framelist->frame_type[pos] != PJMEDIA_JB_MISSING_FRAME) {
+    if (jb_framelist_type(framelist, distance) != PJMEDIA_JB_MISSING_FRAME) {
         /*TRACE__(*/PJ_LOG(4, (THIS_FILE, "JB Put frame #%d maybe a duplicate, ignored", index));
         return PJ_EEXISTS;
     }
 
     /* 放一帧到 slot */
-    framelist->frame_type[pos] = frame_type;
-    framelist->content_len[pos] = frame_size;
-    framelist->bit_info[pos] = bit_info;
-    framelist->ts[pos] = ts;
+    slot = jb_framelist_slot(framelist, distance);
+    slot->tag = framelist->head + distance;
+    slot->type = frame_type;
+    slot->len = frame_size;
+    slot->bit_info = bit_info;
+    slot->ts = ts;
 
     /* 更新 framelist size */
     if (framelist->origin + (int) framelist->size <= index)
@@ -505,7 +563,7 @@ static pj_status_t jb_framelist_put_at(jb_framelist_t *framelist,
 
     if (PJMEDIA_JB_NORMAL_FRAME == frame_type) {
         /* 拷贝帧内容 */
-        pj_memcpy(framelist->content + pos * framelist->frame_size,
+        pj_memcpy(jb_framelist_content(framelist, distance),
                   frame, frame_size);
     }
 
@@ -515,18 +573,30 @@ static pj_status_t jb_framelist_put_at(jb_framelist_t *framelist,
 
 static pj_status_t jb_framelist_discard(jb_framelist_t *framelist,
                                         int index) {
-    unsigned pos;
+    unsigned distance, pos;
+    jb_slot_t *slot;
 
     PJ_ASSERT_RETURN(index >= framelist->origin &&
                      index < framelist->origin + (int) framelist->size,
                      PJ_EINVAL);
 
     /* 获得 slot 位置 */
-    pos = (framelist->head + (index - framelist->origin)) %
-          framelist->max_count;
-
-    /* 丢弃帧 */
-    framelist->frame_type[pos] = PJMEDIA_JB_DISCARDED_FRAME;
+    distance = index - framelist->origin;
+    pos = (framelist->head + distance) & framelist->mask;
+
+    if (jb_framelist_type(framelist, distance) == PJMEDIA_JB_DISCARDED_FRAME)
+        return PJ_SUCCESS;
+
+    /* 丢弃帧，空槽也标记为丢弃 */
+    slot = jb_framelist_slot(framelist, distance);
+    if (slot->tag != framelist->head + distance) {
+        slot->tag = framelist->head + distance;
+        slot->len = 0;
+        slot->bit_info = 0;
+        slot->ts = 0;
+    }
+    slot->type = PJMEDIA_JB_DISCARDED_FRAME;
+    framelist->disc_map[pos >> 5] |= (pj_uint32_t) 1 << (pos & 31);
     framelist->discarded_num++;
 
     if ((pos % 5 == 0) || (framelist->discarded_num > 2)) {
@@ -538,6 +608,85 @@ static pj_status_t jb_framelist_discard(jb_framelist_t *framelist,
 }
 
 
+/* 索引中第 i 个视频帧，0 为最旧的帧 */
+PJ_INLINE(jb_vid_frame_t *) jb_vid_at(const jb_framelist_t *framelist,
+                                      unsigned i) {
+    return &framelist->vid[(framelist->vid_head + i) & framelist->vid_mask];
+}
+
+static void jb_vid_reset(jb_framelist_t *framelist) {
+    framelist->vid_cnt = 0;
+    framelist->vid_prev_seq = INVALID_OFFSET;
+    framelist->vid_prev_marker = PJ_FALSE;
+}
+
+/*
+ * 移除包已全部移出缓冲区的帧。头部的包被移出的帧会被标记，不再被认为是完整的。
+ */
+static void jb_vid_trim(jb_framelist_t *framelist) {
+    jb_vid_frame_t *vf;
+
+    /* 缓冲区为空时，下一个包的序列号会成为新的 origin */
+    while (framelist->vid_cnt &&
+           (framelist->size == 0 ||
+            jb_vid_at(framelist, 0)->last_seq < framelist->origin))
+    {
+        vf = jb_vid_at(framelist, 0);
+        framelist->vid_prev_seq = vf->last_seq;
+        framelist->vid_prev_marker = (vf->flags & PJMEDIA_JB_VID_MARKER) != 0;
+        framelist->vid_head++;
+        framelist->vid_cnt--;
+    }
+
+    if (framelist->vid_cnt) {
+        vf = jb_vid_at(framelist, 0);
+        if (vf->first_seq < framelist->origin) {
+            vf->first_seq = framelist->origin;
+            vf->flags |= JB_VID_TRUNCATED;
+        }
+    }
+}
+
+/*
+ * 把成功放入的包记入索引。同一帧的包序列号连续，因此从最新的帧往回找，
+ * 直到找到同一时间戳的帧或序列号更小的帧；乱序通常只跨一两帧。
+ */
+static void jb_vid_put(jb_framelist_t *framelist, int seq, pj_uint32_t ts,
+                       unsigned flags) {
+    jb_vid_frame_t *vf;
+    unsigned i, j;
+
+    jb_vid_trim(framelist);
+
+    for (i = framelist->vid_cnt; i > 0; --i) {
+        vf = jb_vid_at(framelist, i - 1);
+        if (vf->ts == ts) {
+            if (seq < vf->first_seq)
+                vf->first_seq = seq;
+            if (seq > vf->last_seq)
+                vf->last_seq = seq;
+            vf->pkt_cnt++;
+            vf->flags |= flags;
+            return;
+        }
+        if (vf->first_seq < seq)
+            break;
+    }
+
+    /* 新的帧，插在第 i 项。每一帧至少有一个包在缓冲区中，索引不会满 */
+    pj_assert(framelist->vid_cnt <= framelist->vid_mask);
+    for (j = framelist->vid_cnt; j > i; --j)
+        *jb_vid_at(framelist, j) = *jb_vid_at(framelist, j - 1);
+    framelist->vid_cnt++;
+
+    vf = jb_vid_at(framelist, i);
+    vf->ts = ts;
+    vf->first_seq = vf->last_seq = seq;
+    vf->pkt_cnt = 1;
+    vf->flags = flags;
+}
+
+
 enum pjmedia_jb_op {
     JB_OP_INIT = -1,
     JB_OP_PUT = 1,
@@ -962,6 +1111,18 @@ PJ_DEF(void) pjmedia_jbuf_put_frame3(pjmedia_jbuf *jb,
                                      int frame_seq,  //frame seq
                                      pj_uint32_t ts,
                                      pj_bool_t *discarded) {
+    pjmedia_jbuf_put_frame4(jb, frame, frame_size, bit_info, frame_seq, ts,
+                            0, discarded);
+}
+
+PJ_DEF(void) pjmedia_jbuf_put_frame4(pjmedia_jbuf *jb,
+                                     const void *frame,
+                                     pj_size_t frame_size,
+                                     pj_uint32_t bit_info,
+                                     int frame_seq,
+                                     pj_uint32_t ts,
+                                     unsigned vid_flags,
+                                     pj_bool_t *discarded) {
     pj_size_t min_frame_size;
     int new_size, cur_size;
     pj_status_t status;
@@ -974,6 +1135,10 @@ PJ_DEF(void) pjmedia_jbuf_put_frame3(pjmedia_jbuf *jb,
                (THIS_FILE, "JB Warning: frame too large for jitter buffer, (( frame_size=%d > jb_frame_size=%d )), it will be truncated!", frame_size, jb->jb_frame_size));
     }
 
+    /* 缓冲区为空时 origin 会被重置，先移除索引中的旧帧 */
+    if (jb->jb_framelist.vid)
+        jb_vid_trim(&jb->jb_framelist);
+
     /* 尝试存储帧 */
     min_frame_size = PJ_MIN(frame_size, jb->jb_frame_size);
     status = jb_framelist_put_at(&jb->jb_framelist, frame_seq, frame,
@@ -1009,6 +1174,9 @@ PJ_DEF(void) pjmedia_jbuf_put_frame3(pjmedia_jbuf *jb,
         *discarded = (status != PJ_SUCCESS);
 
     if (status == PJ_SUCCESS) {
+        if (jb->jb_framelist.vid)
+            jb_vid_put(&jb->jb_framelist, frame_seq, ts, vid_flags);
+
         if (jb->jb_prefetching) {
             TRACE__((jb->jb_name.ptr, "JB PUT prefetch_cnt=%d/%d",
                     new_size, jb->jb_prefetch));
@@ -1195,3 +1363,74 @@ PJ_DEF(unsigned) pjmedia_jbuf_remove_frame(pjmedia_jbuf *jb,  //for  vid_stream
 
     return count;
 }
+
+
+PJ_DEF(pj_status_t) pjmedia_jbuf_enable_vid_index(pjmedia_jbuf *jb,
+                                                  pj_pool_t *pool) {
+    jb_framelist_t *framelist;
+
+    PJ_ASSERT_RETURN(jb && pool, PJ_EINVAL);
+
+    framelist = &jb->jb_framelist;
+    if (framelist->vid)
+        return PJ_SUCCESS;
+
+    /* 每一帧至少占一个槽位，索引项数与槽位数相同即可 */
+    framelist->vid_mask = framelist->mask;
+    framelist->vid = (jb_vid_frame_t *)
+            pj_pool_calloc(pool, framelist->vid_mask + 1,
+                           sizeof(jb_vid_frame_t));
+    jb_vid_reset(framelist);
+
+    /* 已在缓冲区中的包不在索引中，丢弃它们 */
+    jb_framelist_remove_head(framelist, framelist->size);
+
+    return PJ_SUCCESS;
+}
+
+
+PJ_DEF(pj_status_t) pjmedia_jbuf_peek_vid_frame(pjmedia_jbuf *jb,
+                                                pjmedia_jb_vid_frame *info) {
+    jb_framelist_t *framelist;
+    const jb_vid_frame_t *vf;
+    unsigned span;
+
+    PJ_ASSERT_RETURN(jb && info, PJ_EINVAL);
+
+    framelist = &jb->jb_framelist;
+    PJ_ASSERT_RETURN(framelist->vid, PJ_EINVALIDOP);
+
+    jb_vid_trim(framelist);
+    if (framelist->vid_cnt == 0)
+        return PJ_ENOTFOUND;
+
+    vf = jb_vid_at(framelist, 0);
+
+    /* 完整的帧：以 marker 结束，紧接在以 marker 结束的上一帧之后，且中间没有丢包 */
+    info->complete = (vf->flags & PJMEDIA_JB_VID_MARKER) &&
+                     !(vf->flags & JB_VID_TRUNCATED) &&
+                     framelist->vid_prev_marker &&
+                     vf->first_seq == framelist->vid_prev_seq + 1 &&
+                     vf->pkt_cnt == (unsigned) (vf->last_seq - vf->first_seq + 1);
+
+    /* 不完整的帧在下一帧的包到达后才可取出，两帧之间丢失的包都算作这一帧的 */
+    if (info->complete)
+        span = vf->last_seq - framelist->origin + 1;
+    else if (framelist->vid_cnt > 1)
+        span = jb_vid_at(framelist, 1)->first_seq - framelist->origin;
+    else
+        return PJ_ENOTFOUND;
+
+    info->ts = vf->ts;
+    info->first_seq = vf->first_seq;
+    info->last_seq = vf->last_seq;
+    info->keyframe = (vf->flags & PJMEDIA_JB_VID_KEYFRAME) != 0;
+    info->pkt_cnt = span;
+    if (framelist->discarded_num) {
+        info->pkt_cnt -= jb_framelist_count_discarded(framelist,
+                                                      framelist->head,
+                                                      span, PJ_FALSE);
+    }
+
+    return PJ_SUCCESS;
+}
@@ -0,0 +1,1073 @@
+/* $Id$ */
+/*
+ * Copyright (C) 2008-2011 Teluu Inc. (http://www.teluu.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include <pjmedia/mp4_writer.h>
+#include <pjmedia/annexb.h>
+#include <pjmedia/errno.h>
+#include <pj/assert.h>
+#include <pj/file_io.h>
+#include <pj/lock.h>
+#include <pj/log.h>
+#include <pj/os.h>
+#include <pj/pool.h>
+#include <pj/string.h>
+
+
+#if defined(PJMEDIA_HAS_MP4_WRITER) && PJMEDIA_HAS_MP4_WRITER != 0
+
+#define THIS_FILE	    "mp4_writer.c"
+
+#define VIDEO_TIMESCALE	    90000
+#define OPUS_TIMESCALE	    48000
+#define OPUS_PRE_SKIP	    312
+#define MAX_PARAM_SET_LEN   256
+#define MOOV_BUF_SIZE	    (1024 + 2 * MAX_PARAM_SET_LEN)
+
+/* Size of the moof box (mfhd and one traf per track, with tfhd, tfdt and
+ * a trun with duration, size and flags of every sample).
+ */
+#define MOOF_BUF_SIZE	    (8 + 16 + 8 + 2 * (8 + 16 + 20 + 20 + \
+			     12 * PJMEDIA_MP4_WRITER_MAX_SAMPLES))
+
+/* trun sample flags */
+#define SAMPLE_FLAGS_SYNC	0x02000000
+#define SAMPLE_FLAGS_NON_SYNC	0x01010000
+
+enum { TRACK_VIDEO, TRACK_AUDIO, TRACK_CNT };
+
+/* Sample of the current fragment */
+struct mp4_sample
+{
+    pj_uint32_t	    size;
+    pj_uint32_t	    duration;
+    pj_bool_t	    key;
+};
+
+/* A track, which is also the media port of the track */
+struct mp4_track
+{
+    pjmedia_port	 base;
+    pjmedia_mp4_writer	*writer;
+    unsigned		 id;		/* MP4 track ID			*/
+    pj_bool_t		 enabled;
+
+    unsigned		 timescale;	/* Units of the sample times	*/
+    unsigned		 ts_clock;	/* Units of frame timestamps	*/
+    pj_uint32_t		 def_duration;	/* When timestamps don't help	*/
+
+    /* Samples of the current fragment */
+    pj_uint8_t		*buf;
+    unsigned		 buf_size;
+    unsigned		 buf_len;
+    struct mp4_sample	*smp;
+    unsigned		 smp_cnt;
+    pj_uint64_t		 frag_dts;	/* Time of the first sample	*/
+
+    pj_bool_t		 started;
+    pj_uint32_t		 last_ts;	/* Timestamp of last frame	*/
+    pj_uint64_t		 last_dts;	/* Time of the last sample	*/
+    pj_uint32_t		 last_duration;
+    pj_uint32_t		 dropped;
+};
+
+struct pjmedia_mp4_writer
+{
+    pj_pool_t		*pool;
+    pjmedia_mp4_writer_param param;
+    pj_mutex_t		*mutex;
+    pj_oshandle_t	 fd;
+    pj_off_t		 file_size;
+    pj_bool_t		 hdr_written;
+    pj_uint32_t		 frag_seq;
+    pj_timestamp	 start_time;	/* When the first track started	*/
+
+    struct mp4_track	 track[TRACK_CNT];
+
+    /* Codec configuration */
+    pj_uint8_t		 sps[MAX_PARAM_SET_LEN];
+    unsigned		 sps_len;
+    pj_uint8_t		 pps[MAX_PARAM_SET_LEN];
+    unsigned		 pps_len;
+    pj_uint8_t		 asc[2];	/* AAC AudioSpecificConfig	*/
+
+    pj_uint8_t		*box_buf;	/* moov/moof building buffer	*/
+    unsigned		 box_buf_size;
+};
+
+
+/*
+ * Box building helpers. The size of a box is written when it's closed.
+ */
+typedef struct bs_t
+{
+    pj_uint8_t	*start;
+    pj_uint8_t	*p;
+} bs_t;
+
+static void put8(bs_t *bs, unsigned v)
+{
+    *bs->p++ = (pj_uint8_t)v;
+}
+
+static void put16(bs_t *bs, unsigned v)
+{
+    put8(bs, v >> 8);
+    put8(bs, v);
+}
+
+static void put24(bs_t *bs, pj_uint32_t v)
+{
+    put8(bs, v >> 16);
+    put16(bs, v);
+}
+
+static void put32(bs_t *bs, pj_uint32_t v)
+{
+    put16(bs, v >> 16);
+    put16(bs, v);
+}
+
+static void put64(bs_t *bs, pj_uint64_t v)
+{
+    put32(bs, (pj_uint32_t)(v >> 32));
+    put32(bs, (pj_uint32_t)v);
+}
+
+static void put_zero(bs_t *bs, unsigned cnt)
+{
+    pj_bzero(bs->p, cnt);
+    bs->p += cnt;
+}
+
+static void put_tag(bs_t *bs, const char *tag)
+{
+    pj_memcpy(bs->p, tag, 4);
+    bs->p += 4;
+}
+
+static pj_uint8_t *box_open(bs_t *bs, const char *tag)
+{
+    pj_uint8_t *box = bs->p;
+    put32(bs, 0);
+    put_tag(bs, tag);
+    return box;
+}
+
+static pj_uint8_t *full_box_open(bs_t *bs, const char *tag, unsigned version,
+				 pj_uint32_t flags)
+{
+    pj_uint8_t *box = box_open(bs, tag);
+    put8(bs, version);
+    put24(bs, flags);
+    return box;
+}
+
+static void box_close(bs_t *bs, pj_uint8_t *box)
+{
+    bs_t hdr;
+    hdr.p = box;
+    put32(&hdr, (pj_uint32_t)(bs->p - box));
+}
+
+/* Unity matrix of mvhd and tkhd */
+static void put_matrix(bs_t *bs)
+{
+    put32(bs, 0x00010000); put32(bs, 0); put32(bs, 0);
+    put32(bs, 0); put32(bs, 0x00010000); put32(bs, 0);
+    put32(bs, 0); put32(bs, 0); put32(bs, 0x40000000);
+}
+
+
+static pj_status_t mp4_put_frame(pjmedia_port *this_port,
+				 pjmedia_frame *frame);
+static pj_status_t mp4_get_frame(pjmedia_port *this_port,
+				 pjmedia_frame *frame);
+static pj_status_t mp4_on_destroy(pjmedia_port *this_port);
+
+
+PJ_DEF(void) pjmedia_mp4_writer_param_default(pjmedia_mp4_writer_param *param)
+{
+    pj_bzero(param, sizeof(*param));
+    param->has_video = PJ_TRUE;
+    param->size.w = 640;
+    param->size.h = 480;
+    param->fps.num = 15;
+    param->fps.denum = 1;
+    param->audio_codec = PJMEDIA_MP4_AUDIO_AAC;
+    param->clock_rate = 16000;
+    param->channel_count = 1;
+    param->samples_per_frame = 1024;
+    param->frag_duration = PJMEDIA_MP4_WRITER_FRAG_DURATION;
+}
+
+
+/* AAC LC AudioSpecificConfig from the sampling rate and channel count. */
+static void aac_make_asc(pj_uint8_t asc[2], unsigned clock_rate,
+			 unsigned channel_count)
+{
+    static const unsigned rates[] = { 96000, 88200, 64000, 48000, 44100,
+				      32000, 24000, 22050, 16000, 12000,
+				      11025, 8000, 7350 };
+    unsigned idx;
+
+    for (idx = 0; idx < PJ_ARRAY_SIZE(rates); ++idx) {
+	if (rates[idx] == clock_rate)
+	    break;
+    }
+    if (idx == PJ_ARRAY_SIZE(rates))
+	idx = 8;
+
+    asc[0] = (pj_uint8_t)((2 << 3) | (idx >> 1));
+    asc[1] = (pj_uint8_t)(((idx & 1) << 7) | ((channel_count & 0x0F) << 3));
+}
+
+
+static pj_status_t init_track(pjmedia_mp4_writer *w, struct mp4_track *t,
+			      unsigned id, const char *filename,
+			      unsigned signature, const pjmedia_format *fmt,
+			      unsigned buf_size)
+{
+    pj_str_t name;
+
+    pj_strdup2(w->pool, &name, filename);
+    pjmedia_port_info_init2(&t->base.info, &name, signature,
+			    PJMEDIA_DIR_PLAYBACK, fmt);
+    t->base.put_frame = &mp4_put_frame;
+    t->base.get_frame = &mp4_get_frame;
+    t->base.on_destroy = &mp4_on_destroy;
+    t->base.port_data.pdata = w;
+
+    t->writer = w;
+    t->id = id;
+    t->enabled = PJ_TRUE;
+    t->buf_size = buf_size;
+    t->buf = (pj_uint8_t*) pj_pool_alloc(w->pool, buf_size);
+    t->smp = (struct mp4_sample*)
+	     pj_pool_calloc(w->pool, PJMEDIA_MP4_WRITER_MAX_SAMPLES,
+			    sizeof(struct mp4_sample));
+    if (!t->buf || !t->smp)
+	return PJ_ENOMEM;
+
+    t->last_duration = t->def_duration;
+    return PJ_SUCCESS;
+}
+
+
+/*
+ * Create the MP4 writer.
+ */
+PJ_DEF(pj_status_t) pjmedia_mp4_writer_create(pj_pool_t *pool,
+					      const char *filename,
+					      const pjmedia_mp4_writer_param *param,
+					      pjmedia_mp4_writer **p_writer)
+{
+    pjmedia_mp4_writer *w;
+    pjmedia_format fmt;
+    unsigned id = 1;
+    pj_status_t status;
+
+    PJ_ASSERT_RETURN(pool && filename && p_writer, PJ_EINVAL);
+
+    w = PJ_POOL_ZALLOC_T(pool, pjmedia_mp4_writer);
+    w->pool = pool;
+    if (param)
+	pj_memcpy(&w->param, param, sizeof(*param));
+    else
+	pjmedia_mp4_writer_param_default(&w->param);
+    param = &w->param;
+
+    PJ_ASSERT_RETURN(param->has_video ||
+		     param->audio_codec != PJMEDIA_MP4_AUDIO_NONE, PJ_EINVAL);
+    PJ_ASSERT_RETURN(!param->has_video ||
+		     (param->size.w && param->size.h), PJ_EINVAL);
+    PJ_ASSERT_RETURN(param->audio_codec == PJMEDIA_MP4_AUDIO_NONE ||
+		     (param->clock_rate && param->channel_count),
+		     PJ_EINVAL);
+
+    if (w->param.frag_duration == 0)
+	w->param.frag_duration = PJMEDIA_MP4_WRITER_FRAG_DURATION;
+    if (w->param.fps.num == 0 || w->param.fps.denum == 0) {
+	w->param.fps.num = 15;
+	w->param.fps.denum = 1;
+    }
+    if (w->param.samples_per_frame == 0)
+	w->param.samples_per_frame = 1024;
+
+    if (param->has_video) {
+	struct mp4_track *t = &w->track[TRACK_VIDEO];
+
+	pjmedia_format_init_video(&fmt, PJMEDIA_FORMAT_H264,
+				  param->size.w, param->size.h,
+				  param->fps.num, param->fps.denum);
+	t->timescale = t->ts_clock = VIDEO_TIMESCALE;
+	t->def_duration = VIDEO_TIMESCALE * param->fps.denum / param->fps.num;
+	status = init_track(w, t, id++, filename,
+			    PJMEDIA_SIG_PORT_VID_MP4_WRITER, &fmt,
+			    PJMEDIA_MP4_WRITER_VID_BUF_SIZE);
+	if (status != PJ_SUCCESS)
+	    return status;
+    }
+
+    if (param->audio_codec != PJMEDIA_MP4_AUDIO_NONE) {
+	struct mp4_track *t = &w->track[TRACK_AUDIO];
+	pj_bool_t opus = (param->audio_codec == PJMEDIA_MP4_AUDIO_OPUS);
+
+	pjmedia_format_init_audio(&fmt, opus? PJMEDIA_FORMAT_OPUS :
+					      PJMEDIA_FORMAT_AAC,
+				  param->clock_rate, param->channel_count,
+				  16, param->samples_per_frame * 1000 /
+				      param->clock_rate * 1000, 0, 0);
+	t->timescale = opus? OPUS_TIMESCALE : param->clock_rate;
+	t->ts_clock = param->clock_rate;
+	t->def_duration = (pj_uint32_t)((pj_uint64_t)param->samples_per_frame *
+					t->timescale / t->ts_clock);
+	status = init_track(w, t, id++, filename,
+			    PJMEDIA_SIG_PORT_MP4_WRITER, &fmt,
+			    PJMEDIA_MP4_WRITER_AUD_BUF_SIZE);
+	if (status != PJ_SUCCESS)
+	    return status;
+
+	aac_make_asc(w->asc, param->clock_rate, param->channel_count);
+    }
+
+    w->box_buf_size = (MOOV_BUF_SIZE > MOOF_BUF_SIZE) ? MOOV_BUF_SIZE :
+		      MOOF_BUF_SIZE;
+    w->box_buf = (pj_uint8_t*) pj_pool_alloc(pool, w->box_buf_size);
+
+    status = pj_mutex_create_simple(pool, "mp4w%p", &w->mutex);
+    if (status != PJ_SUCCESS)
+	return status;
+
+    status = pj_file_open(pool, filename, PJ_O_WRONLY, &w->fd);
+    if (status != PJ_SUCCESS) {
+	pj_mutex_destroy(w->mutex);
+	return status;
+    }
+
+    PJ_LOG(4,(THIS_FILE, "MP4 writer '%s' created: video=%s audio=%s",
+	      filename, param->has_video? "H264" : "none",
+	      param->audio_codec == PJMEDIA_MP4_AUDIO_AAC? "AAC" :
+	      (param->audio_codec == PJMEDIA_MP4_AUDIO_OPUS? "Opus":"none")));
+
+    *p_writer = w;
+    return PJ_SUCCESS;
+}
+
+
+PJ_DEF(pjmedia_port*) pjmedia_mp4_writer_get_port(pjmedia_mp4_writer *writer,
+						  pjmedia_type type)
+{
+    struct mp4_track *t;
+
+    PJ_ASSERT_RETURN(writer, NULL);
+
+    if (type == PJMEDIA_TYPE_VIDEO)
+	t = &writer->track[TRACK_VIDEO];
+    else if (type == PJMEDIA_TYPE_AUDIO)
+	t = &writer->track[TRACK_AUDIO];
+    else
+	return NULL;
+
+    return t->enabled? &t->base : NULL;
+}
+
+
+PJ_DEF(pj_off_t) pjmedia_mp4_writer_get_size(pjmedia_mp4_writer *writer)
+{
+    pj_off_t size;
+
+    PJ_ASSERT_RETURN(writer, -PJ_EINVAL);
+
+    pj_mutex_lock(writer->mutex);
+    size = writer->file_size;
+    pj_mutex_unlock(writer->mutex);
+
+    return size;
+}
+
+
+static pj_status_t write_file(pjmedia_mp4_writer *w, const void *data,
+			      pj_size_t len)
+{
+    pj_ssize_t size = (pj_ssize_t)len;
+    pj_status_t status;
+
+    status = pj_file_write(w->fd, data, &size);
+    if (status != PJ_SUCCESS)
+	return status;
+
+    w->file_size += size;
+    return PJ_SUCCESS;
+}
+
+
+/* The sample entry of a track, inside stsd. */
+static void put_sample_entry(pjmedia_mp4_writer *w, bs_t *bs,
+			     struct mp4_track *t)
+{
+    pj_uint8_t *entry, *box;
+
+    if (t == &w->track[TRACK_VIDEO]) {
+	entry = box_open(bs, "avc1");
+	put_zero(bs, 6);
+	put16(bs, 1);			    /* data_reference_index	*/
+	put_zero(bs, 16);
+	put16(bs, w->param.size.w);
+	put16(bs, w->param.size.h);
+	put32(bs, 0x00480000);		    /* 72 dpi			*/
+	put32(bs, 0x00480000);
+	put32(bs, 0);
+	put16(bs, 1);			    /* frame_count		*/
+	put_zero(bs, 32);		    /* compressorname		*/
+	put16(bs, 0x0018);
+	put16(bs, 0xFFFF);
+
+	box = box_open(bs, "avcC");
+	put8(bs, 1);
+	put8(bs, w->sps[1]);		    /* profile, compat, level	*/
+	put8(bs, w->sps[2]);
+	put8(bs, w->sps[3]);
+	put8(bs, 0xFF);			    /* 4 byte NAL lengths	*/
+	put8(bs, 0xE1);			    /* one SPS			*/
+	put16(bs, w->sps_len);
+	pj_memcpy(bs->p, w->sps, w->sps_len);
+	bs->p += w->sps_len;
+	put8(bs, 1);			    /* one PPS			*/
+	put16(bs, w->pps_len);
+	pj_memcpy(bs->p, w->pps, w->pps_len);
+	bs->p += w->pps_len;
+	box_close(bs, box);
+
+	box_close(bs, entry);
+	return;
+    }
+
+    entry = box_open(bs, w->param.audio_codec == PJMEDIA_MP4_AUDIO_OPUS?
+			 "Opus" : "mp4a");
+    put_zero(bs, 6);
+    put16(bs, 1);			    /* data_reference_index	*/
+    put_zero(bs, 8);
+    put16(bs, w->param.channel_count);
+    put16(bs, 16);			    /* samplesize		*/
+    put32(bs, 0);
+    put32(bs, (t->timescale & 0xFFFF) << 16);
+
+    if (w->param.audio_codec == PJMEDIA_MP4_AUDIO_OPUS) {
+	box = box_open(bs, "dOps");
+	put8(bs, 0);			    /* Version			*/
+	put8(bs, w->param.channel_count);
+	put16(bs, OPUS_PRE_SKIP);
+	put32(bs, w->param.clock_rate);	    /* InputSampleRate		*/
+	put16(bs, 0);			    /* OutputGain		*/
+	put8(bs, 0);			    /* ChannelMappingFamily	*/
+	box_close(bs, box);
+    } else {
+	box = full_box_open(bs, "esds", 0, 0);
+	put8(bs, 0x03);			    /* ES_Descriptor		*/
+	put8(bs, 23 + sizeof(w->asc));
+	put16(bs, t->id);
+	put8(bs, 0);
+	put8(bs, 0x04);			    /* DecoderConfigDescriptor	*/
+	put8(bs, 15 + sizeof(w->asc));
+	put8(bs, 0x40);			    /* MPEG-4 audio		*/
+	put8(bs, 0x15);			    /* AudioStream		*/
+	put24(bs, 0);
+	put32(bs, 0);
+	put32(bs, 0);
+	put8(bs, 0x05);			    /* DecoderSpecificInfo	*/
+	put8(bs, sizeof(w->asc));
+	put8(bs, w->asc[0]);
+	put8(bs, w->asc[1]);
+	put8(bs, 0x06);			    /* SLConfigDescriptor	*/
+	put8(bs, 1);
+	put8(bs, 0x02);
+	box_close(bs, box);
+    }
+
+    box_close(bs, entry);
+}
+
+
+/* Write ftyp and moov. The moov has no samples; they are all in the
+ * fragments.
+ */
+static pj_status_t write_header(pjmedia_mp4_writer *w)
+{
+    bs_t bs;
+    pj_uint8_t *moov, *box, *trak, *mdia, *minf, *dinf, *stbl, *mvex;
+    unsigned i;
+
+    bs.start = bs.p = w->box_buf;
+
+    box = box_open(&bs, "ftyp");
+    put_tag(&bs, "iso5");
+    put32(&bs, 512);
+    put_tag(&bs, "iso5");
+    put_tag(&bs, "iso6");
+    put_tag(&bs, "mp41");
+    box_close(&bs, box);
+
+    moov = box_open(&bs, "moov");
+
+    box = full_box_open(&bs, "mvhd", 0, 0);
+    put32(&bs, 0);			    /* creation_time		*/
+    put32(&bs, 0);			    /* modification_time	*/
+    put32(&bs, 1000);			    /* timescale		*/
+    put32(&bs, 0);			    /* duration			*/
+    put32(&bs, 0x00010000);		    /* rate			*/
+    put16(&bs, 0x0100);			    /* volume			*/
+    put_zero(&bs, 10);
+    put_matrix(&bs);
+    put_zero(&bs, 24);
+    put32(&bs, TRACK_CNT + 1);		    /* next_track_ID		*/
+    box_close(&bs, box);
+
+    for (i = 0; i < TRACK_CNT; ++i) {
+	struct mp4_track *t = &w->track[i];
+	pj_bool_t video = (i == TRACK_VIDEO);
+
+	if (!t->enabled)
+	    continue;
+
+	trak = box_open(&bs, "trak");
+
+	box = full_box_open(&bs, "tkhd", 0, 0x000003);
+	put32(&bs, 0);
+	put32(&bs, 0);
+	put32(&bs, t->id);
+	put32(&bs, 0);
+	put32(&bs, 0);			    /* duration			*/
+	put_zero(&bs, 8);
+	put16(&bs, 0);			    /* layer			*/
+	put16(&bs, 0);			    /* alternate_group		*/
+	put16(&bs, video? 0 : 0x0100);	    /* volume			*/
+	put16(&bs, 0);
+	put_matrix(&bs);
+	put32(&bs, video? w->param.size.w << 16 : 0);
+	put32(&bs, video? w->param.size.h << 16 : 0);
+	box_close(&bs, box);
+
+	mdia = box_open(&bs, "mdia");
+
+	box = full_box_open(&bs, "mdhd", 0, 0);
+	put32(&bs, 0);
+	put32(&bs, 0);
+	put32(&bs, t->timescale);
+	put32(&bs, 0);
+	put16(&bs, 0x55C4);		    /* "und"			*/
+	put16(&bs, 0);
+	box_close(&bs, box);
+
+	box = full_box_open(&bs, "hdlr", 0, 0);
+	put32(&bs, 0);
+	put_tag(&bs, video? "vide" : "soun");
+	put_zero(&bs, 12);
+	pj_memcpy(bs.p, video? "VideoHandler" : "SoundHandler", 13);
+	bs.p += 13;
+	box_close(&bs, box);
+
+	minf = box_open(&bs, "minf");
+	if (video) {
+	    box = full_box_open(&bs, "vmhd", 0, 1);
+	    put_zero(&bs, 8);
+	} else {
+	    box = full_box_open(&bs, "smhd", 0, 0);
+	    put_zero(&bs, 4);
+	}
+	box_close(&bs, box);
+
+	dinf = box_open(&bs, "dinf");
+	box = full_box_open(&bs, "dref", 0, 0);
+	put32(&bs, 1);
+	box_close(&bs, full_box_open(&bs, "url ", 0, 1));
+	box_close(&bs, box);
+	box_close(&bs, dinf);
+
+	stbl = box_open(&bs, "stbl");
+	box = full_box_open(&bs, "stsd", 0, 0);
+	put32(&bs, 1);
+	put_sample_entry(w, &bs, t);
+	box_close(&bs, box);
+	box = full_box_open(&bs, "stts", 0, 0);
+	put32(&bs, 0);
+	box_close(&bs, box);
+	box = full_box_open(&bs, "stsc", 0, 0);
+	put32(&bs, 0);
+	box_close(&bs, box);
+	box = full_box_open(&bs, "stsz", 0, 0);
+	put32(&bs, 0);
+	put32(&bs, 0);
+	box_close(&bs, box);
+	box = full_box_open(&bs, "stco", 0, 0);
+	put32(&bs, 0);
+	box_close(&bs, box);
+	box_close(&bs, stbl);
+
+	box_close(&bs, minf);
+	box_close(&bs, mdia);
+	box_close(&bs, trak);
+    }
+
+    mvex = box_open(&bs, "mvex");
+    for (i = 0; i < TRACK_CNT; ++i) {
+	if (!w->track[i].enabled)
+	    continue;
+	box = full_box_open(&bs, "trex", 0, 0);
+	put32(&bs, w->track[i].id);
+	put32(&bs, 1);			    /* sample description index	*/
+	put32(&bs, 0);
+	put32(&bs, 0);
+	put32(&bs, 0);
+	box_close(&bs, box);
+    }
+    box_close(&bs, mvex);
+
+    box_close(&bs, moov);
+
+    pj_assert((unsigned)(bs.p - bs.start) <= w->box_buf_size);
+    w->hdr_written = PJ_TRUE;
+    return write_file(w, bs.start, bs.p - bs.start);
+}
+
+
+/*
+ * Write the samples collected so far as one fragment: a moof with a traf
+ * per track, followed by the mdat with the video samples, then the audio
+ * samples. The sample data is written straight from the track buffers.
+ */
+static pj_status_t flush_fragment(pjmedia_mp4_writer *w)
+{
+    bs_t bs;
+    pj_uint8_t *moof, *box, *traf;
+    pj_uint8_t *data_offset[TRACK_CNT];
+    pj_uint32_t mdat_len = 0, offset;
+    unsigned i, j;
+    pj_status_t status;
+
+    for (i = 0; i < TRACK_CNT; ++i)
+	mdat_len += w->track[i].buf_len;
+    if (mdat_len == 0)
+	return PJ_SUCCESS;
+
+    if (!w->hdr_written) {
+	status = write_header(w);
+	if (status != PJ_SUCCESS)
+	    return status;
+    }
+
+    bs.start = bs.p = w->box_buf;
+    moof = box_open(&bs, "moof");
+
+    box = full_box_open(&bs, "mfhd", 0, 0);
+    put32(&bs, ++w->frag_seq);
+    box_close(&bs, box);
+
+    for (i = 0; i < TRACK_CNT; ++i) {
+	struct mp4_track *t = &w->track[i];
+	pj_bool_t video = (i == TRACK_VIDEO);
+
+	data_offset[i] = NULL;
+	if (t->smp_cnt == 0)
+	    continue;
+
+	traf = box_open(&bs, "traf");
+
+	/* default-base-is-moof */
+	box = full_box_open(&bs, "tfhd", 0, 0x020000);
+	put32(&bs, t->id);
+	box_close(&bs, box);
+
+	box = full_box_open(&bs, "tfdt", 1, 0);
+	put64(&bs, t->frag_dts);
+	box_close(&bs, box);
+
+	/* data-offset, sample-duration, sample-size (and sample-flags for
+	 * video) present
+	 */
+	box = full_box_open(&bs, "trun", 0, video? 0x000701 : 0x000301);
+	put32(&bs, t->smp_cnt);
+	data_offset[i] = bs.p;
+	put32(&bs, 0);
+	for (j = 0; j < t->smp_cnt; ++j) {
+	    put32(&bs, t->smp[j].duration);
+	    put32(&bs, t->smp[j].size);
+	    if (video)
+		put32(&bs, t->smp[j].key? SAMPLE_FLAGS_SYNC :
+					  SAMPLE_FLAGS_NON_SYNC);
+	}
+	box_close(&bs, box);
+
+	box_close(&bs, traf);
+    }
+    box_close(&bs, moof);
+
+    /* The data offsets are relative to the start of moof */
+    offset = (pj_uint32_t)(bs.p - moof) + 8;
+    for (i = 0; i < TRACK_CNT; ++i) {
+	if (data_offset[i]) {
+	    bs_t off;
+	    off.p = data_offset[i];
+	    put32(&off, offset);
+	    offset += w->track[i].buf_len;
+	}
+    }
+
+    put32(&bs, mdat_len + 8);
+    put_tag(&bs, "mdat");
+
+    pj_assert((unsigned)(bs.p - bs.start) <= w->box_buf_size);
+    status = write_file(w, bs.start, bs.p - bs.start);
+
+    for (i = 0; i < TRACK_CNT && status == PJ_SUCCESS; ++i) {
+	struct mp4_track *t = &w->track[i];
+	if (t->buf_len)
+	    status = write_file(w, t->buf, t->buf_len);
+    }
+
+    for (i = 0; i < TRACK_CNT; ++i) {
+	w->track[i].buf_len = 0;
+	w->track[i].smp_cnt = 0;
+    }
+
+    return status;
+}
+
+
+/* Find the next NAL unit of an Annex-B access unit. */
+static const pj_uint8_t *next_nal(const pj_uint8_t *p, const pj_uint8_t *end,
+				  unsigned *nal_len)
+{
+    const pj_uint8_t *nal, *q;
+
+    /* Skip the start code */
+    p = pjmedia_annexb_find_start_code(p, end);
+    if (!p)
+	return NULL;
+    nal = p + 3;
+
+    /* Find the next start code; the zero before a 4 byte start code
+     * doesn't belong to this NAL unit. Emulation prevention bytes are
+     * skipped.
+     */
+    for (q = nal; (q = pjmedia_annexb_find_escape(q, end)) != NULL; ++q) {
+	if (q[2] <= 1)
+	    break;
+    }
+    if (!q)
+	q = end;
+
+    *nal_len = (unsigned)(q - nal);
+    return nal;
+}
+
+
+/* Set the time of a new sample, and the duration of the previous one. */
+static pj_uint64_t track_next_dts(pjmedia_mp4_writer *w, struct mp4_track *t,
+				  pj_uint32_t ts)
+{
+    pj_int32_t delta;
+
+    if (!t->started) {
+	pj_timestamp now;
+
+	t->started = PJ_TRUE;
+	t->last_ts = ts;
+
+	/* Align the start of a track to the first started track */
+	pj_get_timestamp(&now);
+	if (w->start_time.u64 == 0) {
+	    w->start_time = now;
+	    t->last_dts = 0;
+	} else {
+	    t->last_dts = (pj_uint64_t)pj_elapsed_msec(&w->start_time, &now) *
+			  t->timescale / 1000;
+	}
+	return t->last_dts;
+    }
+
+    delta = (pj_int32_t)(ts - t->last_ts);
+    if (delta <= 0 || (pj_uint32_t)delta > t->ts_clock * 10) {
+	delta = (pj_int32_t)t->def_duration;
+    } else if (t->timescale != t->ts_clock) {
+	delta = (pj_int32_t)((pj_int64_t)delta * t->timescale / t->ts_clock);
+    }
+
+    t->last_ts = ts;
+    t->last_duration = (pj_uint32_t)delta;
+    if (t->smp_cnt)
+	t->smp[t->smp_cnt - 1].duration = (pj_uint32_t)delta;
+
+    t->last_dts += delta;
+    return t->last_dts;
+}
+
+
+/* Check whether the current fragment should be closed before adding a
+ * sample to track t.
+ */
+static pj_bool_t need_flush(pjmedia_mp4_writer *w, struct mp4_track *t,
+			    pj_uint64_t dts, unsigned size, pj_bool_t key)
+{
+    struct mp4_track *main_t;
+
+    if (t->smp_cnt == PJMEDIA_MP4_WRITER_MAX_SAMPLES ||
+	t->buf_len + size > t->buf_size)
+    {
+	return PJ_TRUE;
+    }
+
+    /* Fragments start at a video key frame when there's video */
+    main_t = w->track[TRACK_VIDEO].enabled? &w->track[TRACK_VIDEO] :
+					    &w->track[TRACK_AUDIO];
+    if (t != main_t || !key || t->smp_cnt == 0)
+	return PJ_FALSE;
+
+    return dts - t->frag_dts >=
+	   (pj_uint64_t)w->param.frag_duration * t->timescale / 1000;
+}
+
+
+static void track_add_sample(struct mp4_track *t, pj_uint64_t dts,
+			     unsigned size, pj_bool_t key)
+{
+    struct mp4_sample *s = &t->smp[t->smp_cnt++];
+
+    if (t->smp_cnt == 1)
+	t->frag_dts = dts;
+
+    s->size = size;
+    s->duration = t->last_duration;
+    s->key = key;
+}
+
+
+static pj_status_t put_video(pjmedia_mp4_writer *w, struct mp4_track *t,
+			     const pjmedia_frame *frame)
+{
+    const pj_uint8_t *p = (const pj_uint8_t*)frame->buf;
+    const pj_uint8_t *end = p + frame->size;
+    const pj_uint8_t *nal;
+    unsigned nal_len, size = 0;
+    pj_bool_t key = PJ_FALSE;
+    pj_uint64_t dts;
+    pj_status_t status;
+
+    /* First pass: sample size, key frame, and parameter sets. SPS, PPS
+     * and access unit delimiters are not stored in the samples.
+     */
+    for (nal = next_nal(p, end, &nal_len); nal;
+	 nal = next_nal(nal + nal_len, end, &nal_len))
+    {
+	unsigned type;
+
+	if (nal_len == 0)
+	    continue;
+
+	type = nal[0] & 0x1F;
+	if (type == 7) {
+	    if (nal_len >= 4 && nal_len <= MAX_PARAM_SET_LEN) {
+		pj_memcpy(w->sps, nal, nal_len);
+		w->sps_len = nal_len;
+	    }
+	} else if (type == 8) {
+	    if (nal_len <= MAX_PARAM_SET_LEN) {
+		pj_memcpy(w->pps, nal, nal_len);
+		w->pps_len = nal_len;
+	    }
+	} else if (type != 9) {
+	    if (type == 5)
+		key = PJ_TRUE;
+	    size += 4 + nal_len;
+	}
+    }
+
+    if (size == 0)
+	return PJ_SUCCESS;
+
+    /* The track starts with a key frame with known parameter sets */
+    if (!t->started && (!key || !w->sps_len || !w->pps_len)) {
+	++t->dropped;
+	return PJ_SUCCESS;
+    }
+
+    if (size > t->buf_size) {
+	PJ_LOG(4,(THIS_FILE, "Video frame of %u bytes too large, dropped",
+		  size));
+	++t->dropped;
+	return PJ_ETOOBIG;
+    }
+
+    dts = track_next_dts(w, t, frame->timestamp.u32.lo);
+    if (need_flush(w, t, dts, size, key)) {
+	status = flush_fragment(w);
+	if (status != PJ_SUCCESS)
+	    return status;
+    }
+
+    /* Second pass: store the NAL units with 4 byte length prefixes */
+    for (nal = next_nal(p, end, &nal_len); nal;
+	 nal = next_nal(nal + nal_len, end, &nal_len))
+    {
+	pj_uint8_t *q = t->buf + t->buf_len;
+	unsigned type;
+
+	if (nal_len == 0)
+	    continue;
+	type = nal[0] & 0x1F;
+	if (type == 7 || type == 8 || type == 9)
+	    continue;
+
+	q[0] = (pj_uint8_t)(nal_len >> 24);
+	q[1] = (pj_uint8_t)(nal_len >> 16);
+	q[2] = (pj_uint8_t)(nal_len >> 8);
+	q[3] = (pj_uint8_t)nal_len;
+	pj_memcpy(q + 4, nal, nal_len);
+	t->buf_len += 4 + nal_len;
+    }
+
+    track_add_sample(t, dts, size, key);
+    return PJ_SUCCESS;
+}
+
+
+static pj_status_t put_audio(pjmedia_mp4_writer *w, struct mp4_track *t,
+			     const pjmedia_frame *frame)
+{
+    const pj_uint8_t *p = (const pj_uint8_t*)frame->buf;
+    unsigned size = (unsigned)frame->size;
+    pj_uint64_t dts;
+    pj_status_t status;
+
+    /* Start the audio together with the video */
+    if (w->track[TRACK_VIDEO].enabled && !w->track[TRACK_VIDEO].started)
+	return PJ_SUCCESS;
+
+    /* Strip the ADTS header. The first one also tells the actual
+     * AudioSpecificConfig.
+     */
+    if (w->param.audio_codec == PJMEDIA_MP4_AUDIO_AAC && size > 7 &&
+	p[0] == 0xFF && (p[1] & 0xF6) == 0xF0)
+    {
+	unsigned hdr_len = (p[1] & 0x01)? 7 : 9;
+
+	if (!t->started && !w->hdr_written) {
+	    unsigned profile = ((p[2] >> 6) & 0x03) + 1;
+	    unsigned sf_idx = (p[2] >> 2) & 0x0F;
+	    unsigned chan = ((p[2] & 0x01) << 2) | (p[3] >> 6);
+
+	    w->asc[0] = (pj_uint8_t)((profile << 3) | (sf_idx >> 1));
+	    w->asc[1] = (pj_uint8_t)(((sf_idx & 1) << 7) | (chan << 3));
+	}
+
+	if (size <= hdr_len)
+	    return PJ_SUCCESS;
+	p += hdr_len;
+	size -= hdr_len;
+    }
+
+    if (size > t->buf_size) {
+	++t->dropped;
+	return PJ_ETOOBIG;
+    }
+
+    dts = track_next_dts(w, t, frame->timestamp.u32.lo);
+    if (need_flush(w, t, dts, size, PJ_TRUE)) {
+	status = flush_fragment(w);
+	if (status != PJ_SUCCESS)
+	    return status;
+    }
+
+    pj_memcpy(t->buf + t->buf_len, p, size);
+    t->buf_len += size;
+    track_add_sample(t, dts, size, PJ_TRUE);
+    return PJ_SUCCESS;
+}
+
+
+/*
+ * Put an encoded frame to a track.
+ */
+static pj_status_t mp4_put_frame(pjmedia_port *this_port,
+				 pjmedia_frame *frame)
+{
+    struct mp4_track *t = (struct mp4_track*)this_port;
+    pjmedia_mp4_writer *w = t->writer;
+    pj_status_t status;
+
+    if (frame->type == PJMEDIA_FRAME_TYPE_NONE || frame->size == 0)
+	return PJ_SUCCESS;
+
+    pj_mutex_lock(w->mutex);
+    if (w->fd == NULL) {
+	status = PJ_EINVALIDOP;
+    } else if (t == &w->track[TRACK_VIDEO]) {
+	status = put_video(w, t, frame);
+    } else {
+	status = put_audio(w, t, frame);
+    }
+    pj_mutex_unlock(w->mutex);
+
+    return status;
+}
+
+
+static pj_status_t mp4_get_frame(pjmedia_port *this_port,
+				 pjmedia_frame *frame)
+{
+    PJ_UNUSED_ARG(this_port);
+    PJ_UNUSED_ARG(frame);
+    return PJ_EINVALIDOP;
+}
+
+
+/* The ports belong to the writer, see pjmedia_mp4_writer_destroy(). */
+static pj_status_t mp4_on_destroy(pjmedia_port *this_port)
+{
+    PJ_UNUSED_ARG(this_port);
+    return PJ_SUCCESS;
+}
+
+
+PJ_DEF(pj_status_t) pjmedia_mp4_writer_destroy(pjmedia_mp4_writer *writer)
+{
+    pj_status_t status;
+    unsigned i;
+
+    PJ_ASSERT_RETURN(writer, PJ_EINVAL);
+
+    pj_mutex_lock(writer->mutex);
+
+    status = flush_fragment(writer);
+    pj_file_close(writer->fd);
+    writer->fd = NULL;
+
+    for (i = 0; i < TRACK_CNT; ++i) {
+	if (writer->track[i].dropped) {
+	    PJ_LOG(4,(THIS_FILE, "MP4 writer: %u frames of track %u dropped",
+		      writer->track[i].dropped, writer->track[i].id));
+	}
+    }
+
+    pj_mutex_unlock(writer->mutex);
+    pj_mutex_destroy(writer->mutex);
+
+    return status;
+}
+
+
+#endif	/* PJMEDIA_HAS_MP4_WRITER */
@@ -0,0 +1,404 @@
+/* $Id$ */
+/*
+ * Copyright (C) 2008-2011 Teluu Inc. (http://www.teluu.com)
+ * Copyright (C) 2003-2008 Benny Prijono <benny@prijono.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include <pjmedia/resample.h>
+#include <pjmedia/errno.h>
+#include <pj/assert.h>
+#include <pj/log.h>
+#include <pj/pool.h>
+
+#if PJMEDIA_RESAMPLE_IMP==PJMEDIA_RESAMPLE_POLYPHASE
+
+#include <math.h>
+
+#if PJMEDIA_RESAMPLE_POLYPHASE_USE_SIMD
+#   if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#	include <arm_neon.h>
+#	define RESAMPLE_HAS_NEON	1
+#   elif defined(__SSE2__) || defined(_M_X64) || \
+	 (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	include <emmintrin.h>
+#	define RESAMPLE_HAS_SSE2	1
+#   endif
+#endif
+
+#define THIS_FILE   "resample_polyphase.c"
+
+#ifndef M_PI
+#   define M_PI	    3.14159265358979323846
+#endif
+
+/* Taps of a phase are processed 8 at a time */
+#define TAP_ALIGN	8
+
+/* Largest number of phases (the reduced output rate), which keeps the
+ * filter bank within a few hundred KB.
+ */
+#define MAX_PHASES	2048
+
+/* Largest number of taps per phase, when downsampling by a large factor */
+#define MAX_TAPS	256
+
+/* Passband edge, relative to the lower Nyquist frequency */
+#define CUTOFF		0.92
+
+
+/*
+ * The output is the input upsampled by L, lowpass filtered and decimated
+ * by M, where L/M is rate_out/rate_in in lowest terms. Only the filter
+ * taps which fall on input samples are computed, so the prototype filter
+ * of taps*L coefficients is stored as L phases of taps coefficients each,
+ * in Q15 and in the order of the input samples.
+ *
+ * Output n of a frame uses the input samples up to (n*M)/L with phase
+ * (n*M)%L. The frame sizes are exact multiples, so every frame starts at
+ * phase 0 and only the last taps-1 input samples are kept as history.
+ * Outputs whose taps are all in the input frame read the frame in place;
+ * the first few read a small buffer with the history followed by the
+ * start of the frame.
+ */
+struct pjmedia_resample
+{
+    unsigned	 channel_cnt;	/* Channel count.			    */
+    unsigned	 in_frm;	/* Input samples per frame, per channel.    */
+    unsigned	 out_frm;	/* Output samples per frame, per channel.   */
+    unsigned	 phase_cnt;	/* L, number of phases.			    */
+    unsigned	 step;		/* M, input step per output in phases.	    */
+    unsigned	 taps;		/* Taps per phase, multiple of TAP_ALIGN.   */
+    pj_int16_t	*bank;		/* phase_cnt * taps coefficients.	    */
+
+    pj_int16_t **hist;		/* History (taps-1) of each channel.	    */
+    pj_int16_t	*edge;		/* History + start of the frame.	    */
+
+    /* Buffers for multichannel */
+    pj_int16_t	*in_buf;	/* Deinterleaved input of one channel.	    */
+    pj_int16_t	*out_buf;	/* Output of one channel.		    */
+};
+
+
+static unsigned gcd(unsigned a, unsigned b)
+{
+    while (b) {
+	unsigned t = a % b;
+	a = b;
+	b = t;
+    }
+    return a;
+}
+
+/* Zeroth order modified Bessel function of the first kind */
+static double bessel_i0(double x)
+{
+    double sum = 1.0, term = 1.0;
+    unsigned k;
+
+    for (k = 1; k < 50 && term > sum * 1e-12; ++k) {
+	term *= (x / (2.0 * k)) * (x / (2.0 * k));
+	sum += term;
+    }
+    return sum;
+}
+
+/*
+ * Kaiser windowed sinc, split in phases. Each phase is normalized to unity
+ * DC gain so that a constant input gives a constant output.
+ */
+static void design_bank(pjmedia_resample *resample, double cutoff,
+			double beta)
+{
+    unsigned L = resample->phase_cnt, N = resample->taps;
+    double center = (N * L - 1) / 2.0;
+    double i0_beta = bessel_i0(beta);
+    unsigned p, k;
+
+    for (p = 0; p < L; ++p) {
+	pj_int16_t *coef = resample->bank + p * N;
+	double h[MAX_TAPS], sum = 0;
+
+	for (k = 0; k < N; ++k) {
+	    /* Tap k of the phase multiplies input sample ipos-(N-1)+k,
+	     * which is (N-1-k)*L+p prototype taps back.
+	     */
+	    double t = (N - 1 - k) * (double)L + p - center;
+	    double r = t / center;
+	    double x = 2 * M_PI * cutoff * t;
+	    double w = (r <= 1.0 && r >= -1.0) ?
+		       bessel_i0(beta * sqrt(1.0 - r * r)) / i0_beta : 0;
+
+	    h[k] = (t == 0 ? 1.0 : sin(x) / x) * w;
+	    sum += h[k];
+	}
+
+	for (k = 0; k < N; ++k) {
+	    double v = h[k] / sum * 32768.0;
+	    v = (v >= 0) ? v + 0.5 : v - 0.5;
+	    if (v > 32767) v = 32767;
+	    if (v < -32768) v = -32768;
+	    coef[k] = (pj_int16_t) v;
+	}
+    }
+}
+
+
+/* Q15 inner product of taps (multiple of TAP_ALIGN) samples */
+#if defined(RESAMPLE_HAS_NEON)
+PJ_INLINE(pj_int32_t) dot_product(const pj_int16_t *x, const pj_int16_t *c,
+				  unsigned taps)
+{
+    int32x4_t acc = vdupq_n_s32(0);
+    int32x2_t sum;
+    unsigned k;
+
+    for (k = 0; k < taps; k += TAP_ALIGN) {
+	int16x8_t vx = vld1q_s16(x + k);
+	int16x8_t vc = vld1q_s16(c + k);
+	acc = vmlal_s16(acc, vget_low_s16(vx), vget_low_s16(vc));
+	acc = vmlal_s16(acc, vget_high_s16(vx), vget_high_s16(vc));
+    }
+    sum = vadd_s32(vget_low_s32(acc), vget_high_s32(acc));
+    return vget_lane_s32(vpadd_s32(sum, sum), 0);
+}
+#elif defined(RESAMPLE_HAS_SSE2)
+PJ_INLINE(pj_int32_t) dot_product(const pj_int16_t *x, const pj_int16_t *c,
+				  unsigned taps)
+{
+    __m128i acc = _mm_setzero_si128();
+    unsigned k;
+
+    for (k = 0; k < taps; k += TAP_ALIGN) {
+	__m128i vx = _mm_loadu_si128((const __m128i*)(x + k));
+	__m128i vc = _mm_loadu_si128((const __m128i*)(c + k));
+	acc = _mm_add_epi32(acc, _mm_madd_epi16(vx, vc));
+    }
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1,0,3,2)));
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2,3,0,1)));
+    return _mm_cvtsi128_si32(acc);
+}
+#else
+PJ_INLINE(pj_int32_t) dot_product(const pj_int16_t *x, const pj_int16_t *c,
+				  unsigned taps)
+{
+    pj_int32_t acc = 0;
+    unsigned k;
+
+    for (k = 0; k < taps; ++k)
+	acc += (pj_int32_t)x[k] * c[k];
+    return acc;
+}
+#endif
+
+PJ_INLINE(pj_int16_t) q15_to_sample(pj_int32_t acc)
+{
+    acc = (acc + (1 << 14)) >> 15;
+    if (acc > 32767) return 32767;
+    if (acc < -32768) return -32768;
+    return (pj_int16_t) acc;
+}
+
+
+/* Resample one frame of one channel */
+static void resample_channel(pjmedia_resample *resample, pj_int16_t *hist,
+			     const pj_int16_t *input, pj_int16_t *output)
+{
+    unsigned taps = resample->taps, L = resample->phase_cnt;
+    unsigned adv = resample->step / L, frac = resample->step % L;
+    unsigned hist_len = taps - 1;
+    unsigned edge_len = (resample->in_frm < hist_len) ? resample->in_frm :
+							 hist_len;
+    unsigned ipos = 0, phase = 0, n;
+
+    /* History followed by the start of the frame */
+    pjmedia_copy_samples(resample->edge, hist, hist_len);
+    pjmedia_copy_samples(resample->edge + hist_len, input, edge_len);
+
+    for (n = 0; n < resample->out_frm; ++n) {
+	const pj_int16_t *coef = resample->bank + phase * taps;
+	const pj_int16_t *x;
+
+	if (ipos >= hist_len)
+	    x = input + ipos - hist_len;
+	else
+	    x = resample->edge + ipos;
+	output[n] = q15_to_sample(dot_product(x, coef, taps));
+
+	ipos += adv;
+	phase += frac;
+	if (phase >= L) {
+	    phase -= L;
+	    ++ipos;
+	}
+    }
+    pj_assert(ipos == resample->in_frm && phase == 0);
+
+    /* Keep the last taps-1 samples */
+    if (resample->in_frm >= hist_len) {
+	pjmedia_copy_samples(hist, input + resample->in_frm - hist_len,
+			     hist_len);
+    } else {
+	pjmedia_copy_samples(hist, resample->edge + resample->in_frm,
+			     hist_len);
+    }
+}
+
+
+PJ_DEF(pj_status_t) pjmedia_resample_create( pj_pool_t *pool,
+					     pj_bool_t high_quality,
+					     pj_bool_t large_filter,
+					     unsigned channel_count,
+					     unsigned rate_in,
+					     unsigned rate_out,
+					     unsigned samples_per_frame,
+					     pjmedia_resample **p_resample)
+{
+    pjmedia_resample *resample;
+    unsigned g, taps, ch;
+    double cutoff, beta;
+
+    PJ_ASSERT_RETURN(pool && p_resample && rate_in &&
+		     rate_out && samples_per_frame && channel_count, PJ_EINVAL);
+    PJ_ASSERT_RETURN(samples_per_frame % channel_count == 0, PJ_EINVAL);
+
+    resample = PJ_POOL_ZALLOC_T(pool, pjmedia_resample);
+    PJ_ASSERT_RETURN(resample, PJ_ENOMEM);
+
+    g = gcd(rate_in, rate_out);
+    resample->phase_cnt = rate_out / g;
+    resample->step = rate_in / g;
+    resample->channel_cnt = channel_count;
+    resample->in_frm = samples_per_frame / channel_count;
+
+    /* The output frame must be a whole number of samples */
+    if (resample->phase_cnt > MAX_PHASES ||
+	(resample->in_frm * resample->phase_cnt) % resample->step != 0)
+    {
+	PJ_LOG(4,(THIS_FILE, "Unsupported resampling %d->%d with %d "
+			     "samples per frame", rate_in, rate_out,
+			     samples_per_frame));
+	return PJ_ENOTSUP;
+    }
+    resample->out_frm = resample->in_frm * resample->phase_cnt /
+			resample->step;
+
+    /* Filter length, in input samples. Downsampling lowers the cutoff
+     * relative to the input rate, so the filter gets longer to keep the
+     * same transition band.
+     */
+    if (high_quality) {
+	taps = large_filter ? 32 : 16;
+	beta = large_filter ? 9.0 : 7.0;
+    } else {
+	taps = 8;
+	beta = 5.0;
+    }
+    cutoff = CUTOFF * 0.5 / resample->phase_cnt;
+    if (resample->step > resample->phase_cnt) {
+	taps = taps * resample->step / resample->phase_cnt;
+	cutoff = CUTOFF * 0.5 / resample->step;
+    }
+    taps = (taps + TAP_ALIGN - 1) / TAP_ALIGN * TAP_ALIGN;
+    if (taps > MAX_TAPS)
+	taps = MAX_TAPS;
+    resample->taps = taps;
+
+    resample->bank = (pj_int16_t*)
+		     pj_pool_alloc(pool, resample->phase_cnt * taps *
+					 sizeof(pj_int16_t));
+    design_bank(resample, cutoff, beta);
+
+    resample->edge = (pj_int16_t*)
+		     pj_pool_alloc(pool, 2 * (taps - 1) * sizeof(pj_int16_t));
+    resample->hist = (pj_int16_t**)
+		     pj_pool_alloc(pool, channel_count * sizeof(pj_int16_t*));
+    for (ch = 0; ch < channel_count; ++ch) {
+	resample->hist[ch] = (pj_int16_t*)
+			     pj_pool_alloc(pool, (taps - 1) * sizeof(pj_int16_t));
+	pjmedia_zero_samples(resample->hist[ch], taps - 1);
+    }
+
+    if (channel_count > 1) {
+	resample->in_buf = (pj_int16_t*)
+			   pj_pool_alloc(pool, resample->in_frm *
+					       sizeof(pj_int16_t));
+	resample->out_buf = (pj_int16_t*)
+			    pj_pool_alloc(pool, resample->out_frm *
+						sizeof(pj_int16_t));
+    }
+
+    *p_resample = resample;
+
+    PJ_LOG(5,(THIS_FILE, "resample created: %d phases, %d taps, ch=%d, "
+			  "in/out rate=%d/%d",
+			  resample->phase_cnt, taps, channel_count,
+			  rate_in, rate_out));
+    return PJ_SUCCESS;
+}
+
+
+PJ_DEF(void) pjmedia_resample_run( pjmedia_resample *resample,
+				   const pj_int16_t *input,
+				   pj_int16_t *output )
+{
+    unsigned ch, i;
+
+    PJ_ASSERT_ON_FAIL(resample, return);
+
+    if (resample->channel_cnt == 1) {
+	resample_channel(resample, resample->hist[0], input, output);
+	return;
+    }
+
+    for (ch = 0; ch < resample->channel_cnt; ++ch) {
+	const pj_int16_t *src = input + ch;
+	pj_int16_t *dst = output + ch;
+
+	/* Deinterleave input */
+	for (i = 0; i < resample->in_frm; ++i) {
+	    resample->in_buf[i] = *src;
+	    src += resample->channel_cnt;
+	}
+
+	resample_channel(resample, resample->hist[ch], resample->in_buf,
+			 resample->out_buf);
+
+	/* Reinterleave output */
+	for (i = 0; i < resample->out_frm; ++i) {
+	    *dst = resample->out_buf[i];
+	    dst += resample->channel_cnt;
+	}
+    }
+}
+
+
+PJ_DEF(unsigned) pjmedia_resample_get_input_size(pjmedia_resample *resample)
+{
+    PJ_ASSERT_RETURN(resample != NULL, 0);
+    return resample->in_frm * resample->channel_cnt;
+}
+
+
+PJ_DEF(void) pjmedia_resample_destroy(pjmedia_resample *resample)
+{
+    PJ_UNUSED_ARG(resample);
+}
+
+#else /* PJMEDIA_RESAMPLE_IMP==PJMEDIA_RESAMPLE_POLYPHASE */
+
+int pjmedia_resample_polyphase_excluded;
+
+#endif	/* PJMEDIA_RESAMPLE_IMP==PJMEDIA_RESAMPLE_POLYPHASE */
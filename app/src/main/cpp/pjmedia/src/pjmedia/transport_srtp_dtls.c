@@ -753,10 +753,13 @@ static pj_status_t ssl_handshake(dtls_srtp *ds)
 	}
     }
 
-    /* Create and start clock @4Hz for retransmission */
+    /* Create and start clock @4Hz for retransmission. It runs the
+     * handshake in its own thread, away from the shared media clocks.
+     */
     if (!ds->clock) {
 	status = pjmedia_clock_create(ds->pool, 4, 1, 1,
-				      PJMEDIA_CLOCK_NO_HIGHEST_PRIO, clock_cb,
+				      PJMEDIA_CLOCK_NO_HIGHEST_PRIO |
+				      PJMEDIA_CLOCK_OWN_THREAD, clock_cb,
 				      ds, &ds->clock);
 	if (status != PJ_SUCCESS)
 	    goto on_return;
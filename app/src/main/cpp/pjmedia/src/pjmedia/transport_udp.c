@@ -17,6 +17,10 @@
  * along with this program; if not, write to the Free Software
  * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA 
  */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+    /* For recvmmsg() and sendmmsg() */
+#   define _GNU_SOURCE
+#endif
 #include <pjmedia/transport_udp.h>
 #include <pj/addr_resolv.h>
 #include <pj/assert.h>
@@ -27,6 +31,16 @@
 #include <pj/rand.h>
 #include <pj/string.h>
 
+#if PJMEDIA_TRANSPORT_UDP_BATCH_SIZE
+#   include <errno.h>
+#   include <sys/socket.h>
+#   include <netinet/in.h>
+#   include <netinet/udp.h>
+#   if defined(UDP_SEGMENT) && !defined(SOL_UDP)
+#	define SOL_UDP	    IPPROTO_UDP
+#   endif
+#endif
+
 
 /* Maximum size of incoming RTP packet */
 #define RTP_LEN	    PJMEDIA_MAX_MRU
@@ -81,6 +95,14 @@ struct transport_udp
     int			rtp_addrlen;	/**< Address length.		    */
     char		rtp_pkt[RTP_LEN];/**< Incoming RTP packet buffer    */
 
+#if PJMEDIA_TRANSPORT_UDP_BATCH_SIZE
+    char	      (*rx_batch_pkt)[RTP_LEN]; /**< Batch read buffers	    */
+    pj_sockaddr	       *rx_batch_addr;	/**< Batch read source addresses    */
+    struct mmsghdr     *rx_batch_msg;	/**< Batch read headers		    */
+    struct iovec       *rx_batch_iov;	/**< Batch read vectors		    */
+    pj_bool_t		tx_gso_off;	/**< UDP GSO found not supported    */
+#endif
+
     pj_bool_t		enable_rtcp_mux;/**< Enable RTP & RTCP multiplexing?*/
     pj_bool_t		use_rtcp_mux;	/**< Use RTP & RTCP multiplexing?   */
     pj_sock_t		rtcp_sock;	/**< RTCP socket		    */
@@ -363,6 +385,29 @@ PJ_DEF(pj_status_t) pjmedia_transport_udp_attach( pjmedia_endpt *endpt,
 							   sizeof(tp->rtp_pending_write[i].op_key));
 	}
 
+#if PJMEDIA_TRANSPORT_UDP_BATCH_SIZE
+    /* Buffers for batched reads, the vectors don't change afterwards */
+    tp->rx_batch_pkt = (char(*)[RTP_LEN])
+		       pj_pool_alloc(pool, PJMEDIA_TRANSPORT_UDP_BATCH_SIZE *
+					   RTP_LEN);
+    tp->rx_batch_addr = (pj_sockaddr*)
+			pj_pool_calloc(pool, PJMEDIA_TRANSPORT_UDP_BATCH_SIZE,
+				       sizeof(pj_sockaddr));
+    tp->rx_batch_msg = (struct mmsghdr*)
+		       pj_pool_calloc(pool, PJMEDIA_TRANSPORT_UDP_BATCH_SIZE,
+				      sizeof(struct mmsghdr));
+    tp->rx_batch_iov = (struct iovec*)
+		       pj_pool_calloc(pool, PJMEDIA_TRANSPORT_UDP_BATCH_SIZE,
+				      sizeof(struct iovec));
+    for (i=0; i<PJMEDIA_TRANSPORT_UDP_BATCH_SIZE; ++i) {
+	tp->rx_batch_iov[i].iov_base = tp->rx_batch_pkt[i];
+	tp->rx_batch_iov[i].iov_len = RTP_LEN;
+	tp->rx_batch_msg[i].msg_hdr.msg_name = &tp->rx_batch_addr[i];
+	tp->rx_batch_msg[i].msg_hdr.msg_iov = &tp->rx_batch_iov[i];
+	tp->rx_batch_msg[i].msg_hdr.msg_iovlen = 1;
+    }
+#endif
+
 #if 0 // See #2097: move read op kick-off to media_start()
     /* Kick of pending RTP read from the ioqueue */
     tp->rtp_addrlen = sizeof(tp->rtp_src_addr);
@@ -457,6 +502,127 @@ static pj_status_t transport_destroy(pjmedia_transport *tp)
 }
 
 
+/* Report incoming RTP packet to the attached stream */
+static void deliver_rtp(struct transport_udp *udp, void *pkt,
+			pj_ssize_t bytes_read, const pj_sockaddr *src_addr)
+{
+    void (*cb)(void*,void*,pj_ssize_t);
+    void (*cb2)(pjmedia_tp_cb_param*);
+    void *user_data;
+    pj_bool_t discard = PJ_FALSE;
+    pj_bool_t rem_switch = PJ_FALSE;
+
+    cb = udp->rtp_cb;
+    cb2 = udp->rtp_cb2;
+    user_data = udp->user_data;
+
+    /* Simulate packet lost on RX direction */
+    if (udp->rx_drop_pct) {
+	if ((pj_rand() % 100) <= (int)udp->rx_drop_pct) {
+	    PJ_LOG(5,(udp->base.name, 
+		      "RX RTP packet dropped because of pkt lost "
+		      "simulation"));
+	    discard = PJ_TRUE;
+	}
+    }
+
+    //if (!discard && udp->attached && cb)
+    if (!discard) {
+	if (cb2) {
+	    pjmedia_tp_cb_param param;
+
+	    param.user_data = user_data;
+	    param.pkt = pkt;
+	    param.size = bytes_read;
+	    param.src_addr = (pj_sockaddr*)src_addr;
+	    param.rem_switch = PJ_FALSE;
+	    (*cb2)(&param);
+	    rem_switch = param.rem_switch;
+	} else if (cb) {
+	    (*cb)(user_data, pkt, bytes_read);
+	}
+    }
+
+#if defined(PJMEDIA_TRANSPORT_SWITCH_REMOTE_ADDR) && \
+    (PJMEDIA_TRANSPORT_SWITCH_REMOTE_ADDR == 1)
+    if (rem_switch &&
+	(udp->options & PJMEDIA_UDP_NO_SRC_ADDR_CHECKING)==0)
+    {
+	char addr_text[PJ_INET6_ADDRSTRLEN+10];
+
+	/* Set remote RTP address to source address */
+	pj_sockaddr_cp(&udp->rem_rtp_addr, src_addr);
+
+	PJ_LOG(4,(udp->base.name,
+		  "Remote RTP address switched to %s",
+		  pj_sockaddr_print(src_addr, addr_text,
+				    sizeof(addr_text), 3)));
+
+	if (udp->use_rtcp_mux) {
+	    pj_sockaddr_cp(&udp->rem_rtcp_addr, &udp->rem_rtp_addr);
+	    pj_sockaddr_cp(&udp->rtcp_src_addr, &udp->rem_rtcp_addr);
+	} else if (!pj_sockaddr_has_addr(&udp->rtcp_src_addr)) {
+	    /* Also update remote RTCP address if actual RTCP source
+	     * address is not heard yet.
+	     */
+	    pj_uint16_t port;
+
+	    pj_sockaddr_cp(&udp->rem_rtcp_addr, &udp->rem_rtp_addr);
+	    port = (pj_uint16_t)
+		   (pj_sockaddr_get_port(&udp->rem_rtp_addr)+1);
+	    pj_sockaddr_set_port(&udp->rem_rtcp_addr, port);
+
+	    pj_sockaddr_cp(&udp->rtcp_src_addr, &udp->rem_rtcp_addr);
+
+	    PJ_LOG(4,(udp->base.name,
+		      "Remote RTCP address switched to predicted"
+		      " address %s",
+		      pj_sockaddr_print(&udp->rtcp_src_addr, addr_text,
+					sizeof(addr_text), 3)));
+	}
+    }
+#else
+    PJ_UNUSED_ARG(rem_switch);
+#endif
+}
+
+
+#if PJMEDIA_TRANSPORT_UDP_BATCH_SIZE
+/*
+ * Drain the RTP socket with recvmmsg(), PJMEDIA_TRANSPORT_UDP_BATCH_SIZE
+ * packets at a time. Returns PJ_SUCCESS when the socket is empty, so the
+ * next read can be left to the ioqueue.
+ */
+static pj_status_t drain_rtp(struct transport_udp *udp)
+{
+    int i, n;
+
+    do {
+	for (i=0; i<PJMEDIA_TRANSPORT_UDP_BATCH_SIZE; ++i) {
+	    udp->rx_batch_msg[i].msg_hdr.msg_namelen = sizeof(pj_sockaddr);
+	    udp->rx_batch_msg[i].msg_hdr.msg_flags = 0;
+	}
+
+	n = recvmmsg((int)udp->rtp_sock, udp->rx_batch_msg,
+		     PJMEDIA_TRANSPORT_UDP_BATCH_SIZE, MSG_DONTWAIT, NULL);
+	if (n < 0) {
+	    if (errno == EAGAIN || errno == EWOULDBLOCK)
+		return PJ_SUCCESS;
+	    return PJ_RETURN_OS_ERROR(errno);
+	}
+
+	for (i=0; i<n && udp->started; ++i) {
+	    deliver_rtp(udp, udp->rx_batch_pkt[i],
+			udp->rx_batch_msg[i].msg_len,
+			&udp->rx_batch_addr[i]);
+	}
+    } while (n == PJMEDIA_TRANSPORT_UDP_BATCH_SIZE && udp->started);
+
+    return PJ_SUCCESS;
+}
+#endif
+
+
 /* Notification from ioqueue about incoming RTP packet */
 static void on_rx_rtp(pj_ioqueue_key_t *key,
 		      pj_ioqueue_op_key_t *op_key,
@@ -464,7 +630,6 @@ static void on_rx_rtp(pj_ioqueue_key_t *key,
 {
     struct transport_udp *udp;
     pj_status_t status;
-    pj_bool_t rem_switch = PJ_FALSE;
 
     PJ_UNUSED_ARG(op_key);
 
@@ -489,86 +654,26 @@ static void on_rx_rtp(pj_ioqueue_key_t *key,
 #endif
 
     do {
-	void (*cb)(void*,void*,pj_ssize_t);
-	void (*cb2)(pjmedia_tp_cb_param*);
-	void *user_data;
-	pj_bool_t discard = PJ_FALSE;
-
-	cb = udp->rtp_cb;
-	cb2 = udp->rtp_cb2;
-	user_data = udp->user_data;
-
-	/* Simulate packet lost on RX direction */
-	if (udp->rx_drop_pct) {
-	    if ((pj_rand() % 100) <= (int)udp->rx_drop_pct) {
-		PJ_LOG(5,(udp->base.name, 
-			  "RX RTP packet dropped because of pkt lost "
-			  "simulation"));
-		discard = PJ_TRUE;
-	    }
-	}
+	unsigned read_flags = 0;
 
-	//if (!discard && udp->attached && cb)
-	if (!discard) {
-	    if (cb2) {
-		pjmedia_tp_cb_param param;
-
-	    	param.user_data = user_data;
-	    	param.pkt = udp->rtp_pkt;
-	    	param.size = bytes_read;
-	    	param.src_addr = &udp->rtp_src_addr;
-	    	param.rem_switch = PJ_FALSE;
-	    	(*cb2)(&param);
-	    	rem_switch = param.rem_switch;
-	    } else if (cb) {
-	    	(*cb)(user_data, udp->rtp_pkt, bytes_read);
-	    }
-	}
+	deliver_rtp(udp, udp->rtp_pkt, bytes_read, &udp->rtp_src_addr);
 
-#if defined(PJMEDIA_TRANSPORT_SWITCH_REMOTE_ADDR) && \
-    (PJMEDIA_TRANSPORT_SWITCH_REMOTE_ADDR == 1)
-	if (rem_switch &&
-	    (udp->options & PJMEDIA_UDP_NO_SRC_ADDR_CHECKING)==0)
+#if PJMEDIA_TRANSPORT_UDP_BATCH_SIZE
+	/* Read the rest of the burst in batches. When the socket has been
+	 * drained, don't let the ioqueue try another read that would only
+	 * find it empty.
+	 */
+	if (bytes_read > 0 && udp->started &&
+	    drain_rtp(udp) == PJ_SUCCESS)
 	{
-	    char addr_text[PJ_INET6_ADDRSTRLEN+10];
-
-	    /* Set remote RTP address to source address */
-	    pj_sockaddr_cp(&udp->rem_rtp_addr, &udp->rtp_src_addr);
-
-	    PJ_LOG(4,(udp->base.name,
-		      "Remote RTP address switched to %s",
-		      pj_sockaddr_print(&udp->rtp_src_addr, addr_text,
-					sizeof(addr_text), 3)));
-
-	    if (udp->use_rtcp_mux) {
-	    	pj_sockaddr_cp(&udp->rem_rtcp_addr, &udp->rem_rtp_addr);
-	    	pj_sockaddr_cp(&udp->rtcp_src_addr, &udp->rem_rtcp_addr);
-	    } else if (!pj_sockaddr_has_addr(&udp->rtcp_src_addr)) {
-	        /* Also update remote RTCP address if actual RTCP source
-	         * address is not heard yet.
-	         */
-		pj_uint16_t port;
-
-		pj_sockaddr_cp(&udp->rem_rtcp_addr, &udp->rem_rtp_addr);
-		port = (pj_uint16_t)
-		       (pj_sockaddr_get_port(&udp->rem_rtp_addr)+1);
-		pj_sockaddr_set_port(&udp->rem_rtcp_addr, port);
-
-		pj_sockaddr_cp(&udp->rtcp_src_addr, &udp->rem_rtcp_addr);
-
-		PJ_LOG(4,(udp->base.name,
-			  "Remote RTCP address switched to predicted"
-			  " address %s",
-			  pj_sockaddr_print(&udp->rtcp_src_addr, addr_text,
-					    sizeof(addr_text), 3)));
-	    }
+	    read_flags = PJ_IOQUEUE_ALWAYS_ASYNC;
 	}
 #endif
 
 	bytes_read = sizeof(udp->rtp_pkt);
 	udp->rtp_addrlen = sizeof(udp->rtp_src_addr);
 	status = pj_ioqueue_recvfrom(udp->rtp_key, &udp->rtp_read_op,
-				     udp->rtp_pkt, &bytes_read, 0,
+				     udp->rtp_pkt, &bytes_read, read_flags,
 				     &udp->rtp_src_addr, 
 				     &udp->rtp_addrlen);
 
@@ -914,6 +1019,24 @@ static void transport_detach( pjmedia_transport *tp,
 }
 
 
+/* Check if a write on the RTP socket is still queued in the ioqueue */
+static pj_bool_t rtp_write_pending(struct transport_udp *udp)
+{
+    unsigned i;
+
+    for (i=0; i<PJ_ARRAY_SIZE(udp->rtp_pending_write); ++i) {
+	if (pj_ioqueue_is_pending(udp->rtp_key,
+				  &udp->rtp_pending_write[i].op_key))
+	{
+	    return PJ_TRUE;
+	}
+    }
+
+    return udp->use_rtcp_mux &&
+	   pj_ioqueue_is_pending(udp->rtp_key, &udp->rtcp_write_op);
+}
+
+
 /* Called by application to send RTP packet */
 static pj_status_t transport_send_rtp( pjmedia_transport *tp,
 				       const void *pkt,
@@ -942,6 +1065,18 @@ static pj_status_t transport_send_rtp( pjmedia_transport *tp,
     }
 
 
+    /* Send straight from the caller's buffer when nothing is queued in
+     * the ioqueue. The packet only needs to be copied when the socket
+     * would block and the write has to be left pending.
+     */
+    if (!rtp_write_pending(udp)) {
+	sent = size;
+	status = pj_sock_sendto(udp->rtp_sock, pkt, &sent, 0,
+				&udp->rem_rtp_addr, udp->addr_len);
+	if (status != PJ_STATUS_FROM_OS(PJ_BLOCKING_ERROR_VAL))
+	    return status;
+    }
+
     id = udp->rtp_write_op_id;
     pw = &udp->rtp_pending_write[id];
 
@@ -974,6 +1109,164 @@ static pj_status_t transport_send_rtp( pjmedia_transport *tp,
     return status;
 }
 
+#if PJMEDIA_TRANSPORT_UDP_BATCH_SIZE
+
+#if defined(UDP_SEGMENT)
+/*
+ * Write the packets as one UDP GSO datagram, which the kernel splits at
+ * the segment size. All packets but the last must have the same size.
+ * Returns the number of packets sent, zero if the socket would block,
+ * or -1 if GSO can't be used for these packets.
+ */
+static int send_rtp_gso(struct transport_udp *udp, unsigned count,
+			const void *pkt[], const pj_size_t size[])
+{
+    struct iovec iov[PJMEDIA_TRANSPORT_UDP_BATCH_SIZE];
+    union {
+	char buf[CMSG_SPACE(sizeof(pj_uint16_t))];
+	struct cmsghdr align;
+    } ctrl;
+    struct msghdr msg;
+    struct cmsghdr *cm;
+    pj_size_t total = 0;
+    unsigned i;
+
+    for (i=0; i<count; ++i) {
+	if ((i < count-1 && size[i] != size[0]) || size[i] > size[0])
+	    return -1;
+	iov[i].iov_base = (void*)pkt[i];
+	iov[i].iov_len = size[i];
+	total += size[i];
+    }
+    if (total > 0xFFFF - 8 - 40)
+	return -1;
+
+    pj_bzero(&msg, sizeof(msg));
+    pj_bzero(&ctrl, sizeof(ctrl));
+    msg.msg_name = &udp->rem_rtp_addr;
+    msg.msg_namelen = udp->addr_len;
+    msg.msg_iov = iov;
+    msg.msg_iovlen = count;
+    msg.msg_control = ctrl.buf;
+    msg.msg_controllen = sizeof(ctrl.buf);
+
+    cm = CMSG_FIRSTHDR(&msg);
+    cm->cmsg_level = SOL_UDP;
+    cm->cmsg_type = UDP_SEGMENT;
+    cm->cmsg_len = CMSG_LEN(sizeof(pj_uint16_t));
+    *(pj_uint16_t*)CMSG_DATA(cm) = (pj_uint16_t)size[0];
+
+    if (sendmsg((int)udp->rtp_sock, &msg, MSG_DONTWAIT) >= 0)
+	return (int)count;
+
+    if (errno == EAGAIN || errno == EWOULDBLOCK)
+	return 0;
+
+    if (errno == EIO || errno == EINVAL || errno == ENOPROTOOPT ||
+	errno == EOPNOTSUPP)
+    {
+	/* Not supported by the kernel or the interface */
+	PJ_LOG(5,(udp->base.name, "UDP GSO not available (errno %d), "
+		  "using sendmmsg()", errno));
+	udp->tx_gso_off = PJ_TRUE;
+    }
+    return -1;
+}
+#endif	/* UDP_SEGMENT */
+
+
+/*
+ * Write the packets straight to the RTP socket. Returns the number of
+ * packets sent; the caller queues the rest through the ioqueue.
+ */
+static unsigned send_rtp_batch(struct transport_udp *udp, unsigned count,
+			       const void *pkt[], const pj_size_t size[])
+{
+    struct mmsghdr msg[PJMEDIA_TRANSPORT_UDP_BATCH_SIZE];
+    struct iovec iov[PJMEDIA_TRANSPORT_UDP_BATCH_SIZE];
+    unsigned i, sent = 0;
+
+    /* Don't overtake packets still pending in the ioqueue */
+    if (rtp_write_pending(udp))
+	return 0;
+
+    while (sent < count) {
+	unsigned n = PJ_MIN(count - sent, PJMEDIA_TRANSPORT_UDP_BATCH_SIZE);
+	int ret;
+
+#if defined(UDP_SEGMENT)
+	if (!udp->tx_gso_off && n > 1) {
+	    ret = send_rtp_gso(udp, n, pkt + sent, size + sent);
+	    if (ret == 0)
+		break;
+	    if (ret > 0) {
+		sent += ret;
+		continue;
+	    }
+	}
+#endif
+
+	pj_bzero(msg, n * sizeof(msg[0]));
+	for (i=0; i<n; ++i) {
+	    iov[i].iov_base = (void*)pkt[sent + i];
+	    iov[i].iov_len = size[sent + i];
+	    msg[i].msg_hdr.msg_name = &udp->rem_rtp_addr;
+	    msg[i].msg_hdr.msg_namelen = udp->addr_len;
+	    msg[i].msg_hdr.msg_iov = &iov[i];
+	    msg[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	ret = sendmmsg((int)udp->rtp_sock, msg, n, MSG_DONTWAIT);
+	if (ret <= 0)
+	    break;
+
+	sent += ret;
+	if ((unsigned)ret < n)
+	    break;
+    }
+
+    return sent;
+}
+
+#endif	/* PJMEDIA_TRANSPORT_UDP_BATCH_SIZE */
+
+
+/* Called by application to send several RTP packets */
+PJ_DEF(pj_status_t) pjmedia_transport_udp_send_rtp_batch(
+						pjmedia_transport *tp,
+						unsigned count,
+						const void *pkt[],
+						const pj_size_t size[])
+{
+    struct transport_udp *udp = (struct transport_udp*)tp;
+    pj_status_t status = PJ_SUCCESS;
+    unsigned i = 0;
+
+    PJ_ASSERT_RETURN(tp && pkt && size, PJ_EINVAL);
+    PJ_ASSERT_RETURN(tp->op == &transport_udp_op, PJ_EINVALIDOP);
+
+#if PJMEDIA_TRANSPORT_UDP_BATCH_SIZE
+    /* Packet lost simulation is done packet by packet */
+    if (count > 1 && udp->tx_drop_pct == 0 && udp->rtp_key) {
+	for (i=0; i<count; ++i)
+	    PJ_ASSERT_RETURN(size[i] <= PJMEDIA_MAX_MTU, PJ_ETOOBIG);
+
+	i = send_rtp_batch(udp, count, pkt, size);
+    }
+#else
+    PJ_UNUSED_ARG(udp);
+#endif
+
+    for (; i<count; ++i) {
+	pj_status_t st = transport_send_rtp(tp, pkt[i], size[i]);
+	if (st != PJ_SUCCESS)
+	    status = st;
+    }
+
+    return status;
+}
+
+
 /* Called by application to send RTCP packet */
 static pj_status_t transport_send_rtcp(pjmedia_transport *tp,
 				       const void *pkt,
@@ -634,8 +634,12 @@ PJ_DEF(pj_status_t) pjmedia_vid_port_create( pj_pool_t *pool,
             
         param.usec_interval = PJMEDIA_PTIME(&vfd->fps);
         param.clock_rate = prm->vidparam.clock_rate;
+        /* Capture and encoding run in the clock callback, give the clock
+         * its own thread so it does not delay the shared (audio) clocks.
+         */
         status = pjmedia_clock_create2(pool, &param,
-                                       PJMEDIA_CLOCK_NO_HIGHEST_PRIO,
+                                       PJMEDIA_CLOCK_NO_HIGHEST_PRIO |
+                                       PJMEDIA_CLOCK_OWN_THREAD,
                                        (vp->dir & PJMEDIA_DIR_ENCODING) ?
                                        &enc_clock_cb: &dec_clock_cb,
                                        vp, &vp->clock);
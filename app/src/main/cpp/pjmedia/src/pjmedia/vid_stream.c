@@ -153,6 +153,7 @@ struct pjmedia_vid_stream
 	unsigned		     frame_size;    /**< Size of encoded base frame.*/
 	unsigned		     frame_ts_len;  /**< Frame length in timestamp. */
 
+	pj_bool_t		     rx_h264;	    /**< Incoming payload is H.264  */
 	unsigned		     rx_frame_cnt;  /**< # of array in rx_frames    */
 	pjmedia_frame	    *rx_frames;	    /**< Temp. buffer for incoming
 					         frame assembly.	    */
@@ -626,6 +627,33 @@ static void dump_bin(const char *buf, unsigned len)
 #endif
 
 
+/*
+ * Check if an H.264 RTP payload (single NAL unit, STAP-A or FU-A) carries
+ * an IDR slice or a parameter set.
+ */
+static pj_bool_t h264_is_keyframe_pkt(const pj_uint8_t *payload,
+									  unsigned len)
+{
+	unsigned nal_type;
+
+	if (len < 2)
+		return PJ_FALSE;
+
+	nal_type = payload[0] & 0x1F;
+	if (nal_type == 24) {
+		/* STAP-A, check the first aggregated NAL unit */
+		if (len < 4)
+			return PJ_FALSE;
+		nal_type = payload[3] & 0x1F;
+	} else if (nal_type == 28) {
+		/* FU-A */
+		nal_type = payload[1] & 0x1F;
+	}
+
+	return nal_type == 5 || nal_type == 7 || nal_type == 8;
+}
+
+
 /*
  * This callback is called by stream transport on receipt of packets
  * in the RTP socket.
@@ -830,8 +858,16 @@ static void on_rx_rtp( pjmedia_tp_cb_param *param)
 		PJ_LOG(4,(channel->port.info.name.ptr, "Jitter buffer reset"));
 	} else {
 		/* Just put the payload into jitter buffer */
-		pjmedia_jbuf_put_frame3(stream->jb, payload, payloadlen, 0,
-								pj_ntohs(hdr->seq), pj_ntohl(hdr->ts), NULL);
+		unsigned vid_flags = hdr->m ? PJMEDIA_JB_VID_MARKER : 0;
+
+		if (stream->rx_h264 &&
+			h264_is_keyframe_pkt((const pj_uint8_t*)payload, payloadlen))
+		{
+			vid_flags |= PJMEDIA_JB_VID_KEYFRAME;
+		}
+		pjmedia_jbuf_put_frame4(stream->jb, payload, payloadlen, 0,
+								pj_ntohs(hdr->seq), pj_ntohl(hdr->ts),
+								vid_flags, NULL);
 
 #if TRACE_JB
 		trace_jb_put(stream, hdr, payloadlen, count);
@@ -1173,36 +1209,19 @@ static pj_status_t rx_decode_frame(pjmedia_vid_stream *stream,
 	pj_uint32_t last_ts = 0;
 	int frm_first_seq = 0, frm_last_seq = 0;
 	pj_bool_t got_frame = PJ_FALSE;
-	unsigned cnt;
+	pjmedia_jb_vid_frame vf;
+	unsigned cnt = 0;
 	pj_status_t status;
 
-	/* Repeat get payload from the jitter buffer until all payloads with same
-     * timestamp are collected.
-     */
-
-	/* Check if we got a decodable frame */
-	for (cnt=0; ; ++cnt) {
-		char ptype;
-		pj_uint32_t ts;
-		int seq;
-
-		/* Peek frame from jitter buffer. */
-		pjmedia_jbuf_peek_frame(stream->jb, cnt, NULL, NULL,
-								&ptype, NULL, &ts, &seq);
-		if (ptype == PJMEDIA_JB_NORMAL_FRAME) {
-			if (last_ts == 0) {
-				last_ts = ts;
-				frm_first_seq = seq;
-			}
-			if (ts != last_ts) {
-				got_frame = PJ_TRUE;
-				break;
-			}
-			frm_last_seq = seq;
-		} else if (ptype == PJMEDIA_JB_ZERO_EMPTY_FRAME) {
-			/* No more packet in the jitter buffer */
-			break;
-		}
+	/* The frame index of the jitter buffer tells if the oldest frame is
+	 * complete, or is followed by packets of the next frame.
+	 */
+	if (pjmedia_jbuf_peek_vid_frame(stream->jb, &vf) == PJ_SUCCESS) {
+		got_frame = PJ_TRUE;
+		last_ts = vf.ts;
+		frm_first_seq = vf.first_seq;
+		frm_last_seq = vf.last_seq;
+		cnt = vf.pkt_cnt;
 	}
 
 	if (got_frame) {
@@ -1331,37 +1350,20 @@ static pj_status_t enc_decode_frame(pjmedia_vid_stream *stream,
     pj_uint32_t last_ts = 0;
     int frm_first_seq = 0, frm_last_seq = 0;
     pj_bool_t got_frame = PJ_FALSE;
-    unsigned cnt;
+    pjmedia_jb_vid_frame vf;
+    unsigned cnt = 0;
     pj_status_t status;
     const pj_uint8_t nal_start[] = { 0, 0, 1 };
 
-    /* Repeat get payload from the jitter buffer until all payloads with same
-     * timestamp are collected.
+    /* The frame index of the jitter buffer tells if the oldest frame is
+     * complete, or is followed by packets of the next frame.
      */
-
-    /* Check if we got a decodable frame */
-    for (cnt=0; ; ++cnt) {
-        char ptype;
-        pj_uint32_t ts;
-        int seq;
-
-        /* Peek frame from jitter buffer. */
-        pjmedia_jbuf_peek_frame(stream->jb, cnt, NULL, NULL,
-                                &ptype, NULL, &ts, &seq);
-        if (ptype == PJMEDIA_JB_NORMAL_FRAME) {
-            if (last_ts == 0) {
-                last_ts = ts;
-                frm_first_seq = seq;
-            }
-            if (ts != last_ts) {
-                got_frame = PJ_TRUE;
-                break;
-            }
-            frm_last_seq = seq;
-        } else if (ptype == PJMEDIA_JB_ZERO_EMPTY_FRAME) {
-            /* No more packet in the jitter buffer */
-            break;
-        }
+    if (pjmedia_jbuf_peek_vid_frame(stream->jb, &vf) == PJ_SUCCESS) {
+        got_frame = PJ_TRUE;
+        last_ts = vf.ts;
+        frm_first_seq = vf.first_seq;
+        frm_last_seq = vf.last_seq;
+        cnt = vf.pkt_cnt;
     }
 
     if (got_frame) {
@@ -1916,6 +1918,11 @@ PJ_DEF(pj_status_t) pjmedia_vid_stream_create(
 	/* Set up jitter buffer */
 	pjmedia_jbuf_set_adaptive(stream->jb, jb_init, jb_min_pre, jb_max_pre);
 	pjmedia_jbuf_set_discard(stream->jb, PJMEDIA_JB_DISCARD_NONE);
+	status = pjmedia_jbuf_enable_vid_index(stream->jb, pool);
+	if (status != PJ_SUCCESS)
+		return status;
+	stream->rx_h264 = (pj_stricmp2(&info->codec_info.encoding_name,
+								   "H264") == 0);
 
 	/* Init RTCP session: */
 	{
@@ -36,9 +36,25 @@ typedef struct vid_tee_dst_port
 {
     pjmedia_port	*dst;
     unsigned		 option;
+    unsigned		 grp;
 } vid_tee_dst_port;
 
 
+/* Destination ports with the same format form a group, the frame is
+ * converted once per group and the result is shared by its ports.
+ */
+typedef struct vid_tee_grp
+{
+    pjmedia_format	 fmt;
+    pjmedia_converter   *conv;
+    pj_size_t		 conv_buf_size;
+    unsigned		 dst_cnt;
+} vid_tee_grp;
+
+
+/* Index of the buffers, allocated only when needed */
+enum { TEE_CONV_BUF, TEE_COPY_BUF };
+
 typedef struct vid_tee_port
 {
     pjmedia_port	 base;
@@ -46,17 +62,13 @@ typedef struct vid_tee_port
     pj_pool_factory     *pf;
     pj_pool_t           *buf_pool;
     void		*buf[2];
-    unsigned             buf_cnt;
+    pj_bool_t		 buf_used[2];
     pj_size_t		 buf_size;
     unsigned		 dst_port_maxcnt;
     unsigned		 dst_port_cnt;
     vid_tee_dst_port	*dst_ports;
-    pj_uint8_t		*put_frm_flag;
-    
-    struct vid_tee_conv_t {
-        pjmedia_converter   *conv;
-        pj_size_t            conv_buf_size;        
-    } *tee_conv;
+    unsigned		 grp_cnt;
+    vid_tee_grp		*grps;
 } vid_tee_port;
 
 
@@ -91,12 +103,8 @@ PJ_DEF(pj_status_t) pjmedia_vid_tee_create( pj_pool_t *pool,
     tee->dst_ports = (vid_tee_dst_port*)
                      pj_pool_calloc(pool, max_dst_cnt,
                                     sizeof(vid_tee_dst_port));
-    tee->tee_conv = (struct vid_tee_conv_t *)
-                    pj_pool_calloc(pool, max_dst_cnt,
-                                   sizeof(struct vid_tee_conv_t));
-    tee->put_frm_flag = (pj_uint8_t*)
-			pj_pool_calloc(pool, max_dst_cnt,
-				       sizeof(tee->put_frm_flag[0]));
+    tee->grps = (vid_tee_grp*)
+		pj_pool_calloc(pool, max_dst_cnt, sizeof(vid_tee_grp));
 
     /* Initialize video tee buffer, its size is one frame */
     vfi = pjmedia_get_video_format_info(NULL, fmt->id);
@@ -130,13 +138,13 @@ PJ_DEF(pj_status_t) pjmedia_vid_tee_create( pj_pool_t *pool,
     return PJ_SUCCESS;
 }
 
-static void realloc_buf(vid_tee_port *vid_tee,
-                        unsigned buf_cnt, pj_size_t buf_size)
+static void realloc_buf(vid_tee_port *vid_tee, int buf_idx,
+                        pj_size_t buf_size)
 {
     unsigned i;
     
-    if (buf_cnt > vid_tee->buf_cnt)
-        vid_tee->buf_cnt = buf_cnt;
+    if (buf_idx >= 0)
+        vid_tee->buf_used[buf_idx] = PJ_TRUE;
     
     if (buf_size > vid_tee->buf_size) {
         /* We need a larger buffer here. */
@@ -153,50 +161,117 @@ static void realloc_buf(vid_tee_port *vid_tee,
                                            1000, 1000, NULL);
     }
  
-    for (i = 0; i < vid_tee->buf_cnt; i++) {
-        if (!vid_tee->buf[i])
+    for (i = 0; i < PJ_ARRAY_SIZE(vid_tee->buf); i++) {
+        if (vid_tee->buf_used[i] && !vid_tee->buf[i])
             vid_tee->buf[i] = pj_pool_alloc(vid_tee->buf_pool,
                                             vid_tee->buf_size);
     }
 }
 
+static pj_bool_t same_fmt(const pjmedia_format *f1, const pjmedia_format *f2)
+{
+    return f1->id == f2->id &&
+	   f1->det.vid.size.w == f2->det.vid.size.w &&
+	   f1->det.vid.size.h == f2->det.vid.size.h;
+}
+
 /*
- * Add a destination media port to the video tee.
+ * Find the group of destination ports with the specified format, or
+ * create a new one, with a converter if the format differs from the
+ * source format.
  */
-PJ_DEF(pj_status_t) pjmedia_vid_tee_add_dst_port(pjmedia_port *vid_tee,
-						 unsigned option,
-						 pjmedia_port *port)
+static pj_status_t get_grp(vid_tee_port *tee, const pjmedia_format *fmt,
+			   unsigned *p_grp)
 {
-    vid_tee_port *tee = (vid_tee_port*)vid_tee;
-    pjmedia_video_format_detail *vfd;
+    vid_tee_grp *grp;
+    unsigned i;
 
-    PJ_ASSERT_RETURN(vid_tee && vid_tee->info.signature==TEE_PORT_SIGN,
-		     PJ_EINVAL);
+    for (i = 0; i < tee->grp_cnt; ++i) {
+	if (same_fmt(&tee->grps[i].fmt, fmt)) {
+	    *p_grp = i;
+	    return PJ_SUCCESS;
+	}
+    }
+
+    grp = &tee->grps[tee->grp_cnt];
+    pj_bzero(grp, sizeof(*grp));
+    pjmedia_format_copy(&grp->fmt, fmt);
+
+    if (!same_fmt(&tee->base.info.fmt, fmt)) {
+        const pjmedia_video_format_info *vfi;
+        pjmedia_video_apply_fmt_param vafp;
+        pjmedia_conversion_param conv_param;
+        pj_status_t status;
+
+        vfi = pjmedia_get_video_format_info(NULL, fmt->id);
+        if (vfi == NULL)
+            return PJMEDIA_EBADFMT;
+
+        pj_bzero(&vafp, sizeof(vafp));
+        vafp.size = fmt->det.vid.size;
+        status = vfi->apply_fmt(vfi, &vafp);
+        if (status != PJ_SUCCESS)
+            return status;
+        
+        pjmedia_format_copy(&conv_param.src, &tee->base.info.fmt);
+	pjmedia_format_copy(&conv_param.dst, fmt);
+        
+        status = pjmedia_converter_create(NULL, tee->pool, &conv_param,
+                                          &grp->conv);
+        if (status != PJ_SUCCESS)
+            return status;
+        
+        grp->conv_buf_size = vafp.framebytes;
+        realloc_buf(tee, TEE_CONV_BUF, vafp.framebytes);
+    }
+
+    *p_grp = tee->grp_cnt++;
+    return PJ_SUCCESS;
+}
+
+static pj_status_t add_dst_port(vid_tee_port *tee, unsigned option,
+				pjmedia_port *port)
+{
+    unsigned grp;
+    pj_status_t status;
 
     if (tee->dst_port_cnt >= tee->dst_port_maxcnt)
 	return PJ_ETOOMANY;
-    
-    if (vid_tee->info.fmt.id != port->info.fmt.id)
-	return PJMEDIA_EBADFMT;
 
-    vfd = pjmedia_format_get_video_format_detail(&port->info.fmt, PJ_TRUE);
-    if (vfd->size.w != vid_tee->info.fmt.det.vid.size.w ||
-	vfd->size.h != vid_tee->info.fmt.det.vid.size.h)
-    {
-        return PJMEDIA_EBADFMT;
-    }
-    
-    realloc_buf(tee, (option & PJMEDIA_VID_TEE_DST_DO_IN_PLACE_PROC)?
-                1: 0, tee->buf_size);
+    status = get_grp(tee, &port->info.fmt, &grp);
+    if (status != PJ_SUCCESS)
+	return status;
+
+    if (option & PJMEDIA_VID_TEE_DST_DO_IN_PLACE_PROC)
+        realloc_buf(tee, TEE_COPY_BUF, tee->buf_size);
 
-    pj_bzero(&tee->tee_conv[tee->dst_port_cnt], sizeof(tee->tee_conv[0]));
+    ++tee->grps[grp].dst_cnt;
     tee->dst_ports[tee->dst_port_cnt].dst = port;
     tee->dst_ports[tee->dst_port_cnt].option = option;
+    tee->dst_ports[tee->dst_port_cnt].grp = grp;
     ++tee->dst_port_cnt;
 
     return PJ_SUCCESS;
 }
 
+/*
+ * Add a destination media port to the video tee.
+ */
+PJ_DEF(pj_status_t) pjmedia_vid_tee_add_dst_port(pjmedia_port *vid_tee,
+						 unsigned option,
+						 pjmedia_port *port)
+{
+    vid_tee_port *tee = (vid_tee_port*)vid_tee;
+
+    PJ_ASSERT_RETURN(vid_tee && vid_tee->info.signature==TEE_PORT_SIGN,
+		     PJ_EINVAL);
+
+    if (!same_fmt(&vid_tee->info.fmt, &port->info.fmt))
+	return PJMEDIA_EBADFMT;
+
+    return add_dst_port(tee, option, port);
+}
+
 
 /*
  * Add a destination media port to the video tee. Create a converter if
@@ -207,60 +282,11 @@ PJ_DEF(pj_status_t) pjmedia_vid_tee_add_dst_port2(pjmedia_port *vid_tee,
 						  pjmedia_port *port)
 {
     vid_tee_port *tee = (vid_tee_port*)vid_tee;
-    pjmedia_video_format_detail *vfd;
     
     PJ_ASSERT_RETURN(vid_tee && vid_tee->info.signature==TEE_PORT_SIGN,
 		     PJ_EINVAL);
     
-    if (tee->dst_port_cnt >= tee->dst_port_maxcnt)
-	return PJ_ETOOMANY;
-    
-    pj_bzero(&tee->tee_conv[tee->dst_port_cnt], sizeof(tee->tee_conv[0]));
-    
-    /* Check if we need to create a converter. */
-    vfd = pjmedia_format_get_video_format_detail(&port->info.fmt, PJ_TRUE);
-    if (vid_tee->info.fmt.id != port->info.fmt.id ||
-        vfd->size.w != vid_tee->info.fmt.det.vid.size.w ||
-	vfd->size.h != vid_tee->info.fmt.det.vid.size.h)
-    {
-        const pjmedia_video_format_info *vfi;
-        pjmedia_video_apply_fmt_param vafp;
-        pjmedia_conversion_param conv_param;
-        pj_status_t status;
-
-        vfi = pjmedia_get_video_format_info(NULL, port->info.fmt.id);
-        if (vfi == NULL)
-            return PJMEDIA_EBADFMT;
-
-        pj_bzero(&vafp, sizeof(vafp));
-        vafp.size = port->info.fmt.det.vid.size;
-        status = vfi->apply_fmt(vfi, &vafp);
-        if (status != PJ_SUCCESS)
-            return status;
-        
-        realloc_buf(tee, (option & PJMEDIA_VID_TEE_DST_DO_IN_PLACE_PROC)?
-                    2: 1, vafp.framebytes);
-        
-        pjmedia_format_copy(&conv_param.src, &vid_tee->info.fmt);
-	pjmedia_format_copy(&conv_param.dst, &port->info.fmt);
-        
-        status = pjmedia_converter_create(
-                     NULL, tee->pool, &conv_param,
-                     &tee->tee_conv[tee->dst_port_cnt].conv);
-        if (status != PJ_SUCCESS)
-            return status;
-        
-        tee->tee_conv[tee->dst_port_cnt].conv_buf_size = vafp.framebytes;
-    } else {
-        realloc_buf(tee, (option & PJMEDIA_VID_TEE_DST_DO_IN_PLACE_PROC)?
-                    1: 0, tee->buf_size);        
-    }
-    
-    tee->dst_ports[tee->dst_port_cnt].dst = port;
-    tee->dst_ports[tee->dst_port_cnt].option = option;
-    ++tee->dst_port_cnt;
-    
-    return PJ_SUCCESS;
+    return add_dst_port(tee, option, port);
 }
 
 
@@ -271,21 +297,31 @@ PJ_DEF(pj_status_t) pjmedia_vid_tee_remove_dst_port(pjmedia_port *vid_tee,
 						    pjmedia_port *port)
 {
     vid_tee_port *tee = (vid_tee_port*)vid_tee;
-    unsigned i;
+    unsigned i, j, grp;
 
     PJ_ASSERT_RETURN(vid_tee && vid_tee->info.signature==TEE_PORT_SIGN,
 		     PJ_EINVAL);
 
     for (i = 0; i < tee->dst_port_cnt; ++i) {
 	if (tee->dst_ports[i].dst == port) {
-            if (tee->tee_conv[i].conv)
-                pjmedia_converter_destroy(tee->tee_conv[i].conv);
-            
+	    grp = tee->dst_ports[i].grp;
 	    pj_array_erase(tee->dst_ports, sizeof(tee->dst_ports[0]),
 			   tee->dst_port_cnt, i);
-            pj_array_erase(tee->tee_conv, sizeof(tee->tee_conv[0]),
-			   tee->dst_port_cnt, i);
 	    --tee->dst_port_cnt;
+
+	    /* Remove the group with its converter when it becomes empty */
+	    if (--tee->grps[grp].dst_cnt == 0) {
+		if (tee->grps[grp].conv)
+		    pjmedia_converter_destroy(tee->grps[grp].conv);
+		pj_array_erase(tee->grps, sizeof(tee->grps[0]),
+			       tee->grp_cnt, grp);
+		--tee->grp_cnt;
+
+		for (j = 0; j < tee->dst_port_cnt; ++j) {
+		    if (tee->dst_ports[j].grp > grp)
+			--tee->dst_ports[j].grp;
+		}
+	    }
 	    return PJ_SUCCESS;
 	}
     }
@@ -294,74 +330,80 @@ PJ_DEF(pj_status_t) pjmedia_vid_tee_remove_dst_port(pjmedia_port *vid_tee,
 }
 
 
+/*
+ * Deliver the frame to the destination ports. The frame, or its
+ * conversion, is shared by all ports of a group. Ports which process
+ * in place are served after the others, and only get a private copy if
+ * the shared buffer is still needed: the converted buffer belongs to the
+ * tee, so the last of them can have it, while the source frame always
+ * belongs to the caller.
+ */
 static pj_status_t tee_put_frame(pjmedia_port *port, pjmedia_frame *frame)
 {
     vid_tee_port *tee = (vid_tee_port*)port;
-    unsigned i, j;
-    const pj_uint8_t PUT_FRM_DONE = 1;
-
-    pj_bzero(tee->put_frm_flag, tee->dst_port_cnt *
-				sizeof(tee->put_frm_flag[0]));
+    unsigned g, i;
 
-    for (i = 0; i < tee->dst_port_cnt; ++i) {
-	pjmedia_frame frame_ = *frame;
+    for (g = 0; g < tee->grp_cnt; ++g) {
+	vid_tee_grp *grp = &tee->grps[g];
+	pjmedia_frame shared = *frame;
+	unsigned last_writer = tee->dst_port_cnt;
 
-        if (tee->put_frm_flag[i])
-            continue;
-        
-        if (tee->tee_conv[i].conv) {
+        if (grp->conv) {
             pj_status_t status;
             
-            frame_.buf  = tee->buf[0];
-            frame_.size = tee->tee_conv[i].conv_buf_size;
-            status = pjmedia_converter_convert(tee->tee_conv[i].conv,
-                                               frame, &frame_);
+            shared.buf  = tee->buf[TEE_CONV_BUF];
+            shared.size = grp->conv_buf_size;
+            status = pjmedia_converter_convert(grp->conv, frame, &shared);
             if (status != PJ_SUCCESS) {
                 PJ_LOG(3, (THIS_FILE,
-			       "Failed to convert frame for destination"
-                               " port %d (%.*s)", i,
-                               tee->dst_ports[i].dst->info.name.slen,
-                               tee->dst_ports[i].dst->info.name.ptr));
+			       "Failed to convert frame for %d destination"
+                               " port(s) of format %dx%d", grp->dst_cnt,
+                               grp->fmt.det.vid.size.w,
+                               grp->fmt.det.vid.size.h));
                 continue;
             }
         }
-        
-        /* Find other destination ports which has the same format so
-         * we don't need to do the same conversion twice.
-         */
-        for (j = i; j < tee->dst_port_cnt; ++j) {
-            pjmedia_frame framep;
-            
-            if (tee->put_frm_flag[j] ||
-                (tee->dst_ports[j].dst->info.fmt.id != 
-                 tee->dst_ports[i].dst->info.fmt.id) ||
-                (tee->dst_ports[j].dst->info.fmt.det.vid.size.w != 
-                 tee->dst_ports[i].dst->info.fmt.det.vid.size.w) ||
-                (tee->dst_ports[j].dst->info.fmt.det.vid.size.h != 
-                 tee->dst_ports[i].dst->info.fmt.det.vid.size.h))
-            {
-                continue;
-            }
-            
-            framep = frame_;
-            /* For dst_ports that do in-place processing, we need to duplicate
-             * the data source first.
-             */
-            if (tee->dst_ports[j].option & PJMEDIA_VID_TEE_DST_DO_IN_PLACE_PROC)
-            {
-                PJ_ASSERT_RETURN(tee->buf_size <= frame_.size, PJ_ETOOBIG);
-                framep.buf = tee->buf[tee->buf_cnt-1];
-                framep.size = frame_.size;
-                pj_memcpy(framep.buf, frame_.buf, frame_.size);
-            }
 
-            /* Deliver the data */
-            pjmedia_port_put_frame(tee->dst_ports[j].dst, &framep);
-            tee->put_frm_flag[j] = PUT_FRM_DONE;
-            
-            if (!tee->tee_conv[i].conv)
-                break;
-        }
+	/* Ports which only read get the shared buffer */
+	for (i = 0; i < tee->dst_port_cnt; ++i) {
+	    pjmedia_frame framep;
+
+	    if (tee->dst_ports[i].grp != g)
+		continue;
+
+	    if (tee->dst_ports[i].option &
+		PJMEDIA_VID_TEE_DST_DO_IN_PLACE_PROC)
+	    {
+		last_writer = i;
+		continue;
+	    }
+
+	    framep = shared;
+	    pjmedia_port_put_frame(tee->dst_ports[i].dst, &framep);
+	}
+
+	/* Ports which process in place */
+	for (i = 0; i < tee->dst_port_cnt && last_writer < tee->dst_port_cnt;
+	     ++i)
+	{
+	    pjmedia_frame framep;
+
+	    if (tee->dst_ports[i].grp != g ||
+		!(tee->dst_ports[i].option &
+		  PJMEDIA_VID_TEE_DST_DO_IN_PLACE_PROC))
+	    {
+		continue;
+	    }
+
+	    framep = shared;
+	    if (i != last_writer || !grp->conv) {
+		PJ_ASSERT_RETURN(shared.size <= tee->buf_size, PJ_ETOOBIG);
+		framep.buf = tee->buf[TEE_COPY_BUF];
+		pj_memcpy(framep.buf, shared.buf, shared.size);
+	    }
+
+	    pjmedia_port_put_frame(tee->dst_ports[i].dst, &framep);
+	}
     }
 
     return PJ_SUCCESS;
@@ -380,9 +422,15 @@ static pj_status_t tee_get_frame(pjmedia_port *port, pjmedia_frame *frame)
 static pj_status_t tee_destroy(pjmedia_port *port)
 {
     vid_tee_port *tee = (vid_tee_port*)port;
+    unsigned i;
 
     PJ_ASSERT_RETURN(port && port->info.signature==TEE_PORT_SIGN, PJ_EINVAL);
 
+    for (i = 0; i < tee->grp_cnt; ++i) {
+	if (tee->grps[i].conv)
+	    pjmedia_converter_destroy(tee->grps[i].conv);
+    }
+
     pj_pool_release(tee->pool);
     if (tee->buf_pool)
         pj_pool_release(tee->buf_pool);
@@ -0,0 +1,194 @@
+/* $Id$ */
+/*
+ * Copyright (C) 2008-2011 Teluu Inc. (http://www.teluu.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include "test.h"
+
+/*
+ * Annex-B scanner test.
+ *
+ * The scanner is compared with a byte by byte search on zero-heavy data,
+ * for all alignments of the start and the end of the buffer. Then the NAL
+ * units of an H.264-like stream (one key frame and P frames, with the
+ * emulation prevention applied) are located with both, and the throughput
+ * is reported.
+ */
+
+#define THIS_FILE	"annexb_test.c"
+#define RAND_LEN	4096
+#define GOP_LEN		30
+#define KEY_SLICES	4
+#define KEY_SLICE_SIZE	40000
+#define P_FRAME_SIZE	3000
+#define STREAM_LOOPS	20
+
+/* Byte by byte search of 00 00 x with lo <= x <= hi */
+static const pj_uint8_t *ref_find(const pj_uint8_t *p, const pj_uint8_t *end,
+				  unsigned lo, unsigned hi)
+{
+    for (; p + 3 <= end; ++p) {
+	if (p[0] == 0 && p[1] == 0 && p[2] >= lo && p[2] <= hi)
+	    return p;
+    }
+    return NULL;
+}
+
+static int compare_random(pj_uint8_t *buf)
+{
+    static const pj_uint8_t values[] = { 0, 0, 0, 1, 2, 3, 0x80, 0xFF };
+    unsigned i, s, e;
+
+    for (i = 0; i < RAND_LEN; ++i) {
+	/* Sparse zeros at the beginning, dense ones at the end */
+	if (i < RAND_LEN / 2 && (pj_rand() % 16))
+	    buf[i] = (pj_uint8_t)(0x10 + pj_rand() % 0xE0);
+	else
+	    buf[i] = values[pj_rand() % PJ_ARRAY_SIZE(values)];
+    }
+
+    for (s = 0; s < 40; ++s) {
+	for (e = RAND_LEN - 40; e <= RAND_LEN; ++e) {
+	    const pj_uint8_t *p = buf + s, *end = buf + e;
+
+	    if (pjmedia_annexb_find_start_code(p, end) != ref_find(p, end, 1, 1))
+		return -10;
+	    if (pjmedia_annexb_find_escape(p, end) != ref_find(p, end, 0, 3))
+		return -11;
+	}
+    }
+
+    /* Every match, and the short buffers at the end */
+    for (s = 0; s < RAND_LEN; ++s) {
+	const pj_uint8_t *p = buf + s, *end = buf + RAND_LEN;
+
+	if (pjmedia_annexb_find_escape(p, end) != ref_find(p, end, 0, 3))
+	    return -12;
+	if (pjmedia_annexb_find_start_code(p, p + 20 < end ? p + 20 : end) !=
+	    ref_find(p, p + 20 < end ? p + 20 : end, 1, 1))
+	{
+	    return -13;
+	}
+    }
+
+    return 0;
+}
+
+/* Append a NAL unit of random payload, with emulation prevention */
+static pj_uint8_t *put_nal(pj_uint8_t *p, pj_uint8_t type, unsigned size)
+{
+    unsigned zeros = 0;
+
+    *p++ = 0; *p++ = 0; *p++ = 0; *p++ = 1;
+    *p++ = type;
+    while (size--) {
+	/* Coded slices are close to random, with a few more zeros */
+	pj_uint8_t b = (pj_uint8_t)((pj_rand() % 8) ? pj_rand() : 0);
+
+	if (zeros >= 2 && b <= 3) {
+	    *p++ = 3;
+	    zeros = 0;
+	}
+	*p++ = b;
+	zeros = b ? 0 : zeros + 1;
+    }
+    /* Payload can't end with zero */
+    if (zeros)
+	*p++ = 0x80;
+    return p;
+}
+
+static unsigned count_nals(const pj_uint8_t *p, const pj_uint8_t *end,
+			   pj_bool_t use_ref)
+{
+    unsigned cnt = 0;
+
+    for (;;) {
+	p = use_ref ? ref_find(p, end, 1, 1) :
+		      pjmedia_annexb_find_start_code(p, end);
+	if (!p)
+	    break;
+	++cnt;
+	p += 3;
+    }
+    return cnt;
+}
+
+static int bench_stream(pj_pool_t *pool)
+{
+    pj_size_t cap = 32 + (KEY_SLICES * KEY_SLICE_SIZE +
+			  GOP_LEN * P_FRAME_SIZE) * 3 / 2;
+    pj_uint8_t *buf, *p;
+    unsigned i, nal_cnt, cnt[2] = { 0, 0 };
+    pj_uint32_t usec[2];
+    int k;
+
+    buf = p = (pj_uint8_t*) pj_pool_alloc(pool, cap);
+    p = put_nal(p, 0x67, 12);	/* SPS */
+    p = put_nal(p, 0x68, 4);	/* PPS */
+    for (i = 0; i < KEY_SLICES; ++i)
+	p = put_nal(p, 0x65, KEY_SLICE_SIZE);
+    for (i = 1; i < GOP_LEN; ++i)
+	p = put_nal(p, 0x41, P_FRAME_SIZE);
+    nal_cnt = 2 + KEY_SLICES + GOP_LEN - 1;
+
+    for (k = 0; k < 2; ++k) {
+	pj_timestamp t0, t1;
+
+	pj_get_timestamp(&t0);
+	for (i = 0; i < STREAM_LOOPS; ++i)
+	    cnt[k] += count_nals(buf, p, k == 0);
+	pj_get_timestamp(&t1);
+	usec[k] = pj_elapsed_usec(&t0, &t1);
+	if (usec[k] == 0)
+	    usec[k] = 1;
+    }
+
+    if (cnt[0] != nal_cnt * STREAM_LOOPS || cnt[1] != cnt[0]) {
+	PJ_LOG(3,(THIS_FILE, "    %u/%u NAL units found, expecting %u",
+		  cnt[0] / STREAM_LOOPS, cnt[1] / STREAM_LOOPS, nal_cnt));
+	return -20;
+    }
+
+    PJ_LOG(3,(THIS_FILE, "    %u NAL units in %u KB: byte loop %u MB/s, "
+			 "scanner %u MB/s",
+	      nal_cnt, (unsigned)(p - buf) / 1024,
+	      (unsigned)((pj_uint64_t)(p - buf) * STREAM_LOOPS / usec[0]),
+	      (unsigned)((pj_uint64_t)(p - buf) * STREAM_LOOPS / usec[1])));
+    return 0;
+}
+
+int annexb_test(void)
+{
+    pj_pool_t *pool;
+    pj_uint8_t *buf;
+    int rc;
+
+    PJ_LOG(3,(THIS_FILE, "  Annex-B scanner test"));
+
+    pool = pj_pool_create(mem, "annexb", 4000, 4000, NULL);
+    buf = (pj_uint8_t*) pj_pool_alloc(pool, RAND_LEN);
+
+    pj_srand(0x4A11);
+    rc = compare_random(buf);
+    if (rc != 0)
+	PJ_LOG(3,(THIS_FILE, "    error %d", rc));
+    else
+	rc = bench_stream(pool);
+
+    pj_pool_release(pool);
+    return rc;
+}
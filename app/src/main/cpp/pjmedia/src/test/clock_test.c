@@ -0,0 +1,249 @@
+/* $Id$ */
+/*
+ * Copyright (C) 2008-2011 Teluu Inc. (http://www.teluu.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include "test.h"
+
+/*
+ * Media clock test.
+ *
+ * A number of asynchronous clocks with different intervals, priorities
+ * and options run together for a while. Each clock must have ticked at
+ * its own rate with increasing timestamps, and no callback may be called
+ * once pjmedia_clock_stop() has returned. A clock stops itself and two
+ * others (one with its own thread) destroy themselves from the callback,
+ * a stopped clock is restarted, and a synchronous clock is polled with
+ * pjmedia_clock_wait(). The lateness statistics of the clocks are
+ * reported, and all pools of the clocks must have been released.
+ */
+
+#define THIS_FILE	"clock_test.c"
+#define CLOCK_CNT	12
+#define DURATION	600	/* msec */
+#define SELF_STOP	5	/* ticks */
+
+struct clock_data
+{
+    pjmedia_clock   *clock;
+    unsigned	     ptime;	/* msec */
+    unsigned	     options;
+    pj_atomic_t	    *ticks;
+    unsigned	     cb_cnt;
+    pj_uint64_t	     last_ts;
+    pj_bool_t	     ts_error;
+    pj_bool_t	     self_stop;
+    pj_bool_t	     self_destroy;
+};
+
+static void clock_cb(const pj_timestamp *ts, void *user_data)
+{
+    struct clock_data *cd = (struct clock_data*) user_data;
+    pjmedia_clock *clock = cd->clock;
+    pj_bool_t self_stop = cd->self_stop, last = PJ_FALSE;
+
+    if (cd->cb_cnt > 0 && ts->u64 <= cd->last_ts)
+	cd->ts_error = PJ_TRUE;
+    cd->last_ts = ts->u64;
+
+    /* Don't touch cd once the main thread can see the tick */
+    if (++cd->cb_cnt == SELF_STOP && (self_stop || cd->self_destroy)) {
+	last = PJ_TRUE;
+	if (cd->self_destroy)
+	    cd->clock = NULL;
+    }
+    pj_atomic_inc(cd->ticks);
+
+    if (last) {
+	if (self_stop)
+	    pjmedia_clock_stop(clock);
+	else
+	    pjmedia_clock_destroy(clock);
+    }
+}
+
+static pj_status_t create_clock(pj_pool_t *pool, struct clock_data *cd)
+{
+    pjmedia_clock_param param;
+    pj_status_t status;
+
+    param.usec_interval = cd->ptime * 1000;
+    param.clock_rate = 8000;
+
+    status = pj_atomic_create(pool, 0, &cd->ticks);
+    if (status != PJ_SUCCESS)
+	return status;
+
+    return pjmedia_clock_create2(pool, &param, cd->options, &clock_cb, cd,
+				 &cd->clock);
+}
+
+int clock_test(void)
+{
+    pj_pool_t *pool;
+    pj_caching_pool_stat cp_stat;
+    pj_size_t used_count;
+    struct clock_data cd[CLOCK_CNT], sync_cd;
+    unsigned i;
+    pj_status_t status;
+    int rc = 0;
+
+    PJ_LOG(3,(THIS_FILE, "  media clock test"));
+
+    pool = pj_pool_create(mem, "clocktest", 4000, 4000, NULL);
+    pj_caching_pool_get_stat((pj_caching_pool*)mem, &cp_stat);
+    used_count = cp_stat.used_count;
+    pj_bzero(cd, sizeof(cd));
+    pj_bzero(&sync_cd, sizeof(sync_cd));
+
+    for (i = 0; i < CLOCK_CNT; ++i) {
+	static const unsigned ptimes[] = { 10, 20, 30, 40 };
+
+	cd[i].ptime = ptimes[i % PJ_ARRAY_SIZE(ptimes)];
+	if (i % 3 == 1)
+	    cd[i].options = PJMEDIA_CLOCK_NO_HIGHEST_PRIO;
+	else if (i % 5 == 4)
+	    cd[i].options = PJMEDIA_CLOCK_OWN_THREAD;
+	cd[i].self_stop = (i == 2);
+	cd[i].self_destroy = (i == 3 || i == 9);
+
+	status = create_clock(pool, &cd[i]);
+	if (status != PJ_SUCCESS) {
+	    app_perror(status, "Error creating clock");
+	    rc = -10;
+	    goto on_return;
+	}
+    }
+
+    for (i = 0; i < CLOCK_CNT; ++i)
+	pjmedia_clock_start(cd[i].clock);
+
+    pj_thread_sleep(DURATION);
+
+    for (i = 0; i < CLOCK_CNT; ++i) {
+	pj_atomic_value_t ticks;
+	pjmedia_clock_stat stat;
+	unsigned expected = DURATION / cd[i].ptime;
+
+	if (!cd[i].self_destroy)
+	    pjmedia_clock_stop(cd[i].clock);
+	ticks = pj_atomic_get(cd[i].ticks);
+
+	if (cd[i].self_stop || cd[i].self_destroy) {
+	    if (ticks != SELF_STOP) {
+		PJ_LOG(3,(THIS_FILE, "    clock %d: %d ticks, expecting %d",
+			  i, ticks, SELF_STOP));
+		rc = -20;
+		goto on_return;
+	    }
+	    continue;
+	}
+
+	/* Allow for a loaded machine, but not for a drifting clock */
+	if (ticks < (pj_atomic_value_t)(expected * 3 / 4) ||
+	    ticks > (pj_atomic_value_t)(expected + 2))
+	{
+	    PJ_LOG(3,(THIS_FILE, "    clock %d (%d ms): %d ticks, expecting %d",
+		      i, cd[i].ptime, ticks, expected));
+	    rc = -30;
+	    goto on_return;
+	}
+	if (cd[i].ts_error) {
+	    rc = -31;
+	    goto on_return;
+	}
+
+	pjmedia_clock_get_stat(cd[i].clock, &stat);
+	if (stat.tick_cnt != (unsigned)ticks ||
+	    stat.avg_late_usec > stat.max_late_usec)
+	{
+	    rc = -32;
+	    goto on_return;
+	}
+	PJ_LOG(3,(THIS_FILE, "    clock %2d (%d ms%s): %3d ticks, late avg "
+		  "%4u us, max %5u us, %u overrun(s)", i, cd[i].ptime,
+		  (cd[i].options & PJMEDIA_CLOCK_OWN_THREAD)? ", own thread" :
+		  (cd[i].options? ", normal prio" : ""),
+		  ticks, stat.avg_late_usec, stat.max_late_usec,
+		  stat.overrun_cnt));
+    }
+
+    /* No callback after the clocks are stopped */
+    {
+	pj_atomic_value_t ticks = pj_atomic_get(cd[0].ticks);
+
+	pj_thread_sleep(50);
+	if (pj_atomic_get(cd[0].ticks) != ticks) {
+	    rc = -40;
+	    goto on_return;
+	}
+    }
+
+    /* Restart a stopped clock */
+    pjmedia_clock_start(cd[0].clock);
+    pj_thread_sleep(100);
+    pjmedia_clock_stop(cd[0].clock);
+    if (pj_atomic_get(cd[0].ticks) < (pj_atomic_value_t)
+				     (DURATION / cd[0].ptime * 3 / 4 + 5))
+    {
+	rc = -41;
+	goto on_return;
+    }
+
+    /* Synchronous clock */
+    sync_cd.ptime = 10;
+    sync_cd.options = PJMEDIA_CLOCK_NO_ASYNC;
+    status = create_clock(pool, &sync_cd);
+    if (status != PJ_SUCCESS) {
+	rc = -50;
+	goto on_return;
+    }
+    pjmedia_clock_start(sync_cd.clock);
+    if (pjmedia_clock_wait(sync_cd.clock, PJ_FALSE, NULL)) {
+	rc = -51;
+	goto on_return;
+    }
+    for (i = 0; i < 5; ++i)
+	pjmedia_clock_wait(sync_cd.clock, PJ_TRUE, NULL);
+    if (pj_atomic_get(sync_cd.ticks) != 5 || sync_cd.ts_error) {
+	rc = -52;
+	goto on_return;
+    }
+
+on_return:
+    for (i = 0; i < CLOCK_CNT; ++i) {
+	if (cd[i].clock)
+	    pjmedia_clock_destroy(cd[i].clock);
+	if (cd[i].ticks)
+	    pj_atomic_destroy(cd[i].ticks);
+    }
+    if (sync_cd.clock)
+	pjmedia_clock_destroy(sync_cd.clock);
+    if (sync_cd.ticks)
+	pj_atomic_destroy(sync_cd.ticks);
+
+    /* The clocks destroyed from their callbacks have released their pools
+     * too, by now.
+     */
+    pj_caching_pool_get_stat((pj_caching_pool*)mem, &cp_stat);
+    if (rc == 0 && cp_stat.used_count != used_count)
+	rc = -60;
+
+    if (rc != 0)
+	PJ_LOG(3,(THIS_FILE, "    error %d", rc));
+    pj_pool_release(pool);
+    return rc;
+}
@@ -0,0 +1,472 @@
+/* $Id$ */
+/*
+ * Copyright (C) 2008-2011 Teluu Inc. (http://www.teluu.com)
+ * Copyright (C) 2003-2008 Benny Prijono <benny@prijono.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include "test.h"
+
+/*
+ * Conference bridge mixing benchmark.
+ *
+ * N source ports are each connected to M listener ports (and to port 0),
+ * and the bridge is clocked from its master port. The same topology is
+ * run with the scalar mixing kernel (PJMEDIA_CONF_NO_SIMD_MIX) and with
+ * the default kernel, the output of port 0 is compared, and the time per
+ * tick is reported together with the number of such bridges that one
+ * core could run in real time.
+ *
+ * The second part simulates sources with expensive get_frame() (e.g.
+ * decoding and resampling), and compares reading them from the clock
+ * thread with reading them using the bridge's worker threads.
+ *
+ * Then a few ports are run on bridges with many free slots, to check
+ * that the cost of a tick doesn't depend on the number of slots.
+ *
+ * The last part checks the VAD-gated mixing: silent sources and sources
+ * beyond the max_speakers loudest ones must not be heard, and skipping
+ * them must make the tick cheaper.
+ */
+
+#define THIS_FILE	"conf_mix_test.c"
+#define CLOCK_RATE	16000
+#define PTIME		20
+#define SPF		(CLOCK_RATE * PTIME / 1000)
+#define TICKS		500
+#define WORKERS		4
+#define SRC_ABSENT	0xFF	/* Don't add this source to the bridge */
+#define SRC_SILENT	15	/* Attenuation of silent source */
+
+/* Source port data */
+struct src_data
+{
+    pj_int16_t	samples[SPF];
+    unsigned	work;		/* Simulated decoding work per frame */
+    unsigned	shift;		/* Attenuation, in bits */
+};
+
+/* Source port which returns the same (loud) frame forever, so that the
+ * bridge has to adjust the level of the mixed signal.
+ */
+static pj_status_t src_get_frame(pjmedia_port *this_port,
+				 pjmedia_frame *frame)
+{
+    struct src_data *sd = (struct src_data*)this_port->port_data.pdata;
+    pj_int16_t *samples = (pj_int16_t*)frame->buf;
+    unsigned i, j;
+
+    pj_memcpy(samples, sd->samples, SPF * 2);
+
+    /* Simple IIR smoothing, repeated to simulate decoding cost. The
+     * output is the same on every call.
+     */
+    for (j=0; j<sd->work; ++j) {
+	pj_int32_t acc = 0;
+	for (i=0; i<SPF; ++i) {
+	    acc = (acc * 3 + sd->samples[i]) >> 2;
+	    samples[i] = (pj_int16_t)((samples[i] + acc) >> 1);
+	}
+    }
+
+    frame->size = SPF * 2;
+    frame->type = PJMEDIA_FRAME_TYPE_AUDIO;
+    return PJ_SUCCESS;
+}
+
+static pjmedia_port *create_src_port(pj_pool_t *pool, unsigned seed,
+				     unsigned work, unsigned shift)
+{
+    const pj_str_t name = pj_str("src");
+    pjmedia_port *port;
+    struct src_data *sd;
+    pj_int16_t *samples;
+    unsigned i;
+
+    sd = PJ_POOL_ZALLOC_T(pool, struct src_data);
+    sd->work = work;
+    samples = sd->samples;
+    for (i=0; i<SPF; ++i) {
+	/* Triangle wave with different period and phase per port */
+	unsigned period = 40 + seed * 3;
+	int pos = (int)((i + seed * 7) % period);
+	int half = (int)period / 2;
+	int v = (pos < half ? pos : (int)period - pos) * 2 * 24000 / half;
+	samples[i] = (pj_int16_t)((v - 24000) >> shift);
+    }
+
+    port = PJ_POOL_ZALLOC_T(pool, pjmedia_port);
+    pjmedia_port_info_init(&port->info, &name,
+			   PJMEDIA_SIG_CLASS_PORT_AUD('S','R'),
+			   CLOCK_RATE, 1, 16, SPF);
+    port->port_data.pdata = sd;
+    port->get_frame = &src_get_frame;
+
+    return port;
+}
+
+static int run_bridge(unsigned n_src, unsigned n_dst, unsigned max_slots,
+		      unsigned options, unsigned workers, unsigned work,
+		      pj_int16_t *out, pj_uint32_t *p_usec)
+{
+    pj_pool_t *pool;
+    pjmedia_conf_param param;
+    pjmedia_conf *conf;
+    pjmedia_port *master;
+    pjmedia_frame frame;
+    pj_timestamp t0, t1;
+    unsigned i, j, *dst_slots;
+    pj_status_t status;
+    int rc = 0;
+
+    pool = pj_pool_create(mem, "confmix", 4000, 4000, NULL);
+
+    pjmedia_conf_param_default(&param);
+    param.max_slots = max_slots ? max_slots : 1 + n_src + n_dst;
+    param.sampling_rate = CLOCK_RATE;
+    param.channel_count = 1;
+    param.samples_per_frame = SPF;
+    param.options = PJMEDIA_CONF_NO_DEVICE | options;
+    param.worker_threads = workers;
+
+    status = pjmedia_conf_create2(pool, &param, &conf);
+    if (status != PJ_SUCCESS) {
+	app_perror(status, "  error creating conference bridge");
+	pj_pool_release(pool);
+	return -10;
+    }
+
+    dst_slots = (unsigned*) pj_pool_calloc(pool, n_dst, sizeof(unsigned));
+    for (j=0; j<n_dst; ++j) {
+	pjmedia_port *null_port;
+
+	pjmedia_null_port_create(pool, CLOCK_RATE, 1, SPF, 16, &null_port);
+	status = pjmedia_conf_add_port(conf, pool, null_port, NULL,
+				       &dst_slots[j]);
+	if (status != PJ_SUCCESS) {
+	    rc = -20;
+	    goto on_return;
+	}
+    }
+
+    for (i=0; i<n_src; ++i) {
+	unsigned slot;
+
+	status = pjmedia_conf_add_port(conf, pool,
+				       create_src_port(pool, i, work, 0),
+				       NULL, &slot);
+	if (status != PJ_SUCCESS) {
+	    rc = -30;
+	    goto on_return;
+	}
+
+	/* Use non-normal level on some connections */
+	pjmedia_conf_connect_port(conf, slot, 0, (i & 1) ? -32 : 0);
+	for (j=0; j<n_dst; ++j)
+	    pjmedia_conf_connect_port(conf, slot, dst_slots[j], 0);
+    }
+
+    master = pjmedia_conf_get_master_port(conf);
+
+    frame.buf = out;
+    frame.size = SPF * 2;
+    frame.timestamp.u64 = 0;
+
+    pj_get_timestamp(&t0);
+    for (i=0; i<TICKS; ++i) {
+	frame.size = SPF * 2;
+	pjmedia_port_get_frame(master, &frame);
+	frame.timestamp.u64 += SPF;
+    }
+    pj_get_timestamp(&t1);
+
+    *p_usec = pj_elapsed_usec(&t0, &t1) / TICKS;
+
+on_return:
+    pjmedia_conf_destroy(conf);
+    pj_pool_release(pool);
+    return rc;
+}
+
+/* Run bridge with VAD-gated mixing. The shift[] specifies the attenuation
+ * of each source, and all sources are connected to port 0 and to n_dst
+ * listeners.
+ */
+static int run_vad_bridge(unsigned n_src, const unsigned *shift,
+			  unsigned n_dst, pj_bool_t vad_gate,
+			  unsigned max_speakers, pj_int16_t *out,
+			  pj_uint32_t *p_usec)
+{
+    pj_pool_t *pool;
+    pjmedia_conf_param param;
+    pjmedia_conf *conf;
+    pjmedia_port *master;
+    pjmedia_frame frame;
+    pj_timestamp t0, t1;
+    unsigned i, j, *dst_slots;
+    pj_status_t status;
+    int rc = 0;
+
+    pool = pj_pool_create(mem, "confvad", 4000, 4000, NULL);
+
+    pjmedia_conf_param_default(&param);
+    param.max_slots = 1 + n_src + n_dst;
+    param.sampling_rate = CLOCK_RATE;
+    param.channel_count = 1;
+    param.samples_per_frame = SPF;
+    param.options = PJMEDIA_CONF_NO_DEVICE;
+    param.vad_gate = vad_gate;
+    param.max_speakers = max_speakers;
+
+    status = pjmedia_conf_create2(pool, &param, &conf);
+    if (status != PJ_SUCCESS) {
+	app_perror(status, "  error creating conference bridge");
+	pj_pool_release(pool);
+	return -100;
+    }
+
+    dst_slots = (unsigned*) pj_pool_calloc(pool, n_dst, sizeof(unsigned));
+    for (j=0; j<n_dst; ++j) {
+	pjmedia_port *null_port;
+
+	pjmedia_null_port_create(pool, CLOCK_RATE, 1, SPF, 16, &null_port);
+	status = pjmedia_conf_add_port(conf, pool, null_port, NULL,
+				       &dst_slots[j]);
+	if (status != PJ_SUCCESS) {
+	    rc = -110;
+	    goto on_return;
+	}
+    }
+
+    for (i=0; i<n_src; ++i) {
+	unsigned slot;
+
+	if (shift[i] == SRC_ABSENT)
+	    continue;
+
+	status = pjmedia_conf_add_port(conf, pool,
+				       create_src_port(pool, i, 0, shift[i]),
+				       NULL, &slot);
+	if (status != PJ_SUCCESS) {
+	    rc = -120;
+	    goto on_return;
+	}
+
+	pjmedia_conf_connect_port(conf, slot, 0, 0);
+	for (j=0; j<n_dst; ++j)
+	    pjmedia_conf_connect_port(conf, slot, dst_slots[j], 0);
+    }
+
+    master = pjmedia_conf_get_master_port(conf);
+
+    frame.buf = out;
+    frame.timestamp.u64 = 0;
+
+    pj_get_timestamp(&t0);
+    for (i=0; i<TICKS; ++i) {
+	frame.size = SPF * 2;
+	pjmedia_port_get_frame(master, &frame);
+	frame.timestamp.u64 += SPF;
+    }
+    pj_get_timestamp(&t1);
+
+    *p_usec = pj_elapsed_usec(&t0, &t1) / TICKS;
+
+on_return:
+    pjmedia_conf_destroy(conf);
+    pj_pool_release(pool);
+    return rc;
+}
+
+static int vad_test(void)
+{
+    enum { N = 16, DST = 4 };
+    unsigned shift[N], ref_shift[N];
+    pj_int16_t out_ref[SPF], out_vad[SPF];
+    pj_uint32_t usec_ref, usec_vad;
+    unsigned i;
+    int rc;
+
+    /* Three talkers of decreasing level, the rest are silent. */
+    for (i=0; i<N; ++i) {
+	shift[i] = (i < 3) ? i : SRC_SILENT;
+	ref_shift[i] = SRC_ABSENT;
+    }
+
+    /* Gating silent ports must sound the same as not having them */
+    ref_shift[0] = 0;
+    ref_shift[1] = 1;
+    ref_shift[2] = 2;
+
+    rc = run_vad_bridge(N, ref_shift, DST, PJ_FALSE, 0, out_ref, &usec_ref);
+    if (rc != 0)
+	return rc;
+
+    rc = run_vad_bridge(N, shift, DST, PJ_TRUE, 0, out_vad, &usec_vad);
+    if (rc != 0)
+	return rc;
+
+    if (pj_memcmp(out_ref, out_vad, sizeof(out_ref)) != 0) {
+	PJ_LOG(3,(THIS_FILE, "  error: silent ports are mixed"));
+	return -130;
+    }
+
+    /* With two speakers max, the quietest talker must be dropped too */
+    ref_shift[2] = SRC_ABSENT;
+
+    rc = run_vad_bridge(N, ref_shift, DST, PJ_FALSE, 0, out_ref, &usec_ref);
+    if (rc != 0)
+	return rc;
+
+    rc = run_vad_bridge(N, shift, DST, PJ_TRUE, 2, out_vad, &usec_vad);
+    if (rc != 0)
+	return rc;
+
+    if (pj_memcmp(out_ref, out_vad, sizeof(out_ref)) != 0) {
+	PJ_LOG(3,(THIS_FILE, "  error: more than max_speakers are mixed"));
+	return -140;
+    }
+
+    /* Cost of the tick, 3 talkers among N sources */
+    rc = run_vad_bridge(N, shift, DST, PJ_FALSE, 0, out_ref, &usec_ref);
+    if (rc != 0)
+	return rc;
+
+    rc = run_vad_bridge(N, shift, DST, PJ_TRUE, 2, out_vad, &usec_vad);
+    if (rc != 0)
+	return rc;
+
+    PJ_LOG(3,(THIS_FILE, "  VAD gate, %d x %d, 3 talkers: %d usec without, "
+			 "%d usec with max 2 speakers", N, DST, usec_ref,
+	      usec_vad));
+
+    return 0;
+}
+
+int conf_mix_test(void)
+{
+    static const struct
+    {
+	unsigned n_src;
+	unsigned n_dst;
+    } cfg[] =
+    {
+	{ 2, 2 }, { 4, 4 }, { 8, 8 }, { 16, 16 }, { 32, 1 }, { 32, 32 }
+    };
+    static const struct
+    {
+	unsigned n_src;
+	unsigned work;
+    } slow_cfg[] =
+    {
+	{ 8, 20 }, { 16, 20 }, { 32, 20 }, { 32, 50 }
+    };
+    static const unsigned sparse_slots[] = { 16, 254, 1024 };
+    pj_int16_t out_scalar[SPF], out_def[SPF];
+    unsigned i;
+
+    PJ_LOG(3,(THIS_FILE, "  Conference mixing, %d Hz, %d ms ptime",
+	      CLOCK_RATE, PTIME));
+    PJ_LOG(3,(THIS_FILE, "  Src x Dst   Scalar(usec)  Default(usec)  "
+			 "Speedup  Ports/core"));
+
+    for (i=0; i<PJ_ARRAY_SIZE(cfg); ++i) {
+	pj_uint32_t usec_scalar, usec_def;
+	unsigned ports_per_core;
+	int rc;
+
+	rc = run_bridge(cfg[i].n_src, cfg[i].n_dst, 0,
+			PJMEDIA_CONF_NO_SIMD_MIX, 0, 0, out_scalar,
+			&usec_scalar);
+	if (rc != 0)
+	    return rc;
+
+	rc = run_bridge(cfg[i].n_src, cfg[i].n_dst, 0, 0, 0, 0,
+			out_def, &usec_def);
+	if (rc != 0)
+	    return rc;
+
+	/* Both kernels must produce exactly the same signal */
+	if (pj_memcmp(out_scalar, out_def, sizeof(out_scalar)) != 0) {
+	    PJ_LOG(3,(THIS_FILE, "  error: mixed signal mismatch (%dx%d)",
+		      cfg[i].n_src, cfg[i].n_dst));
+	    return -40;
+	}
+
+	if (usec_scalar == 0) usec_scalar = 1;
+	if (usec_def == 0) usec_def = 1;
+
+	ports_per_core = (cfg[i].n_src + cfg[i].n_dst) * PTIME * 1000 /
+			 usec_def;
+
+	PJ_LOG(3,(THIS_FILE, "  %3d x %-3d    %8d       %8d      %3d.%02dx  %8d",
+		  cfg[i].n_src, cfg[i].n_dst, usec_scalar, usec_def,
+		  usec_scalar / usec_def, usec_scalar * 100 / usec_def % 100,
+		  ports_per_core));
+    }
+
+    PJ_LOG(3,(THIS_FILE, "  Slow sources, %d worker threads", WORKERS));
+    PJ_LOG(3,(THIS_FILE, "  Src  Work   Sequential(usec)  Workers(usec)"));
+
+    for (i=0; i<PJ_ARRAY_SIZE(slow_cfg); ++i) {
+	pj_uint32_t usec_seq, usec_par;
+	int rc;
+
+	rc = run_bridge(slow_cfg[i].n_src, 1, 0, 0, 0, slow_cfg[i].work,
+			out_scalar, &usec_seq);
+	if (rc != 0)
+	    return rc;
+
+	rc = run_bridge(slow_cfg[i].n_src, 1, 0, 0, WORKERS,
+			slow_cfg[i].work, out_def, &usec_par);
+	if (rc != 0)
+	    return rc;
+
+	/* Reading in parallel must not change the mixed signal */
+	if (pj_memcmp(out_scalar, out_def, sizeof(out_scalar)) != 0) {
+	    PJ_LOG(3,(THIS_FILE, "  error: mixed signal mismatch with "
+				 "worker threads (%d sources)",
+		      slow_cfg[i].n_src));
+	    return -50;
+	}
+
+	PJ_LOG(3,(THIS_FILE, "  %3d  %4d       %8d        %8d",
+		  slow_cfg[i].n_src, slow_cfg[i].work, usec_seq, usec_par));
+    }
+
+    PJ_LOG(3,(THIS_FILE, "  Sparse bridge, 4 x 2 ports"));
+    PJ_LOG(3,(THIS_FILE, "  Slots  Tick(usec)"));
+
+    for (i=0; i<PJ_ARRAY_SIZE(sparse_slots); ++i) {
+	pj_uint32_t usec;
+	int rc;
+
+	rc = run_bridge(4, 2, sparse_slots[i], 0, 0, 0, out_def, &usec);
+	if (rc != 0)
+	    return rc;
+
+	/* Free slots must not change the mixed signal */
+	if (i > 0 && pj_memcmp(out_scalar, out_def, sizeof(out_scalar)) != 0) {
+	    PJ_LOG(3,(THIS_FILE, "  error: mixed signal mismatch with "
+				 "%d slots", sparse_slots[i]));
+	    return -60;
+	}
+	pj_memcpy(out_scalar, out_def, sizeof(out_scalar));
+
+	PJ_LOG(3,(THIS_FILE, "  %5d   %8d", sparse_slots[i], usec));
+    }
+
+    return vad_test();
+}
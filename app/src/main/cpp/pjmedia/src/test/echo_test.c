@@ -0,0 +1,206 @@
+/* $Id$ */
+/*
+ * Copyright (C) 2008-2011 Teluu Inc. (http://www.teluu.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include "test.h"
+
+/*
+ * Echo canceller reference buffer test.
+ *
+ * Playback and capture are first driven in lockstep from one thread, then
+ * with capture running faster and slower than playback, and with capture
+ * stalled. The reference buffer must keep capture at the configured
+ * latency, repeating or skipping frames only when the drift exceeds the
+ * tolerance. Finally playback and capture run from their own threads.
+ */
+
+#define THIS_FILE	"echo_test.c"
+#define CLOCK_RATE	8000
+#define SPF		80	/* 10 ms */
+#define LATENCY		60	/* msec */
+#define THREAD_FRAMES	500
+
+static pj_int16_t play_frm[SPF], rec_frm[SPF];
+
+static void play(pjmedia_echo_state *ec, unsigned cnt)
+{
+    while (cnt--)
+	pjmedia_echo_playback(ec, play_frm);
+}
+
+static void capture(pjmedia_echo_state *ec, unsigned cnt)
+{
+    while (cnt--)
+	pjmedia_echo_capture(ec, rec_frm, 0);
+}
+
+static int play_thread(void *arg)
+{
+    pjmedia_echo_state *ec = (pjmedia_echo_state*) arg;
+    unsigned i;
+
+    for (i = 0; i < THREAD_FRAMES; ++i) {
+	play(ec, 1);
+	if (i % 4 == 0)
+	    pj_thread_sleep(1);
+    }
+    return 0;
+}
+
+static int capture_thread(void *arg)
+{
+    pjmedia_echo_state *ec = (pjmedia_echo_state*) arg;
+    unsigned i;
+
+    for (i = 0; i < THREAD_FRAMES; ++i) {
+	capture(ec, 1);
+	if (i % 4 == 2)
+	    pj_thread_sleep(1);
+    }
+    return 0;
+}
+
+int echo_test(void)
+{
+    pj_pool_t *pool;
+    pjmedia_echo_state *ec;
+    pjmedia_echo_stat stat;
+    pj_thread_t *thread[2] = { NULL, NULL };
+    unsigned i, frame_cnt;
+    pj_status_t status;
+    int rc = 0;
+
+    PJ_LOG(3,(THIS_FILE, "  echo canceller reference buffer test"));
+
+    pool = pj_pool_create(mem, "echotest", 4000, 4000, NULL);
+
+    status = pjmedia_echo_create(pool, CLOCK_RATE, SPF, 100, LATENCY,
+				 PJMEDIA_ECHO_SIMPLE, &ec);
+    if (status != PJ_SUCCESS) {
+	app_perror(status, "Error creating echo canceller");
+	pj_pool_release(pool);
+	return -10;
+    }
+
+    /* Nothing is used before the latency has been built up */
+    capture(ec, 3);
+    play(ec, 2);
+    capture(ec, 1);
+    pjmedia_echo_get_stat(ec, &stat);
+    if (stat.frame_cnt != 0) {
+	rc = -20;
+	goto on_return;
+    }
+
+    /* Lockstep */
+    play(ec, 8);
+    for (i = 0; i < 200; ++i) {
+	play(ec, 1);
+	capture(ec, 1);
+    }
+    pjmedia_echo_get_stat(ec, &stat);
+    if (stat.frame_cnt != 200 || stat.drop_cnt || stat.underrun_cnt ||
+	stat.overrun_cnt)
+    {
+	PJ_LOG(3,(THIS_FILE, "    lockstep: %u frames, %u drops, %u underruns, "
+		  "%u overruns", stat.frame_cnt, stat.drop_cnt,
+		  stat.underrun_cnt, stat.overrun_cnt));
+	rc = -30;
+	goto on_return;
+    }
+
+    /* Capture is faster than playback */
+    for (i = 0; i < 200; ++i) {
+	play(ec, 1);
+	capture(ec, (i % 10 == 0) ? 2 : 1);
+    }
+    pjmedia_echo_get_stat(ec, &stat);
+    if (stat.underrun_cnt == 0 || stat.overrun_cnt || stat.drop_cnt) {
+	rc = -40;
+	goto on_return;
+    }
+
+    /* Playback is faster than capture */
+    for (i = 0; i < 200; ++i) {
+	play(ec, (i % 10 == 0) ? 2 : 1);
+	capture(ec, 1);
+    }
+    pjmedia_echo_get_stat(ec, &stat);
+    if (stat.overrun_cnt == 0 || stat.drop_cnt) {
+	rc = -50;
+	goto on_return;
+    }
+
+    /* Capture is stalled: playback drops frames, then capture skips */
+    i = stat.overrun_cnt;
+    play(ec, 100);
+    capture(ec, 1);
+    pjmedia_echo_get_stat(ec, &stat);
+    if (stat.drop_cnt == 0 || stat.overrun_cnt != i + 1) {
+	rc = -60;
+	goto on_return;
+    }
+
+    /* Reset starts over with the latency */
+    pjmedia_echo_reset(ec);
+    i = stat.frame_cnt;
+    capture(ec, 1);
+    pjmedia_echo_get_stat(ec, &stat);
+    if (stat.frame_cnt != i) {
+	rc = -70;
+	goto on_return;
+    }
+
+    /* Playback and capture from different threads */
+    frame_cnt = stat.frame_cnt;
+    status = pj_thread_create(pool, "echoplay", &play_thread, ec, 0, 0,
+			      &thread[0]);
+    if (status == PJ_SUCCESS)
+	status = pj_thread_create(pool, "echocap", &capture_thread, ec, 0, 0,
+				  &thread[1]);
+    if (status != PJ_SUCCESS) {
+	rc = -80;
+	goto on_return;
+    }
+    for (i = 0; i < 2; ++i) {
+	pj_thread_join(thread[i]);
+	pj_thread_destroy(thread[i]);
+	thread[i] = NULL;
+    }
+
+    pjmedia_echo_get_stat(ec, &stat);
+    if (stat.frame_cnt <= frame_cnt) {
+	rc = -81;
+	goto on_return;
+    }
+    PJ_LOG(3,(THIS_FILE, "    %u frames, %u drops, %u underruns, "
+	      "%u overruns, delay %u us", stat.frame_cnt, stat.drop_cnt,
+	      stat.underrun_cnt, stat.overrun_cnt, stat.delay_usec));
+
+on_return:
+    for (i = 0; i < 2; ++i) {
+	if (thread[i]) {
+	    pj_thread_join(thread[i]);
+	    pj_thread_destroy(thread[i]);
+	}
+    }
+    if (rc != 0)
+	PJ_LOG(3,(THIS_FILE, "    error %d", rc));
+    pjmedia_echo_destroy(ec);
+    pj_pool_release(pool);
+    return rc;
+}
@@ -0,0 +1,439 @@
+/* $Id$ */
+/*
+ * Copyright (C) 2008-2011 Teluu Inc. (http://www.teluu.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <pjlib-util/pcap.h>
+#include "test.h"
+
+/*
+ * Jitter buffer replay benchmark.
+ *
+ * RTP arrival traces are replayed into the jitter buffer in simulated
+ * time: packets are put at their arrival time and a frame is taken every
+ * ptime, as the stream would do. For each trace and each discard
+ * algorithm the benchmark reports the end-to-end delay percentiles of the
+ * played frames (from the send time to the play time), the number of
+ * concealed (missing), empty and discarded frames, and the CPU time spent
+ * in the jitter buffer per frame.
+ *
+ * The traces come from synthetic network models, and from the RTP stream
+ * in JB_REPLAY_PCAP when that file can be found. For a capture, the send
+ * time of a packet is estimated from its RTP timestamp, so the delay is
+ * relative to the network delay of the first packet. Times are kept in
+ * usec, so the packet spacing of a capture is replayed as it was.
+ */
+
+#define THIS_FILE	    "jbuf_replay_test.c"
+
+#define JB_PTIME	    20
+#define JB_BUF_SIZE	    50
+#define JB_FRAME_SIZE	    160
+#define JB_MODEL_SECONDS    60
+
+/* The capture to replay, and the RTP clock rate of its stream */
+#ifndef JB_REPLAY_PCAP
+#   define JB_REPLAY_PCAP   "jbreplay.pcap"
+#endif
+#ifndef JB_CLOCK_RATE
+#   define JB_CLOCK_RATE    8000
+#endif
+
+/* One packet of the arrival trace */
+typedef struct replay_pkt
+{
+    pj_uint32_t	    arrival;	/**< Arrival time, in usec.		*/
+    pj_uint32_t	    sent;	/**< Send time, in usec.		*/
+    int		    seq;	/**< Extended sequence number.		*/
+    pj_uint32_t	    ts;		/**< RTP timestamp.			*/
+} replay_pkt;
+
+typedef struct replay_trace
+{
+    const char	    *name;
+    replay_pkt	    *pkt;
+    unsigned	    count;
+    unsigned	    capacity;
+} replay_trace;
+
+typedef struct replay_result
+{
+    unsigned	    played;
+    unsigned	    missing;
+    unsigned	    empty;
+    unsigned	    discard;
+    unsigned	    lost;
+    unsigned	    delay_p50;
+    unsigned	    delay_p95;
+    unsigned	    delay_p99;
+    unsigned	    delay_max;
+    unsigned	    nsec_per_frame;
+} replay_result;
+
+
+static replay_pkt *trace_add(pj_pool_t *pool, replay_trace *trace)
+{
+    if (trace->count == trace->capacity) {
+	unsigned cap = trace->capacity ? trace->capacity * 2 : 1024;
+	replay_pkt *pkt;
+
+	pkt = (replay_pkt*) pj_pool_alloc(pool, cap * sizeof(replay_pkt));
+	if (trace->count)
+	    pj_memcpy(pkt, trace->pkt, trace->count * sizeof(replay_pkt));
+	trace->pkt = pkt;
+	trace->capacity = cap;
+    }
+
+    return &trace->pkt[trace->count++];
+}
+
+static int cmp_arrival(const void *a, const void *b)
+{
+    const replay_pkt *pa = (const replay_pkt*)a;
+    const replay_pkt *pb = (const replay_pkt*)b;
+
+    if (pa->arrival != pb->arrival)
+	return pa->arrival < pb->arrival ? -1 : 1;
+    return pa->seq - pb->seq;
+}
+
+static int cmp_uint(const void *a, const void *b)
+{
+    unsigned ua = *(const unsigned*)a, ub = *(const unsigned*)b;
+    return ua < ub ? -1 : (ua > ub ? 1 : 0);
+}
+
+/*
+ * Synthetic network models.
+ */
+enum model_type
+{
+    MODEL_JITTER,	/* 40 ms base delay, 0-60 ms uniform jitter	*/
+    MODEL_BURST,	/* Like jitter, plus 400 ms stalls every 5 sec	*/
+    MODEL_LOSS		/* 20 ms jitter and 2% loss, in bursts of 1-3	*/
+};
+
+static void gen_model(pj_pool_t *pool, enum model_type model,
+		      replay_trace *trace)
+{
+    static const char *names[] = { "jitter", "burst", "loss" };
+    unsigned i, n = JB_MODEL_SECONDS * 1000 / JB_PTIME, loss_run = 0;
+
+    pj_srand(1234 + model);
+    pj_bzero(trace, sizeof(*trace));
+    trace->name = names[model];
+
+    for (i = 0; i < n; ++i) {
+	pj_uint32_t sent = i * JB_PTIME;
+	pj_uint32_t delay;
+	replay_pkt *pkt;
+
+	switch (model) {
+	case MODEL_BURST:
+	    delay = 40 + pj_rand() % 61;
+	    /* Everything sent during a stall arrives when it ends */
+	    if (sent % 5000 >= 4600)
+		delay += 5000 - sent % 5000;
+	    break;
+	case MODEL_LOSS:
+	    delay = 40 + pj_rand() % 21;
+	    if (loss_run == 0 && pj_rand() % 100 < 1)
+		loss_run = 1 + pj_rand() % 3;
+	    if (loss_run) {
+		--loss_run;
+		continue;
+	    }
+	    break;
+	default:
+	    delay = 40 + pj_rand() % 61;
+	    break;
+	}
+
+	pkt = trace_add(pool, trace);
+	pkt->sent = sent * 1000;
+	pkt->arrival = (sent + delay) * 1000;
+	pkt->seq = i;
+	pkt->ts = i * (JB_CLOCK_RATE * JB_PTIME / 1000);
+    }
+
+    qsort(trace->pkt, trace->count, sizeof(replay_pkt), &cmp_arrival);
+}
+
+/*
+ * Load the first RTP stream of a capture.
+ */
+static pj_status_t load_pcap(pj_pool_t *pool, const char *filename,
+			     replay_trace *trace)
+{
+    pj_pcap_file *file;
+    pj_pcap_filter filter;
+    pj_uint8_t pkt_buf[1500];
+    pj_uint32_t ssrc = 0, ts0 = 0, t0 = 0;
+    pj_uint16_t last_seq = 0;
+    int cycles = 0;
+    pj_status_t status;
+
+    pj_bzero(trace, sizeof(*trace));
+    trace->name = "pcap";
+
+    status = pj_pcap_open(pool, filename, &file);
+    if (status != PJ_SUCCESS)
+	return status;
+
+    pj_pcap_filter_default(&filter);
+    filter.link = PJ_PCAP_LINK_TYPE_ETH;
+    filter.proto = PJ_PCAP_PROTO_TYPE_UDP;
+    pj_pcap_set_filter(file, &filter);
+
+    for (;;) {
+	pj_size_t sz = sizeof(pkt_buf);
+	pj_pcap_time tv;
+	pj_uint32_t arrival, pkt_ssrc, pkt_ts;
+	pj_uint16_t seq;
+	replay_pkt *pkt;
+
+	status = pj_pcap_read_udp2(file, NULL, &tv, pkt_buf, &sz);
+	if (status != PJ_SUCCESS)
+	    break;
+
+	/* RTP version 2, not RTCP */
+	if (sz < 12 || (pkt_buf[0] >> 6) != 2 ||
+	    (pkt_buf[1] >= 200 && pkt_buf[1] <= 204))
+	{
+	    continue;
+	}
+
+	seq = (pj_uint16_t)((pkt_buf[2] << 8) | pkt_buf[3]);
+	pkt_ts = ((pj_uint32_t)pkt_buf[4] << 24) | (pkt_buf[5] << 16) |
+		 (pkt_buf[6] << 8) | pkt_buf[7];
+	pkt_ssrc = ((pj_uint32_t)pkt_buf[8] << 24) | (pkt_buf[9] << 16) |
+		   (pkt_buf[10] << 8) | pkt_buf[11];
+	/* Wraps every 71 minutes, but only the difference to the first
+	 * packet is used.
+	 */
+	arrival = tv.sec * 1000000 + tv.usec;
+
+	if (trace->count == 0) {
+	    ssrc = pkt_ssrc;
+	    ts0 = pkt_ts;
+	    t0 = arrival;
+	    last_seq = seq;
+	} else if (pkt_ssrc != ssrc) {
+	    continue;
+	}
+
+	/* Extend the sequence number */
+	if (seq < 0x1000 && last_seq > 0xF000)
+	    ++cycles;
+	if (seq > last_seq || (seq < 0x1000 && last_seq > 0xF000))
+	    last_seq = seq;
+
+	pkt = trace_add(pool, trace);
+	pkt->arrival = arrival - t0;
+	pkt->ts = pkt_ts;
+	if ((pj_int32_t)(pkt_ts - ts0) > 0)
+	    pkt->sent = (pj_uint32_t)((pj_uint64_t)(pkt_ts - ts0) * 1000000 /
+				      JB_CLOCK_RATE);
+	else
+	    pkt->sent = 0;
+	pkt->seq = cycles * 0x10000 + seq;
+	/* Late packet from before the wrap */
+	if (seq > 0xF000 && last_seq < 0x1000)
+	    pkt->seq -= 0x10000;
+    }
+
+    pj_pcap_close(file);
+
+    return trace->count ? PJ_SUCCESS : PJ_ENOTFOUND;
+}
+
+/*
+ * Replay a trace into a jitter buffer.
+ */
+static int replay(pj_pool_t *pool, const replay_trace *trace,
+		  pjmedia_jb_discard_algo algo, replay_result *res)
+{
+    pj_str_t jb_name = {"JBREPLAY", 8};
+    pjmedia_jbuf *jb;
+    pjmedia_jb_state state;
+    pj_uint32_t *sent_by_seq;
+    unsigned *delay, seq_base, seq_span, i, next = 0;
+    pj_uint32_t now, end;
+    pj_timestamp t_total, t0, t1;
+    char frame[JB_FRAME_SIZE];
+    pj_status_t status;
+
+    pj_bzero(res, sizeof(*res));
+    t_total.u64 = 0;
+
+    /* Send time lookup by sequence number */
+    seq_base = trace->pkt[0].seq;
+    seq_span = 1;
+    for (i = 0; i < trace->count; ++i) {
+	if (trace->pkt[i].seq < (int)seq_base) {
+	    seq_span += seq_base - trace->pkt[i].seq;
+	    seq_base = trace->pkt[i].seq;
+	}
+	if (trace->pkt[i].seq - (int)seq_base >= (int)seq_span)
+	    seq_span = trace->pkt[i].seq - seq_base + 1;
+    }
+    sent_by_seq = (pj_uint32_t*)
+		  pj_pool_calloc(pool, seq_span, sizeof(pj_uint32_t));
+    for (i = 0; i < trace->count; ++i)
+	sent_by_seq[trace->pkt[i].seq - seq_base] = trace->pkt[i].sent;
+
+    delay = (unsigned*) pj_pool_alloc(pool, trace->count * 2 *
+					    sizeof(unsigned));
+
+    status = pjmedia_jbuf_create(pool, &jb_name, JB_FRAME_SIZE, JB_PTIME,
+				 JB_BUF_SIZE, &jb);
+    if (status != PJ_SUCCESS)
+	return -10;
+    pjmedia_jbuf_set_adaptive(jb, 0, 0, JB_BUF_SIZE * 4 / 5);
+    pjmedia_jbuf_set_discard(jb, algo);
+
+    pj_bzero(frame, sizeof(frame));
+    end = trace->pkt[trace->count - 1].arrival +
+	  JB_BUF_SIZE * JB_PTIME * 1000;
+
+    for (now = trace->pkt[0].arrival; now <= end; now += JB_PTIME * 1000) {
+	pj_size_t size = sizeof(frame);
+	char f_type;
+	pj_uint32_t ts;
+	int seq;
+
+	pj_get_timestamp(&t0);
+
+	/* Put everything that has arrived by now */
+	for (; next < trace->count && trace->pkt[next].arrival <= now;
+	     ++next)
+	{
+	    const replay_pkt *pkt = &trace->pkt[next];
+	    pjmedia_jbuf_put_frame3(jb, frame, JB_FRAME_SIZE, 0, pkt->seq,
+				    pkt->ts, NULL);
+	}
+
+	pjmedia_jbuf_get_frame3(jb, frame, &size, &f_type, NULL, &ts, &seq);
+
+	pj_get_timestamp(&t1);
+	pj_add_timestamp(&t_total, &t1);
+	pj_sub_timestamp(&t_total, &t0);
+
+	switch (f_type) {
+	case PJMEDIA_JB_NORMAL_FRAME:
+	    if (seq >= (int)seq_base && seq - seq_base < seq_span) {
+		pj_uint32_t sent = sent_by_seq[seq - seq_base];
+		delay[res->played] = (now > sent) ? (now - sent) / 1000 : 0;
+	    } else {
+		delay[res->played] = 0;
+	    }
+	    ++res->played;
+	    break;
+	case PJMEDIA_JB_MISSING_FRAME:
+	    ++res->missing;
+	    break;
+	default:
+	    ++res->empty;
+	    break;
+	}
+    }
+
+    pjmedia_jbuf_get_state(jb, &state);
+    res->discard = state.discard;
+    res->lost = state.lost;
+    pjmedia_jbuf_destroy(jb);
+
+    if (res->played == 0)
+	return -20;
+
+    qsort(delay, res->played, sizeof(unsigned), &cmp_uint);
+    res->delay_p50 = delay[res->played * 50 / 100];
+    res->delay_p95 = delay[res->played * 95 / 100];
+    res->delay_p99 = delay[res->played * 99 / 100];
+    res->delay_max = delay[res->played - 1];
+    t0.u64 = 0;
+    res->nsec_per_frame = pj_elapsed_nanosec(&t0, &t_total) /
+			  (res->played + res->missing + res->empty);
+
+    return 0;
+}
+
+static int run_trace(pj_pool_t *pool, const replay_trace *trace)
+{
+    static const struct {
+	pjmedia_jb_discard_algo algo;
+	const char *name;
+    } algos[] = {
+	{ PJMEDIA_JB_DISCARD_STATIC, "static" },
+	{ PJMEDIA_JB_DISCARD_PROGRESSIVE, "progressive" }
+    };
+    unsigned i;
+
+    for (i = 0; i < PJ_ARRAY_SIZE(algos); ++i) {
+	replay_result res;
+	int rc;
+
+	rc = replay(pool, trace, algos[i].algo, &res);
+	if (rc != 0) {
+	    PJ_LOG(3,(THIS_FILE, "    %s/%s: error %d", trace->name,
+		      algos[i].name, rc));
+	    return rc;
+	}
+
+	PJ_LOG(3,(THIS_FILE, "    %-6s %-11s %4u %4u %4u %4u  %6u %5u %5u "
+		  "%5u %5u  %5u",
+		  trace->name, algos[i].name,
+		  res.delay_p50, res.delay_p95, res.delay_p99, res.delay_max,
+		  res.played, res.missing, res.empty, res.discard, res.lost,
+		  res.nsec_per_frame));
+    }
+
+    return 0;
+}
+
+int jbuf_replay_test(void)
+{
+    pj_pool_t *pool;
+    replay_trace trace;
+    unsigned model;
+    int rc = 0;
+
+    PJ_LOG(3,(THIS_FILE, "  Jitter buffer replay (delay in ms, cpu in "
+			 "nsec/frame):"));
+    PJ_LOG(3,(THIS_FILE, "    trace  algo         p50  p95  p99  max  "
+			 "played  miss empty  disc  lost    cpu"));
+
+    for (model = MODEL_JITTER; rc == 0 && model <= MODEL_LOSS; ++model) {
+	pool = pj_pool_create(mem, "jbreplay", 64000, 64000, NULL);
+	gen_model(pool, (enum model_type)model, &trace);
+	rc = run_trace(pool, &trace);
+	pj_pool_release(pool);
+    }
+
+    if (rc == 0) {
+	pool = pj_pool_create(mem, "jbreplay", 64000, 64000, NULL);
+	if (load_pcap(pool, JB_REPLAY_PCAP, &trace) == PJ_SUCCESS)
+	    rc = run_trace(pool, &trace);
+	else
+	    PJ_LOG(3,(THIS_FILE, "    %s not found, capture replay skipped",
+		      JB_REPLAY_PCAP));
+	pj_pool_release(pool);
+    }
+
+    return rc;
+}
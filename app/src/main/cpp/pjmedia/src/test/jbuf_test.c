@@ -22,6 +22,8 @@
 #include <pj/pool.h>
 #include "test.h"
 
+#define THIS_FILE	    "jbuf_test.c"
+
 #define JB_INIT_PREFETCH    0
 #define JB_MIN_PREFETCH	    0
 #define JB_MAX_PREFETCH	    10
@@ -349,3 +351,326 @@ int jbuf_main(void)
 
     return rc;
 }
+
+
+/*
+ * Randomised trace test.
+ *
+ * Puts (in order, with gaps, late, duplicated, and with short and far
+ * jumps), gets, peeks, bulk removals and resets are applied in a random
+ * order, with put and get bursts so that the discard algorithms kick in.
+ * It runs for all three discard modes, on buffers whose slot ring is
+ * exactly, or is rounded up to, a power of two, so the rings wrap around
+ * many times. Each frame carries its sequence number in its timestamp,
+ * and its payload, length and bit info are derived from it, so every
+ * frame returned by get or peek is checked against its slot.
+ *
+ * A bulk removal must leave the frame that peek reported at the removed
+ * count as the new head. Draining the buffer with gets must return as many
+ * frames as the buffer size reported before, less the frames the discard
+ * algorithm removes meanwhile, so the count of discarded frames has to
+ * match the discarded slots (e.g. a frame discarded twice must not be
+ * counted twice).
+ *
+ * The trace uses its own random generator, so its results are the same on
+ * every platform. They are hashed and compared with the hash of the
+ * implementation with parallel arrays that the slot ring replaced, so any
+ * change of behaviour shows up as a different hash. The hash assumes the
+ * default PJMEDIA_JBUF_* settings.
+ */
+
+#define TRACE_OPS	    20000
+#define TRACE_FRAME_SIZE    64
+#define TRACE_TS_STEP	    160
+#define TRACE_HASH	    0x51af4de3
+
+typedef struct trace_ctx
+{
+    pjmedia_jbuf    *jb;
+    unsigned	     max_count;
+    pj_uint32_t	     rand;
+    pj_uint32_t	     hash;
+    int		     seq;	/**< Next sequence number to put.   */
+} trace_ctx;
+
+static pj_uint32_t trace_rand(trace_ctx *ctx)
+{
+    /* xorshift32 */
+    ctx->rand ^= ctx->rand << 13;
+    ctx->rand ^= ctx->rand >> 17;
+    ctx->rand ^= ctx->rand << 5;
+    return ctx->rand;
+}
+
+static void trace_hash(trace_ctx *ctx, pj_uint32_t val)
+{
+    unsigned i;
+
+    /* FNV-1a */
+    for (i = 0; i < 4; ++i) {
+	ctx->hash ^= (val >> (i * 8)) & 0xFF;
+	ctx->hash *= 16777619;
+    }
+}
+
+static unsigned trace_frame_len(int seq)
+{
+    return 1 + (unsigned)seq % TRACE_FRAME_SIZE;
+}
+
+static void trace_put(trace_ctx *ctx, int seq)
+{
+    pj_uint8_t frame[TRACE_FRAME_SIZE];
+    unsigned i, len = trace_frame_len(seq);
+    pj_bool_t discarded;
+
+    for (i = 0; i < len; ++i)
+	frame[i] = (pj_uint8_t)(seq * 7 + i);
+    pjmedia_jbuf_put_frame3(ctx->jb, frame, len, seq ^ 0x5A5A, seq,
+			    seq * TRACE_TS_STEP, &discarded);
+    trace_hash(ctx, discarded);
+}
+
+/* Check a normal frame against the sequence number in its timestamp */
+static pj_bool_t trace_frame_ok(const void *frame, pj_size_t size,
+				pj_uint32_t bit_info, pj_uint32_t ts)
+{
+    const pj_uint8_t *p = (const pj_uint8_t*) frame;
+    int seq = ts / TRACE_TS_STEP;
+    unsigned i;
+
+    if (ts % TRACE_TS_STEP || size != trace_frame_len(seq) ||
+	bit_info != (pj_uint32_t)(seq ^ 0x5A5A))
+    {
+	return PJ_FALSE;
+    }
+    for (i = 0; i < size; ++i) {
+	if (p[i] != (pj_uint8_t)(seq * 7 + i))
+	    return PJ_FALSE;
+    }
+
+    return PJ_TRUE;
+}
+
+static int trace_get(trace_ctx *ctx, char *p_type)
+{
+    pj_uint8_t frame[TRACE_FRAME_SIZE];
+    pj_size_t size = sizeof(frame);
+    pj_uint32_t bit_info = 0, ts = 0;
+    int seq = 0;
+
+    pjmedia_jbuf_get_frame3(ctx->jb, frame, &size, p_type, &bit_info, &ts,
+			    &seq);
+    trace_hash(ctx, *p_type);
+    if (*p_type != PJMEDIA_JB_NORMAL_FRAME)
+	return 0;
+
+    trace_hash(ctx, (pj_uint32_t)size);
+    trace_hash(ctx, seq);
+    if (!trace_frame_ok(frame, size, bit_info, ts) ||
+	ts != (pj_uint32_t)seq * TRACE_TS_STEP)
+    {
+	return -10;
+    }
+
+    return 0;
+}
+
+static int trace_peek(trace_ctx *ctx, unsigned offset, char *p_type,
+		      pj_uint32_t *p_ts)
+{
+    const void *frame = NULL;
+    pj_size_t size = 0;
+    pj_uint32_t bit_info = 0, ts = 0;
+    int seq = 0;
+
+    pjmedia_jbuf_peek_frame(ctx->jb, offset, &frame, &size, p_type,
+			    &bit_info, &ts, &seq);
+    trace_hash(ctx, *p_type);
+    if (p_ts)
+	*p_ts = ts;
+    if (*p_type != PJMEDIA_JB_NORMAL_FRAME)
+	return 0;
+
+    trace_hash(ctx, ts);
+    if (!trace_frame_ok(frame, size, bit_info, ts))
+	return -20;
+
+    return 0;
+}
+
+static int trace_op(trace_ctx *ctx, pj_bool_t put_burst)
+{
+    pjmedia_jb_state state;
+    unsigned r = trace_rand(ctx) % 1000;
+    char type;
+    int rc = 0;
+
+    pjmedia_jbuf_get_state(ctx->jb, &state);
+
+    if (r < (put_burst ? 600u : 300u)) {
+	/* Put, mostly in order */
+	unsigned r2 = trace_rand(ctx) % 1000;
+
+	if (r2 < 50) {
+	    /* Gap */
+	    ctx->seq += 1 + trace_rand(ctx) % 3;
+	} else if (r2 < 80 && ctx->seq > 60) {
+	    /* Late, possibly filling a gap */
+	    trace_put(ctx, ctx->seq - 1 - trace_rand(ctx) % 60);
+	    return 0;
+	} else if (r2 < 100 && ctx->seq > 1) {
+	    /* Duplicate */
+	    trace_put(ctx, ctx->seq - 1);
+	    return 0;
+	} else if (r2 < 110) {
+	    /* Jump past the end of the buffer */
+	    ctx->seq += 1 + trace_rand(ctx) % (ctx->max_count * 2);
+	} else if (r2 < 113) {
+	    /* Far jump, forward or backward */
+	    if (ctx->seq > 5000 && (trace_rand(ctx) & 1))
+		ctx->seq -= 4000;
+	    else
+		ctx->seq += 4000;
+	}
+	trace_put(ctx, ctx->seq++);
+
+    } else if (r < 900) {
+	rc = trace_get(ctx, &type);
+
+    } else if (r < 960) {
+	/* Peek, also one past the end */
+	unsigned offset = trace_rand(ctx) % (state.size + 2);
+
+	rc = trace_peek(ctx, offset, &type, NULL);
+	if (rc == 0 && (offset < state.size) !=
+		       (type != PJMEDIA_JB_ZERO_EMPTY_FRAME))
+	{
+	    rc = -30;
+	}
+
+    } else if (r < 990) {
+	/* Bulk removal, up to the whole buffer and more */
+	unsigned cnt = trace_rand(ctx) % (ctx->max_count + 10);
+	char next_type = PJMEDIA_JB_ZERO_EMPTY_FRAME;
+	pj_uint32_t next_ts = 0, ts;
+	unsigned removed, i;
+
+	if (cnt < state.size) {
+	    rc = trace_peek(ctx, cnt, &next_type, &next_ts);
+	    if (rc != 0)
+		return rc;
+	}
+
+	removed = pjmedia_jbuf_remove_frame(ctx->jb, cnt);
+	trace_hash(ctx, removed);
+	if (removed != PJ_MIN(cnt, state.size))
+	    return -40;
+
+	pjmedia_jbuf_get_state(ctx->jb, &state);
+	i = state.size;
+	if (i != 0 && next_type == PJMEDIA_JB_ZERO_EMPTY_FRAME)
+	    return -41;
+	if (i != 0) {
+	    rc = trace_peek(ctx, 0, &type, &ts);
+	    if (rc == 0 && (type != next_type || ts != next_ts))
+		rc = -42;
+	}
+
+    } else if (r < 996) {
+	/* Drain */
+	unsigned size = state.size, discard = state.discard, cnt = 0;
+
+	for (;;) {
+	    rc = trace_get(ctx, &type);
+	    if (rc != 0 || type == PJMEDIA_JB_ZERO_EMPTY_FRAME)
+		break;
+	    if (++cnt > ctx->max_count)
+		return -50;
+	}
+	pjmedia_jbuf_get_state(ctx->jb, &state);
+	if (rc == 0 && cnt + (state.discard - discard) != size)
+	    rc = -51;
+
+    } else {
+	pjmedia_jbuf_reset(ctx->jb);
+    }
+
+    if (rc == 0) {
+	pjmedia_jbuf_get_state(ctx->jb, &state);
+	trace_hash(ctx, state.size);
+	trace_hash(ctx, state.burst);
+	trace_hash(ctx, state.lost);
+	trace_hash(ctx, state.discard);
+	trace_hash(ctx, state.empty);
+    }
+
+    return rc;
+}
+
+int jbuf_trace_test(void)
+{
+    static const pjmedia_jb_discard_algo algos[] = {
+	PJMEDIA_JB_DISCARD_NONE,
+	PJMEDIA_JB_DISCARD_STATIC,
+	PJMEDIA_JB_DISCARD_PROGRESSIVE
+    };
+    /* Rounded up to a power of two, exactly one, and large */
+    static const unsigned max_counts[] = { 50, 64, 200, 1000 };
+    pj_str_t jb_name = {"JBTRACE", 7};
+    trace_ctx ctx;
+    unsigned i, j, op;
+    int old_log_level;
+    int rc = 0;
+
+    PJ_LOG(3,(THIS_FILE, "  jitter buffer trace test"));
+
+    old_log_level = pj_log_get_level();
+    pj_log_set_level(3);
+
+    pj_bzero(&ctx, sizeof(ctx));
+    ctx.hash = 2166136261U;
+
+    for (i = 0; rc == 0 && i < PJ_ARRAY_SIZE(algos); ++i) {
+	for (j = 0; rc == 0 && j < PJ_ARRAY_SIZE(max_counts); ++j) {
+	    pj_pool_t *pool;
+	    pj_bool_t put_burst = PJ_FALSE;
+
+	    pool = pj_pool_create(mem, "jbtrace", 4000, 4000, NULL);
+	    ctx.max_count = max_counts[j];
+	    ctx.rand = 1 + i * 16 + j;
+	    ctx.seq = 1;
+	    pjmedia_jbuf_create(pool, &jb_name, TRACE_FRAME_SIZE, JB_PTIME,
+				ctx.max_count, &ctx.jb);
+	    /* No prefetching, so a get never waits with frames in the
+	     * buffer.
+	     */
+	    pjmedia_jbuf_set_adaptive(ctx.jb, 0, 0, 0);
+	    pjmedia_jbuf_set_discard(ctx.jb, algos[i]);
+	    pjmedia_jbuf_reset(ctx.jb);
+
+	    for (op = 0; rc == 0 && op < TRACE_OPS; ++op) {
+		if (trace_rand(&ctx) % 100 == 0)
+		    put_burst = !put_burst;
+		rc = trace_op(&ctx, put_burst);
+	    }
+	    if (rc != 0) {
+		PJ_LOG(3,(THIS_FILE, "    algo %d, max count %u: error %d "
+			  "at op %u", algos[i], ctx.max_count, rc, op - 1));
+	    }
+
+	    pjmedia_jbuf_destroy(ctx.jb);
+	    pj_pool_release(pool);
+	}
+    }
+
+    if (rc == 0 && ctx.hash != TRACE_HASH) {
+	PJ_LOG(3,(THIS_FILE, "    trace hash is 0x%08x, expecting 0x%08x",
+		  ctx.hash, TRACE_HASH));
+	rc = -60;
+    }
+
+    pj_log_set_level(old_log_level);
+
+    return rc;
+}
@@ -0,0 +1,291 @@
+/* $Id$ */
+/*
+ * Copyright (C) 2008-2011 Teluu Inc. (http://www.teluu.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include "test.h"
+
+/*
+ * Video frame index test.
+ *
+ * Packets of video frames are put in order, reordered, lost and with a
+ * lost first packet, and the oldest frame reported by the index is checked
+ * after each step. Then the index is compared with the peek_frame() rescan
+ * done by the video stream before, on a stream with large keyframes.
+ */
+
+#define THIS_FILE	"jbuf_vid_test.c"
+#define PKT_SIZE	100
+#define MAX_COUNT	256
+#define TS_STEP		3000
+
+#define KEY_PKTS	60
+#define P_PKTS		4
+#define GOP_LEN		30
+#define GOP_CNT		10
+
+static pj_uint8_t pkt_buf[PKT_SIZE];
+
+static void put_pkt(pjmedia_jbuf *jb, int seq, unsigned frm, unsigned flags)
+{
+    pkt_buf[0] = (pj_uint8_t) seq;
+    pjmedia_jbuf_put_frame4(jb, pkt_buf, PKT_SIZE, 0, seq, frm * TS_STEP,
+			    flags, NULL);
+}
+
+/* Check the oldest frame, then take it out with its packets */
+static int pop_frame(pjmedia_jbuf *jb, unsigned frm, int first_seq,
+		     int last_seq, unsigned pkt_cnt, unsigned lost,
+		     pj_bool_t complete, pj_bool_t keyframe)
+{
+    pjmedia_jb_vid_frame vf;
+    unsigned i, missing = 0;
+
+    if (pjmedia_jbuf_peek_vid_frame(jb, &vf) != PJ_SUCCESS)
+	return -1;
+    if (vf.ts != frm * TS_STEP || vf.first_seq != first_seq ||
+	vf.last_seq != last_seq || vf.pkt_cnt != pkt_cnt ||
+	vf.complete != complete || vf.keyframe != keyframe)
+    {
+	PJ_LOG(3,(THIS_FILE, "    frame %u: ts=%u seq=%d-%d cnt=%u "
+			     "complete=%d keyframe=%d", frm, vf.ts,
+		  vf.first_seq, vf.last_seq, vf.pkt_cnt, vf.complete,
+		  vf.keyframe));
+	return -2;
+    }
+
+    for (i = 0; i < vf.pkt_cnt; ++i) {
+	const void *p;
+	char type;
+	int seq;
+
+	pjmedia_jbuf_peek_frame(jb, i, &p, NULL, &type, NULL, NULL, &seq);
+	if (type != PJMEDIA_JB_NORMAL_FRAME)
+	    ++missing;
+	else if (*(const pj_uint8_t*)p != (pj_uint8_t)seq)
+	    return -3;
+    }
+    if (missing != lost)
+	return -4;
+
+    if (pjmedia_jbuf_remove_frame(jb, vf.pkt_cnt) != vf.pkt_cnt)
+	return -5;
+    return 0;
+}
+
+static pj_bool_t has_frame(pjmedia_jbuf *jb)
+{
+    pjmedia_jb_vid_frame vf;
+    return pjmedia_jbuf_peek_vid_frame(jb, &vf) == PJ_SUCCESS;
+}
+
+static int index_test(pjmedia_jbuf *jb)
+{
+    const unsigned M = PJMEDIA_JB_VID_MARKER, K = PJMEDIA_JB_VID_KEYFRAME;
+    int rc;
+
+    /* The first frame is not known to be complete until the next one */
+    put_pkt(jb, 100, 0, K);
+    put_pkt(jb, 101, 0, K);
+    put_pkt(jb, 102, 0, K);
+    put_pkt(jb, 103, 0, K | M);
+    if (has_frame(jb))
+	return -10;
+    put_pkt(jb, 104, 1, 0);
+    rc = pop_frame(jb, 0, 100, 103, 4, 0, PJ_FALSE, PJ_TRUE);
+    if (rc != 0)
+	return rc - 10;
+
+    /* Reordered, complete when the last hole is filled */
+    put_pkt(jb, 106, 1, M);
+    if (has_frame(jb))
+	return -20;
+    put_pkt(jb, 105, 1, 0);
+    rc = pop_frame(jb, 1, 104, 106, 3, 0, PJ_TRUE, PJ_FALSE);
+    if (rc != 0)
+	return rc - 20;
+
+    /* Lost packet, ready when the next frame starts */
+    put_pkt(jb, 107, 2, 0);
+    put_pkt(jb, 108, 2, 0);
+    put_pkt(jb, 110, 2, M);
+    if (has_frame(jb))
+	return -30;
+    put_pkt(jb, 111, 3, 0);
+    rc = pop_frame(jb, 2, 107, 110, 4, 1, PJ_FALSE, PJ_FALSE);
+    if (rc != 0)
+	return rc - 30;
+
+    /* Complete after a frame with a lost packet */
+    put_pkt(jb, 112, 3, M);
+    rc = pop_frame(jb, 3, 111, 112, 2, 0, PJ_TRUE, PJ_FALSE);
+    if (rc != 0)
+	return rc - 40;
+
+    /* Lost first packet. The buffer is empty, so the hole doesn't take a
+     * slot, but the frame is not complete.
+     */
+    put_pkt(jb, 114, 4, K);
+    put_pkt(jb, 115, 4, M);
+    if (has_frame(jb))
+	return -50;
+    put_pkt(jb, 116, 5, M);
+    rc = pop_frame(jb, 4, 114, 115, 2, 0, PJ_FALSE, PJ_TRUE);
+    if (rc == 0)
+	rc = pop_frame(jb, 5, 116, 116, 1, 0, PJ_TRUE, PJ_FALSE);
+    if (rc != 0)
+	return rc - 50;
+    if (has_frame(jb))
+	return -56;
+
+    /* After a reset, the previous frame is unknown again */
+    pjmedia_jbuf_reset(jb);
+    put_pkt(jb, 117, 6, M);
+    if (has_frame(jb))
+	return -60;
+    put_pkt(jb, 118, 7, M);
+    rc = pop_frame(jb, 6, 117, 117, 1, 0, PJ_FALSE, PJ_FALSE);
+    if (rc == 0)
+	rc = pop_frame(jb, 7, 118, 118, 1, 0, PJ_TRUE, PJ_FALSE);
+    if (rc != 0)
+	return rc - 60;
+
+    return 0;
+}
+
+/* What the video stream did before: peek until the timestamp changes */
+static unsigned rescan_frame(pjmedia_jbuf *jb)
+{
+    pj_uint32_t last_ts = 0;
+    unsigned cnt;
+
+    for (cnt = 0; ; ++cnt) {
+	char ptype;
+	pj_uint32_t ts;
+	int seq;
+
+	pjmedia_jbuf_peek_frame(jb, cnt, NULL, NULL, &ptype, NULL, &ts, &seq);
+	if (ptype == PJMEDIA_JB_NORMAL_FRAME) {
+	    if (last_ts == 0)
+		last_ts = ts;
+	    if (ts != last_ts)
+		return cnt;
+	} else if (ptype == PJMEDIA_JB_ZERO_EMPTY_FRAME) {
+	    return 0;
+	}
+    }
+}
+
+static unsigned index_frame(pjmedia_jbuf *jb)
+{
+    pjmedia_jb_vid_frame vf;
+
+    if (pjmedia_jbuf_peek_vid_frame(jb, &vf) != PJ_SUCCESS)
+	return 0;
+    return vf.pkt_cnt;
+}
+
+/* Try to take a frame before each packet is put, like on_rx_rtp() */
+static int run_stream(pjmedia_jbuf *jb, unsigned (*get_frame)(pjmedia_jbuf*),
+		      unsigned *frm_cnt, pj_uint32_t *usec)
+{
+    pj_timestamp t0, t1;
+    unsigned g, f, i;
+    int seq = 1;
+
+    *frm_cnt = 0;
+    pj_get_timestamp(&t0);
+    for (g = 0; g < GOP_CNT; ++g) {
+	for (f = 0; f < GOP_LEN; ++f) {
+	    unsigned n = f ? P_PKTS : KEY_PKTS;
+
+	    for (i = 0; i < n; ++i) {
+		unsigned cnt = (*get_frame)(jb);
+
+		if (cnt) {
+		    if (pjmedia_jbuf_remove_frame(jb, cnt) != cnt)
+			return -70;
+		    ++*frm_cnt;
+		}
+		put_pkt(jb, seq++, 1 + g * GOP_LEN + f,
+			(i == n - 1) ? PJMEDIA_JB_VID_MARKER : 0);
+	    }
+	}
+    }
+    pj_get_timestamp(&t1);
+    *usec = pj_elapsed_usec(&t0, &t1);
+    return 0;
+}
+
+static int bench(pjmedia_jbuf *jb)
+{
+    unsigned frm_cnt[2];
+    pj_uint32_t usec[2];
+    int rc;
+
+    pjmedia_jbuf_reset(jb);
+    rc = run_stream(jb, &rescan_frame, &frm_cnt[0], &usec[0]);
+    if (rc != 0)
+	return rc;
+
+    pjmedia_jbuf_reset(jb);
+    rc = run_stream(jb, &index_frame, &frm_cnt[1], &usec[1]);
+    if (rc != 0)
+	return rc;
+
+    /* Both take all frames but the last one, which is taken only when
+     * the next packet arrives.
+     */
+    if (frm_cnt[0] != GOP_CNT * GOP_LEN - 1 || frm_cnt[1] != frm_cnt[0]) {
+	PJ_LOG(3,(THIS_FILE, "    %u/%u frames", frm_cnt[0], frm_cnt[1]));
+	return -80;
+    }
+
+    PJ_LOG(3,(THIS_FILE, "    %u frames, %u packets per keyframe: "
+			 "rescan %u usec, index %u usec",
+	      frm_cnt[0], KEY_PKTS, usec[0], usec[1]));
+    return 0;
+}
+
+int jbuf_vid_test(void)
+{
+    pj_pool_t *pool;
+    pjmedia_jbuf *jb;
+    pj_str_t name = pj_str("vidjb");
+    pj_status_t status;
+    int rc;
+
+    PJ_LOG(3,(THIS_FILE, "  video jitter buffer frame index test"));
+
+    pool = pj_pool_create(mem, "jbvid", 4000, 4000, NULL);
+    status = pjmedia_jbuf_create(pool, &name, PKT_SIZE, 33, MAX_COUNT, &jb);
+    if (status != PJ_SUCCESS) {
+	pj_pool_release(pool);
+	return -1;
+    }
+    pjmedia_jbuf_set_discard(jb, PJMEDIA_JB_DISCARD_NONE);
+    pjmedia_jbuf_enable_vid_index(jb, pool);
+
+    rc = index_test(jb);
+    if (rc == 0)
+	rc = bench(jb);
+    if (rc != 0)
+	PJ_LOG(3,(THIS_FILE, "    error %d", rc));
+
+    pjmedia_jbuf_destroy(jb);
+    pj_pool_release(pool);
+    return rc;
+}
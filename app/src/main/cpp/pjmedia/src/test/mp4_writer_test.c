@@ -0,0 +1,298 @@
+/* $Id$ */
+/*
+ * Copyright (C) 2008-2011 Teluu Inc. (http://www.teluu.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include "test.h"
+
+/*
+ * Fragmented MP4 writer test.
+ *
+ * Three seconds of synthetic H.264 access units (15 fps, a key frame with
+ * SPS and PPS every second) and AAC frames (16 kHz, with ADTS header) are
+ * recorded, then the file is parsed back: it must be ftyp and moov
+ * followed by moof/mdat pairs, the box sizes must add up to the file
+ * size, every fragment must start with a video key frame, and the sample
+ * sizes of each moof must add up to the size of its mdat.
+ */
+
+#if defined(PJMEDIA_HAS_MP4_WRITER) && PJMEDIA_HAS_MP4_WRITER != 0
+
+#define THIS_FILE	"mp4_writer_test.c"
+#define FILENAME	"mp4_writer_test.mp4"
+#define SECONDS		3
+#define FPS		15
+#define AUD_RATE	16000
+#define AUD_SPF		1024
+
+static pj_uint32_t rd32(const pj_uint8_t *p)
+{
+    return ((pj_uint32_t)p[0] << 24) | ((pj_uint32_t)p[1] << 16) |
+	   ((pj_uint32_t)p[2] << 8) | p[3];
+}
+
+/* Find a child box in [p, end) */
+static const pj_uint8_t *find_box(const pj_uint8_t *p, const pj_uint8_t *end,
+				  const char *tag)
+{
+    while (p + 8 <= end) {
+	pj_uint32_t size = rd32(p);
+	if (size < 8 || p + size > end)
+	    return NULL;
+	if (pj_memcmp(p + 4, tag, 4) == 0)
+	    return p;
+	p += size;
+    }
+    return NULL;
+}
+
+static unsigned make_video_au(pj_uint8_t *buf, pj_bool_t key, unsigned n)
+{
+    static const pj_uint8_t sps[] = { 0, 0, 0, 1, 0x67, 0x42, 0xC0, 0x1E,
+				      0xDA, 0x02, 0x80, 0xBF, 0xE5 };
+    static const pj_uint8_t pps[] = { 0, 0, 0, 1, 0x68, 0xCE, 0x3C, 0x80 };
+    unsigned len = 0, i, slice_len = key? 3000 : 400 + (n % 7) * 50;
+
+    if (key) {
+	pj_memcpy(buf, sps, sizeof(sps));
+	len += sizeof(sps);
+	pj_memcpy(buf + len, pps, sizeof(pps));
+	len += sizeof(pps);
+    }
+
+    buf[len++] = 0; buf[len++] = 0; buf[len++] = 1;
+    buf[len++] = key? 0x65 : 0x41;
+    for (i = 0; i < slice_len; ++i)
+	buf[len++] = (pj_uint8_t)(0x80 | (i + n));
+
+    return len;
+}
+
+static unsigned make_aac_frame(pj_uint8_t *buf, unsigned n)
+{
+    unsigned len = 7 + 60 + (n % 5), i;
+
+    /* ADTS: AAC LC, 16 kHz (index 8), mono, no CRC */
+    buf[0] = 0xFF;
+    buf[1] = 0xF1;
+    buf[2] = (1 << 6) | (8 << 2);
+    buf[3] = (pj_uint8_t)((1 << 6) | (len >> 11));
+    buf[4] = (pj_uint8_t)(len >> 3);
+    buf[5] = (pj_uint8_t)((len << 5) | 0x1F);
+    buf[6] = 0xFC;
+    for (i = 7; i < len; ++i)
+	buf[i] = (pj_uint8_t)(i + n);
+
+    return len;
+}
+
+/* Check one moof: key frame first, and the sample sizes add up to mdat */
+static int check_moof(const pj_uint8_t *moof, pj_uint32_t mdat_payload)
+{
+    const pj_uint8_t *end = moof + rd32(moof);
+    const pj_uint8_t *traf = find_box(moof + 8, end, "traf");
+    pj_uint32_t total = 0;
+    unsigned cnt = 0;
+
+    for (; traf; traf = find_box(traf + rd32(traf), end, "traf")) {
+	const pj_uint8_t *trun = find_box(traf + 8, traf + rd32(traf), "trun");
+	const pj_uint8_t *tfhd = find_box(traf + 8, traf + rd32(traf), "tfhd");
+	pj_uint32_t flags, smp_cnt, i, entry;
+
+	if (!trun || !tfhd || !find_box(traf + 8, traf + rd32(traf), "tfdt"))
+	    return -10;
+
+	flags = rd32(trun + 8) & 0xFFFFFF;
+	smp_cnt = rd32(trun + 12);
+	entry = (flags & 0x400)? 12 : 8;
+
+	/* Video track is track 1 */
+	if (rd32(tfhd + 12) == 1) {
+	    if ((flags & 0x400) == 0 || rd32(trun + 20 + 8) != 0x02000000)
+		return -11;
+	}
+
+	for (i = 0; i < smp_cnt; ++i)
+	    total += rd32(trun + 20 + i * entry + 4);
+	++cnt;
+    }
+
+    if (cnt == 0)
+	return -12;
+    if (total != mdat_payload)
+	return -13;
+    return 0;
+}
+
+int mp4_writer_test(void)
+{
+    pj_pool_t *pool;
+    pjmedia_mp4_writer_param param;
+    pjmedia_mp4_writer *writer = NULL;
+    pjmedia_port *vport, *aport;
+    pj_uint8_t *buf;
+    pj_oshandle_t fd;
+    pj_ssize_t size;
+    pj_off_t file_size;
+    const pj_uint8_t *p, *end;
+    unsigned i, frags = 0;
+    pj_uint32_t vts = 0, ats = 0;
+    pj_timestamp t0, t1;
+    pj_status_t status;
+    int rc = 0;
+
+    PJ_LOG(3,(THIS_FILE, "  MP4 writer test"));
+
+    pool = pj_pool_create(mem, "mp4test", 4000, 4000, NULL);
+
+    pjmedia_mp4_writer_param_default(&param);
+    param.size.w = 640;
+    param.size.h = 480;
+    param.fps.num = FPS;
+    param.clock_rate = AUD_RATE;
+    param.samples_per_frame = AUD_SPF;
+
+    status = pjmedia_mp4_writer_create(pool, FILENAME, &param, &writer);
+    if (status != PJ_SUCCESS) {
+	app_perror(status, "Error creating MP4 writer");
+	rc = -1;
+	goto on_return;
+    }
+
+    vport = pjmedia_mp4_writer_get_port(writer, PJMEDIA_TYPE_VIDEO);
+    aport = pjmedia_mp4_writer_get_port(writer, PJMEDIA_TYPE_AUDIO);
+    if (!vport || !aport) {
+	rc = -2;
+	goto on_return;
+    }
+
+    buf = (pj_uint8_t*) pj_pool_alloc(pool, 8000);
+
+    /* Interleave the frames in time order, 1 ms steps */
+    pj_get_timestamp(&t0);
+    for (i = 0; i < SECONDS * 1000; ++i) {
+	pjmedia_frame frame;
+
+	pj_bzero(&frame, sizeof(frame));
+	frame.buf = buf;
+
+	if (i * FPS % 1000 < FPS) {
+	    unsigned n = i * FPS / 1000;
+	    frame.type = PJMEDIA_FRAME_TYPE_VIDEO;
+	    frame.size = make_video_au(buf, n % FPS == 0, n);
+	    frame.timestamp.u64 = vts;
+	    vts += 90000 / FPS;
+	    if (pjmedia_port_put_frame(vport, &frame) != PJ_SUCCESS) {
+		rc = -3;
+		goto on_return;
+	    }
+	}
+	if ((pj_uint64_t)i * AUD_RATE / 1000 >= ats + AUD_SPF) {
+	    frame.type = PJMEDIA_FRAME_TYPE_AUDIO;
+	    frame.size = make_aac_frame(buf, ats / AUD_SPF);
+	    frame.timestamp.u64 = ats;
+	    ats += AUD_SPF;
+	    if (pjmedia_port_put_frame(aport, &frame) != PJ_SUCCESS) {
+		rc = -4;
+		goto on_return;
+	    }
+	}
+    }
+    pj_get_timestamp(&t1);
+
+    pjmedia_mp4_writer_destroy(writer);
+    writer = NULL;
+
+    PJ_LOG(3,(THIS_FILE, "    %d sec recorded in %u usec",
+	      SECONDS, pj_elapsed_usec(&t0, &t1)));
+
+    /* Read it back */
+    file_size = pj_file_size(FILENAME);
+    buf = (pj_uint8_t*) pj_pool_alloc(pool, (pj_size_t)file_size);
+    status = pj_file_open(pool, FILENAME, PJ_O_RDONLY, &fd);
+    if (status != PJ_SUCCESS) {
+	rc = -5;
+	goto on_return;
+    }
+    size = (pj_ssize_t)file_size;
+    pj_file_read(fd, buf, &size);
+    pj_file_close(fd);
+    if (size != file_size) {
+	rc = -6;
+	goto on_return;
+    }
+
+    p = buf;
+    end = buf + size;
+    if (find_box(p, end, "ftyp") != p) {
+	rc = -7;
+	goto on_return;
+    }
+    p += rd32(p);
+    if (find_box(p, end, "moov") != p ||
+	!find_box(p + 8, p + rd32(p), "mvex"))
+    {
+	rc = -8;
+	goto on_return;
+    }
+    p += rd32(p);
+
+    while (p < end) {
+	const pj_uint8_t *moof = p, *mdat;
+
+	if (find_box(p, end, "moof") != p) {
+	    rc = -20;
+	    goto on_return;
+	}
+	mdat = moof + rd32(moof);
+	if (find_box(mdat, end, "mdat") != mdat) {
+	    rc = -21;
+	    goto on_return;
+	}
+	rc = check_moof(moof, rd32(mdat) - 8);
+	if (rc != 0)
+	    goto on_return;
+
+	p = mdat + rd32(mdat);
+	++frags;
+    }
+
+    if (p != end || frags < SECONDS - 1) {
+	rc = -22;
+	goto on_return;
+    }
+
+    PJ_LOG(3,(THIS_FILE, "    %u fragments, %u bytes", frags,
+	      (unsigned)file_size));
+
+on_return:
+    if (writer)
+	pjmedia_mp4_writer_destroy(writer);
+    if (rc != 0)
+	PJ_LOG(3,(THIS_FILE, "    error %d", rc));
+    pj_file_delete(FILENAME);
+    pj_pool_release(pool);
+    return rc;
+}
+
+#else
+
+int mp4_writer_test(void)
+{
+    return 0;
+}
+
+#endif	/* PJMEDIA_HAS_MP4_WRITER */
@@ -0,0 +1,259 @@
+/* $Id$ */
+/*
+ * Copyright (C) 2008-2011 Teluu Inc. (http://www.teluu.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include "test.h"
+#include <pjmedia-codec/opus.h>
+
+/*
+ * Opus codec test.
+ *
+ * Single owner codecs are encoded and decoded with the batch API, one of
+ * them with two frames in a packet, and the result is compared with the
+ * normal codec API on codecs with a mutex.
+ */
+
+#if defined(PJMEDIA_HAS_OPUS_CODEC) && (PJMEDIA_HAS_OPUS_CODEC != 0)
+
+#define THIS_FILE	"opus_test.c"
+#define CLOCK_RATE	16000
+#define PTIME		20
+#define SPF		(CLOCK_RATE * PTIME / 1000)
+#define CODEC_CNT	3
+#define PKT_CNT		10
+#define MAX_PKT_SIZE	1000
+
+static pj_int16_t pcm[CODEC_CNT][SPF * 2];
+static pj_int16_t dec_pcm[CODEC_CNT][SPF * 2];
+static pj_uint8_t pkt[CODEC_CNT][MAX_PKT_SIZE];
+static pj_uint8_t ref_pkt[MAX_PKT_SIZE];
+
+/* Number of frames in a packet of each codec */
+static const unsigned frm_per_pkt[CODEC_CNT] = { 1, 2, 1 };
+
+static void gen_pcm(unsigned pkt_idx)
+{
+    unsigned c, i;
+
+    for (c = 0; c < CODEC_CNT; ++c) {
+	for (i = 0; i < SPF * frm_per_pkt[c]; ++i) {
+	    unsigned t = pkt_idx * SPF * 2 + i;
+	    pcm[c][i] = (pj_int16_t)(((t * (c + 3)) % 64) * 256 - 8192);
+	}
+    }
+}
+
+static int open_codecs(pjmedia_codec_mgr *mgr, const pjmedia_codec_info *ci,
+		       pj_bool_t single_owner, pjmedia_codec *codec[])
+{
+    pjmedia_codec_opus_config cfg;
+    pjmedia_codec_param param;
+    unsigned c;
+    pj_status_t status;
+
+    pjmedia_codec_mgr_get_default_param(mgr, ci, &param);
+    pjmedia_codec_opus_get_config(&cfg);
+    cfg.sample_rate = CLOCK_RATE;
+    cfg.frm_ptime = PTIME;
+    cfg.single_owner = single_owner;
+    status = pjmedia_codec_opus_set_default_param(&cfg, &param);
+    if (status == PJ_SUCCESS)
+	status = pjmedia_codec_mgr_get_default_param(mgr, ci, &param);
+    if (status != PJ_SUCCESS)
+	return -10;
+
+    for (c = 0; c < CODEC_CNT; ++c) {
+	status = pjmedia_codec_mgr_alloc_codec(mgr, ci, &codec[c]);
+	if (status != PJ_SUCCESS)
+	    return -11;
+
+	param.setting.frm_per_pkt = (pj_uint8_t) frm_per_pkt[c];
+	status = pjmedia_codec_init(codec[c], NULL);
+	if (status == PJ_SUCCESS)
+	    status = pjmedia_codec_open(codec[c], &param);
+	if (status != PJ_SUCCESS)
+	    return -12;
+    }
+    return 0;
+}
+
+static void close_codecs(pjmedia_codec_mgr *mgr, pjmedia_codec *codec[])
+{
+    unsigned c;
+
+    for (c = 0; c < CODEC_CNT; ++c) {
+	if (codec[c]) {
+	    pjmedia_codec_close(codec[c]);
+	    pjmedia_codec_mgr_dealloc_codec(mgr, codec[c]);
+	    codec[c] = NULL;
+	}
+    }
+}
+
+static int run(pjmedia_codec *codec[], pjmedia_codec *ref[])
+{
+    pjmedia_frame in[CODEC_CNT], out[CODEC_CNT];
+    pjmedia_frame frames[CODEC_CNT][4];
+    unsigned frame_cnt[CODEC_CNT];
+    unsigned n, c, f;
+    pj_status_t status;
+
+    for (n = 0; n < PKT_CNT; ++n) {
+	gen_pcm(n);
+
+	/* Encode */
+	for (c = 0; c < CODEC_CNT; ++c) {
+	    pj_bzero(&in[c], sizeof(in[c]));
+	    in[c].type = PJMEDIA_FRAME_TYPE_AUDIO;
+	    in[c].buf = pcm[c];
+	    in[c].size = SPF * frm_per_pkt[c] * sizeof(pj_int16_t);
+	    in[c].timestamp.u64 = n * SPF * frm_per_pkt[c];
+	    pj_bzero(&out[c], sizeof(out[c]));
+	    out[c].buf = pkt[c];
+	}
+	status = pjmedia_codec_opus_encode_batch(codec, CODEC_CNT, in,
+						 MAX_PKT_SIZE, out);
+	if (status != PJ_SUCCESS)
+	    return -20;
+
+	for (c = 0; c < CODEC_CNT; ++c) {
+	    pjmedia_frame ref_out;
+
+	    if (out[c].type != PJMEDIA_FRAME_TYPE_AUDIO || out[c].size < 2)
+		return -21;
+
+	    /* Same packet as the codec with a mutex */
+	    pj_bzero(&ref_out, sizeof(ref_out));
+	    ref_out.buf = ref_pkt;
+	    status = pjmedia_codec_encode(ref[c], &in[c], MAX_PKT_SIZE,
+					  &ref_out);
+	    if (status != PJ_SUCCESS || ref_out.size != out[c].size ||
+		pj_memcmp(ref_pkt, pkt[c], out[c].size) != 0)
+	    {
+		PJ_LOG(3,(THIS_FILE, "    codec %d packet %d differs", c, n));
+		return -22;
+	    }
+
+	    /* Parse */
+	    status = pjmedia_codec_parse(codec[c], pkt[c], out[c].size,
+					 &in[c].timestamp, &frame_cnt[c],
+					 frames[c]);
+	    if (status != PJ_SUCCESS || frame_cnt[c] != frm_per_pkt[c])
+		return -23;
+	    for (f = 0; f < frame_cnt[c]; ++f) {
+		if ((frames[c][f].bit_info & 0xFFFF) != SPF ||
+		    frames[c][f].timestamp.u64 != in[c].timestamp.u64 + f*SPF)
+		{
+		    return -24;
+		}
+	    }
+	}
+
+	/* Decode each frame of the packets, losing one frame of the
+	 * last codec.
+	 */
+	for (f = 0; f < 2; ++f) {
+	    unsigned cnt = 0;
+	    pjmedia_codec *dec_codec[CODEC_CNT];
+	    pjmedia_frame dec_in[CODEC_CNT];
+
+	    for (c = 0; c < CODEC_CNT; ++c) {
+		if (f >= frame_cnt[c])
+		    continue;
+		dec_codec[cnt] = codec[c];
+		dec_in[cnt] = frames[c][f];
+		if (c == CODEC_CNT - 1 && n == PKT_CNT / 2)
+		    dec_in[cnt].type = PJMEDIA_FRAME_TYPE_NONE;
+		pj_bzero(&out[cnt], sizeof(out[cnt]));
+		out[cnt].buf = dec_pcm[cnt];
+		++cnt;
+	    }
+	    status = pjmedia_codec_opus_decode_batch(dec_codec, cnt, dec_in,
+						     SPF * sizeof(pj_int16_t),
+						     out);
+	    if (status != PJ_SUCCESS)
+		return -30;
+
+	    /* The decoder holds back the first frame for FEC */
+	    for (c = 0; c < cnt; ++c) {
+		pj_size_t expected = (n == 0 && f == 0) ? 0 :
+				     SPF * sizeof(pj_int16_t);
+		if (out[c].size != expected)
+		    return -31;
+	    }
+	}
+    }
+
+    return 0;
+}
+
+int opus_test(void)
+{
+    pjmedia_endpt *endpt = NULL;
+    pjmedia_codec_mgr *mgr;
+    const pj_str_t codec_id = { "opus", 4 };
+    const pjmedia_codec_info *ci[1] = { NULL };
+    pjmedia_codec_opus_config cfg;
+    pjmedia_codec *codec[CODEC_CNT], *ref[CODEC_CNT];
+    unsigned count = 1;
+    pj_status_t status;
+    int rc = 0;
+
+    PJ_LOG(3,(THIS_FILE, "  opus codec test"));
+
+    pj_bzero(codec, sizeof(codec));
+    pj_bzero(ref, sizeof(ref));
+    pjmedia_codec_opus_get_config(&cfg);
+
+    status = pjmedia_endpt_create(mem, NULL, 0, &endpt);
+    if (status != PJ_SUCCESS)
+	return -1;
+
+    mgr = pjmedia_endpt_get_codec_mgr(endpt);
+    status = pjmedia_codec_opus_init(endpt);
+    if (status == PJ_SUCCESS)
+	status = pjmedia_codec_mgr_find_codecs_by_id(mgr, &codec_id, &count,
+						     ci, NULL);
+    if (status != PJ_SUCCESS) {
+	rc = -2;
+	goto on_return;
+    }
+
+    rc = open_codecs(mgr, ci[0], PJ_FALSE, ref);
+    if (rc == 0)
+	rc = open_codecs(mgr, ci[0], PJ_TRUE, codec);
+    if (rc == 0)
+	rc = run(codec, ref);
+
+on_return:
+    if (rc != 0)
+	PJ_LOG(3,(THIS_FILE, "    error %d", rc));
+    close_codecs(mgr, codec);
+    close_codecs(mgr, ref);
+    if (ci[0]) {
+	pjmedia_codec_param param;
+
+	/* Restore the default configuration */
+	pjmedia_codec_mgr_get_default_param(mgr, ci[0], &param);
+	pjmedia_codec_opus_set_default_param(&cfg, &param);
+    }
+    pjmedia_codec_opus_deinit();
+    pjmedia_endpt_destroy(endpt);
+    return rc;
+}
+
+#endif /* PJMEDIA_HAS_OPUS_CODEC */
@@ -0,0 +1,236 @@
+/* $Id$ */
+/*
+ * Copyright (C) 2008-2011 Teluu Inc. (http://www.teluu.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include "test.h"
+#include <math.h>
+
+/*
+ * Resampler test.
+ *
+ * A sine wave is resampled in 10ms frames by the configured backend and
+ * the output is compared with the ideal sine at the output rate, fitted
+ * with least squares since each backend has its own delay. Then a tone
+ * above the output Nyquist frequency is downsampled and must be filtered
+ * out, and the throughput of the conference bridge conversions is
+ * reported.
+ */
+
+#define THIS_FILE	"resample_test.c"
+#define MAX_FRM		(48000 / 100 * 2)
+#define FRM_CNT		50
+#define SKIP_FRM	5
+#define AMPLITUDE	10000.0
+#define MIN_SNR		40
+#define MAX_ALIAS	-40
+#define BENCH_SEC	10
+
+#ifndef M_PI
+#   define M_PI		3.14159265358979323846
+#endif
+
+static pj_int16_t in_frm[MAX_FRM];
+static pj_int16_t out_frm[MAX_FRM * 6];
+
+/* Sums to fit out[i] = a*sin(w*i) + b*cos(w*i) */
+struct fit
+{
+    double ss, cc, sc, sy, cy, yy;
+};
+
+static void fit_add(struct fit *f, double w, unsigned i, double y)
+{
+    double s = sin(w * i), c = cos(w * i);
+
+    f->ss += s * s; f->cc += c * c; f->sc += s * c;
+    f->sy += s * y; f->cy += c * y; f->yy += y * y;
+}
+
+/* Signal to residual ratio, in dB */
+static double fit_snr(const struct fit *f)
+{
+    double det = f->ss * f->cc - f->sc * f->sc;
+    double a = (f->sy * f->cc - f->cy * f->sc) / det;
+    double b = (f->cy * f->ss - f->sy * f->sc) / det;
+    double sig = a * f->sy + b * f->cy;
+    double noise = f->yy - sig;
+
+    if (noise < 1e-9 * sig)
+	return 90;
+    return 10 * log10(sig / noise);
+}
+
+/*
+ * Resample a tone of freq[ch] Hz on each channel. Returns the SNR of the
+ * worst channel, or the output power relative to the input when alias is
+ * set, or a value below -1000 on error.
+ */
+static double run_tone(pj_pool_t *pool, unsigned rate_in, unsigned rate_out,
+		       unsigned ch_cnt, const unsigned freq[],
+		       pj_bool_t alias)
+{
+    pjmedia_resample *resample;
+    unsigned spf_in = rate_in / 100 * ch_cnt;
+    unsigned spf_out = rate_out / 100 * ch_cnt;
+    struct fit f[2];
+    double worst = 1000, power = 0;
+    unsigned n, i, ch, pos = 0, cnt = 0;
+
+    if (pjmedia_resample_create(pool, PJ_TRUE, PJ_TRUE, ch_cnt, rate_in,
+				rate_out, spf_in, &resample) != PJ_SUCCESS)
+    {
+	return -2000;
+    }
+    if (pjmedia_resample_get_input_size(resample) != spf_in)
+	return -2001;
+
+    pj_bzero(f, sizeof(f));
+    for (n = 0; n < FRM_CNT; ++n) {
+	for (i = 0; i < spf_in; ++i) {
+	    double w = 2 * M_PI * freq[i % ch_cnt] / rate_in;
+	    in_frm[i] = (pj_int16_t)(AMPLITUDE * sin(w * (i / ch_cnt + n *
+							   spf_in / ch_cnt)));
+	}
+	pjmedia_resample_run(resample, in_frm, out_frm);
+
+	if (n < SKIP_FRM) {
+	    pos += spf_out / ch_cnt;
+	    continue;
+	}
+	for (i = 0; i < spf_out; ++i) {
+	    double w = 2 * M_PI * freq[i % ch_cnt] / rate_out;
+	    fit_add(&f[i % ch_cnt], w, pos + i / ch_cnt, out_frm[i]);
+	    power += (double)out_frm[i] * out_frm[i];
+	}
+	pos += spf_out / ch_cnt;
+	cnt += spf_out;
+    }
+    pjmedia_resample_destroy(resample);
+
+    if (alias)
+	return 10 * log10(power / cnt / (AMPLITUDE * AMPLITUDE / 2) + 1e-12);
+
+    for (ch = 0; ch < ch_cnt; ++ch) {
+	double snr = fit_snr(&f[ch]);
+	if (snr < worst)
+	    worst = snr;
+    }
+    return worst;
+}
+
+static int accuracy_test(pj_pool_t *pool)
+{
+    static const struct {
+	unsigned rate_in, rate_out, ch_cnt, freq[2];
+    } tones[] = {
+	{  8000, 16000, 1, { 1000 } },
+	{ 16000,  8000, 1, { 1000 } },
+	{ 16000, 48000, 1, { 3000 } },
+	{ 48000, 16000, 1, { 3000 } },
+	{ 44100, 48000, 1, { 5000 } },
+	{ 32000, 16000, 2, { 1000, 2500 } },
+    };
+    unsigned i;
+
+    for (i = 0; i < PJ_ARRAY_SIZE(tones); ++i) {
+	double snr = run_tone(pool, tones[i].rate_in, tones[i].rate_out,
+			      tones[i].ch_cnt, tones[i].freq, PJ_FALSE);
+
+	PJ_LOG(3,(THIS_FILE, "    %u->%u ch=%u: SNR %d dB",
+		  tones[i].rate_in, tones[i].rate_out, tones[i].ch_cnt,
+		  (int)snr));
+	if (snr < MIN_SNR)
+	    return -10 - (int)i;
+    }
+    return 0;
+}
+
+static int alias_test(pj_pool_t *pool)
+{
+    /* 11 kHz would fold to 5 kHz at 16 kHz, 5.5 kHz to 2.5 kHz at 8 kHz */
+    static const unsigned f48[] = { 11000 }, f16[] = { 5500 };
+    double att;
+
+    att = run_tone(pool, 48000, 16000, 1, f48, PJ_TRUE);
+    PJ_LOG(3,(THIS_FILE, "    48000->16000 11 kHz tone: %d dB", (int)att));
+    if (att < -1000 || att > MAX_ALIAS)
+	return -20;
+
+    att = run_tone(pool, 16000, 8000, 1, f16, PJ_TRUE);
+    PJ_LOG(3,(THIS_FILE, "    16000->8000 5.5 kHz tone: %d dB", (int)att));
+    if (att < -1000 || att > MAX_ALIAS)
+	return -21;
+
+    return 0;
+}
+
+static int bench(pj_pool_t *pool, unsigned rate_in, unsigned rate_out)
+{
+    pjmedia_resample *resample;
+    unsigned spf_in = rate_in / 100, i;
+    unsigned frm_cnt = BENCH_SEC * 100;
+    pj_timestamp t0, t1;
+    pj_uint32_t usec;
+
+    if (pjmedia_resample_create(pool, PJ_TRUE, PJ_TRUE, 1, rate_in,
+				rate_out, spf_in, &resample) != PJ_SUCCESS)
+    {
+	return -30;
+    }
+
+    for (i = 0; i < spf_in; ++i)
+	in_frm[i] = (pj_int16_t)(pj_rand() % 20000 - 10000);
+
+    pj_get_timestamp(&t0);
+    for (i = 0; i < frm_cnt; ++i)
+	pjmedia_resample_run(resample, in_frm, out_frm);
+    pj_get_timestamp(&t1);
+    usec = pj_elapsed_usec(&t0, &t1);
+    if (usec == 0)
+	usec = 1;
+
+    PJ_LOG(3,(THIS_FILE, "    %u->%u: %u sec of audio in %u usec "
+			 "(%u x realtime)", rate_in, rate_out, BENCH_SEC,
+	      usec, (unsigned)((pj_uint64_t)BENCH_SEC * 1000000 / usec)));
+    pjmedia_resample_destroy(resample);
+    return 0;
+}
+
+int resample_test(void)
+{
+    pj_pool_t *pool;
+    int rc;
+
+    PJ_LOG(3,(THIS_FILE, "  resample test"));
+
+    pool = pj_pool_create(mem, "resample", 4000, 4000, NULL);
+
+    rc = accuracy_test(pool);
+    if (rc == 0)
+	rc = alias_test(pool);
+    if (rc == 0)
+	rc = bench(pool, 16000, 48000);
+    if (rc == 0)
+	rc = bench(pool, 48000, 16000);
+    if (rc == 0)
+	rc = bench(pool, 44100, 48000);
+    if (rc != 0)
+	PJ_LOG(3,(THIS_FILE, "    error %d", rc));
+
+    pj_pool_release(pool);
+    return rc;
+}
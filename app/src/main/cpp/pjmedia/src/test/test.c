@@ -88,6 +88,10 @@ int test_main(void)
     DO_TEST(vid_codec_test());
 #endif
 
+#if HAS_VID_TEE_TEST
+    DO_TEST(vid_tee_test());
+#endif
+
 #if HAS_SDP_NEG_TEST
     DO_TEST(sdp_neg_test());
 #endif
@@ -96,13 +100,41 @@ int test_main(void)
     //DO_TEST(session_test (&caching_pool.factory));
 #if HAS_JBUF_TEST
     DO_TEST(jbuf_main());
+    DO_TEST(jbuf_trace_test());
+#endif
+#if HAS_JBUF_REPLAY_TEST
+    DO_TEST(jbuf_replay_test());
+#endif
+#if HAS_JBUF_VID_TEST
+    DO_TEST(jbuf_vid_test());
 #endif
 #if HAS_MIPS_TEST
     DO_TEST(mips_test());
 #endif
+#if HAS_CONF_MIX_TEST
+    DO_TEST(conf_mix_test());
+#endif
+#if HAS_MP4_WRITER_TEST
+    DO_TEST(mp4_writer_test());
+#endif
 #if HAS_CODEC_VECTOR_TEST
     DO_TEST(codec_test_vectors());
 #endif
+#if HAS_CLOCK_TEST
+    DO_TEST(clock_test());
+#endif
+#if HAS_ECHO_TEST
+    DO_TEST(echo_test());
+#endif
+#if HAS_OPUS_TEST
+    DO_TEST(opus_test());
+#endif
+#if HAS_ANNEXB_TEST
+    DO_TEST(annexb_test());
+#endif
+#if HAS_RESAMPLE_TEST
+    DO_TEST(resample_test());
+#endif
 
     PJ_LOG(3,(THIS_FILE," "));
 
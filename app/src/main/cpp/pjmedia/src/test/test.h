@@ -28,19 +28,40 @@
 #define HAS_VID_CODEC_TEST	PJMEDIA_HAS_VIDEO
 #define HAS_SDP_NEG_TEST	1
 #define HAS_JBUF_TEST		1
+#define HAS_JBUF_REPLAY_TEST	1
+#define HAS_JBUF_VID_TEST	1
 #define HAS_MIPS_TEST		1
+#define HAS_CONF_MIX_TEST	1
+#define HAS_MP4_WRITER_TEST	PJMEDIA_HAS_MP4_WRITER
 #define HAS_CODEC_VECTOR_TEST	1
+#define HAS_CLOCK_TEST		1
+#define HAS_ECHO_TEST		1
+#define HAS_VID_TEE_TEST	PJMEDIA_HAS_VIDEO
+#define HAS_OPUS_TEST		PJMEDIA_HAS_OPUS_CODEC
+#define HAS_ANNEXB_TEST		1
+#define HAS_RESAMPLE_TEST	(PJMEDIA_RESAMPLE_IMP != PJMEDIA_RESAMPLE_NONE)
 
 int session_test(void);
 int rtp_test(void);
 int sdp_test(void);
 int jbuf_main(void);
+int jbuf_trace_test(void);
+int jbuf_replay_test(void);
+int jbuf_vid_test(void);
 int sdp_neg_test(void);
 int mips_test(void);
+int conf_mix_test(void);
+int mp4_writer_test(void);
 int codec_test_vectors(void);
+int clock_test(void);
+int echo_test(void);
+int opus_test(void);
+int annexb_test(void);
+int resample_test(void);
 int vid_codec_test(void);
 int vid_dev_test(void);
 int vid_port_test(void);
+int vid_tee_test(void);
 
 extern pj_pool_factory *mem;
 void app_perror(pj_status_t status, const char *title);
@@ -0,0 +1,255 @@
+/* $Id$ */
+/*
+ * Copyright (C) 2011 Teluu Inc. (http://www.teluu.com)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include "test.h"
+
+/*
+ * Video tee test.
+ *
+ * A frame is put to a tee with destination ports of the source format and
+ * of a converted format, some of them processing the frame in place. The
+ * frame must be converted once for all ports of the converted format,
+ * ports which only read must share the buffer, and in-place processing
+ * must not be seen by any other port or by the source.
+ */
+
+#if defined(PJMEDIA_HAS_VIDEO) && (PJMEDIA_HAS_VIDEO != 0)
+
+#define THIS_FILE	"vid_tee_test.c"
+#define SRC_W		64
+#define SRC_H		48
+#define SRC_BYTE	0x11
+#define CONV_BYTE	0xC0
+#define WRITE_BYTE	0xFF
+
+/* Converter that counts its conversions */
+static unsigned conv_cnt, conv_destroy_cnt;
+
+static pj_status_t test_convert(pjmedia_converter *cv,
+				pjmedia_frame *src_frame,
+				pjmedia_frame *dst_frame)
+{
+    PJ_UNUSED_ARG(cv);
+    PJ_UNUSED_ARG(src_frame);
+
+    pj_memset(dst_frame->buf, CONV_BYTE, dst_frame->size);
+    ++conv_cnt;
+    return PJ_SUCCESS;
+}
+
+static void test_conv_destroy(pjmedia_converter *cv)
+{
+    PJ_UNUSED_ARG(cv);
+    ++conv_destroy_cnt;
+}
+
+static pjmedia_converter_op test_conv_op =
+{
+    &test_convert,
+    &test_conv_destroy
+};
+
+static pj_status_t test_create_converter(pjmedia_converter_factory *cf,
+					 pj_pool_t *pool,
+					 const pjmedia_conversion_param *prm,
+					 pjmedia_converter **p_cv)
+{
+    PJ_UNUSED_ARG(cf);
+    PJ_UNUSED_ARG(prm);
+
+    *p_cv = PJ_POOL_ZALLOC_T(pool, pjmedia_converter);
+    (*p_cv)->op = &test_conv_op;
+    return PJ_SUCCESS;
+}
+
+static void test_destroy_factory(pjmedia_converter_factory *cf)
+{
+    PJ_UNUSED_ARG(cf);
+}
+
+static pjmedia_converter_factory_op test_factory_op =
+{
+    &test_create_converter,
+    &test_destroy_factory
+};
+
+/* Destination port which remembers what it received */
+struct dst_port
+{
+    pjmedia_port     base;
+    pj_bool_t	     in_place;
+    void	    *buf;
+    pj_uint8_t	     first_byte;
+    unsigned	     frame_cnt;
+};
+
+static pj_status_t dst_put_frame(pjmedia_port *port, pjmedia_frame *frame)
+{
+    struct dst_port *dp = (struct dst_port*) port;
+
+    dp->buf = frame->buf;
+    dp->first_byte = *(pj_uint8_t*)frame->buf;
+    ++dp->frame_cnt;
+
+    if (dp->in_place)
+	pj_memset(frame->buf, WRITE_BYTE, frame->size);
+    return PJ_SUCCESS;
+}
+
+static void init_dst(struct dst_port *dp, unsigned w, unsigned h,
+		     pj_bool_t in_place)
+{
+    pjmedia_format fmt;
+    pj_str_t name = pj_str("teedst");
+
+    pj_bzero(dp, sizeof(*dp));
+    pjmedia_format_init_video(&fmt, PJMEDIA_FORMAT_I420, w, h, 15, 1);
+    pjmedia_port_info_init2(&dp->base.info, &name, PJMEDIA_SIG_CLASS_PORT_VID('T','D'),
+			    PJMEDIA_DIR_DECODING, &fmt);
+    dp->base.put_frame = &dst_put_frame;
+    dp->in_place = in_place;
+}
+
+enum { RD1, RD2, WR1, WR2, CONV_RD1, CONV_RD2, CONV_WR, DST_CNT };
+
+int vid_tee_test(void)
+{
+    pjmedia_converter_factory factory;
+    pj_pool_t *pool;
+    pjmedia_port *tee = NULL;
+    pjmedia_format fmt;
+    pjmedia_frame frame;
+    struct dst_port dst[DST_CNT];
+    pj_uint8_t *src_buf;
+    pj_size_t src_size = SRC_W * SRC_H * 3 / 2;
+    unsigned i;
+    pj_status_t status;
+    int rc = 0;
+
+    PJ_LOG(3,(THIS_FILE, "  video tee test"));
+
+    pool = pj_pool_create(mem, "teetest", 4000, 4000, NULL);
+
+    pj_bzero(&factory, sizeof(factory));
+    factory.name = "tee-test";
+    factory.priority = PJMEDIA_CONVERTER_PRIORITY_HIGHEST;
+    factory.op = &test_factory_op;
+    status = pjmedia_converter_mgr_register_factory(NULL, &factory);
+    if (status != PJ_SUCCESS) {
+	pj_pool_release(pool);
+	return -10;
+    }
+    conv_cnt = conv_destroy_cnt = 0;
+
+    pjmedia_format_init_video(&fmt, PJMEDIA_FORMAT_I420, SRC_W, SRC_H, 15, 1);
+    status = pjmedia_vid_tee_create(pool, &fmt, DST_CNT, &tee);
+    if (status != PJ_SUCCESS) {
+	rc = -20;
+	goto on_return;
+    }
+
+    for (i = 0; i < DST_CNT; ++i) {
+	pj_bool_t converted = (i >= CONV_RD1);
+	pj_bool_t in_place = (i == WR1 || i == WR2 || i == CONV_WR);
+
+	init_dst(&dst[i], converted ? SRC_W/2 : SRC_W,
+		 converted ? SRC_H/2 : SRC_H, in_place);
+	status = pjmedia_vid_tee_add_dst_port2(tee, in_place ?
+				PJMEDIA_VID_TEE_DST_DO_IN_PLACE_PROC : 0,
+				&dst[i].base);
+	if (status != PJ_SUCCESS) {
+	    rc = -21;
+	    goto on_return;
+	}
+    }
+
+    src_buf = (pj_uint8_t*) pj_pool_alloc(pool, src_size);
+    pj_memset(src_buf, SRC_BYTE, src_size);
+    pj_bzero(&frame, sizeof(frame));
+    frame.type = PJMEDIA_FRAME_TYPE_VIDEO;
+    frame.buf = src_buf;
+    frame.size = src_size;
+
+    pjmedia_port_put_frame(tee, &frame);
+
+    /* One conversion for the ports of the converted format */
+    if (conv_cnt != 1) {
+	rc = -30;
+	goto on_return;
+    }
+
+    for (i = 0; i < DST_CNT; ++i) {
+	pj_uint8_t expected = (i >= CONV_RD1) ? CONV_BYTE : SRC_BYTE;
+
+	if (dst[i].frame_cnt != 1 || dst[i].first_byte != expected) {
+	    PJ_LOG(3,(THIS_FILE, "    port %d: %d frame(s), byte 0x%02x",
+		      i, dst[i].frame_cnt, dst[i].first_byte));
+	    rc = -31;
+	    goto on_return;
+	}
+    }
+
+    /* Readers share the buffer, writers of the source format get a copy,
+     * the writer of the converted format gets the conversion itself.
+     */
+    if (dst[RD1].buf != src_buf || dst[RD2].buf != src_buf ||
+	dst[WR1].buf == src_buf || dst[WR2].buf == src_buf ||
+	dst[CONV_RD2].buf != dst[CONV_RD1].buf ||
+	dst[CONV_WR].buf != dst[CONV_RD1].buf)
+    {
+	rc = -32;
+	goto on_return;
+    }
+
+    if (src_buf[0] != SRC_BYTE || src_buf[src_size-1] != SRC_BYTE) {
+	rc = -33;
+	goto on_return;
+    }
+
+    /* Removing the last port of a format removes its converter */
+    pjmedia_vid_tee_remove_dst_port(tee, &dst[CONV_RD1].base);
+    pjmedia_vid_tee_remove_dst_port(tee, &dst[CONV_WR].base);
+    if (conv_destroy_cnt != 0) {
+	rc = -40;
+	goto on_return;
+    }
+    pjmedia_vid_tee_remove_dst_port(tee, &dst[CONV_RD2].base);
+    if (conv_destroy_cnt != 1) {
+	rc = -41;
+	goto on_return;
+    }
+
+    pjmedia_port_put_frame(tee, &frame);
+    if (conv_cnt != 1 || dst[RD1].frame_cnt != 2 || dst[WR2].frame_cnt != 2 ||
+	dst[CONV_RD2].frame_cnt != 1)
+    {
+	rc = -42;
+	goto on_return;
+    }
+
+on_return:
+    if (tee)
+	pjmedia_port_destroy(tee);
+    pjmedia_converter_mgr_unregister_factory(NULL, &factory, PJ_FALSE);
+    if (rc != 0)
+	PJ_LOG(3,(THIS_FILE, "    error %d", rc));
+    pj_pool_release(pool);
+    return rc;
+}
+
+#endif /* PJMEDIA_HAS_VIDEO */
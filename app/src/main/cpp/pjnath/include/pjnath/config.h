@@ -211,6 +211,20 @@
 #endif
 
 
+/**
+ * Number of TURN channels, counted from the first channel number, that the
+ * TURN client session keeps in an array indexed by channel number, so that
+ * received ChannelData packets are matched to their peer without a hash
+ * table lookup. Channels above this are found in the hash table. Set to
+ * zero to always use the hash table.
+ *
+ * Default: 16
+ */
+#ifndef PJ_TURN_CHANNEL_INDEX_SIZE
+#   define PJ_TURN_CHANNEL_INDEX_SIZE		    16
+#endif
+
+
 /**
  * The TURN session timer heart beat interval. When this timer occurs, the 
  * TURN session will scan all the permissions/channel bindings to see which
@@ -643,6 +643,7 @@ struct pj_ice_sess
     unsigned		 comp_cnt;		    /**< # of components.   */
     pj_ice_sess_comp	 comp[PJ_ICE_MAX_COMP];	    /**< Component array    */
     unsigned		 comp_ka;		    /**< Next comp for KA   */
+    pj_stun_msg_tmpl	*ka_tmpl;		    /**< KA indication.	    */
 
     /* Local candidates */
     unsigned		 lcand_cnt;		    /**< # of local cand.   */
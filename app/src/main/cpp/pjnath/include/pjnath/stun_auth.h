@@ -445,6 +445,24 @@ PJ_DECL(pj_status_t) pj_stun_authenticate_response(const pj_uint8_t *pkt,
 					           const pj_str_t *key);
 
 
+/**
+ * Verify MESSAGE-INTEGRITY of a STUN message view, created with
+ * #pj_stun_msg_view_parse(), with a short term credential key or a key
+ * created with #pj_stun_create_key(). This is the allocation free
+ * counterpart of #pj_stun_authenticate_response(), and can be used for
+ * requests as well when the key is known (such as ICE connectivity
+ * checks).
+ *
+ * @param view		The message view.
+ * @param key		Authentication key to calculate MESSAGE-INTEGRITY
+ *			value.
+ *
+ * @return		PJ_SUCCESS if credential is verified successfully.
+ */
+PJ_DECL(pj_status_t) pj_stun_authenticate_view(const pj_stun_msg_view *view,
+					       const pj_str_t *key);
+
+
 /**
  * @}
  */
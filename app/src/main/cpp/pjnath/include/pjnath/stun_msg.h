@@ -1191,6 +1191,68 @@ enum pj_stun_decode_options
 };
 
 
+/**
+ * This structure describes an attribute of a STUN message view. The
+ * attribute value stays in the packet buffer.
+ */
+typedef struct pj_stun_attr_view
+{
+    /**
+     * Attribute type, from pj_stun_attr_type.
+     */
+    pj_uint16_t		type;
+
+    /**
+     * Length of the value, without padding.
+     */
+    pj_uint16_t		length;
+
+    /**
+     * Offset of the value from the start of the packet.
+     */
+    unsigned		offset;
+
+} pj_stun_attr_view;
+
+
+/**
+ * This structure describes a STUN message which is validated and indexed
+ * in place by #pj_stun_msg_view_parse(), without allocating memory. The
+ * view refers to the packet buffer, which must stay unmodified while the
+ * view is used.
+ */
+typedef struct pj_stun_msg_view
+{
+    /**
+     * The packet buffer.
+     */
+    const pj_uint8_t   *pdu;
+
+    /**
+     * STUN message header, in host byte order.
+     */
+    pj_stun_msg_hdr	hdr;
+
+    /**
+     * Number of attributes in the STUN message.
+     */
+    unsigned		attr_count;
+
+    /**
+     * Array of STUN attributes.
+     */
+    pj_stun_attr_view	attr[PJ_STUN_MAX_ATTR];
+
+} pj_stun_msg_view;
+
+
+/**
+ * Opaque declaration of STUN message template, see
+ * #pj_stun_msg_tmpl_create().
+ */
+typedef struct pj_stun_msg_tmpl pj_stun_msg_tmpl;
+
+
 /**
  * Get STUN message method name.
  *
@@ -1468,6 +1530,184 @@ PJ_DECL(pj_stun_attr_hdr*) pj_stun_attr_clone(pj_pool_t *pool,
 					      const pj_stun_attr_hdr *attr);
 
 
+/**
+ * Validate a STUN packet and index its attributes in place, without
+ * allocating memory. The packet is checked with the same rules as
+ * #pj_stun_msg_decode(), except that no error response is created; the
+ * application may decode the packet with #pj_stun_msg_decode() when it
+ * needs one.
+ *
+ * @param pdu		The packet buffer.
+ * @param pdu_len	The length of the packet buffer.
+ * @param options	Decoding options, bitmask of pj_stun_decode_options.
+ * @param view		The view to be initialized.
+ *
+ * @return		PJ_SUCCESS if the packet is a valid STUN message, or
+ *			the same error code as #pj_stun_msg_decode().
+ */
+PJ_DECL(pj_status_t) pj_stun_msg_view_parse(const pj_uint8_t *pdu,
+					    pj_size_t pdu_len,
+					    unsigned options,
+					    pj_stun_msg_view *view);
+
+/**
+ * Find STUN attribute in the STUN message view, starting from the
+ * specified index.
+ *
+ * @param view		The STUN message view.
+ * @param attr_type	The attribute type to be found, from pj_stun_attr_type.
+ * @param start_index	The start index of the attribute in the message.
+ *
+ * @return		The attribute, or NULL if it cannot be found.
+ */
+PJ_DECL(const pj_stun_attr_view*)
+pj_stun_msg_view_find_attr(const pj_stun_msg_view *view,
+			   int attr_type,
+			   unsigned start_index);
+
+/**
+ * Get the value of a 32bit integer attribute (such as PRIORITY or
+ * FINGERPRINT) of the STUN message view.
+ *
+ * @param view		The STUN message view.
+ * @param attr		The attribute, which length has been verified by
+ *			#pj_stun_msg_view_parse().
+ *
+ * @return		The value, in host byte order.
+ */
+PJ_DECL(pj_uint32_t) pj_stun_msg_view_get_uint(const pj_stun_msg_view *view,
+					       const pj_stun_attr_view *attr);
+
+/**
+ * Get the value of a 64bit integer attribute (such as ICE-CONTROLLING)
+ * of the STUN message view.
+ *
+ * @param view		The STUN message view.
+ * @param attr		The attribute.
+ * @param value		Pointer to receive the value, in host byte order.
+ */
+PJ_DECL(void) pj_stun_msg_view_get_uint64(const pj_stun_msg_view *view,
+					  const pj_stun_attr_view *attr,
+					  pj_timestamp *value);
+
+/**
+ * Get the value of a string or binary attribute (such as USERNAME) of the
+ * STUN message view. The string points to the packet buffer and is not
+ * NULL terminated.
+ *
+ * @param view		The STUN message view.
+ * @param attr		The attribute.
+ *
+ * @return		The value.
+ */
+PJ_DECL(pj_str_t) pj_stun_msg_view_get_string(const pj_stun_msg_view *view,
+					      const pj_stun_attr_view *attr);
+
+/**
+ * Get the address of a socket address attribute (such as
+ * XOR-MAPPED-ADDRESS) of the STUN message view. XOR-ed attributes are
+ * decoded.
+ *
+ * @param view		The STUN message view.
+ * @param attr		The attribute.
+ * @param addr		Pointer to receive the address.
+ *
+ * @return		PJ_SUCCESS on success, or PJ_EINVAL if the attribute
+ *			is not a socket address attribute.
+ */
+PJ_DECL(pj_status_t) pj_stun_msg_view_get_sockaddr(
+					    const pj_stun_msg_view *view,
+					    const pj_stun_attr_view *attr,
+					    pj_sockaddr *addr);
+
+/**
+ * Get the ERROR-CODE attribute of the STUN message view.
+ *
+ * @param view		The STUN message view.
+ * @param attr		The attribute.
+ * @param err_code	Pointer to receive the STUN error code.
+ * @param reason	Optional pointer to receive the reason phrase, which
+ *			points to the packet buffer.
+ */
+PJ_DECL(void) pj_stun_msg_view_get_errcode(const pj_stun_msg_view *view,
+					   const pj_stun_attr_view *attr,
+					   int *err_code,
+					   pj_str_t *reason);
+
+
+/**
+ * Create a template from a STUN message which is sent repeatedly with
+ * only the transaction ID and the values of a few attributes changing,
+ * such as ICE keep-alives. The message is encoded once, and
+ * #pj_stun_msg_tmpl_encode() then only patches the packet and computes
+ * MESSAGE-INTEGRITY and FINGERPRINT, if the message has them.
+ *
+ * @param pool		Pool to allocate the template.
+ * @param msg		The STUN message, with blank MESSAGE-INTEGRITY and
+ *			FINGERPRINT attributes if they are needed, as for
+ *			#pj_stun_msg_encode().
+ * @param key		Authentication key to calculate MESSAGE-INTEGRITY
+ *			value, or NULL if the message has no
+ *			MESSAGE-INTEGRITY attribute. The key is copied.
+ * @param p_tmpl	Pointer to receive the template.
+ *
+ * @return		PJ_SUCCESS on success or the appropriate error code.
+ */
+PJ_DECL(pj_status_t) pj_stun_msg_tmpl_create(pj_pool_t *pool,
+					     const pj_stun_msg *msg,
+					     const pj_str_t *key,
+					     pj_stun_msg_tmpl **p_tmpl);
+
+/**
+ * Change the value of a 32bit integer attribute (such as PRIORITY) in
+ * the template.
+ *
+ * @param tmpl		The template.
+ * @param attr_type	The attribute type.
+ * @param value		The new value.
+ *
+ * @return		PJ_SUCCESS on success, or PJ_ENOTFOUND if the
+ *			template has no such attribute.
+ */
+PJ_DECL(pj_status_t) pj_stun_msg_tmpl_set_uint(pj_stun_msg_tmpl *tmpl,
+					       int attr_type,
+					       pj_uint32_t value);
+
+/**
+ * Change the value of a 64bit integer attribute (such as ICE-CONTROLLING)
+ * in the template.
+ *
+ * @param tmpl		The template.
+ * @param attr_type	The attribute type.
+ * @param value		The new value.
+ *
+ * @return		PJ_SUCCESS on success, or PJ_ENOTFOUND if the
+ *			template has no such attribute.
+ */
+PJ_DECL(pj_status_t) pj_stun_msg_tmpl_set_uint64(pj_stun_msg_tmpl *tmpl,
+						 int attr_type,
+						 const pj_timestamp *value);
+
+/**
+ * Print a message from the template to a packet buffer.
+ *
+ * @param tmpl		The template.
+ * @param tsx_id	The transaction ID of the message, or NULL to
+ *			generate a new one.
+ * @param pkt_buf	The buffer to be filled with the packet.
+ * @param buf_size	Size of the buffer.
+ * @param p_msg_len	Upon return, it will be filled with the size of
+ *			the packet in bytes.
+ *
+ * @return		PJ_SUCCESS on success or the appropriate error code.
+ */
+PJ_DECL(pj_status_t) pj_stun_msg_tmpl_encode(pj_stun_msg_tmpl *tmpl,
+					     const pj_uint8_t tsx_id[12],
+					     pj_uint8_t *pkt_buf,
+					     pj_size_t buf_size,
+					     pj_size_t *p_msg_len);
+
+
 /**
  * Initialize generic STUN IP address attribute. The \a addr_len and
  * \a addr parameters specify whether the address is IPv4 or IPv4
@@ -225,6 +225,13 @@ typedef struct pj_turn_channel_data
 #pragma pack()
 
 
+/**
+ * Space, in bytes, that #pj_turn_session_sendto_hdr() needs in front of
+ * the packet to write the ChannelData header.
+ */
+#define PJ_TURN_CHANNEL_DATA_HDR_LEN	4
+
+
 /**
  * Callback to receive events from TURN session.
  */
@@ -692,6 +699,63 @@ PJ_DECL(pj_status_t) pj_turn_session_sendto(pj_turn_session *sess,
 					    const pj_sockaddr_t *peer_addr,
 					    unsigned addr_len);
 
+/**
+ * Send a data to the specified peer address via the TURN relay, like
+ * #pj_turn_session_sendto(), without copying the data when the peer is
+ * bound to a channel. The packet must be preceded by
+ * #PJ_TURN_CHANNEL_DATA_HDR_LEN bytes of writable space, where the
+ * ChannelData header is written, and the packet is then given to
+ * \a on_send_pkt() in place. Over TCP, where ChannelData must be padded
+ * to a multiple of four bytes, this is only done when the length of the
+ * data is a multiple of four. Otherwise, and when the peer is not bound
+ * to a channel, the data is sent as with #pj_turn_session_sendto().
+ *
+ * Since the packet buffer itself may be given to \a on_send_pkt(), it
+ * must stay valid for as long as the application's transport needs it,
+ * as for any other buffer given to that callback.
+ *
+ * @param sess		The TURN client session.
+ * @param pkt		The data/packet to be sent to peer, preceded by
+ *			PJ_TURN_CHANNEL_DATA_HDR_LEN bytes of writable
+ *			space.
+ * @param pkt_len	Length of the data.
+ * @param peer_addr	The remote peer address (the ultimate destination
+ *			of the data, and not the TURN server address).
+ * @param addr_len	Length of the address.
+ *
+ * @return		PJ_SUCCESS if the operation has been successful,
+ *			or the appropriate error code on failure.
+ */
+PJ_DECL(pj_status_t) pj_turn_session_sendto_hdr(pj_turn_session *sess,
+						pj_uint8_t *pkt,
+						unsigned pkt_len,
+						const pj_sockaddr_t *peer_addr,
+						unsigned addr_len);
+
+/**
+ * Send several packets to the same peer via the TURN relay at once, for
+ * example all packets of a packetized video frame. The permission and
+ * channel of the peer are looked up once, and each packet is then sent
+ * as with #pj_turn_session_sendto_hdr(), so each packet must be preceded
+ * by #PJ_TURN_CHANNEL_DATA_HDR_LEN bytes of writable space.
+ *
+ * @param sess		The TURN client session.
+ * @param count		Number of packets.
+ * @param pkt		Array of packets.
+ * @param pkt_len	Array of packet lengths.
+ * @param peer_addr	The remote peer address.
+ * @param addr_len	Length of the address.
+ *
+ * @return		PJ_SUCCESS if all packets have been sent, or the
+ *			error code of the last packet that failed.
+ */
+PJ_DECL(pj_status_t) pj_turn_session_sendto_batch(pj_turn_session *sess,
+						  unsigned count,
+						  pj_uint8_t *pkt[],
+						  const unsigned pkt_len[],
+						  const pj_sockaddr_t *peer_addr,
+						  unsigned addr_len);
+
 /**
  * Optionally establish channel binding for the specified a peer address.
  * This function will assign a unique channel number for the peer address
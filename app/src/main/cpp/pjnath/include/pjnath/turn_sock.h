@@ -426,6 +426,51 @@ PJ_DECL(pj_status_t) pj_turn_sock_sendto(pj_turn_sock *turn_sock,
 					const pj_sockaddr_t *peer_addr,
 					unsigned addr_len);
 
+/**
+ * Send a data to the specified peer address via the TURN relay, writing
+ * the ChannelData header in the space before the data instead of copying
+ * it. See #pj_turn_session_sendto_hdr() for the details.
+ *
+ * @param turn_sock	The TURN transport instance.
+ * @param pkt		The data/packet to be sent to peer, preceded by
+ *			PJ_TURN_CHANNEL_DATA_HDR_LEN bytes of writable
+ *			space.
+ * @param pkt_len	Length of the data.
+ * @param peer_addr	The remote peer address.
+ * @param addr_len	Length of the address.
+ *
+ * @return		PJ_SUCCESS if the operation has been successful,
+ *			or the appropriate error code on failure.
+ */
+PJ_DECL(pj_status_t) pj_turn_sock_sendto_hdr(pj_turn_sock *turn_sock,
+					     pj_uint8_t *pkt,
+					     unsigned pkt_len,
+					     const pj_sockaddr_t *peer_addr,
+					     unsigned addr_len);
+
+/**
+ * Send several packets to the same peer via the TURN relay at once. See
+ * #pj_turn_session_sendto_batch() for the details.
+ *
+ * @param turn_sock	The TURN transport instance.
+ * @param count		Number of packets.
+ * @param pkt		Array of packets, each preceded by
+ *			PJ_TURN_CHANNEL_DATA_HDR_LEN bytes of writable
+ *			space.
+ * @param pkt_len	Array of packet lengths.
+ * @param peer_addr	The remote peer address.
+ * @param addr_len	Length of the address.
+ *
+ * @return		PJ_SUCCESS if all packets have been sent, or the
+ *			error code of the last packet that failed.
+ */
+PJ_DECL(pj_status_t) pj_turn_sock_sendto_batch(pj_turn_sock *turn_sock,
+					       unsigned count,
+					       pj_uint8_t *pkt[],
+					       const unsigned pkt_len[],
+					       const pj_sockaddr_t *peer_addr,
+					       unsigned addr_len);
+
 /**
  * Optionally establish channel binding for the specified a peer address.
  * This function will assign a unique channel number for the peer address
@@ -957,6 +957,356 @@ static int handle_unknown_non_mandatory(void)
 }
 
 
+/* Parse the packets of the decode test and the test vector in place */
+static int view_test(void)
+{
+    pj_pool_t *pool = pj_pool_create(mem, "view_test", 1024, 1024, NULL);
+    test_vector *v = &test_vectors[0];
+    pj_stun_msg_view view;
+    const pj_stun_attr_view *attr;
+    pj_stun_msg *msg;
+    pj_timestamp u64;
+    pj_uint8_t buf[1500];
+    pj_str_t s1, s2, key;
+    unsigned i, j;
+    int rc = 0;
+
+    PJ_LOG(3,(THIS_FILE, "  STUN message view test"));
+
+    for (i=0; i<PJ_ARRAY_SIZE(tests); ++i) {
+	struct test *t = &tests[i];
+	pj_status_t status, status2;
+
+	if (t->pdu == NULL)
+	    continue;
+
+	status = pj_stun_msg_decode(pool, (pj_uint8_t*)t->pdu, t->pdu_len,
+				    PJ_STUN_IS_DATAGRAM | PJ_STUN_CHECK_PACKET,
+				    &msg, NULL, NULL);
+	status2 = pj_stun_msg_view_parse((pj_uint8_t*)t->pdu, t->pdu_len,
+					 PJ_STUN_IS_DATAGRAM |
+					   PJ_STUN_CHECK_PACKET,
+					 &view);
+	if (status != status2) {
+	    PJ_LOG(1,(THIS_FILE, "    %s: decode status %d, view status %d",
+		      t->title, status, status2));
+	    rc = -2010;
+	    goto on_return;
+	}
+	if (status != PJ_SUCCESS)
+	    continue;
+
+	if (view.hdr.type != msg->hdr.type ||
+	    view.attr_count != msg->attr_count)
+	{
+	    rc = -2020;
+	    goto on_return;
+	}
+	for (j=0; j<view.attr_count; ++j) {
+	    if (view.attr[j].type != msg->attr[j]->type ||
+		view.attr[j].length != msg->attr[j]->length)
+	    {
+		rc = -2030;
+		goto on_return;
+	    }
+	}
+    }
+
+    /* Attribute values of the test vector */
+    if (pj_stun_msg_view_parse((pj_uint8_t*)v->pdu, v->pdu_len,
+			       PJ_STUN_IS_DATAGRAM | PJ_STUN_CHECK_PACKET,
+			       &view) != PJ_SUCCESS)
+    {
+	rc = -2040;
+	goto on_return;
+    }
+
+    attr = pj_stun_msg_view_find_attr(&view, PJ_STUN_ATTR_PRIORITY, 0);
+    if (!attr || pj_stun_msg_view_get_uint(&view, attr) != 0x6e0001ff) {
+	rc = -2050;
+	goto on_return;
+    }
+
+    attr = pj_stun_msg_view_find_attr(&view, PJ_STUN_ATTR_ICE_CONTROLLED, 0);
+    if (!attr) {
+	rc = -2060;
+	goto on_return;
+    }
+    pj_stun_msg_view_get_uint64(&view, attr, &u64);
+    if (u64.u32.hi != 0x932ff9b1 || u64.u32.lo != 0x51263b36) {
+	rc = -2061;
+	goto on_return;
+    }
+
+    attr = pj_stun_msg_view_find_attr(&view, PJ_STUN_ATTR_USERNAME, 0);
+    s1 = attr ? pj_stun_msg_view_get_string(&view, attr) : pj_str("");
+    if (pj_strcmp2(&s1, v->username)) {
+	rc = -2070;
+	goto on_return;
+    }
+
+    pj_stun_create_key(pool, &key, NULL, pj_cstr(&s1, v->username),
+		       PJ_STUN_PASSWD_PLAIN, pj_cstr(&s2, v->password));
+    if (pj_stun_authenticate_view(&view, &key) != PJ_SUCCESS) {
+	rc = -2080;
+	goto on_return;
+    }
+
+    /* Corrupt USERNAME, MESSAGE-INTEGRITY must not match */
+    pj_memcpy(buf, v->pdu, v->pdu_len);
+    buf[attr->offset] ^= 1;
+    if (pj_stun_msg_view_parse(buf, v->pdu_len, 0, &view) != PJ_SUCCESS ||
+	pj_stun_authenticate_view(&view, &key) == PJ_SUCCESS)
+    {
+	rc = -2090;
+	goto on_return;
+    }
+
+    /* XOR-ed and plain addresses, IPv4 and IPv6 */
+    for (i=0; i<(USE_IPV6 ? 4u : 2u); ++i) {
+	int attr_type = (i & 1) ? PJ_STUN_ATTR_MAPPED_ADDR :
+				  PJ_STUN_ATTR_XOR_MAPPED_ADDR;
+	pj_sockaddr addr, addr2;
+	pj_size_t len;
+
+	pj_sockaddr_init((i & 2) ? pj_AF_INET6() : pj_AF_INET(), &addr,
+			 pj_cstr(&s1, (i & 2) ? "2001:db8:1234:5678:11:2233:"
+						"4455:6677" : "192.0.2.1"),
+			 32853);
+	pj_stun_msg_create(pool, PJ_STUN_BINDING_RESPONSE, PJ_STUN_MAGIC,
+			   NULL, &msg);
+	pj_stun_msg_add_sockaddr_attr(pool, msg, attr_type, !(i & 1), &addr,
+				      pj_sockaddr_get_len(&addr));
+	pj_stun_msg_encode(msg, buf, sizeof(buf), 0, NULL, &len);
+
+	if (pj_stun_msg_view_parse(buf, len, 0, &view) != PJ_SUCCESS ||
+	    pj_stun_msg_view_get_sockaddr(&view, &view.attr[0],
+					  &addr2) != PJ_SUCCESS ||
+	    pj_sockaddr_cmp(&addr, &addr2) != 0)
+	{
+	    rc = -2100 - (int)i;
+	    goto on_return;
+	}
+    }
+
+on_return:
+    pj_pool_release(pool);
+    return rc;
+}
+
+/* Encode a message from template, and compare with pj_stun_msg_encode() */
+static int tmpl_cmp(pj_pool_t *pool, pj_stun_msg *msg, const pj_str_t *key,
+		    const pj_uint8_t *tsx_id, pj_uint32_t prio)
+{
+    pj_stun_msg_tmpl *tmpl;
+    pj_stun_uint_attr *aprio;
+    pj_uint8_t buf1[1500], buf2[1500];
+    pj_size_t len1, len2;
+
+    if (pj_stun_msg_tmpl_create(pool, msg, key, &tmpl) != PJ_SUCCESS)
+	return -1;
+
+    aprio = (pj_stun_uint_attr*)
+	    pj_stun_msg_find_attr(msg, PJ_STUN_ATTR_PRIORITY, 0);
+    if (aprio) {
+	aprio->value = prio;
+	if (pj_stun_msg_tmpl_set_uint(tmpl, PJ_STUN_ATTR_PRIORITY,
+				      prio) != PJ_SUCCESS)
+	{
+	    return -2;
+	}
+    } else if (pj_stun_msg_tmpl_set_uint(tmpl, PJ_STUN_ATTR_PRIORITY,
+					 prio) != PJ_ENOTFOUND)
+    {
+	return -3;
+    }
+
+    pj_memcpy(msg->hdr.tsx_id, tsx_id, sizeof(msg->hdr.tsx_id));
+    if (pj_stun_msg_encode(msg, buf1, sizeof(buf1), 0, key,
+			   &len1) != PJ_SUCCESS ||
+	pj_stun_msg_tmpl_encode(tmpl, tsx_id, buf2, sizeof(buf2),
+				&len2) != PJ_SUCCESS)
+    {
+	return -4;
+    }
+
+    if (len1 != len2 || cmp_buf(buf1, buf2, (unsigned)len1) != -1)
+	return -5;
+
+    return 0;
+}
+
+static int tmpl_test(void)
+{
+    pj_pool_t *pool = pj_pool_create(mem, "tmpl_test", 1024, 1024, NULL);
+    test_vector *v = &test_vectors[0];
+    const pj_uint8_t tsx_id[12] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12 };
+    pj_stun_msg_tmpl *tmpl;
+    pj_stun_msg *msg;
+    pj_uint8_t buf[1500];
+    pj_str_t s1, s2, key;
+    pj_size_t len;
+    int rc = 0;
+
+    PJ_LOG(3,(THIS_FILE, "  STUN message template test"));
+
+    pj_stun_create_key(pool, &key, NULL, pj_cstr(&s1, v->username),
+		       PJ_STUN_PASSWD_PLAIN, pj_cstr(&s2, v->password));
+
+    /* The test vector itself */
+    msg = v->create(pool, v);
+    if (pj_stun_msg_tmpl_create(pool, msg, &key, &tmpl) != PJ_SUCCESS ||
+	pj_stun_msg_tmpl_encode(tmpl, (pj_uint8_t*)v->tsx_id, buf,
+				sizeof(buf), &len) != PJ_SUCCESS ||
+	len != v->pdu_len ||
+	cmp_buf(buf, (const pj_uint8_t*)v->pdu, (unsigned)len) != -1)
+    {
+	rc = -2210;
+	goto on_return;
+    }
+
+    /* Buffer too small */
+    if (pj_stun_msg_tmpl_encode(tmpl, NULL, buf, v->pdu_len-1,
+				&len) != PJ_ETOOSMALL)
+    {
+	rc = -2220;
+	goto on_return;
+    }
+
+    /* New transaction ID and PRIORITY */
+    rc = tmpl_cmp(pool, v->create(pool, v), &key, tsx_id, 0x7e7f00ff);
+    if (rc != 0) {
+	rc += -2230;
+	goto on_return;
+    }
+
+    /* IPv4 and IPv6 XOR-MAPPED-ADDRESS */
+    rc = tmpl_cmp(pool, create_msgint2(pool, v), &key, tsx_id, 0);
+    if (rc != 0) {
+	rc += -2240;
+	goto on_return;
+    }
+#if USE_IPV6
+    rc = tmpl_cmp(pool, create_msgint3(pool, v), &key, tsx_id, 0);
+    if (rc != 0) {
+	rc += -2250;
+	goto on_return;
+    }
+#endif
+
+on_return:
+    pj_pool_release(pool);
+    return rc;
+}
+
+/* Packets per second of decoding/encoding the test vector */
+static int view_bench(void)
+{
+    enum { COUNT = 20000 };
+    pj_pool_t *pool = pj_pool_create(mem, "view_bench", 4000, 4000, NULL);
+    pj_pool_t *msg_pool = pj_pool_create(mem, "msg", 4000, 4000, NULL);
+    test_vector *v = &test_vectors[0];
+    pj_stun_auth_cred cred;
+    pj_stun_msg_tmpl *tmpl;
+    pj_stun_msg_view view;
+    pj_stun_msg *msg;
+    pj_uint8_t buf[1500];
+    pj_timestamp t0, t1;
+    pj_uint32_t usec[4];
+    pj_str_t s1, s2, key;
+    pj_size_t len;
+    unsigned i;
+    int rc = 0;
+
+    PJ_LOG(3,(THIS_FILE, "  STUN message view benchmark"));
+
+    pj_bzero(&cred, sizeof(cred));
+    cred.type = PJ_STUN_AUTH_CRED_STATIC;
+    cred.data.static_cred.username = pj_str(v->username);
+    cred.data.static_cred.data = pj_str(v->password);
+    pj_stun_create_key(pool, &key, NULL, pj_cstr(&s1, v->username),
+		       PJ_STUN_PASSWD_PLAIN, pj_cstr(&s2, v->password));
+
+    /* Decode and authenticate */
+    pj_get_timestamp(&t0);
+    for (i=0; i<COUNT && rc==0; ++i) {
+	pj_pool_reset(msg_pool);
+	if (pj_stun_msg_decode(msg_pool, (pj_uint8_t*)v->pdu, v->pdu_len,
+			       PJ_STUN_IS_DATAGRAM | PJ_STUN_CHECK_PACKET,
+			       &msg, NULL, NULL) != PJ_SUCCESS ||
+	    pj_stun_authenticate_request((pj_uint8_t*)v->pdu, v->pdu_len, msg,
+					 &cred, msg_pool, NULL,
+					 NULL) != PJ_SUCCESS)
+	{
+	    rc = -2310;
+	}
+    }
+    pj_get_timestamp(&t1);
+    usec[0] = pj_elapsed_usec(&t0, &t1);
+
+    pj_get_timestamp(&t0);
+    for (i=0; i<COUNT && rc==0; ++i) {
+	if (pj_stun_msg_view_parse((pj_uint8_t*)v->pdu, v->pdu_len,
+				   PJ_STUN_IS_DATAGRAM | PJ_STUN_CHECK_PACKET,
+				   &view) != PJ_SUCCESS ||
+	    pj_stun_authenticate_view(&view, &key) != PJ_SUCCESS)
+	{
+	    rc = -2320;
+	}
+    }
+    pj_get_timestamp(&t1);
+    usec[1] = pj_elapsed_usec(&t0, &t1);
+
+    /* Create and encode */
+    pj_get_timestamp(&t0);
+    for (i=0; i<COUNT && rc==0; ++i) {
+	pj_pool_reset(msg_pool);
+	msg = v->create(msg_pool, v);
+	if (!msg || pj_stun_msg_encode(msg, buf, sizeof(buf), 0, &key,
+				       &len) != PJ_SUCCESS)
+	{
+	    rc = -2330;
+	}
+    }
+    pj_get_timestamp(&t1);
+    usec[2] = pj_elapsed_usec(&t0, &t1);
+
+    msg = v->create(pool, v);
+    if (rc == 0 && pj_stun_msg_tmpl_create(pool, msg, &key,
+					   &tmpl) != PJ_SUCCESS)
+    {
+	rc = -2340;
+    }
+    pj_get_timestamp(&t0);
+    for (i=0; i<COUNT && rc==0; ++i) {
+	if (pj_stun_msg_tmpl_encode(tmpl, NULL, buf, sizeof(buf),
+				    &len) != PJ_SUCCESS)
+	{
+	    rc = -2350;
+	}
+    }
+    pj_get_timestamp(&t1);
+    usec[3] = pj_elapsed_usec(&t0, &t1);
+
+    if (rc == 0) {
+	for (i=0; i<4; ++i) {
+	    if (usec[i] == 0)
+		usec[i] = 1;
+	}
+	PJ_LOG(3,(THIS_FILE, "    decode: %u pps, view: %u pps",
+		  (unsigned)((pj_uint64_t)COUNT * 1000000 / usec[0]),
+		  (unsigned)((pj_uint64_t)COUNT * 1000000 / usec[1])));
+	PJ_LOG(3,(THIS_FILE, "    encode: %u pps, template: %u pps",
+		  (unsigned)((pj_uint64_t)COUNT * 1000000 / usec[2]),
+		  (unsigned)((pj_uint64_t)COUNT * 1000000 / usec[3])));
+    }
+
+    pj_pool_release(msg_pool);
+    pj_pool_release(pool);
+    return rc;
+}
+
+
 int stun_test(void)
 {
     int pad, rc;
@@ -979,6 +1329,18 @@ int stun_test(void)
     if (rc != 0)
 	goto on_return;
 
+    rc = view_test();
+    if (rc != 0)
+	goto on_return;
+
+    rc = tmpl_test();
+    if (rc != 0)
+	goto on_return;
+
+    rc = view_bench();
+    if (rc != 0)
+	goto on_return;
+
 on_return:
     pj_stun_set_padding_char(pad);
     return rc;
@@ -120,12 +120,13 @@ void poll_events(pj_stun_config *stun_cfg, unsigned msec,
 
 void capture_pjlib_state(pj_stun_config *cfg, struct pjlib_state *st)
 {
-    pj_caching_pool *cp;
+    pj_caching_pool_stat stat;
 
     st->timer_cnt = (unsigned)pj_timer_heap_count(cfg->timer_heap);
 
-    cp = (pj_caching_pool*)cfg->pf;
-    st->pool_used_cnt = (unsigned)cp->used_count;
+    /* Includes the pools created from the per-thread caches */
+    pj_caching_pool_get_stat((pj_caching_pool*)cfg->pf, &stat);
+    st->pool_used_cnt = (unsigned)stat.used_count;
 }
 
 int check_pjlib_state(pj_stun_config *cfg,
@@ -500,6 +500,281 @@ static int destroy_test(pj_stun_config  *stun_cfg,
 }
 
 
+/////////////////////////////////////////////////////////////////////
+
+/* Packets sent and data received by the TURN session of channel_test() */
+static struct channel_test
+{
+    pj_pool_t		*pool;
+    pj_turn_session	*sess;
+    pj_bool_t		 capture;
+    unsigned		 tx_cnt;
+    const pj_uint8_t	*tx_ptr;
+    unsigned		 tx_len;
+    pj_uint8_t		 tx_pkt[1500];
+    unsigned		 rx_cnt;
+    pj_sockaddr		 rx_addr;
+    unsigned		 rx_len;
+} chtest;
+
+static pj_status_t chtest_on_send_pkt(pj_turn_session *sess,
+				      const pj_uint8_t *pkt,
+				      unsigned pkt_len,
+				      const pj_sockaddr_t *dst_addr,
+				      unsigned addr_len)
+{
+    PJ_UNUSED_ARG(sess);
+    PJ_UNUSED_ARG(dst_addr);
+    PJ_UNUSED_ARG(addr_len);
+
+    ++chtest.tx_cnt;
+    if (chtest.capture) {
+	chtest.tx_ptr = pkt;
+	chtest.tx_len = pkt_len;
+	pj_memcpy(chtest.tx_pkt, pkt, pkt_len);
+    }
+    return PJ_SUCCESS;
+}
+
+static void chtest_on_rx_data(pj_turn_session *sess,
+			      void *pkt,
+			      unsigned pkt_len,
+			      const pj_sockaddr_t *peer_addr,
+			      unsigned addr_len)
+{
+    PJ_UNUSED_ARG(sess);
+    PJ_UNUSED_ARG(pkt);
+
+    ++chtest.rx_cnt;
+    chtest.rx_len = pkt_len;
+    pj_memcpy(&chtest.rx_addr, peer_addr, addr_len);
+}
+
+/* Answer the last request sent by the session as the server would */
+static int chtest_respond(pj_uint16_t req_type, pj_uint32_t lifetime)
+{
+    pj_stun_msg *req, *resp;
+    pj_sockaddr addr;
+    pj_uint8_t buf[1500];
+    pj_str_t s;
+    pj_size_t len;
+
+    if (pj_stun_msg_decode(chtest.pool, chtest.tx_pkt, chtest.tx_len,
+			   PJ_STUN_IS_DATAGRAM, &req, NULL,
+			   NULL) != PJ_SUCCESS ||
+	req->hdr.type != req_type)
+    {
+	return -1;
+    }
+
+    pj_stun_msg_create_response(chtest.pool, req, 0, NULL, &resp);
+    if (req_type != PJ_STUN_CHANNEL_BIND_REQUEST) {
+	pj_sockaddr_init(pj_AF_INET(), &addr, pj_cstr(&s, "127.0.0.1"),
+			 50000);
+	pj_stun_msg_add_sockaddr_attr(chtest.pool, resp,
+				      PJ_STUN_ATTR_XOR_RELAYED_ADDR, PJ_TRUE,
+				      &addr, sizeof(pj_sockaddr_in));
+	pj_stun_msg_add_sockaddr_attr(chtest.pool, resp,
+				      PJ_STUN_ATTR_XOR_MAPPED_ADDR, PJ_TRUE,
+				      &addr, sizeof(pj_sockaddr_in));
+	pj_stun_msg_add_uint_attr(chtest.pool, resp, PJ_STUN_ATTR_LIFETIME,
+				  lifetime);
+    }
+    pj_stun_msg_encode(resp, buf, sizeof(buf), 0, NULL, &len);
+
+    return pj_turn_session_on_rx_pkt(chtest.sess, buf, len,
+				     NULL) == PJ_SUCCESS ? 0 : -2;
+}
+
+/* Check that the last packet sent is ChannelData */
+static int chtest_check_cd(const pj_uint8_t *payload, unsigned len,
+			   pj_bool_t in_place)
+{
+    const pj_uint8_t *p = chtest.tx_pkt;
+
+    if ((p[0] << 8 | p[1]) != 0x4000 || (unsigned)(p[2] << 8 | p[3]) != len)
+	return -1;
+    if (pj_memcmp(p + PJ_TURN_CHANNEL_DATA_HDR_LEN, payload, len))
+	return -2;
+    if (in_place) {
+	/* Sent in place, without the optional padding over UDP */
+	if (chtest.tx_ptr != payload - PJ_TURN_CHANNEL_DATA_HDR_LEN ||
+	    chtest.tx_len != len + PJ_TURN_CHANNEL_DATA_HDR_LEN)
+	{
+	    return -3;
+	}
+    } else if (chtest.tx_len != ((len + PJ_TURN_CHANNEL_DATA_HDR_LEN + 3) &
+				 ~3))
+    {
+	return -4;
+    }
+    return 0;
+}
+
+static int channel_test(pj_stun_config *stun_cfg)
+{
+    enum { BENCH_CNT = 100000, BATCH_CNT = 3, LEN = 101 };
+    pj_turn_session_cb cb;
+    pj_sockaddr peer1, peer2;
+    pj_uint8_t buf[BATCH_CNT][PJ_TURN_CHANNEL_DATA_HDR_LEN + LEN + 3];
+    pj_uint8_t *pkt[BATCH_CNT];
+    unsigned pkt_len[BATCH_CNT];
+    pj_turn_session_info info;
+    pj_timestamp t0, t1;
+    pj_uint32_t usec[2];
+    pj_str_t s;
+    unsigned i;
+    int rc = 0;
+
+    PJ_LOG(3,("", "  ChannelData test"));
+
+    pj_bzero(&chtest, sizeof(chtest));
+    chtest.pool = pj_pool_create(mem, "chtest", 1000, 1000, NULL);
+    chtest.capture = PJ_TRUE;
+
+    pj_bzero(&cb, sizeof(cb));
+    cb.on_send_pkt = &chtest_on_send_pkt;
+    cb.on_rx_data = &chtest_on_rx_data;
+    if (pj_turn_session_create(stun_cfg, "chtest", pj_AF_INET(),
+			       PJ_TURN_TP_UDP, NULL, &cb, 0, NULL,
+			       &chtest.sess) != PJ_SUCCESS)
+    {
+	pj_pool_release(chtest.pool);
+	return -300;
+    }
+
+    /* Allocate and bind a channel to peer1 */
+    pj_turn_session_set_server(chtest.sess, pj_cstr(&s, "127.0.0.1"),
+			       TURN_SERVER_PORT, NULL);
+    pj_turn_session_alloc(chtest.sess, NULL);
+    if (chtest_respond(PJ_STUN_ALLOCATE_REQUEST, 600) != 0) {
+	rc = -310;
+	goto on_return;
+    }
+    pj_turn_session_get_info(chtest.sess, &info);
+    if (info.state != PJ_TURN_STATE_READY) {
+	rc = -320;
+	goto on_return;
+    }
+
+    pj_sockaddr_init(pj_AF_INET(), &peer1, pj_cstr(&s, "127.0.0.1"), 6000);
+    pj_sockaddr_init(pj_AF_INET(), &peer2, pj_cstr(&s, "127.0.0.1"), 6002);
+    pj_turn_session_bind_channel(chtest.sess, &peer1, sizeof(peer1));
+    if (chtest_respond(PJ_STUN_CHANNEL_BIND_REQUEST, 0) != 0) {
+	rc = -330;
+	goto on_return;
+    }
+
+    for (i=0; i<BATCH_CNT; ++i) {
+	pkt[i] = buf[i] + PJ_TURN_CHANNEL_DATA_HDR_LEN;
+	pkt_len[i] = LEN - i;
+	pj_memset(pkt[i], 'a' + i, LEN);
+    }
+
+    /* Copied, and padded */
+    pj_turn_session_sendto(chtest.sess, pkt[0], LEN, &peer1, sizeof(peer1));
+    rc = chtest_check_cd(pkt[0], LEN, PJ_FALSE);
+    if (rc != 0) {
+	rc += -340;
+	goto on_return;
+    }
+
+    /* In place */
+    pj_turn_session_sendto_hdr(chtest.sess, pkt[0], LEN, &peer1,
+			       sizeof(peer1));
+    rc = chtest_check_cd(pkt[0], LEN, PJ_TRUE);
+    if (rc != 0) {
+	rc += -350;
+	goto on_return;
+    }
+
+    /* Peer without channel uses Send Indication, then back to peer1 */
+    pj_turn_session_sendto_hdr(chtest.sess, pkt[0], LEN, &peer2,
+			       sizeof(peer2));
+    if ((chtest.tx_pkt[0] & 0xC0) != 0 ||
+	(chtest.tx_pkt[0] << 8 | chtest.tx_pkt[1]) != PJ_STUN_SEND_INDICATION)
+    {
+	rc = -360;
+	goto on_return;
+    }
+    pj_turn_session_sendto_hdr(chtest.sess, pkt[1], LEN-1, &peer1,
+			       sizeof(peer1));
+    rc = chtest_check_cd(pkt[1], LEN-1, PJ_TRUE);
+    if (rc != 0) {
+	rc += -370;
+	goto on_return;
+    }
+
+    /* Batch */
+    chtest.tx_cnt = 0;
+    pj_turn_session_sendto_batch(chtest.sess, BATCH_CNT, pkt, pkt_len,
+				 &peer1, sizeof(peer1));
+    if (chtest.tx_cnt != BATCH_CNT) {
+	rc = -380;
+	goto on_return;
+    }
+    rc = chtest_check_cd(pkt[BATCH_CNT-1], pkt_len[BATCH_CNT-1], PJ_TRUE);
+    if (rc != 0) {
+	rc += -385;
+	goto on_return;
+    }
+
+    /* Received ChannelData */
+    buf[0][0] = 0x40; buf[0][1] = 0x00;
+    buf[0][2] = 0x00; buf[0][3] = LEN;
+    if (pj_turn_session_on_rx_pkt(chtest.sess, buf[0],
+				  PJ_TURN_CHANNEL_DATA_HDR_LEN + LEN,
+				  NULL) != PJ_SUCCESS ||
+	chtest.rx_cnt != 1 || chtest.rx_len != LEN ||
+	pj_sockaddr_cmp(&chtest.rx_addr, &peer1) != 0)
+    {
+	rc = -390;
+	goto on_return;
+    }
+    buf[0][1] = 0x01;
+    if (pj_turn_session_on_rx_pkt(chtest.sess, buf[0],
+				  PJ_TURN_CHANNEL_DATA_HDR_LEN + LEN,
+				  NULL) != PJ_ENOTFOUND ||
+	pj_turn_session_on_rx_pkt(chtest.sess, buf[0], 3,
+				  NULL) != PJ_ETOOSMALL ||
+	chtest.rx_cnt != 1)
+    {
+	rc = -395;
+	goto on_return;
+    }
+
+    /* Copy and in place send rate */
+    chtest.capture = PJ_FALSE;
+    pj_get_timestamp(&t0);
+    for (i=0; i<BENCH_CNT; ++i)
+	pj_turn_session_sendto(chtest.sess, pkt[0], LEN, &peer1,
+			       sizeof(peer1));
+    pj_get_timestamp(&t1);
+    usec[0] = pj_elapsed_usec(&t0, &t1);
+
+    pj_get_timestamp(&t0);
+    for (i=0; i<BENCH_CNT; ++i)
+	pj_turn_session_sendto_hdr(chtest.sess, pkt[0], LEN, &peer1,
+				   sizeof(peer1));
+    pj_get_timestamp(&t1);
+    usec[1] = pj_elapsed_usec(&t0, &t1);
+
+    PJ_LOG(3,("", "    %u packets: sendto %u usec, sendto_hdr %u usec",
+	      BENCH_CNT, usec[0], usec[1]));
+    chtest.capture = PJ_TRUE;
+
+on_return:
+    /* Deallocate */
+    chtest.tx_len = 0;
+    pj_turn_session_shutdown(chtest.sess);
+    if (chtest.tx_len)
+	chtest_respond(PJ_STUN_REFRESH_REQUEST, 0);
+    poll_events(stun_cfg, 100, PJ_FALSE);
+    pj_pool_release(chtest.pool);
+    return rc;
+}
+
+
 /////////////////////////////////////////////////////////////////////
 
 int turn_sock_test(void)
@@ -515,6 +790,10 @@ int turn_sock_test(void)
 	return -2;
     }
 
+    rc = channel_test(&stun_cfg);
+    if (rc != 0) 
+	goto on_return;
+
     rc = state_progression_test(&stun_cfg, USE_IPV6);
     if (rc != 0) 
 	goto on_return;
@@ -394,6 +394,26 @@ PJ_DEF(pj_status_t) pj_ice_sess_create(pj_stun_config *stun_cfg,
 	}
     }
 
+    /* The keep-alive Binding Indication only differs in the transaction
+     * ID, so it is encoded once here and sent from the template.
+     */
+    {
+	pj_stun_msg *ka_msg;
+
+	status = pj_stun_msg_create(ice->pool, PJ_STUN_BINDING_INDICATION,
+				    PJ_STUN_MAGIC, NULL, &ka_msg);
+	if (status == PJ_SUCCESS)
+	    status = pj_stun_msg_add_uint_attr(ice->pool, ka_msg,
+					       PJ_STUN_ATTR_FINGERPRINT, 0);
+	if (status == PJ_SUCCESS)
+	    status = pj_stun_msg_tmpl_create(ice->pool, ka_msg, NULL,
+					     &ice->ka_tmpl);
+	if (status != PJ_SUCCESS) {
+	    destroy_ice(ice, status);
+	    return status;
+	}
+    }
+
     /* Initialize transport datas */
     for (i=0; i<PJ_ARRAY_SIZE(ice->tp_data); ++i) {
 	ice->tp_data[i].transport_id = 0;
@@ -1195,44 +1215,33 @@ static void ice_keep_alive(pj_ice_sess *ice, pj_bool_t send_now)
     if (send_now) {
 	/* Send Binding Indication for the component */
 	pj_ice_sess_comp *comp = &ice->comp[ice->comp_ka];
-	pj_stun_tx_data *tdata;
 	pj_ice_sess_check *the_check;
-	pj_ice_msg_data *msg_data;
+	pj_uint8_t pkt[sizeof(pj_stun_msg_hdr) + 8];
+	pj_size_t pkt_len;
 	int addr_len;
-	pj_bool_t saved;
 	pj_status_t status;
 
 	/* Must have nominated check by now */
 	pj_assert(comp->nominated_check != NULL);
 	the_check = comp->nominated_check;
 
-	/* Create the Binding Indication */
-	status = pj_stun_session_create_ind(comp->stun_sess, 
-					    PJ_STUN_BINDING_INDICATION,
-					    &tdata);
-	if (status != PJ_SUCCESS)
-	    goto done;
-
-	/* Need the transport_id */
-	msg_data = PJ_POOL_ZALLOC_T(tdata->pool, pj_ice_msg_data);
-	msg_data->transport_id = the_check->lcand->transport_id;
-
 	/* RFC 5245 Section 10:
 	 * The Binding Indication SHOULD contain the FINGERPRINT attribute
 	 * to aid in demultiplexing, but SHOULD NOT contain any other
 	 * attributes.
+	 *
+	 * No response is expected, so the STUN session is bypassed and the
+	 * indication is encoded from the template with a new transaction ID.
 	 */
-	saved = pj_stun_session_use_fingerprint(comp->stun_sess, PJ_TRUE);
+	status = pj_stun_msg_tmpl_encode(ice->ka_tmpl, NULL, pkt, sizeof(pkt),
+					 &pkt_len);
+	if (status != PJ_SUCCESS)
+	    goto done;
 
-	/* Send to session */
 	addr_len = pj_sockaddr_get_len(&the_check->rcand->addr);
-	status = pj_stun_session_send_msg(comp->stun_sess, msg_data,
-					  PJ_FALSE, PJ_FALSE, 
-					  &the_check->rcand->addr, 
-					  addr_len, tdata);
-
-	/* Restore FINGERPRINT usage */
-	pj_stun_session_use_fingerprint(comp->stun_sess, saved);
+	(*ice->cb.on_tx_pkt)(ice, ice->comp_ka + 1,
+			     the_check->lcand->transport_id,
+			     pkt, pkt_len, &the_check->rcand->addr, addr_len);
 
 done:
 	ice->comp_ka = (ice->comp_ka + 1) % ice->comp_cnt;
@@ -3079,6 +3088,23 @@ PJ_DEF(pj_status_t) pj_ice_sess_on_rx_pkt(pj_ice_sess *ice,
     			       PJ_STUN_IS_DATAGRAM |
     			         PJ_STUN_NO_FINGERPRINT_CHECK);
     if (status == PJ_SUCCESS) {
+	const pj_uint8_t *pdu = (const pj_uint8_t*)pkt;
+	pj_stun_msg_view view;
+
+	/* Keep-alives need nothing from the STUN session, so they are
+	 * validated in place instead of being decoded.
+	 */
+	if (((pdu[0] << 8) | pdu[1]) == PJ_STUN_BINDING_INDICATION &&
+	    pj_stun_msg_view_parse(pdu, pkt_size,
+				   PJ_STUN_CHECK_PACKET | PJ_STUN_IS_DATAGRAM,
+				   &view) == PJ_SUCCESS)
+	{
+	    LOG5((ice->obj_name, "Received Binding Indication keep-alive "
+		  "for component %d", comp_id));
+	    pj_grp_lock_release(ice->grp_lock);
+	    return PJ_SUCCESS;
+	}
+
 	status = pj_stun_session_on_rx_pkt(comp->stun_sess, pkt, pkt_size,
 					   PJ_STUN_IS_DATAGRAM, msg_data,
 					   NULL, src_addr, src_addr_len);
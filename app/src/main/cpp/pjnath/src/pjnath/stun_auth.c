@@ -629,3 +629,56 @@ PJ_DEF(pj_status_t) pj_stun_authenticate_response(const pj_uint8_t *pkt,
     return PJ_SUCCESS;
 }
 
+
+
+/* Authenticate MESSAGE-INTEGRITY in a message view */
+PJ_DEF(pj_status_t) pj_stun_authenticate_view(const pj_stun_msg_view *view,
+					      const pj_str_t *key)
+{
+    const pj_stun_attr_view *amsgi;
+    unsigned amsgi_pos;
+    pj_hmac_sha1_context ctx;
+    pj_uint8_t digest[PJ_SHA1_DIGEST_SIZE];
+
+    PJ_ASSERT_RETURN(view && key, PJ_EINVAL);
+
+    amsgi = pj_stun_msg_view_find_attr(view, PJ_STUN_ATTR_MESSAGE_INTEGRITY,
+				       0);
+    if (amsgi == NULL) {
+	return PJ_STATUS_FROM_STUN_CODE(PJ_STUN_SC_UNAUTHORIZED);
+    }
+
+    /* Length of the header and the attributes before MESSAGE-INTEGRITY */
+    amsgi_pos = amsgi->offset - 4;
+
+    pj_hmac_sha1_init(&ctx, (pj_uint8_t*)key->ptr, (unsigned)key->slen);
+
+#if PJ_STUN_OLD_STYLE_MI_FINGERPRINT
+    pj_hmac_sha1_update(&ctx, view->pdu, amsgi_pos);
+    if (amsgi_pos & 0x3F) {
+    	pj_uint8_t zeroes[64];
+    	pj_bzero(zeroes, sizeof(zeroes));
+    	pj_hmac_sha1_update(&ctx, zeroes, 64-(amsgi_pos & 0x3F));
+    }
+#else
+    {
+	/* The length in the header covers MESSAGE-INTEGRITY but not the
+	 * attributes after it (i.e. FINGERPRINT).
+	 */
+	pj_uint8_t hdr_copy[20];
+	pj_memcpy(hdr_copy, view->pdu, 20);
+	PUT_VAL16(hdr_copy, 2, (pj_uint16_t)(amsgi_pos - 20 + 24));
+	pj_hmac_sha1_update(&ctx, hdr_copy, 20);
+	pj_hmac_sha1_update(&ctx, view->pdu+20, amsgi_pos-20);
+    }
+#endif	/* PJ_STUN_OLD_STYLE_MI_FINGERPRINT */
+
+    pj_hmac_sha1_final(&ctx, digest);
+
+    /* Compare HMACs */
+    if (pj_memcmp(view->pdu + amsgi->offset, digest, 20)) {
+	return PJ_STATUS_FROM_STUN_CODE(PJ_STUN_SC_UNAUTHORIZED);
+    }
+
+    return PJ_SUCCESS;
+}
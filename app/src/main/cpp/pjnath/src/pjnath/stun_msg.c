@@ -2088,6 +2088,28 @@ static void* clone_binary_attr(pj_pool_t *pool, const void *src)
 
 //////////////////////////////////////////////////////////////////////////////
 
+/* Generate a new transaction ID */
+static void create_tsx_id(pj_uint8_t tsx_id[12])
+{
+    struct transaction_id
+    {
+	pj_uint32_t	    proc_id;
+	pj_uint32_t	    random;
+	pj_uint32_t	    counter;
+    } id;
+    static pj_uint32_t pj_stun_tsx_id_counter;
+
+    if (!pj_stun_tsx_id_counter)
+	pj_stun_tsx_id_counter = pj_rand();
+
+    id.proc_id = pj_getpid();
+    id.random = pj_rand();
+    id.counter = pj_stun_tsx_id_counter++;
+
+    pj_memcpy(tsx_id, &id, 12);
+}
+
+
 /*
  * Initialize a generic STUN message.
  */
@@ -2106,22 +2128,7 @@ PJ_DEF(pj_status_t) pj_stun_msg_init( pj_stun_msg *msg,
     if (tsx_id) {
 	pj_memcpy(&msg->hdr.tsx_id, tsx_id, sizeof(msg->hdr.tsx_id));
     } else {
-	struct transaction_id
-	{
-	    pj_uint32_t	    proc_id;
-	    pj_uint32_t	    random;
-	    pj_uint32_t	    counter;
-	} id;
-	static pj_uint32_t pj_stun_tsx_id_counter;
-
-	if (!pj_stun_tsx_id_counter)
-	    pj_stun_tsx_id_counter = pj_rand();
-
-	id.proc_id = pj_getpid();
-	id.random = pj_rand();
-	id.counter = pj_stun_tsx_id_counter++;
-
-	pj_memcpy(&msg->hdr.tsx_id, &id, sizeof(msg->hdr.tsx_id));
+	create_tsx_id(msg->hdr.tsx_id);
     }
 
     return PJ_SUCCESS;
@@ -2828,3 +2835,470 @@ PJ_DEF(pj_stun_attr_hdr*) pj_stun_attr_clone( pj_pool_t *pool,
 }
 
 
+
+
+//////////////////////////////////////////////////////////////////////////////
+/*
+ * STUN message view.
+ */
+
+#define IS_SOCKADDR_DESC(adesc)	((adesc)->decode_attr==&decode_sockaddr_attr ||\
+				 (adesc)->decode_attr==&decode_xored_sockaddr_attr)
+
+/* Check the length of an attribute like its decode function does */
+static pj_status_t check_attr_value(const struct attr_desc *adesc,
+				    const pj_uint8_t *buf)
+{
+    unsigned length = GETVAL16H(buf, 2);
+
+    if (IS_SOCKADDR_DESC(adesc)) {
+	unsigned family;
+
+	if (length != STUN_GENERIC_IPV4_ADDR_LEN &&
+	    length != STUN_GENERIC_IPV6_ADDR_LEN)
+	{
+	    return PJNATH_ESTUNINATTRLEN;
+	}
+
+	family = buf[ATTR_HDR_LEN + 1];
+	if (family == 1) {
+	    if (length != STUN_GENERIC_IPV4_ADDR_LEN)
+		return PJNATH_ESTUNINATTRLEN;
+	} else if (family == 2) {
+	    if (length != STUN_GENERIC_IPV6_ADDR_LEN)
+		return PJNATH_ESTUNINATTRLEN;
+	} else {
+	    return PJNATH_EINVAF;
+	}
+
+    } else if (adesc->decode_attr == &decode_uint_attr) {
+	if (length != 4)
+	    return PJNATH_ESTUNINATTRLEN;
+    } else if (adesc->decode_attr == &decode_uint64_attr) {
+	if (length != 8)
+	    return PJNATH_ESTUNINATTRLEN;
+    } else if (adesc->decode_attr == &decode_msgint_attr) {
+	if (length != 20)
+	    return PJNATH_ESTUNINATTRLEN;
+    } else if (adesc->decode_attr == &decode_empty_attr) {
+	if (length != 0)
+	    return PJNATH_ESTUNINATTRLEN;
+    } else if (adesc->decode_attr == &decode_errcode_attr) {
+	if (length < 4)
+	    return PJNATH_ESTUNINATTRLEN;
+    } else if (adesc->decode_attr == &decode_unknown_attr) {
+	if ((length >> 1) > PJ_STUN_MAX_ATTR)
+	    return PJ_ETOOMANY;
+    }
+
+    return PJ_SUCCESS;
+}
+
+
+/*
+ * Validate and index STUN packet in place.
+ */
+PJ_DEF(pj_status_t) pj_stun_msg_view_parse(const pj_uint8_t *pdu,
+					   pj_size_t pdu_len,
+					   unsigned options,
+					   pj_stun_msg_view *view)
+{
+    const pj_uint8_t *p;
+    unsigned remaining;
+    pj_bool_t has_msg_int = PJ_FALSE;
+    pj_bool_t has_fingerprint = PJ_FALSE;
+    pj_status_t status;
+
+    PJ_ASSERT_RETURN(pdu && pdu_len && view, PJ_EINVAL);
+
+    if (options & PJ_STUN_CHECK_PACKET) {
+	status = pj_stun_msg_check(pdu, pdu_len, options);
+	if (status != PJ_SUCCESS)
+	    return status;
+    } else if (pdu_len < sizeof(pj_stun_msg_hdr)) {
+	return PJNATH_EINSTUNMSGLEN;
+    }
+
+    view->pdu = pdu;
+    view->hdr.type = GETVAL16H(pdu, 0);
+    view->hdr.length = GETVAL16H(pdu, 2);
+    view->hdr.magic = GETVAL32H(pdu, 4);
+    pj_memcpy(view->hdr.tsx_id, pdu+8, sizeof(view->hdr.tsx_id));
+    view->attr_count = 0;
+
+    /* Unlike pj_stun_msg_decode(), never trust the length in the header */
+    if (sizeof(pj_stun_msg_hdr) + view->hdr.length > pdu_len)
+	return PJNATH_EINSTUNMSGLEN;
+
+    p = pdu + sizeof(pj_stun_msg_hdr);
+    remaining = view->hdr.length;
+
+    while (remaining >= ATTR_HDR_LEN) {
+	unsigned attr_type = GETVAL16H(p, 0);
+	unsigned attr_len = GETVAL16H(p, 2);
+	unsigned total_len = ATTR_HDR_LEN + ((attr_len + 3) & (~3));
+	const struct attr_desc *adesc;
+	pj_stun_attr_view *attr;
+
+	if (total_len > remaining)
+	    return PJNATH_ESTUNINATTRLEN;
+
+	adesc = find_attr_desc(attr_type);
+	if (adesc == NULL) {
+	    /* Unrecognized mandatory attribute */
+	    if (attr_type <= 0x7FFF)
+		return PJ_STATUS_FROM_STUN_CODE(PJ_STUN_SC_UNKNOWN_ATTRIBUTE);
+
+	} else {
+	    status = check_attr_value(adesc, p);
+	    if (status != PJ_SUCCESS)
+		return status;
+
+	    /* Same ordering rules as pj_stun_msg_decode() */
+	    if (attr_type == PJ_STUN_ATTR_MESSAGE_INTEGRITY &&
+		!has_fingerprint)
+	    {
+		if (has_msg_int)
+		    return PJNATH_ESTUNDUPATTR;
+		has_msg_int = PJ_TRUE;
+
+	    } else if (attr_type == PJ_STUN_ATTR_FINGERPRINT) {
+		if (has_fingerprint)
+		    return PJNATH_ESTUNDUPATTR;
+		has_fingerprint = PJ_TRUE;
+
+	    } else if (has_fingerprint) {
+		return PJNATH_ESTUNFINGERPOS;
+	    }
+	}
+
+	if (view->attr_count >= PJ_STUN_MAX_ATTR)
+	    return PJNATH_ESTUNTOOMANYATTR;
+
+	attr = &view->attr[view->attr_count++];
+	attr->type = (pj_uint16_t) attr_type;
+	attr->length = (pj_uint16_t) attr_len;
+	attr->offset = (unsigned)(p - pdu) + ATTR_HDR_LEN;
+
+	p += total_len;
+	remaining -= total_len;
+    }
+
+    if (remaining > 0) {
+	/* Stray trailing bytes */
+	return PJNATH_EINSTUNMSGLEN;
+    }
+
+    return PJ_SUCCESS;
+}
+
+
+/*
+ * Find attribute in the view.
+ */
+PJ_DEF(const pj_stun_attr_view*)
+pj_stun_msg_view_find_attr(const pj_stun_msg_view *view,
+			   int attr_type,
+			   unsigned start_index)
+{
+    PJ_ASSERT_RETURN(view, NULL);
+
+    for (; start_index < view->attr_count; ++start_index) {
+	if (view->attr[start_index].type == attr_type)
+	    return &view->attr[start_index];
+    }
+
+    return NULL;
+}
+
+
+PJ_DEF(pj_uint32_t) pj_stun_msg_view_get_uint(const pj_stun_msg_view *view,
+					      const pj_stun_attr_view *attr)
+{
+    pj_assert(attr->length == 4);
+    return GETVAL32H(view->pdu, attr->offset);
+}
+
+
+PJ_DEF(void) pj_stun_msg_view_get_uint64(const pj_stun_msg_view *view,
+					 const pj_stun_attr_view *attr,
+					 pj_timestamp *value)
+{
+    pj_assert(attr->length == 8);
+    GETVAL64H(view->pdu, attr->offset, value);
+}
+
+
+PJ_DEF(pj_str_t) pj_stun_msg_view_get_string(const pj_stun_msg_view *view,
+					     const pj_stun_attr_view *attr)
+{
+    pj_str_t value;
+
+    value.ptr = (char*)(view->pdu + attr->offset);
+    value.slen = attr->length;
+    return value;
+}
+
+
+PJ_DEF(pj_status_t) pj_stun_msg_view_get_sockaddr(
+					    const pj_stun_msg_view *view,
+					    const pj_stun_attr_view *attr,
+					    pj_sockaddr *addr)
+{
+    const struct attr_desc *adesc;
+    const pj_uint8_t *buf;
+    pj_uint8_t *dst;
+    pj_uint16_t port;
+    unsigned addr_len, i;
+
+    PJ_ASSERT_RETURN(view && attr && addr, PJ_EINVAL);
+
+    adesc = find_attr_desc(attr->type);
+    PJ_ASSERT_RETURN(adesc && IS_SOCKADDR_DESC(adesc), PJ_EINVAL);
+
+    /* Length and family have been checked by the parser */
+    buf = view->pdu + attr->offset;
+    if (buf[1] == 1) {
+	pj_sockaddr_init(pj_AF_INET(), addr, NULL, 0);
+	addr_len = 4;
+    } else {
+	pj_sockaddr_init(pj_AF_INET6(), addr, NULL, 0);
+	addr_len = 16;
+    }
+
+    port = GETVAL16H(buf, 2);
+    dst = (pj_uint8_t*) pj_sockaddr_get_addr(addr);
+    pj_memcpy(dst, buf+4, addr_len);
+
+    if (adesc->decode_attr == &decode_xored_sockaddr_attr) {
+	pj_uint8_t magic[4];
+
+	PUTVAL32H(magic, 0, PJ_STUN_MAGIC);
+	port ^= (pj_uint16_t)(PJ_STUN_MAGIC >> 16);
+	for (i=0; i<4; ++i)
+	    dst[i] ^= magic[i];
+	for (i=4; i<addr_len; ++i)
+	    dst[i] ^= view->hdr.tsx_id[i-4];
+    }
+    pj_sockaddr_set_port(addr, port);
+
+    return PJ_SUCCESS;
+}
+
+
+PJ_DEF(void) pj_stun_msg_view_get_errcode(const pj_stun_msg_view *view,
+					  const pj_stun_attr_view *attr,
+					  int *err_code,
+					  pj_str_t *reason)
+{
+    const pj_uint8_t *buf = view->pdu + attr->offset;
+
+    *err_code = buf[2] * 100 + buf[3];
+    if (reason) {
+	reason->ptr = (char*)buf + 4;
+	reason->slen = attr->length - 4;
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+/*
+ * STUN message template.
+ */
+struct pj_stun_msg_tmpl
+{
+    pj_uint8_t		*pkt;		/* The encoded message.		    */
+    unsigned		 pkt_len;	/* Length of the message.	    */
+    pj_stun_msg_view	 view;		/* Index of the attributes.	    */
+    int			 msgint_pos;	/* MESSAGE-INTEGRITY offset, or -1. */
+    int			 fingerprint_pos;/* FINGERPRINT offset, or -1.	    */
+    pj_bool_t		 has_xor_ipv6;	/* Has XOR-ed IPv6 address.	    */
+    pj_hmac_sha1_context hmac;		/* HMAC context with the key.	    */
+};
+
+
+PJ_DEF(pj_status_t) pj_stun_msg_tmpl_create(pj_pool_t *pool,
+					    const pj_stun_msg *msg,
+					    const pj_str_t *key,
+					    pj_stun_msg_tmpl **p_tmpl)
+{
+    pj_stun_msg_tmpl *tmpl;
+    pj_stun_msg *clone;
+    pj_uint8_t buf[PJ_STUN_MAX_PKT_LEN];
+    pj_size_t len;
+    unsigned i;
+    pj_status_t status;
+
+    PJ_ASSERT_RETURN(pool && msg && p_tmpl, PJ_EINVAL);
+
+    /* Encoding updates the message, so encode a copy */
+    clone = pj_stun_msg_clone(pool, msg);
+    PJ_ASSERT_RETURN(clone, PJ_ENOMEM);
+
+    if (pj_stun_msg_find_attr(clone, PJ_STUN_ATTR_MESSAGE_INTEGRITY, 0)) {
+	PJ_ASSERT_RETURN(key, PJ_EINVALIDOP);
+    } else {
+	key = NULL;
+    }
+
+    status = pj_stun_msg_encode(clone, buf, sizeof(buf), 0, key, &len);
+    if (status != PJ_SUCCESS)
+	return status;
+
+    tmpl = PJ_POOL_ZALLOC_T(pool, pj_stun_msg_tmpl);
+    tmpl->pkt = (pj_uint8_t*) pj_pool_alloc(pool, len);
+    tmpl->pkt_len = (unsigned)len;
+    pj_memcpy(tmpl->pkt, buf, len);
+
+    status = pj_stun_msg_view_parse(tmpl->pkt, len, 0, &tmpl->view);
+    if (status != PJ_SUCCESS)
+	return status;
+
+    tmpl->msgint_pos = tmpl->fingerprint_pos = -1;
+    for (i=0; i<tmpl->view.attr_count; ++i) {
+	const pj_stun_attr_view *attr = &tmpl->view.attr[i];
+	const struct attr_desc *adesc = find_attr_desc(attr->type);
+
+	if (attr->type == PJ_STUN_ATTR_MESSAGE_INTEGRITY) {
+	    tmpl->msgint_pos = attr->offset - ATTR_HDR_LEN;
+	} else if (attr->type == PJ_STUN_ATTR_FINGERPRINT) {
+	    tmpl->fingerprint_pos = attr->offset - ATTR_HDR_LEN;
+	} else if (adesc && adesc->decode_attr==&decode_xored_sockaddr_attr &&
+		   attr->length == STUN_GENERIC_IPV6_ADDR_LEN)
+	{
+	    tmpl->has_xor_ipv6 = PJ_TRUE;
+	}
+    }
+
+    if (key) {
+	pj_hmac_sha1_init(&tmpl->hmac, (const pj_uint8_t*)key->ptr,
+			  (unsigned)key->slen);
+    }
+
+    *p_tmpl = tmpl;
+    return PJ_SUCCESS;
+}
+
+
+/* Find attribute of the specified length in the template */
+static const pj_stun_attr_view *tmpl_find_attr(pj_stun_msg_tmpl *tmpl,
+					       int attr_type,
+					       unsigned length)
+{
+    const pj_stun_attr_view *attr;
+
+    attr = pj_stun_msg_view_find_attr(&tmpl->view, attr_type, 0);
+    return (attr && attr->length == length) ? attr : NULL;
+}
+
+
+PJ_DEF(pj_status_t) pj_stun_msg_tmpl_set_uint(pj_stun_msg_tmpl *tmpl,
+					      int attr_type,
+					      pj_uint32_t value)
+{
+    const pj_stun_attr_view *attr;
+
+    PJ_ASSERT_RETURN(tmpl, PJ_EINVAL);
+
+    attr = tmpl_find_attr(tmpl, attr_type, 4);
+    if (!attr)
+	return PJ_ENOTFOUND;
+
+    PUTVAL32H(tmpl->pkt, attr->offset, value);
+    return PJ_SUCCESS;
+}
+
+
+PJ_DEF(pj_status_t) pj_stun_msg_tmpl_set_uint64(pj_stun_msg_tmpl *tmpl,
+						int attr_type,
+						const pj_timestamp *value)
+{
+    const pj_stun_attr_view *attr;
+
+    PJ_ASSERT_RETURN(tmpl && value, PJ_EINVAL);
+
+    attr = tmpl_find_attr(tmpl, attr_type, 8);
+    if (!attr)
+	return PJ_ENOTFOUND;
+
+    PUTVAL64H(tmpl->pkt, attr->offset, value);
+    return PJ_SUCCESS;
+}
+
+
+PJ_DEF(pj_status_t) pj_stun_msg_tmpl_encode(pj_stun_msg_tmpl *tmpl,
+					    const pj_uint8_t tsx_id[12],
+					    pj_uint8_t *pkt_buf,
+					    pj_size_t buf_size,
+					    pj_size_t *p_msg_len)
+{
+    pj_uint8_t new_tsx_id[12];
+
+    PJ_ASSERT_RETURN(tmpl && pkt_buf && p_msg_len, PJ_EINVAL);
+
+    if (buf_size < tmpl->pkt_len)
+	return PJ_ETOOSMALL;
+
+    if (tsx_id == NULL) {
+	create_tsx_id(new_tsx_id);
+	tsx_id = new_tsx_id;
+    }
+
+    pj_memcpy(pkt_buf, tmpl->pkt, tmpl->pkt_len);
+    pj_memcpy(pkt_buf+8, tsx_id, 12);
+
+    /* IPv6 X-Address is XOR-ed with the transaction ID too */
+    if (tmpl->has_xor_ipv6) {
+	unsigned i, j;
+
+	for (i=0; i<tmpl->view.attr_count; ++i) {
+	    const pj_stun_attr_view *attr = &tmpl->view.attr[i];
+	    const struct attr_desc *adesc = find_attr_desc(attr->type);
+	    pj_uint8_t *dst = pkt_buf + attr->offset + 8;
+
+	    if (!adesc || adesc->decode_attr != &decode_xored_sockaddr_attr ||
+		attr->length != STUN_GENERIC_IPV6_ADDR_LEN)
+	    {
+		continue;
+	    }
+	    for (j=0; j<12; ++j)
+		dst[j] ^= (pj_uint8_t)(tmpl->pkt[8+j] ^ tsx_id[j]);
+	}
+    }
+
+    if (tmpl->msgint_pos >= 0) {
+	pj_hmac_sha1_context ctx;
+	pj_uint8_t hdr[20];
+
+	/* The key has been set up when the template was created */
+	pj_memcpy(&ctx, &tmpl->hmac, sizeof(ctx));
+	pj_memcpy(hdr, pkt_buf, sizeof(hdr));
+
+#if PJ_STUN_OLD_STYLE_MI_FINGERPRINT
+	pj_hmac_sha1_update(&ctx, hdr, 20);
+	pj_hmac_sha1_update(&ctx, pkt_buf+20, tmpl->msgint_pos-20);
+	if (tmpl->msgint_pos & 0x3F) {
+	    pj_uint8_t zeroes[64];
+	    pj_bzero(zeroes, sizeof(zeroes));
+	    pj_hmac_sha1_update(&ctx, zeroes, 64-(tmpl->msgint_pos & 0x3F));
+	}
+#else
+	/* Message length up to and including MESSAGE-INTEGRITY */
+	PUTVAL16H(hdr, 2, (pj_uint16_t)(tmpl->msgint_pos - 20 + 24));
+	pj_hmac_sha1_update(&ctx, hdr, 20);
+	pj_hmac_sha1_update(&ctx, pkt_buf+20, tmpl->msgint_pos-20);
+#endif
+	pj_hmac_sha1_final(&ctx, pkt_buf + tmpl->msgint_pos + ATTR_HDR_LEN);
+    }
+
+    if (tmpl->fingerprint_pos >= 0) {
+	pj_uint32_t crc;
+
+	crc = pj_crc32_calc(pkt_buf, tmpl->fingerprint_pos);
+	crc ^= STUN_XOR_FINGERPRINT;
+	PUTVAL32H(pkt_buf, tmpl->fingerprint_pos + ATTR_HDR_LEN, crc);
+    }
+
+    *p_msg_len = tmpl->pkt_len;
+    return PJ_SUCCESS;
+}
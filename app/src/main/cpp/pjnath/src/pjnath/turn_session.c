@@ -147,6 +147,14 @@ struct pj_turn_session
     pj_hash_table_t	*ch_table;
     pj_hash_table_t	*perm_table;
 
+#if PJ_TURN_CHANNEL_INDEX_SIZE
+    /* Bound channels, indexed by channel number - PJ_TURN_CHANNEL_MIN */
+    struct ch_t		*ch_index[PJ_TURN_CHANNEL_INDEX_SIZE];
+#endif
+
+    /* Bound channel of the peer that data was last sent to */
+    struct ch_t		*tx_ch;
+
     pj_uint32_t		 send_ind_tsx_id[3];
     /* tx_pkt must be 16bit aligned */
     pj_uint8_t		 tx_pkt[PJ_TURN_MAX_PKT_LEN];
@@ -956,30 +964,26 @@ on_error:
 }
 
 
-/**
- * Relay data to the specified peer through the session.
+/*
+ * Find the permission and channel of the peer that data is going to be
+ * sent to, and install the permission if there is none. Returns the
+ * channel in p_ch if the peer is bound to one, or NULL for Send
+ * Indication. The bound channel of the last peer is cached, since media
+ * goes to the same peer most of the time.
  */
-PJ_DEF(pj_status_t) pj_turn_session_sendto( pj_turn_session *sess,
-					    const pj_uint8_t *pkt,
-					    unsigned pkt_len,
-					    const pj_sockaddr_t *addr,
-					    unsigned addr_len)
+static pj_status_t get_tx_ch(pj_turn_session *sess,
+			     const pj_sockaddr_t *addr,
+			     struct ch_t **p_ch)
 {
-    struct ch_t *ch;
+    struct ch_t *ch = sess->tx_ch;
     struct perm_t *perm;
     pj_status_t status;
 
-    PJ_ASSERT_RETURN(sess && pkt && pkt_len && addr && addr_len, 
-		     PJ_EINVAL);
-
-    /* Return error if we're not ready */
-    if (sess->state != PJ_TURN_STATE_READY) {
-	return PJ_EIGNORED;
+    if (ch && pj_sockaddr_cmp(&ch->addr, addr) == 0) {
+	*p_ch = ch;
+	return PJ_SUCCESS;
     }
 
-    /* Lock session now */
-    pj_grp_lock_acquire(sess->grp_lock);
-
     /* Lookup permission first */
     perm = lookup_perm(sess, addr, pj_sockaddr_get_len(addr), PJ_FALSE);
     if (perm == NULL) {
@@ -992,88 +996,227 @@ PJ_DEF(pj_status_t) pj_turn_session_sendto( pj_turn_session *sess,
 
 	status = pj_turn_session_set_perm(sess, 1, (const pj_sockaddr*)addr, 
 					  0);
-	if (status != PJ_SUCCESS) {
-	    pj_grp_lock_release(sess->grp_lock);
+	if (status != PJ_SUCCESS)
 	    return status;
-	}
     }
 
     /* See if the peer is bound to a channel number */
     ch = lookup_ch_by_addr(sess, addr, pj_sockaddr_get_len(addr), 
 			   PJ_FALSE, PJ_FALSE);
     if (ch && ch->num != PJ_TURN_INVALID_CHANNEL && ch->bound) {
-	unsigned total_len;
+	sess->tx_ch = ch;
+    } else {
+	ch = NULL;
+    }
+
+    *p_ch = ch;
+    return PJ_SUCCESS;
+}
+
+
+/*
+ * Send data as ChannelData. With in_place, the header is written in the
+ * space before the packet, otherwise the packet is copied to tx_pkt.
+ */
+static pj_status_t send_channel_data(pj_turn_session *sess,
+				     const struct ch_t *ch,
+				     const pj_uint8_t *pkt,
+				     unsigned pkt_len,
+				     pj_bool_t in_place)
+{
+    pj_uint8_t *cd;
+    unsigned total_len;
 
-	/* Peer is assigned a channel number, we can use ChannelData */
-	pj_turn_channel_data *cd = (pj_turn_channel_data*)sess->tx_pkt;
-	
-	pj_assert(sizeof(*cd)==4);
+    pj_assert(sizeof(pj_turn_channel_data)==PJ_TURN_CHANNEL_DATA_HDR_LEN);
+    pj_assert(sess->srv_addr != NULL);
 
+    /* ChannelData over TCP must be padded to a multiple of four bytes,
+     * over UDP the padding is optional (RFC 5766 Section 11.5).
+     */
+    if (in_place && pkt_len <= 0xFFFF &&
+	(sess->conn_type == PJ_TURN_TP_UDP || (pkt_len & 3) == 0))
+    {
+	cd = (pj_uint8_t*)pkt - PJ_TURN_CHANNEL_DATA_HDR_LEN;
+	total_len = pkt_len + PJ_TURN_CHANNEL_DATA_HDR_LEN;
+    } else {
 	/* Calculate total length, including paddings */
-	total_len = (pkt_len + sizeof(*cd) + 3) & (~3);
-	if (total_len > sizeof(sess->tx_pkt)) {
-	    status = PJ_ETOOBIG;
-	    goto on_return;
-	}
+	total_len = (pkt_len + PJ_TURN_CHANNEL_DATA_HDR_LEN + 3) & (~3);
+	if (total_len > sizeof(sess->tx_pkt))
+	    return PJ_ETOOBIG;
 
-	cd->ch_number = pj_htons((pj_uint16_t)ch->num);
-	cd->length = pj_htons((pj_uint16_t)pkt_len);
-	pj_memcpy(cd+1, pkt, pkt_len);
+	cd = sess->tx_pkt;
+	pj_memcpy(cd + PJ_TURN_CHANNEL_DATA_HDR_LEN, pkt, pkt_len);
+    }
 
-	pj_assert(sess->srv_addr != NULL);
+    /* The space before the packet may not be 16bit aligned */
+    cd[0] = (pj_uint8_t)(ch->num >> 8);
+    cd[1] = (pj_uint8_t)(ch->num & 0xFF);
+    cd[2] = (pj_uint8_t)(pkt_len >> 8);
+    cd[3] = (pj_uint8_t)(pkt_len & 0xFF);
 
-	status = sess->cb.on_send_pkt(sess, sess->tx_pkt, total_len,
-				      sess->srv_addr,
-				      pj_sockaddr_get_len(sess->srv_addr));
+    return sess->cb.on_send_pkt(sess, cd, total_len, sess->srv_addr,
+				pj_sockaddr_get_len(sess->srv_addr));
+}
 
-    } else {
-	/* Use Send Indication. */
-	pj_stun_sockaddr_attr peer_attr;
-	pj_stun_binary_attr data_attr;
-	pj_stun_msg send_ind;
-	pj_size_t send_ind_len;
-
-	/* Increment counter */
-	++sess->send_ind_tsx_id[2];
-
-	/* Create blank SEND-INDICATION */
-	status = pj_stun_msg_init(&send_ind, PJ_STUN_SEND_INDICATION,
-				  PJ_STUN_MAGIC, 
-				  (const pj_uint8_t*)sess->send_ind_tsx_id);
-	if (status != PJ_SUCCESS)
-	    goto on_return;
 
-	/* Add XOR-PEER-ADDRESS */
-	pj_stun_sockaddr_attr_init(&peer_attr, PJ_STUN_ATTR_XOR_PEER_ADDR,
-				   PJ_TRUE, addr, addr_len);
-	pj_stun_msg_add_attr(&send_ind, (pj_stun_attr_hdr*)&peer_attr);
-
-	/* Add DATA attribute */
-	pj_stun_binary_attr_init(&data_attr, NULL, PJ_STUN_ATTR_DATA, NULL, 0);
-	data_attr.data = (pj_uint8_t*)pkt;
-	data_attr.length = pkt_len;
-	pj_stun_msg_add_attr(&send_ind, (pj_stun_attr_hdr*)&data_attr);
-
-	/* Encode the message */
-	status = pj_stun_msg_encode(&send_ind, sess->tx_pkt, 
-				    sizeof(sess->tx_pkt), 0,
-				    NULL, &send_ind_len);
-	if (status != PJ_SUCCESS)
-	    goto on_return;
+/*
+ * Send data as Send Indication.
+ */
+static pj_status_t send_indication(pj_turn_session *sess,
+				   const pj_uint8_t *pkt,
+				   unsigned pkt_len,
+				   const pj_sockaddr_t *addr,
+				   unsigned addr_len)
+{
+    pj_stun_sockaddr_attr peer_attr;
+    pj_stun_binary_attr data_attr;
+    pj_stun_msg send_ind;
+    pj_size_t send_ind_len;
+    pj_status_t status;
 
-	/* Send the Send Indication */
-	status = sess->cb.on_send_pkt(sess, sess->tx_pkt, 
-				      (unsigned)send_ind_len,
-				      sess->srv_addr,
-				      pj_sockaddr_get_len(sess->srv_addr));
+    /* Increment counter */
+    ++sess->send_ind_tsx_id[2];
+
+    /* Create blank SEND-INDICATION */
+    status = pj_stun_msg_init(&send_ind, PJ_STUN_SEND_INDICATION,
+			      PJ_STUN_MAGIC, 
+			      (const pj_uint8_t*)sess->send_ind_tsx_id);
+    if (status != PJ_SUCCESS)
+	return status;
+
+    /* Add XOR-PEER-ADDRESS */
+    pj_stun_sockaddr_attr_init(&peer_attr, PJ_STUN_ATTR_XOR_PEER_ADDR,
+			       PJ_TRUE, addr, addr_len);
+    pj_stun_msg_add_attr(&send_ind, (pj_stun_attr_hdr*)&peer_attr);
+
+    /* Add DATA attribute */
+    pj_stun_binary_attr_init(&data_attr, NULL, PJ_STUN_ATTR_DATA, NULL, 0);
+    data_attr.data = (pj_uint8_t*)pkt;
+    data_attr.length = pkt_len;
+    pj_stun_msg_add_attr(&send_ind, (pj_stun_attr_hdr*)&data_attr);
+
+    /* Encode the message */
+    status = pj_stun_msg_encode(&send_ind, sess->tx_pkt, 
+				sizeof(sess->tx_pkt), 0,
+				NULL, &send_ind_len);
+    if (status != PJ_SUCCESS)
+	return status;
+
+    /* Send the Send Indication */
+    return sess->cb.on_send_pkt(sess, sess->tx_pkt, 
+				(unsigned)send_ind_len,
+				sess->srv_addr,
+				pj_sockaddr_get_len(sess->srv_addr));
+}
+
+
+/*
+ * Common body of the sendto functions.
+ */
+static pj_status_t sendto_peer(pj_turn_session *sess,
+			       unsigned count,
+			       const pj_uint8_t *pkt[],
+			       const unsigned pkt_len[],
+			       pj_bool_t in_place,
+			       const pj_sockaddr_t *addr,
+			       unsigned addr_len)
+{
+    struct ch_t *ch;
+    unsigned i;
+    pj_status_t status;
+
+    /* Return error if we're not ready */
+    if (sess->state != PJ_TURN_STATE_READY) {
+	return PJ_EIGNORED;
+    }
+
+    /* Lock session now */
+    pj_grp_lock_acquire(sess->grp_lock);
+
+    status = get_tx_ch(sess, addr, &ch);
+    if (status != PJ_SUCCESS) {
+	pj_grp_lock_release(sess->grp_lock);
+	return status;
+    }
+
+    for (i=0; i<count; ++i) {
+	pj_status_t st;
+
+	if (ch) {
+	    /* Peer is assigned a channel number, we can use ChannelData */
+	    st = send_channel_data(sess, ch, pkt[i], pkt_len[i], in_place);
+	} else {
+	    /* Use Send Indication. */
+	    st = send_indication(sess, pkt[i], pkt_len[i], addr, addr_len);
+	}
+	if (st != PJ_SUCCESS)
+	    status = st;
     }
 
-on_return:
     pj_grp_lock_release(sess->grp_lock);
     return status;
 }
 
 
+/**
+ * Relay data to the specified peer through the session.
+ */
+PJ_DEF(pj_status_t) pj_turn_session_sendto( pj_turn_session *sess,
+					    const pj_uint8_t *pkt,
+					    unsigned pkt_len,
+					    const pj_sockaddr_t *addr,
+					    unsigned addr_len)
+{
+    PJ_ASSERT_RETURN(sess && pkt && pkt_len && addr && addr_len, 
+		     PJ_EINVAL);
+
+    return sendto_peer(sess, 1, &pkt, &pkt_len, PJ_FALSE, addr, addr_len);
+}
+
+
+/**
+ * Relay data with space for the ChannelData header in front of it.
+ */
+PJ_DEF(pj_status_t) pj_turn_session_sendto_hdr(pj_turn_session *sess,
+					       pj_uint8_t *pkt,
+					       unsigned pkt_len,
+					       const pj_sockaddr_t *addr,
+					       unsigned addr_len)
+{
+    const pj_uint8_t *p = pkt;
+
+    PJ_ASSERT_RETURN(sess && pkt && pkt_len && addr && addr_len, 
+		     PJ_EINVAL);
+
+    return sendto_peer(sess, 1, &p, &pkt_len, PJ_TRUE, addr, addr_len);
+}
+
+
+/**
+ * Relay several packets to the same peer.
+ */
+PJ_DEF(pj_status_t) pj_turn_session_sendto_batch(pj_turn_session *sess,
+						 unsigned count,
+						 pj_uint8_t *pkt[],
+						 const unsigned pkt_len[],
+						 const pj_sockaddr_t *addr,
+						 unsigned addr_len)
+{
+    unsigned i;
+
+    PJ_ASSERT_RETURN(sess && pkt && pkt_len && addr && addr_len, 
+		     PJ_EINVAL);
+    for (i=0; i<count; ++i)
+	PJ_ASSERT_RETURN(pkt[i] && pkt_len[i], PJ_EINVAL);
+
+    if (count == 0)
+	return PJ_SUCCESS;
+
+    return sendto_peer(sess, count, (const pj_uint8_t**)pkt, pkt_len,
+		       PJ_TRUE, addr, addr_len);
+}
+
+
 /**
  * Bind a peer address to a channel number.
  */
@@ -1181,7 +1324,8 @@ PJ_DEF(pj_status_t) pj_turn_session_on_rx_pkt(pj_turn_session *sess,
 
 	if (pkt_len < 4) {
 	    if (parsed_len) *parsed_len = 0;
-	    return PJ_ETOOSMALL;
+	    status = PJ_ETOOSMALL;
+	    goto on_return;
 	}
 
 	/* Decode ChannelData packet */
@@ -1826,6 +1970,14 @@ static struct ch_t *lookup_ch_by_addr(pj_turn_session *sess,
 		pj_hash_set(sess->pool, sess->ch_table, &ch->num,
 			    sizeof(ch->num), hval2, ch);
 	    }
+
+#if PJ_TURN_CHANNEL_INDEX_SIZE
+	    if ((unsigned)ch->num - PJ_TURN_CHANNEL_MIN <
+		PJ_TURN_CHANNEL_INDEX_SIZE)
+	    {
+		sess->ch_index[ch->num - PJ_TURN_CHANNEL_MIN] = ch;
+	    }
+#endif
 	}
     }
 
@@ -1848,6 +2000,13 @@ static struct ch_t *lookup_ch_by_addr(pj_turn_session *sess,
 static struct ch_t *lookup_ch_by_chnum(pj_turn_session *sess,
 					 pj_uint16_t chnum)
 {
+#if PJ_TURN_CHANNEL_INDEX_SIZE
+    unsigned idx = (unsigned)chnum - PJ_TURN_CHANNEL_MIN;
+
+    if (idx < PJ_TURN_CHANNEL_INDEX_SIZE)
+	return sess->ch_index[idx];
+#endif
+
     return (struct ch_t*) pj_hash_get(sess->ch_table, &chnum, 
 				      sizeof(chnum), NULL);
 }
@@ -1899,6 +2058,9 @@ static struct perm_t *lookup_perm(pj_turn_session *sess,
 static void invalidate_perm(pj_turn_session *sess,
 			    struct perm_t *perm)
 {
+    /* The cached channel may be for this permission */
+    sess->tx_ch = NULL;
+
     pj_hash_set(NULL, sess->perm_table, &perm->addr,
 		pj_sockaddr_get_len(&perm->addr), perm->hval, NULL);
 }
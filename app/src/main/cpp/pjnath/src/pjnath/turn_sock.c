@@ -475,6 +475,43 @@ PJ_DEF(pj_status_t) pj_turn_sock_sendto( pj_turn_sock *turn_sock,
 				  addr, addr_len);
 }
 
+/*
+ * Send packet with space for the ChannelData header.
+ */ 
+PJ_DEF(pj_status_t) pj_turn_sock_sendto_hdr( pj_turn_sock *turn_sock,
+					    pj_uint8_t *pkt,
+					    unsigned pkt_len,
+					    const pj_sockaddr_t *addr,
+					    unsigned addr_len)
+{
+    PJ_ASSERT_RETURN(turn_sock && addr && addr_len, PJ_EINVAL);
+
+    if (turn_sock->sess == NULL)
+	return PJ_EINVALIDOP;
+
+    return pj_turn_session_sendto_hdr(turn_sock->sess, pkt, pkt_len, 
+				      addr, addr_len);
+}
+
+/*
+ * Send several packets.
+ */ 
+PJ_DEF(pj_status_t) pj_turn_sock_sendto_batch( pj_turn_sock *turn_sock,
+					      unsigned count,
+					      pj_uint8_t *pkt[],
+					      const unsigned pkt_len[],
+					      const pj_sockaddr_t *addr,
+					      unsigned addr_len)
+{
+    PJ_ASSERT_RETURN(turn_sock && addr && addr_len, PJ_EINVAL);
+
+    if (turn_sock->sess == NULL)
+	return PJ_EINVALIDOP;
+
+    return pj_turn_session_sendto_batch(turn_sock->sess, count, pkt, pkt_len,
+					addr, addr_len);
+}
+
 /*
  * Bind a peer address to a channel number.
  */